@@ -106,6 +106,7 @@
 #include "blacklists.h"
 #include "xlog.h"
 #include "db/db_insertq.h"
+#include "evi/evi_dispatch.h"
 #include "bin_interface.h"
 #include "net/trans.h"
 #include "config.h"
@@ -320,8 +321,13 @@ extern int cfg_parse_only_routes;
 %token TCPTHRESHOLD
 %token EVENT_SHM_THRESHOLD
 %token EVENT_PKG_THRESHOLD
+%token EVENT_QUEUE_SIZE
+%token EVENT_QUEUE_POLICY
 %token QUERYBUFFERSIZE
 %token QUERYFLUSHTIME
+%token QUERYBUFFERWRITER
+%token QUERYBUFFERMAXROWS
+%token QUERYBUFFERSPOOLDIR
 %token SIP_WARNING
 %token SERVER_SIGNATURE
 %token SERVER_HEADER
@@ -920,10 +926,24 @@ assign_stm: LOGLEVEL EQUAL snumber { IFOR();
 			#endif
 			}
 		| EVENT_PKG_THRESHOLD EQUAL error { yyerror("int value expected"); }
+		| EVENT_QUEUE_SIZE EQUAL NUMBER { IFOR(); evi_queue_size=$3; }
+		| EVENT_QUEUE_SIZE EQUAL error { yyerror("int value expected"); }
+		| EVENT_QUEUE_POLICY EQUAL STRING { IFOR();
+				if (evi_queue_set_policy($3) < 0)
+					yyerror("event_queue_policy has to be \"drop\" or \"block\"");
+				}
+		| EVENT_QUEUE_POLICY EQUAL error { yyerror("string value expected"); }
 		| QUERYBUFFERSIZE EQUAL NUMBER { IFOR(); query_buffer_size=$3; }
 		| QUERYBUFFERSIZE EQUAL error { yyerror("int value expected"); }
 		| QUERYFLUSHTIME EQUAL NUMBER { IFOR(); query_flush_time=$3; }
 		| QUERYFLUSHTIME EQUAL error { yyerror("int value expected"); }
+		| QUERYBUFFERWRITER EQUAL NUMBER { IFOR(); query_buffer_writer=$3; }
+		| QUERYBUFFERWRITER EQUAL error { yyerror("boolean value expected"); }
+		| QUERYBUFFERMAXROWS EQUAL NUMBER { IFOR(); query_buffer_max_rows=$3; }
+		| QUERYBUFFERMAXROWS EQUAL error { yyerror("int value expected"); }
+		| QUERYBUFFERSPOOLDIR EQUAL STRING { IFOR();
+				query_buffer_spool_dir=$3; }
+		| QUERYBUFFERSPOOLDIR EQUAL error { yyerror("string value expected"); }
 		| SIP_WARNING EQUAL NUMBER { IFOR(); sip_warning=$3; }
 		| SIP_WARNING EQUAL error { yyerror("boolean value expected"); }
 		| CHROOT EQUAL STRING     { IFOR(); chroot_dir=$3; }
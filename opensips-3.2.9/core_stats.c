@@ -57,6 +57,8 @@ stat_var* err_rpls;
 stat_var* bad_URIs;
 stat_var* bad_msg_hdr;
 stat_var* slow_msgs;
+stat_var* msg_proc_time;
+stat_var* db_query_time;
 
 
 stat_export_t core_stats[] = {
@@ -71,6 +73,8 @@ stat_export_t core_stats[] = {
 	{"bad_URIs_rcvd",         0,  &bad_URIs              },
 	{"bad_msg_hdr",           0,  &bad_msg_hdr           },
 	{"slow_messages" ,        0,  &slow_msgs             },
+	{"msg_processing_time",   STAT_IS_HIST,  &msg_proc_time  },
+	{"db_query_time",         STAT_IS_HIST,  &db_query_time  },
 	{"timestamp",  STAT_IS_FUNC, (stat_var**)get_ticks   },
 	{0,0,0}
 };
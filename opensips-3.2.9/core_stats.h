@@ -74,6 +74,12 @@ extern stat_var* bad_msg_hdr;
 /*! \brief SIP message processing which exceeded 'threshold' duration */
 extern stat_var* slow_msgs;
 
+/*! \brief SIP message processing durations, in microseconds */
+extern stat_var* msg_proc_time;
+
+/*! \brief SQL query durations, in microseconds */
+extern stat_var* db_query_time;
+
 #ifdef PKG_MALLOC
 int init_pkg_stats(int no_procs);
 #endif
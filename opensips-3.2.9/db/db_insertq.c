@@ -25,16 +25,34 @@
 
 #include "../timer.h"
 #include "../pt.h"
+#include "../ut.h"
+#include "../daemonize.h"
+#include "../statistics.h"
 
 #include "db_insertq.h"
+#include "db_insertq_spool.h"
 #include "db_cap.h"
 
+#define QL_WRITER_IDLE_US	100000
+#define QL_MAX_RETRIES		3 /* failed writes before spooling */
+#define QL_MAX_BACKOFF		60 /* seconds */
+
 int query_buffer_size = 0;
 int query_flush_time = 0;
+int query_buffer_writer = 0;
+int query_buffer_max_rows = 0;
+char *query_buffer_spool_dir = NULL;
 query_list_t **query_list = NULL;
 query_list_t **last_query = NULL;
 gen_lock_t *ql_lock;
 
+static stat_var *ql_queued_rows;
+static stat_var *ql_written_rows;
+static stat_var *ql_failed_writes;
+static stat_var *ql_spooled_rows;
+static stat_var *ql_replayed_rows;
+static stat_var *ql_dropped_rows;
+
 /* inits all the global variables needed for the insert query lists */
 int init_query_list(void)
 {
@@ -83,68 +101,126 @@ error0:
  * inherit same queue */
 int init_ql_support(void)
 {
-	if (query_buffer_size > 1)
+	if (query_buffer_size <= 1)
+		return 0;
+
+	if (init_query_list() != 0)
 	{
-		if  (init_query_list() != 0 ||
-			register_timer("querydb-flush", ql_timer_routine,NULL,
+		LM_ERR("failed initializing ins list support\n");
+		return -1;
+	}
+
+	if (!query_buffer_writer)
+	{
+		query_buffer_max_rows = query_buffer_size;
+		if (register_timer("querydb-flush", ql_timer_routine,NULL,
 				query_flush_time>0?query_flush_time:DEF_FLUSH_TIME,
 				TIMER_FLAG_DELAY_ON_DELAY) < 0 )
 		{
 			LM_ERR("failed initializing ins list support\n");
 			return -1;
 		}
+
+		return 0;
 	}
 
+	/* the rows are written by the DB writer process */
+	if (query_buffer_max_rows <= 0)
+		query_buffer_max_rows = DEF_MAX_ROWS_FACTOR * query_buffer_size;
+	else if (query_buffer_max_rows < query_buffer_size)
+		query_buffer_max_rows = query_buffer_size;
+
+	if (ql_spool_init() != 0)
+		return -1;
+
+	if (register_stat("sql", "sql_queued_rows", &ql_queued_rows,
+			STAT_NO_RESET) ||
+		register_stat("sql", "sql_written_rows", &ql_written_rows, 0) ||
+		register_stat("sql", "sql_failed_writes", &ql_failed_writes, 0) ||
+		register_stat("sql", "sql_spooled_rows", &ql_spooled_rows, 0) ||
+		register_stat("sql", "sql_replayed_rows", &ql_replayed_rows, 0) ||
+		register_stat("sql", "sql_dropped_rows", &ql_dropped_rows, 0))
+	{
+		LM_ERR("failed to register the insert queue stats\n");
+		return -1;
+	}
+
+	LM_DBG("DB writer enabled, up to %d queued rows per table\n",
+		query_buffer_max_rows);
 	return 0;
 }
 
 
+static db_ps_t shutdown_ps = NULL;
+
+/* writes the rows one by one, at shutdown; the ones failing go to
+ * the spool, if any */
+static void ql_flush_rows_at_shutdown(query_list_t *it, db_con_t *con,
+											db_val_t **rows, int no_rows)
+{
+	int i;
+
+	for (i=0;i<no_rows;i++)
+	{
+		if (con)
+			CON_SET_CURR_PS(con, &shutdown_ps);
+		if (!con || it->dbf.insert(con,it->cols,rows[i],it->col_no) < 0)
+		{
+			if (query_buffer_spool_dir && ql_spool_rows(it,&rows[i],1) == 0)
+				LM_DBG("spooled row at shutdown\n");
+			else
+				LM_ERR("failed to insert into DB\n");
+		}
+
+		shm_free(rows[i]);
+		rows[i] = NULL;
+	}
+}
+
 void flush_query_list(void)
 {
 	query_list_t *it;
-	static db_ps_t my_ps = NULL;
-	int i;
+	db_con_t *con;
+	int n;
 
 	/* no locks, only attendent is left at this point */
 	for (it=*query_list;it;it=it->next)
 	{
-		if (it->no_rows > 0)
+		if (it->no_rows > 0 || it->pending_no > 0)
 		{
+			con = NULL;
+
 			memset(&it->dbf,0,sizeof(db_func_t));
 			if (db_bind_mod(&it->url,&it->dbf) < 0)
-			{
 				LM_ERR("failed to bind to db at shutdown\n");
-				lock_release(it->lock);
-				continue;
-			}
-
-			it->conn[process_no] = it->dbf.init(&it->url);
-			if (it->conn[process_no] == 0)
-			{
+			else if ((con = it->dbf.init(&it->url)) == 0)
 				LM_ERR("unable to connect to DB at shutdown\n");
-				lock_release(it->lock);
+
+			if (!con && !query_buffer_spool_dir)
 				continue;
-			}
 
-			it->dbf.use_table(it->conn[process_no],&it->table);
+			it->conn[process_no] = con;
+			if (con)
+				it->dbf.use_table(con,&it->table);
 
 			//Reset prepared statement between query lists/connections
-			my_ps = NULL;
+			shutdown_ps = NULL;
 
-			/* and let's insert the rows */
-			for (i=0;i<it->no_rows;i++)
-			{
-				CON_SET_CURR_PS(it->conn[process_no], &my_ps);
-				if (it->dbf.insert(it->conn[process_no],it->cols,it->rows[i],
-							it->col_no) < 0)
-					LM_ERR("failed to insert into DB\n");
+			/* the batch the writer was busy with goes first */
+			ql_flush_rows_at_shutdown(it, con, it->pending, it->pending_no);
+			it->pending_no = 0;
 
-				shm_free(it->rows[i]);
-			}
+			/* and let's insert the rows, the ring may wrap around */
+			n = it->max_rows - it->head;
+			if (n > it->no_rows)
+				n = it->no_rows;
+			ql_flush_rows_at_shutdown(it, con, it->rows + it->head, n);
+			ql_flush_rows_at_shutdown(it, con, it->rows, it->no_rows - n);
+			it->no_rows = 0;
 
 			/* no longer need this connection */
-			if (it->conn[process_no] && it->dbf.close)
-				it->dbf.close(it->conn[process_no]);
+			if (con && it->dbf.close)
+				it->dbf.close(con);
 		}
 	}
 }
@@ -197,7 +273,7 @@ void ql_add_unsafe(query_list_t *entry)
 int ql_detach_rows_unsafe(query_list_t *entry,db_val_t ***ins_rows)
 {
 	static db_val_t **detached_rows = NULL;
-	int no_rows;
+	int no_rows,i;
 
 	if (detached_rows == NULL)
 	{
@@ -214,14 +290,27 @@ int ql_detach_rows_unsafe(query_list_t *entry,db_val_t ***ins_rows)
 	if (entry->no_rows == 0)
 		return 0;
 
-	memcpy(detached_rows,entry->rows,query_buffer_size * sizeof(db_val_t *));
-	memset(entry->rows,0,query_buffer_size * sizeof(db_val_t *));
+	/* at most one batch, starting with the oldest row in the ring */
+	no_rows = entry->no_rows < query_buffer_size ?
+		entry->no_rows : query_buffer_size;
+	for (i=0;i<no_rows;i++)
+	{
+		detached_rows[i] = entry->rows[entry->head];
+		entry->rows[entry->head] = NULL;
+		entry->head = (entry->head + 1) % entry->max_rows;
+	}
+	memset(detached_rows + no_rows,0,
+		(query_buffer_size - no_rows) * sizeof(db_val_t *));
 
-	no_rows = entry->no_rows;
 	LM_DBG("detached %d rows\n",no_rows);
 
-	entry->no_rows = 0;
-	entry->oldest_query = 0;
+	entry->no_rows -= no_rows;
+	/* any rows left are newer, keep the timestamp so they are
+	 * flushed early rather than late */
+	if (entry->no_rows == 0)
+		entry->oldest_query = 0;
+	if (!(entry->flags & QL_CALLER_OWNS_ROWS))
+		if_update_stat(query_buffer_writer, ql_queued_rows, -no_rows);
 	*ins_rows = detached_rows;
 
 	return no_rows;
@@ -303,15 +392,28 @@ int ql_row_add(query_list_t *entry,const db_val_t *row,db_val_t ***ins_rows)
 	LM_DBG("before locking query entry\n");
 	lock_get(entry->lock);
 
+	/* the writer is not keeping up (or the DB is down and there
+	 * is no spool), push back on the caller */
+	if (entry->no_rows == entry->max_rows)
+	{
+		lock_release(entry->lock);
+		shm_free(shm_row);
+		if_update_stat(query_buffer_writer, ql_dropped_rows, 1);
+		LM_ERR("insert queue for table [%.*s] is full (%d rows)\n",
+			entry->table.len,entry->table.s,entry->max_rows);
+		return -1;
+	}
+
 	/* store oldest query for timer to know */
 	if (entry->no_rows == 0)
 		entry->oldest_query = time(0);
 
-	entry->rows[entry->no_rows++] = shm_row;
+	entry->rows[(entry->head + entry->no_rows++) % entry->max_rows] = shm_row;
+	if_update_stat(query_buffer_writer, ql_queued_rows, 1);
 	LM_DBG("query for table [%.*s] has %d rows\n",entry->table.len,entry->table.s,entry->no_rows);
 
-	/* is it time to flush to DB ? */
-	if (entry->no_rows == query_buffer_size)
+	/* is it time to flush to DB ? (the writer does it, if enabled) */
+	if (!query_buffer_writer && entry->no_rows == query_buffer_size)
 	{
 		if ((no_rows = ql_detach_rows_unsafe(entry,ins_rows)) < 0)
 		{
@@ -328,7 +430,7 @@ int ql_row_add(query_list_t *entry,const db_val_t *row,db_val_t ***ins_rows)
 /* initializez a new query entry */
 query_list_t *ql_init(db_con_t *con,db_key_t *cols,int col_no)
 {
-	int key_size,row_q_size,size,i;
+	int key_size,row_q_size,size,i,j;
 	char *pos;
 	query_list_t *entry;
 
@@ -336,7 +438,10 @@ query_list_t *ql_init(db_con_t *con,db_key_t *cols,int col_no)
 	for (i=0;i<col_no;i++)
 		key_size += cols[i]->len;
 
-	row_q_size = sizeof(db_val_t *) * query_buffer_size;
+	/* the ring, plus the batch being written by the writer */
+	row_q_size = sizeof(db_val_t *) * query_buffer_max_rows;
+	if (query_buffer_writer)
+		row_q_size += sizeof(db_val_t *) * query_buffer_size;
 	size = sizeof(query_list_t) +
 		counted_max_processes * sizeof(db_con_t *) +
 		con->table->len + key_size + row_q_size + con->url.len;
@@ -385,11 +490,19 @@ query_list_t *ql_init(db_con_t *con,db_key_t *cols,int col_no)
 		entry->cols[i]->s = pos;
 		memcpy(pos,cols[i]->s,cols[i]->len);
 		pos += cols[i]->len;
+
+		for (j=0;j<cols[i]->len;j++)
+			entry->cols_hash = entry->cols_hash * 31 + cols[i]->s[j];
+		entry->cols_hash = entry->cols_hash * 31 + ',';
 	}
 
 	/* deal with the rows */
 	entry->rows = (db_val_t **)(void *)((char *)(entry + 1) +
 					con->table->len + key_size);
+	entry->max_rows = query_buffer_max_rows;
+	if (query_buffer_writer)
+		entry->pending = entry->rows + query_buffer_max_rows;
+	entry->replay_fd = -1;
 
 	/* save url for later use by timer */
 	entry->url.s = (char *)entry + sizeof(query_list_t) +
@@ -648,3 +761,261 @@ void ql_force_process_disconnect(int p_id)
 	}
 }
 
+
+/* writes a batch of rows (owned by the caller) as a single query, via
+ * the flushing path of the DB layer */
+static int ql_write_rows(query_list_t *entry,db_val_t **rows,int no_rows)
+{
+	static query_list_t batch;
+	static gen_lock_t batch_lock;
+	static db_val_t **batch_rows = NULL;
+	db_con_t *con;
+
+	if (batch_rows == NULL)
+	{
+		batch_rows = pkg_malloc(query_buffer_size * sizeof(db_val_t *));
+		if (batch_rows == NULL)
+		{
+			LM_ERR("no more pkg mem\n");
+			return -1;
+		}
+		lock_init(&batch_lock);
+	}
+
+	if (entry->dbf.init == NULL && db_bind_mod(&entry->url,&entry->dbf) < 0)
+	{
+		LM_ERR("writer failed to bind to db\n");
+		return -1;
+	}
+
+	if (entry->conn[process_no] == NULL)
+	{
+		entry->conn[process_no] = entry->dbf.init(&entry->url);
+		if (entry->conn[process_no] == NULL)
+		{
+			LM_ERR("unable to connect to DB\n");
+			return -1;
+		}
+	}
+	con = entry->conn[process_no];
+
+	/* a private list, holding just this batch */
+	batch = *entry;
+	batch.rows = batch_rows;
+	batch.max_rows = query_buffer_size;
+	batch.head = 0;
+	batch.no_rows = no_rows;
+	batch.flags |= QL_CALLER_OWNS_ROWS;
+	batch.lock = &batch_lock;
+	memcpy(batch_rows,rows,no_rows * sizeof(db_val_t *));
+
+	entry->dbf.use_table(con,&entry->table);
+
+	con->ins_list = &batch;
+	CON_FLUSH_SAFE(con);
+
+	if (entry->dbf.insert(con,entry->cols,(db_val_t *)-1,entry->col_no) < 0)
+		return -1;
+
+	return 0;
+}
+
+static void ql_writer_failed(query_list_t *entry,time_t now)
+{
+	int backoff;
+
+	update_stat(ql_failed_writes, 1);
+
+	entry->failures++;
+	backoff = entry->failures < 6 ? 1 << entry->failures : QL_MAX_BACKOFF;
+	if (backoff > QL_MAX_BACKOFF)
+		backoff = QL_MAX_BACKOFF;
+	entry->retry_at = now + backoff;
+
+	LM_ERR("failed to write to table [%.*s] (%d times), retrying in %ds\n",
+		entry->table.len,entry->table.s,entry->failures,backoff);
+}
+
+/* moves the next batch out of the ring, if it is time to write it */
+static int ql_writer_detach(query_list_t *entry,time_t now,int force)
+{
+	db_val_t **rows;
+	int flush_time, no_rows = 0;
+
+	flush_time = query_flush_time>0 ? query_flush_time : DEF_FLUSH_TIME;
+
+	lock_get(entry->lock);
+	if (entry->no_rows >= query_buffer_size || (entry->no_rows > 0 &&
+	(force || now - entry->oldest_query >= flush_time)))
+	{
+		no_rows = ql_detach_rows_unsafe(entry,&rows);
+		if (no_rows > 0)
+			memcpy(entry->pending,rows,no_rows * sizeof(db_val_t *));
+		else
+			no_rows = 0;
+	}
+	lock_release(entry->lock);
+
+	entry->pending_no = no_rows;
+	return no_rows;
+}
+
+/* frees the first @no_rows of the batch, already taken off it */
+static void ql_free_pending(query_list_t *entry,int no_rows)
+{
+	int i;
+
+	for (i=0;i<no_rows;i++)
+	{
+		shm_free(entry->pending[i]);
+		entry->pending[i] = NULL;
+	}
+}
+
+/* the DB is down - keep the ring drained into the spool */
+static void ql_writer_spool(query_list_t *entry,time_t now)
+{
+	int no_rows;
+
+	do {
+		if (entry->pending_no == 0 && ql_writer_detach(entry,now,1) == 0)
+			return;
+
+		no_rows = entry->pending_no;
+		if (ql_spool_rows(entry,entry->pending,no_rows) < 0)
+			return;
+		/* spooled - not to be written again at shutdown */
+		entry->pending_no = 0;
+
+		update_stat(ql_spooled_rows, no_rows);
+		ql_free_pending(entry,no_rows);
+	} while (1);
+}
+
+/* writes a batch of spooled rows
+ * returns 1 if rows were written, 0 if nothing to do, -1 on failure */
+static int ql_writer_replay(query_list_t *entry)
+{
+	static db_val_t **rows = NULL;
+	off_t next;
+	int no_rows, rc, i;
+
+	if (rows == NULL)
+	{
+		rows = pkg_malloc(query_buffer_size * sizeof(db_val_t *));
+		if (rows == NULL)
+		{
+			LM_ERR("no more pkg mem\n");
+			return 0;
+		}
+	}
+
+	no_rows = ql_spool_read(entry,rows,query_buffer_size,&next);
+	if (no_rows <= 0)
+		return 0;
+
+	rc = ql_write_rows(entry,rows,no_rows);
+	if (rc == 0)
+	{
+		ql_spool_commit(entry,next);
+		update_stat(ql_replayed_rows, no_rows);
+	}
+
+	for (i=0;i<no_rows;i++)
+		pkg_free(rows[i]);
+
+	return rc == 0 ? 1 : -1;
+}
+
+/* does the pending work of a query
+ * returns 1 if more work may be done right away */
+static int ql_writer_run(query_list_t *entry,time_t now)
+{
+	int busy = 0, no_rows;
+
+	if (entry->retry_at > now)
+	{
+		if (query_buffer_spool_dir && entry->failures >= QL_MAX_RETRIES)
+			ql_writer_spool(entry,now);
+		return 0;
+	}
+
+	/* the spooled rows are interleaved with the queued ones, so the
+	 * queue does not fill up while catching up */
+	if (query_buffer_spool_dir && entry->pending_no == 0)
+	{
+		busy = ql_writer_replay(entry);
+		if (busy < 0)
+		{
+			ql_writer_failed(entry,now);
+			return 0;
+		}
+	}
+
+	if (entry->pending_no == 0 && ql_writer_detach(entry,now,0) == 0)
+		return busy;
+
+	no_rows = entry->pending_no;
+	if (ql_write_rows(entry,entry->pending,no_rows) < 0)
+	{
+		ql_writer_failed(entry,now);
+		return 0;
+	}
+	/* committed - not to be written again at shutdown */
+	entry->pending_no = 0;
+
+	if (entry->failures)
+	{
+		LM_INFO("writing to table [%.*s] again\n",
+			entry->table.len,entry->table.s);
+		entry->failures = 0;
+	}
+
+	update_stat(ql_written_rows, no_rows);
+	ql_free_pending(entry,no_rows);
+	return 1;
+}
+
+static void ql_writer_loop(void)
+{
+	query_list_t *it;
+	time_t now;
+	int busy;
+
+	for (;;)
+	{
+		now = time(0);
+		busy = 0;
+
+		for (it=*query_list;it;it=it->next)
+			busy |= ql_writer_run(it,now);
+
+		if (!busy)
+			sleep_us(QL_WRITER_IDLE_US);
+	}
+}
+
+int ql_start_writer(void)
+{
+	int id;
+
+	if (!ql_count_processes())
+		return 0;
+
+	if ((id=internal_fork("DB insert writer",
+	OSS_PROC_NO_IPC|OSS_PROC_NO_LOAD, TYPE_NONE))<0)
+	{
+		LM_CRIT("cannot fork the DB insert writer process\n");
+		return -1;
+	}
+	else if (id==0)
+	{
+		/* new process */
+		clean_write_pipeend();
+
+		ql_writer_loop();
+		exit(-1);
+	}
+
+	return 0;
+}
@@ -26,6 +26,8 @@
 #ifndef _DB_INSERTQ_H
 #define _DB_INSERTQ_H
 
+#include <sys/types.h>
+
 #include "db_ut.h"
 #include "db_query.h"
 #include "../locking.h"
@@ -38,9 +40,18 @@ extern int query_flush_time; /* if the query contains inserts older
 								that query_flush_time seconds, the timer
 								will kick in and flush to DB,
 								to maintain "real time" sync with DB */
+extern int query_buffer_writer; /* the queued rows are flushed by a
+								   dedicated process, not by the workers */
+extern int query_buffer_max_rows; /* rows that may be queued for a table,
+									 in writer mode, before refusing more */
+extern char *query_buffer_spool_dir; /* where the writer spools the rows
+										it is unable to write to DB */
 
 #define CON_HAS_INSLIST(cn)	((cn)->ins_list)
 #define DEF_FLUSH_TIME		10 /* seconds */
+#define DEF_MAX_ROWS_FACTOR	16 /* default max_rows, in buffer sizes */
+
+#define QL_CALLER_OWNS_ROWS	(1<<0) /* the DB layer must not free the rows */
 
 typedef struct query_list {
 	str url;			/* url for the connection - needed by timer */
@@ -49,10 +60,21 @@ typedef struct query_list {
 	str table;			/* table that query is targetting */
 	db_key_t *cols;		/* columns for the insert */
 	int col_no;			/* number of columns */
-	db_val_t **rows;	/* rows queued to be inserted */
+	db_val_t **rows;	/* ring of rows queued to be inserted */
+	int max_rows;		/* size of the ring */
+	int head;			/* index of the oldest row in the ring */
 	gen_lock_t* lock;	/* lock for adding rows */
 	int no_rows;		/* number of rows in queue */
 	time_t oldest_query;	/* timestamp of oldest query in queue */
+	int flags;
+	/* only used by the writer process */
+	db_val_t **pending;	/* batch detached from the ring, not yet written */
+	int pending_no;
+	int failures;		/* consecutive failed writes */
+	time_t retry_at;	/* no writes until then, the DB is down */
+	unsigned int cols_hash; /* identifies the spool files of the query */
+	int replay_fd;
+	off_t replay_off;
 	struct query_list *next;
 	struct query_list *prev;
 } query_list_t;
@@ -69,6 +91,11 @@ void ql_timer_routine(unsigned int ticks,void *param);
 int ql_flush_rows(db_func_t *dbf, db_con_t *conn,query_list_t *entry);
 void ql_force_process_disconnect(int p_id);
 
+/* the number of processes needed by the insert queues */
+#define ql_count_processes() \
+	((query_buffer_size > 1 && query_buffer_writer) ? 1 : 0)
+int ql_start_writer(void);
+
 #define CON_RESET_INSLIST(con) \
 	do { \
 		*((query_list_t **)&con->ins_list) = NULL; \
@@ -76,6 +103,10 @@ void ql_force_process_disconnect(int p_id);
 
 #define IS_INSTANT_FLUSH(con)		((con)->flags & CON_INSTANT_FLUSH)
 
+/* are the flushed rows to be freed by the DB layer ? */
+#define CON_FREES_ROWS(con) \
+	(!CON_HAS_INSLIST(con) || !((con)->ins_list->flags & QL_CALLER_OWNS_ROWS))
+
 #define CON_FLUSH_UNSAFE(con) \
 	do { \
 		(con)->flags |= CON_INSTANT_FLUSH; \
@@ -0,0 +1,388 @@
+/*
+ * Copyright (C) 2026 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../dprint.h"
+#include "../mem/mem.h"
+
+#include "db_insertq_spool.h"
+
+/* each row is spooled as its length, followed by the type and the null
+ * flag of each value and then by the value itself; the strings are kept
+ * as their length and content (including the NULL end of the DB_STRING) */
+typedef unsigned int spool_len_t;
+
+#define SPOOL_HDR_LEN 2
+
+
+static char *ql_spool_path(query_list_t *entry, const char *ext, char *path)
+{
+	int len, i;
+
+	len = snprintf(path, PATH_MAX, "%s/%.*s-%08x.%s", query_buffer_spool_dir,
+		entry->table.len, entry->table.s, entry->cols_hash, ext);
+	if (len < 0 || len >= PATH_MAX) {
+		LM_ERR("spool path too long for table [%.*s]\n",
+			entry->table.len, entry->table.s);
+		return NULL;
+	}
+
+	/* the table may come as "schema/table" or so */
+	for (i = strlen(query_buffer_spool_dir) + 1; i < len; i++)
+		if (path[i] == '/')
+			path[i] = '_';
+
+	return path;
+}
+
+int ql_spool_init(void)
+{
+	if (!query_buffer_spool_dir)
+		return 0;
+
+	if (access(query_buffer_spool_dir, W_OK|X_OK) != 0) {
+		LM_ERR("bad query_buffer_spool_dir [%s]: %s\n",
+			query_buffer_spool_dir, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+static int ql_spool_val_size(const db_val_t *v)
+{
+	if (VAL_NULL(v))
+		return SPOOL_HDR_LEN;
+
+	switch (VAL_TYPE(v)) {
+		case DB_INT:
+			return SPOOL_HDR_LEN + sizeof(int);
+		case DB_BIGINT:
+		case DB_DATETIME:
+			return SPOOL_HDR_LEN + sizeof(long long);
+		case DB_DOUBLE:
+			return SPOOL_HDR_LEN + sizeof(double);
+		case DB_BITMAP:
+			return SPOOL_HDR_LEN + sizeof(unsigned int);
+		case DB_STRING:
+			return SPOOL_HDR_LEN + sizeof(int) + strlen(VAL_STRING(v)) + 1;
+		case DB_STR:
+		case DB_BLOB:
+			return SPOOL_HDR_LEN + sizeof(int) + VAL_STR(v).len;
+	}
+
+	return -1;
+}
+
+static char *ql_spool_val(const db_val_t *v, char *p)
+{
+	long long ll;
+	int len;
+
+	*p++ = VAL_TYPE(v);
+	*p++ = VAL_NULL(v) ? 1 : 0;
+	if (VAL_NULL(v))
+		return p;
+
+	switch (VAL_TYPE(v)) {
+		case DB_INT:
+			memcpy(p, &VAL_INT(v), sizeof(int));
+			return p + sizeof(int);
+		case DB_BIGINT:
+			memcpy(p, &VAL_BIGINT(v), sizeof(long long));
+			return p + sizeof(long long);
+		case DB_DATETIME:
+			ll = VAL_TIME(v);
+			memcpy(p, &ll, sizeof(long long));
+			return p + sizeof(long long);
+		case DB_DOUBLE:
+			memcpy(p, &VAL_DOUBLE(v), sizeof(double));
+			return p + sizeof(double);
+		case DB_BITMAP:
+			memcpy(p, &VAL_BITMAP(v), sizeof(unsigned int));
+			return p + sizeof(unsigned int);
+		case DB_STRING:
+			len = strlen(VAL_STRING(v)) + 1;
+			memcpy(p, &len, sizeof(int));
+			memcpy(p + sizeof(int), VAL_STRING(v), len);
+			return p + sizeof(int) + len;
+		case DB_STR:
+		case DB_BLOB:
+			len = VAL_STR(v).len;
+			memcpy(p, &len, sizeof(int));
+			memcpy(p + sizeof(int), VAL_STR(v).s, len);
+			return p + sizeof(int) + len;
+	}
+
+	return p;
+}
+
+int ql_spool_rows(query_list_t *entry, db_val_t **rows, int no_rows)
+{
+	char path[PATH_MAX];
+	char *buf, *p, *q;
+	spool_len_t len;
+	int size, i, j, n, fd;
+
+	if (!query_buffer_spool_dir || no_rows == 0)
+		return -1;
+
+	for (size = 0, i = 0; i < no_rows; i++) {
+		size += sizeof(spool_len_t);
+		for (j = 0; j < entry->col_no; j++) {
+			if ((n = ql_spool_val_size(rows[i] + j)) < 0) {
+				LM_ERR("unsupported DB type %d\n", VAL_TYPE(rows[i] + j));
+				return -1;
+			}
+			size += n;
+		}
+	}
+
+	buf = pkg_malloc(size);
+	if (!buf) {
+		LM_ERR("no more pkg mem\n");
+		return -1;
+	}
+
+	for (p = buf, i = 0; i < no_rows; i++) {
+		q = p + sizeof(spool_len_t);
+		for (j = 0; j < entry->col_no; j++)
+			q = ql_spool_val(rows[i] + j, q);
+
+		len = q - p - sizeof(spool_len_t);
+		memcpy(p, &len, sizeof(spool_len_t));
+		p = q;
+	}
+
+	if (!ql_spool_path(entry, "spool", path))
+		goto error;
+
+	fd = open(path, O_WRONLY|O_CREAT|O_APPEND, 0600);
+	if (fd < 0) {
+		LM_ERR("failed to open spool file %s: %s\n", path, strerror(errno));
+		goto error;
+	}
+
+	for (p = buf; p < buf + size; p += n) {
+		n = write(fd, p, buf + size - p);
+		if (n < 0) {
+			if (errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			LM_ERR("failed to write spool file %s: %s\n", path,
+				strerror(errno));
+			/* drop the partial record, if any */
+			if (p != buf && ftruncate(fd, lseek(fd, 0, SEEK_END) - (p - buf)) < 0)
+				LM_ERR("failed to truncate %s\n", path);
+			close(fd);
+			goto error;
+		}
+	}
+
+	close(fd);
+	pkg_free(buf);
+	return 0;
+
+error:
+	pkg_free(buf);
+	return -1;
+}
+
+static int ql_spool_decode(query_list_t *entry, db_val_t *row, char *p,
+																char *end)
+{
+	long long ll;
+	int i, len;
+
+	for (i = 0; i < entry->col_no; i++) {
+		if (end - p < SPOOL_HDR_LEN)
+			return -1;
+
+		VAL_TYPE(row + i) = *p++;
+		VAL_NULL(row + i) = *p++;
+		if (VAL_NULL(row + i))
+			continue;
+
+		switch (VAL_TYPE(row + i)) {
+			case DB_INT:
+				if (end - p < sizeof(int))
+					return -1;
+				memcpy(&VAL_INT(row + i), p, sizeof(int));
+				p += sizeof(int);
+				break;
+			case DB_BIGINT:
+				if (end - p < sizeof(long long))
+					return -1;
+				memcpy(&VAL_BIGINT(row + i), p, sizeof(long long));
+				p += sizeof(long long);
+				break;
+			case DB_DATETIME:
+				if (end - p < sizeof(long long))
+					return -1;
+				memcpy(&ll, p, sizeof(long long));
+				VAL_TIME(row + i) = (time_t)ll;
+				p += sizeof(long long);
+				break;
+			case DB_DOUBLE:
+				if (end - p < sizeof(double))
+					return -1;
+				memcpy(&VAL_DOUBLE(row + i), p, sizeof(double));
+				p += sizeof(double);
+				break;
+			case DB_BITMAP:
+				if (end - p < sizeof(unsigned int))
+					return -1;
+				memcpy(&VAL_BITMAP(row + i), p, sizeof(unsigned int));
+				p += sizeof(unsigned int);
+				break;
+			case DB_STRING:
+			case DB_STR:
+			case DB_BLOB:
+				if (end - p < sizeof(int))
+					return -1;
+				memcpy(&len, p, sizeof(int));
+				p += sizeof(int);
+				if (len < 0 || end - p < len)
+					return -1;
+				if (VAL_TYPE(row + i) == DB_STRING) {
+					if (len == 0 || p[len - 1] != '\0')
+						return -1;
+					VAL_STRING(row + i) = p;
+				} else {
+					VAL_STR(row + i).s = p;
+					VAL_STR(row + i).len = len;
+				}
+				p += len;
+				break;
+			default:
+				return -1;
+		}
+	}
+
+	return p == end ? 0 : -1;
+}
+
+int ql_spool_read(query_list_t *entry, db_val_t **rows, int max, off_t *next)
+{
+	char spool[PATH_MAX], replay[PATH_MAX];
+	struct stat st;
+	spool_len_t len;
+	db_val_t *row;
+	off_t off;
+	int n;
+
+	if (!query_buffer_spool_dir)
+		return 0;
+
+	if (entry->replay_fd < 0) {
+		if (!ql_spool_path(entry, "replay", replay))
+			return -1;
+
+		/* a replay interrupted by a restart goes first */
+		if (access(replay, F_OK) != 0) {
+			if (!ql_spool_path(entry, "spool", spool))
+				return -1;
+			if (rename(spool, replay) < 0) {
+				if (errno == ENOENT)
+					return 0;
+				LM_ERR("failed to rename %s: %s\n", spool, strerror(errno));
+				return -1;
+			}
+		}
+
+		entry->replay_fd = open(replay, O_RDONLY);
+		if (entry->replay_fd < 0) {
+			LM_ERR("failed to open %s: %s\n", replay, strerror(errno));
+			return -1;
+		}
+		entry->replay_off = 0;
+		LM_INFO("replaying the spooled rows of table [%.*s]\n",
+			entry->table.len, entry->table.s);
+	}
+
+	if (fstat(entry->replay_fd, &st) < 0) {
+		LM_ERR("failed to stat the replay file: %s\n", strerror(errno));
+		return -1;
+	}
+
+	for (n = 0, off = entry->replay_off; n < max && off < st.st_size; ) {
+		if (st.st_size - off < sizeof(spool_len_t) ||
+		pread(entry->replay_fd, &len, sizeof(spool_len_t), off) !=
+		sizeof(spool_len_t) || st.st_size - off - sizeof(spool_len_t) < len)
+			goto truncated;
+
+		row = pkg_malloc(entry->col_no * sizeof(db_val_t) + len);
+		if (!row) {
+			LM_ERR("no more pkg mem\n");
+			break;
+		}
+		memset(row, 0, entry->col_no * sizeof(db_val_t));
+
+		if (pread(entry->replay_fd, row + entry->col_no, len,
+		off + sizeof(spool_len_t)) != len ||
+		ql_spool_decode(entry, row, (char *)(row + entry->col_no),
+		(char *)(row + entry->col_no) + len) < 0) {
+			pkg_free(row);
+			goto truncated;
+		}
+
+		rows[n++] = row;
+		off += sizeof(spool_len_t) + len;
+	}
+
+	*next = off;
+	if (n == 0)
+		ql_spool_commit(entry, off);
+
+	return n;
+
+truncated:
+	LM_ERR("dropping the corrupted tail of the spool of table [%.*s]\n",
+		entry->table.len, entry->table.s);
+	*next = st.st_size;
+	if (n == 0)
+		ql_spool_commit(entry, st.st_size);
+	return n;
+}
+
+void ql_spool_commit(query_list_t *entry, off_t next)
+{
+	char replay[PATH_MAX];
+	struct stat st;
+
+	entry->replay_off = next;
+	if (fstat(entry->replay_fd, &st) == 0 && next < st.st_size)
+		return;
+
+	close(entry->replay_fd);
+	entry->replay_fd = -1;
+	entry->replay_off = 0;
+
+	if (ql_spool_path(entry, "replay", replay) && unlink(replay) < 0)
+		LM_ERR("failed to remove %s: %s\n", replay, strerror(errno));
+}
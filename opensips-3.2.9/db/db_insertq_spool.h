@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2026 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * On-disk spool of the insert queues, used by the DB writer process while
+ * the DB is down. The rows of each query (table and columns) are appended
+ * to "<spool_dir>/<table>-<columns hash>.spool"; once the DB is back, the
+ * file is renamed to ".replay" and written to DB batch by batch, while new
+ * failures keep on going to a fresh ".spool" file. The replay position is
+ * only kept in memory, so the rows of a replay interrupted by a restart are
+ * written again (at least once delivery).
+ */
+
+#ifndef _DB_INSERTQ_SPOOL_H
+#define _DB_INSERTQ_SPOOL_H
+
+#include "db_insertq.h"
+
+int ql_spool_init(void);
+
+/* appends the rows to the spool file of the query */
+int ql_spool_rows(query_list_t *entry, db_val_t **rows, int no_rows);
+
+/* reads up to @max spooled rows, each row being a single pkg chunk
+ * returns the number of rows, while @next is where the next batch starts */
+int ql_spool_read(query_list_t *entry, db_val_t **rows, int max, off_t *next);
+
+/* the rows read up to @next were written to DB */
+void ql_spool_commit(query_list_t *entry, off_t next);
+
+#endif
@@ -32,6 +32,8 @@
 #include <stdio.h>
 #include "../dprint.h"
 #include "../locking.h"
+#include "../core_stats.h"
+#include "db_ps.h"
 #include "db_ut.h"
 #include "db_query.h"
 #include "db_insertq.h"
@@ -39,6 +41,23 @@
 static str  sql_str;
 static char sql_buf[SQL_BUF_LEN];
 
+/* with a prepared statement, the driver only runs (and times) it later on */
+static inline int db_submit_query(const db_con_t* _h, const str* _s,
+	int (*submit_query)(const db_con_t* _h, const str* _c))
+{
+	struct timeval start;
+	int ret;
+
+	if (CON_HAS_PS(_h))
+		return submit_query(_h, _s);
+
+	start_hist_timer(start);
+	ret = submit_query(_h, _s);
+	stop_hist_timer(start, db_query_time);
+
+	return ret;
+}
+
 int db_do_query(const db_con_t* _h, const db_key_t* _k, const db_op_t* _op,
 	const db_val_t* _v, const db_key_t* _c, const int _n, const int _nc,
 	const db_key_t _o, db_res_t** _r, int (*val2str) (const db_con_t*,
@@ -96,7 +115,7 @@ int db_do_query(const db_con_t* _h, const db_key_t* _k, const db_op_t* _op,
 	sql_str.s = sql_buf;
 	sql_str.len = off;
 
-	if (submit_query(_h, &sql_str) < 0) {
+	if (db_submit_query(_h, &sql_str, submit_query) < 0) {
 		LM_ERR("error while submitting query - [%.*s]\n",sql_str.len,sql_str.s);
 		goto err_exit;
 	}
@@ -133,7 +152,7 @@ int db_do_raw_query(const db_con_t* _h, const str* _s, db_res_t** _r,
 		return -1;
 	}
 
-	if (submit_query(_h, _s) < 0) {
+	if (db_submit_query(_h, _s, submit_query) < 0) {
 		LM_ERR("error while submitting query\n");
 		return -2;
 	}
@@ -247,7 +266,7 @@ build_query:
 
 				/* if we have a PS, leave the function handling prep stmts
 				   in the module to free the rows once it's done */
-				if (!CON_HAS_PS(_h)) {
+				if (!CON_HAS_PS(_h) && CON_FREES_ROWS(_h)) {
 					shm_free(buffered_rows[i]);
 					buffered_rows[i] = NULL;
 				}
@@ -285,14 +304,15 @@ build_query:
 	sql_str.len = off;
 
 submit:
-	if (submit_query(_h, &sql_str) < 0) {
+	if (db_submit_query(_h, &sql_str, submit_query) < 0) {
 	        LM_ERR("error while submitting query\n");
 		return -2;
 	}
 	return 0;
 
 error:
-	cleanup_rows(buffered_rows);
+	if (CON_FREES_ROWS(_h))
+		cleanup_rows(buffered_rows);
 error0:
 	LM_ERR("error while preparing insert operation\n");
 	return -1;
@@ -330,7 +350,7 @@ int db_do_delete(const db_con_t* _h, const db_key_t* _k, const db_op_t* _o,
 	sql_str.s = sql_buf;
 	sql_str.len = off;
 
-	if (submit_query(_h, &sql_str) < 0) {
+	if (db_submit_query(_h, &sql_str, submit_query) < 0) {
 		LM_ERR("error while submitting query\n");
 		CON_OR_RESET(_h);
 		return -2;
@@ -382,7 +402,7 @@ int db_do_update(const db_con_t* _h, const db_key_t* _k, const db_op_t* _o,
 	sql_str.s = sql_buf;
 	sql_str.len = off;
 
-	if (submit_query(_h, &sql_str) < 0) {
+	if (db_submit_query(_h, &sql_str, submit_query) < 0) {
 		LM_ERR("error while submitting query\n");
 		CON_OR_RESET(_h);
 		return -2;
@@ -435,7 +455,7 @@ int db_do_replace(const db_con_t* _h, const db_key_t* _k, const db_val_t* _v,
 	sql_str.s = sql_buf;
 	sql_str.len = off;
 
-	if (submit_query(_h, &sql_str) < 0) {
+	if (db_submit_query(_h, &sql_str, submit_query) < 0) {
 	        LM_ERR("error while submitting query\n");
 		return -2;
 	}
@@ -25,6 +25,7 @@
 
 #include "event_interface.h"
 #include "evi_modules.h"
+#include "evi_dispatch.h"
 #include "../mem/shm_mem.h"
 #include "../mi/mi.h"
 #include "../pvar.h"
@@ -130,6 +131,7 @@ int evi_raise_event_msg(struct sip_msg *msg, event_id_t id, evi_params_t* params
 {
 	evi_subs_p subs, prev;
 	evi_async_ctx_t async_status = {NULL, NULL};
+	struct evi_dispatch_event *qev = NULL;
 	long now;
 	int flags, pflags = 0;
 	int ret = 0;
@@ -158,6 +160,7 @@ int evi_raise_event_msg(struct sip_msg *msg, event_id_t id, evi_params_t* params
 		}
 		/* check expire */
 		if (!(subs->reply_sock->flags & EVI_PENDING) &&
+				!__atomic_load_n(&subs->queued, __ATOMIC_ACQUIRE) &&
 				subs->reply_sock->flags & EVI_EXPIRE &&
 				subs->reply_sock->subscription_time +
 				subs->reply_sock->expire < now) {
@@ -189,14 +192,30 @@ int evi_raise_event_msg(struct sip_msg *msg, event_id_t id, evi_params_t* params
 					subs->trans_mod->proto.len, subs->trans_mod->proto.s);
 			goto next;
 		}
+		if (subs->queue && !evi_dispatcher &&
+				!qev && !(qev = evi_dispatch_event_new(id, params))) {
+			LM_ERR("cannot queue event %.*s\n",
+					events[id].name.len, events[id].name.s);
+			goto next;
+		}
+
 		/* we use this var to make sure nested calls don't reset the flag */
 		flags = subs->reply_sock->flags;
 		subs->reply_sock->flags |= EVI_PENDING;
 		/* make sure nested events don't deadlock */
 		lock_release(events[id].lock);
 
-		ret += (subs->trans_mod->raise)(msg, &events[id].name,
+		if (qev && subs->queue) {
+			/* keeps the subscriber around until dispatched */
+			__atomic_add_fetch(&subs->queued, 1, __ATOMIC_RELAXED);
+			if (evi_dispatch_push(qev, subs) < 0) {
+				__atomic_sub_fetch(&subs->queued, 1, __ATOMIC_RELAXED);
+				ret--;
+			}
+		} else {
+			ret += (subs->trans_mod->raise)(msg, &events[id].name,
 					subs->reply_sock, params, &async_status);
+		}
 
 		lock_get(events[id].lock);
 		subs->reply_sock->flags = flags;
@@ -206,6 +225,9 @@ next:
 	}
 	lock_release(events[id].lock);
 
+	if (qev)
+		evi_dispatch_event_release(qev);
+
 	events_rec_level++;
 	if (params)
 		params->flags = pflags;
@@ -335,9 +357,11 @@ int evi_event_subscribe(str event_name,
 			return 0;
 		}
 
+		memset(subscriber, 0, sizeof(evi_subs_t));
 		sock->subscription_time = time(0);
 		subscriber->trans_mod = trans_mod;
 		subscriber->reply_sock = sock;
+		subscriber->queue = evi_dispatch_queue(trans_mod);
 
 		if (EVI_EXPIRE & sock->flags)
 			subscriber->reply_sock->expire = expire;
@@ -543,6 +567,18 @@ static int evi_print_subscriber(mi_item_t *subs_obj, evi_subs_p subs)
 	}
 	/* XXX - does subscription time make sense? */
 
+	if (subs->queue) {
+		if (add_mi_number(subs_obj, MI_SSTR("queued"),
+				__atomic_load_n(&subs->queued, __ATOMIC_RELAXED)) < 0)
+			return -1;
+		if (add_mi_number(subs_obj, MI_SSTR("lag"),
+				__atomic_load_n(&subs->lag, __ATOMIC_RELAXED)) < 0)
+			return -1;
+		if (add_mi_number(subs_obj, MI_SSTR("dropped"),
+				__atomic_load_n(&subs->dropped, __ATOMIC_RELAXED)) < 0)
+			return -1;
+	}
+
 	return 0;
 }
 
@@ -37,6 +37,10 @@
 typedef struct evi_subscriber {
 	evi_export_t* trans_mod;			/* transport module */
 	evi_reply_sock* reply_sock;		/* reply socket */
+	struct evi_queue *queue;			/* queue of the transport, if any */
+	unsigned int queued;				/* events waiting to be dispatched */
+	unsigned int lag;					/* wait of the last one, in ms */
+	unsigned long dropped;				/* events dropped on a full queue */
 	struct evi_subscriber *next;		/* next subscriber */
 } evi_subs_t, *evi_subs_p;
 
@@ -72,6 +76,9 @@ mi_response_t *w_mi_raise_event(const mi_params_t *params,
 /* returns the transport export */
 evi_export_t* get_trans_mod(str* tran);
 
+/* returns the list of the registered transports */
+evi_trans_t *get_trans_mods(void);
+
 /* returns the transport modules number */
 int get_trans_mod_no(void);
 
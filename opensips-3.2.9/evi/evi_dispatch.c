@@ -0,0 +1,358 @@
+/*
+ * Copyright (C) 2026 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "../mem/shm_mem.h"
+#include "../dprint.h"
+#include "../globals.h"
+#include "../daemonize.h"
+#include "../action.h"
+#include "../usr_avp.h"
+#include "../sr_module.h"
+#include "../pt.h"
+#include "../ut.h"
+
+#include "evi_dispatch.h"
+
+/* how long a raising process waits for room, with the "block" policy */
+#define EVI_QUEUE_BLOCK_US  100
+
+int evi_queue_size = 0;
+int evi_queue_policy = EVI_QUEUE_DROP;
+
+int evi_dispatcher = 0;
+
+extern evi_event_t *events;
+
+struct evi_dispatch_event {
+	int refs;
+	event_id_t id;
+	unsigned long long stamp;   /* when raised, in us */
+	evi_params_t params;        /* followed by the flat parameters */
+};
+
+struct evi_queue_slot {
+	unsigned long seq;
+	struct evi_dispatch_event *ev;
+	evi_subs_p subs;
+};
+
+/* bounded MPSC ring: each slot carries a sequence number telling whether it
+ * is free for the producer at a given position, or filled for the consumer;
+ * the producers only compete on the head, while the tail is private to the
+ * dispatcher */
+struct evi_queue {
+	evi_export_t *trans;
+	unsigned long head;         /* next position to fill */
+	unsigned long tail;         /* next position to dispatch */
+	int sleeping;               /* the dispatcher waits on the eventfd */
+	int fd;
+	unsigned long mask;
+	struct evi_queue *next;
+	struct evi_queue_slot slots[0];
+};
+
+static struct evi_queue *evi_queues;
+static int evi_queues_no;
+
+
+static inline unsigned long long evi_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+int evi_queue_set_policy(char *policy)
+{
+	if (!strcasecmp(policy, "drop"))
+		evi_queue_policy = EVI_QUEUE_DROP;
+	else if (!strcasecmp(policy, "block"))
+		evi_queue_policy = EVI_QUEUE_BLOCK;
+	else
+		return -1;
+
+	return 0;
+}
+
+static int evi_queue_new(evi_export_t *trans)
+{
+	struct evi_queue *q;
+	unsigned long size, i;
+
+	for (size = 1; size < evi_queue_size; size <<= 1);
+
+	q = shm_malloc(sizeof *q + size * sizeof(struct evi_queue_slot));
+	if (!q) {
+		LM_ERR("no more shm memory for the queue of %.*s\n",
+			trans->proto.len, trans->proto.s);
+		return -1;
+	}
+	memset(q, 0, sizeof *q);
+
+	q->fd = eventfd(0, EFD_CLOEXEC);
+	if (q->fd < 0) {
+		LM_ERR("failed to create eventfd: %s\n", strerror(errno));
+		shm_free(q);
+		return -1;
+	}
+
+	for (i = 0; i < size; i++) {
+		q->slots[i].seq = i;
+		q->slots[i].ev = NULL;
+		q->slots[i].subs = NULL;
+	}
+	q->mask = size - 1;
+	q->trans = trans;
+
+	q->next = evi_queues;
+	evi_queues = q;
+	evi_queues_no++;
+
+	LM_DBG("queueing the %.*s events, %lu slots\n",
+		trans->proto.len, trans->proto.s, size);
+	return 0;
+}
+
+int evi_dispatch_init(void)
+{
+	evi_trans_t *t;
+
+	if (evi_queue_size <= 0)
+		return 0;
+
+	for (t = get_trans_mods(); t; t = t->next)
+		if ((t->module->flags & EVI_DISPATCH) && evi_queue_new(t->module) < 0)
+			return -1;
+
+	return 0;
+}
+
+struct evi_queue *evi_dispatch_queue(evi_export_t *trans)
+{
+	struct evi_queue *q;
+
+	for (q = evi_queues; q; q = q->next)
+		if (q->trans == trans)
+			return q;
+
+	return NULL;
+}
+
+int evi_dispatch_count_processes(void)
+{
+	return evi_queues_no;
+}
+
+
+struct evi_dispatch_event *evi_dispatch_event_new(event_id_t id,
+													evi_params_p params)
+{
+	struct evi_dispatch_event *ev;
+
+	ev = shm_malloc(sizeof *ev + evi_params_flat_size(params));
+	if (!ev) {
+		LM_ERR("no more shm memory\n");
+		return NULL;
+	}
+
+	ev->refs = 1;
+	ev->id = id;
+	ev->stamp = evi_now_us();
+	evi_params_flatten(params, &ev->params, ev + 1);
+
+	return ev;
+}
+
+void evi_dispatch_event_release(struct evi_dispatch_event *ev)
+{
+	if (__atomic_sub_fetch(&ev->refs, 1, __ATOMIC_ACQ_REL) == 0)
+		shm_free(ev);
+}
+
+static int evi_queue_push(struct evi_queue *q, struct evi_dispatch_event *ev,
+															evi_subs_p subs)
+{
+	struct evi_queue_slot *slot;
+	unsigned long pos, seq;
+	uint64_t one = 1;
+	long dif;
+
+	pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+	for (;;) {
+		slot = &q->slots[pos & q->mask];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		dif = (long)(seq - pos);
+
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&q->head, &pos, pos + 1, 1,
+			__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (dif < 0) {
+			/* not yet taken out by the dispatcher */
+			return -1;
+		} else {
+			pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+		}
+	}
+
+	slot->ev = ev;
+	slot->subs = subs;
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_SEQ_CST);
+
+	if (__atomic_exchange_n(&q->sleeping, 0, __ATOMIC_SEQ_CST) &&
+	write(q->fd, &one, sizeof one) < 0)
+		LM_ERR("failed to wake up the %.*s dispatcher: %s\n",
+			q->trans->proto.len, q->trans->proto.s, strerror(errno));
+
+	return 0;
+}
+
+static int evi_queue_pop(struct evi_queue *q, struct evi_dispatch_event **ev,
+															evi_subs_p *subs)
+{
+	struct evi_queue_slot *slot;
+	unsigned long pos = q->tail;
+
+	slot = &q->slots[pos & q->mask];
+	if (__atomic_load_n(&slot->seq, __ATOMIC_SEQ_CST) != pos + 1)
+		return -1;
+
+	*ev = slot->ev;
+	*subs = slot->subs;
+
+	/* free for the producers of the next round */
+	__atomic_store_n(&slot->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+	q->tail = pos + 1;
+
+	return 0;
+}
+
+int evi_dispatch_push(struct evi_dispatch_event *ev, evi_subs_p subs)
+{
+	struct evi_queue *q = subs->queue;
+
+	__atomic_add_fetch(&ev->refs, 1, __ATOMIC_RELAXED);
+
+	while (evi_queue_push(q, ev, subs) < 0) {
+		if (evi_queue_policy == EVI_QUEUE_DROP) {
+			__atomic_add_fetch(&subs->dropped, 1, __ATOMIC_RELAXED);
+			LM_DBG("%.*s queue full, dropping event\n",
+				q->trans->proto.len, q->trans->proto.s);
+			evi_dispatch_event_release(ev);
+			return -1;
+		}
+
+		sleep_us(EVI_QUEUE_BLOCK_US);
+	}
+
+	return 0;
+}
+
+
+static void evi_dispatch_raise(struct evi_dispatch_event *ev, evi_subs_p subs)
+{
+	evi_async_ctx_t async_status = {NULL, NULL};
+	struct usr_avp *event_avps = 0;
+	struct usr_avp **bak_avps;
+	struct sip_msg *req;
+
+	__atomic_store_n(&subs->lag, (evi_now_us() - ev->stamp) / 1000,
+		__ATOMIC_RELAXED);
+
+	req = get_dummy_sip_msg();
+	if (!req) {
+		LM_ERR("no more memory, dropping event\n");
+		return;
+	}
+	bak_avps = set_avp_list(&event_avps);
+
+	subs->trans_mod->raise(req, &events[ev->id].name, subs->reply_sock,
+		&ev->params, &async_status);
+
+	release_dummy_sip_msg(req);
+	destroy_avp_list(&event_avps);
+	set_avp_list(bak_avps);
+}
+
+static void evi_dispatch_loop(struct evi_queue *q)
+{
+	struct evi_dispatch_event *ev;
+	evi_subs_p subs;
+	uint64_t n;
+
+	for (;;) {
+		if (evi_queue_pop(q, &ev, &subs) < 0) {
+			__atomic_store_n(&q->sleeping, 1, __ATOMIC_SEQ_CST);
+			if (evi_queue_pop(q, &ev, &subs) < 0) {
+				if (read(q->fd, &n, sizeof n) < 0 && errno != EINTR)
+					LM_ERR("failed to read eventfd: %s\n", strerror(errno));
+				continue;
+			}
+			__atomic_store_n(&q->sleeping, 0, __ATOMIC_RELAXED);
+		}
+
+		evi_dispatch_raise(ev, subs);
+
+		/* the subscriber may be gone once no longer counted as queued */
+		__atomic_sub_fetch(&subs->queued, 1, __ATOMIC_RELEASE);
+		evi_dispatch_event_release(ev);
+	}
+}
+
+int evi_dispatch_start(void)
+{
+	struct evi_queue *q;
+	int id;
+
+	for (q = evi_queues; q; q = q->next) {
+		if ((id=internal_fork("EVI dispatcher",
+		OSS_PROC_NO_IPC|OSS_PROC_NO_LOAD, TYPE_NONE))<0) {
+			LM_CRIT("cannot fork the %.*s event dispatcher process\n",
+				q->trans->proto.len, q->trans->proto.s);
+			return -1;
+		} else if (id==0) {
+			/* new process */
+			evi_dispatcher = 1;
+
+			if (init_child(PROC_MODULE) < 0) {
+				LM_ERR("error in init_child for the %.*s event dispatcher\n",
+					q->trans->proto.len, q->trans->proto.s);
+				report_failure_status();
+				exit(-1);
+			}
+			report_conditional_status( (!no_daemon_mode), 0);
+
+			evi_dispatch_loop(q);
+			exit(-1);
+		}
+	}
+
+	return 0;
+}
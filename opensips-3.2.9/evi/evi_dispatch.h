@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2026 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Event dispatcher: with "event_queue_size" set, each transport module that
+ * allows it (EVI_DISPATCH in the flags of its export) gets a shm ring of that
+ * many events and a process of its own, raising the queued events to the
+ * subscribers of the transport. The raising processes only copy the event
+ * parameters (once per event, in a single chunk) and push a reference to
+ * them in the ring of each such subscriber, so a slow subscriber no longer
+ * delays the SIP processing. Any number of processes push in a ring, but
+ * only its dispatcher takes out of it, so the ring needs no lock.
+ */
+
+#ifndef _EVI_DISPATCH_H_
+#define _EVI_DISPATCH_H_
+
+#include "evi.h"
+#include "evi_params.h"
+#include "event_interface.h"
+
+#define EVI_QUEUE_DROP   0  /* drop the events not fitting in the ring */
+#define EVI_QUEUE_BLOCK  1  /* wait for the dispatcher to make room */
+
+struct evi_dispatch_event;
+struct evi_queue;
+
+extern int evi_queue_size;
+extern int evi_queue_policy;
+
+/* is this the dispatcher process of a transport? */
+extern int evi_dispatcher;
+
+int evi_queue_set_policy(char *policy);
+
+/* sets up the queues of the registered transports */
+int evi_dispatch_init(void);
+
+/* returns the queue of the transport, NULL if raised inline */
+struct evi_queue *evi_dispatch_queue(evi_export_t *trans);
+
+int evi_dispatch_count_processes(void);
+
+int evi_dispatch_start(void);
+
+/* a copy of the event, shared by all the subscribers it is queued to */
+struct evi_dispatch_event *evi_dispatch_event_new(event_id_t id,
+	evi_params_p params);
+
+void evi_dispatch_event_release(struct evi_dispatch_event *ev);
+
+/* queues the event to the subscriber; the subscriber is expected to be
+ * pinned by the caller, by counting it as queued */
+int evi_dispatch_push(struct evi_dispatch_event *ev, evi_subs_p subs);
+
+#endif /* _EVI_DISPATCH_H_ */
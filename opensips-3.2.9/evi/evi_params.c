@@ -145,38 +145,47 @@ void evi_free_params(evi_params_p list)
 	pkg_free(list);
 }
 
-evi_params_p evi_dup_shm_params(evi_params_p pkg_params)
+/* returns the size of the flat copy of a parameters list, not including
+ * the evi_params_t head */
+int evi_params_flat_size(evi_params_p params)
 {
-	int parambufs_size, strbufs_size;
-	evi_params_p shm_params;
-	evi_param_p param, prev, sp;
-	char *p;
+	evi_param_p param;
+	int size = 0;
 
-	if(!pkg_params)
-		return NULL;
+	if (!params)
+		return 0;
 
-	parambufs_size = sizeof(evi_params_t);
-	strbufs_size = 0;
-	for (param = pkg_params->first; param; param = param->next) {
-		parambufs_size += sizeof(evi_param_t);
-		strbufs_size += param->name.len;
+	for (param = params->first; param; param = param->next) {
+		size += sizeof(evi_param_t) + param->name.len;
 		if (param->flags & EVI_STR_VAL)
-			strbufs_size += param->val.s.len;
+			size += param->val.s.len;
 	}
 
-	shm_params = shm_malloc(parambufs_size + strbufs_size);
-	if (!shm_params) {
-		return NULL;
-	}
-	shm_params->flags = 0;
+	return size;
+}
+
+/* copies the parameters in the buffer (of evi_params_flat_size() bytes),
+ * linking them to the dst head; the copy needs no other allocation */
+void evi_params_flatten(evi_params_p params, evi_params_p dst, void *buf)
+{
+	evi_param_p param, prev, sp;
+	char *p;
+
+	dst->flags = 0;
+	dst->first = dst->last = NULL;
+	if (!params)
+		return;
+
+	for (param = params->first, sp = buf; param; param = param->next, sp++);
+	p = (char *)sp;
 
-	sp = (evi_param_p)(shm_params + 1);
-	p = (char *)(shm_params) + parambufs_size;
-	for (param = pkg_params->first, prev = NULL; param;
+	sp = (evi_param_p)buf;
+	for (param = params->first, prev = NULL; param;
 			prev = sp++, param = param->next) {
 		sp->flags = param->flags;
 		sp->next = NULL;
 		sp->name.len = param->name.len;
+		sp->name.s = NULL;
 		if (sp->name.len) {
 			sp->name.s = p;
 			p += param->name.len;
@@ -189,12 +198,28 @@ evi_params_p evi_dup_shm_params(evi_params_p pkg_params)
 			memcpy(sp->val.s.s, param->val.s.s, param->val.s.len);
 		} else
 			sp->val.n = param->val.n;
-		if (prev) {
+		if (prev)
 			prev->next = sp;
-			shm_params->last = sp;
-		} else
-			shm_params->first = sp;
+		else
+			dst->first = sp;
+		dst->last = sp;
+	}
+}
+
+evi_params_p evi_dup_shm_params(evi_params_p pkg_params)
+{
+	evi_params_p shm_params;
+
+	if(!pkg_params)
+		return NULL;
+
+	shm_params = shm_malloc(sizeof(evi_params_t) +
+		evi_params_flat_size(pkg_params));
+	if (!shm_params) {
+		return NULL;
 	}
+
+	evi_params_flatten(pkg_params, shm_params, shm_params + 1);
 	return shm_params;
 }
 
@@ -83,6 +83,10 @@ int evi_param_set(evi_param_p element, const void *param, int flags);
 #define evi_param_set_str(p_el, p_str) \
 		evi_param_set(p_el, p_str, EVI_STR_VAL)
 
+/* flat copy of a parameters list, in a single chunk */
+int evi_params_flat_size(evi_params_p params);
+void evi_params_flatten(evi_params_p params, evi_params_p dst, void *buf);
+
 evi_params_p evi_dup_shm_params(evi_params_p);
 void evi_free_shm_params(evi_params_p);
 
@@ -71,7 +71,7 @@ int register_event_mod(evi_export_t *ev)
 
 		/* check to see if there are two modules with the same id (or protocol) */
 		for (trans_mod = evi_trans_mods; trans_mod; trans_mod = trans_mod->next){
-			if (trans_mod->module->flags & ev->flags) {
+			if (trans_mod->module->flags & ev->flags & ~EVI_DISPATCH) {
 				LM_ERR("duplicate flag %x\n", ev->flags);
 				goto error;
 			}
@@ -101,6 +101,12 @@ error:
 	return EVI_ERROR;
 }
 
+/* returns the list of the registered transports */
+evi_trans_t *get_trans_mods(void)
+{
+	return evi_trans_mods;
+}
+
 /* checks if there are any modules loaded */
 int get_trans_mod_no(void)
 {
@@ -42,6 +42,7 @@
 #define		EVI_EXPIRE		(1 << 8) // indicates that the socket may expire
 #define		EVI_PENDING		(1 << 9) // indicates that the socket is in use
 #define		EVI_ASYNC_STATUS	(1<<10)
+#define		EVI_DISPATCH		(1<<11) // raised from the event dispatcher
 
 /* sockets */
 typedef union {
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2026 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * Scheduling of the SIP probes (OPTIONS pings) sent to the destinations
+ * of the routing modules (dispatcher, drouting).
+ *
+ * Instead of probing all the destinations at each interval, the prober
+ * runs every second and only sends the probes that are due. The first
+ * probe of a destination is placed at a random offset within the interval,
+ * and each following one gets a +/-10% jitter, so the probes are spread
+ * over the whole interval. The number of probes waiting for a reply may
+ * be capped, the probes over the cap being postponed to the next tick.
+ *
+ * With adaptive intervals, a failing destination is probed twice as often,
+ * while one answering PROBE_STABLE_STREAK probes in a row is probed half
+ * as often.
+ */
+
+#ifndef __LIB_PROBING_H__
+#define __LIB_PROBING_H__
+
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "../statistics.h"
+#include "../ut.h"
+
+#define PROBE_STABLE_STREAK  8
+
+struct probe_state {
+	unsigned int next;     /* tick of the next probe, 0 if not scheduled */
+	unsigned int rtt;      /* smoothed probe RTT, in usec */
+	unsigned short streak; /* consecutive probes with the same outcome */
+	unsigned short failed; /* outcome of the last probe */
+};
+
+/* set in the callback param of a probe */
+struct probe_ctx {
+	struct timeval sent;
+};
+
+
+/*! \brief
+ * Tells if the probe of a destination is due at tick @now. The first call
+ * for a destination only schedules its first probe somewhere within the
+ * next @interval seconds.
+ */
+static inline int probe_is_due(struct probe_state *ps, unsigned int now,
+		unsigned int interval)
+{
+	if (ps->next == 0) {
+		ps->next = now + 1 + rand() % interval;
+		return 0;
+	}
+
+	return (int)(now - ps->next) >= 0;
+}
+
+/*! \brief
+ * Schedules the next probe of a destination, just sent at tick @now
+ */
+static inline void probe_reschedule(struct probe_state *ps, unsigned int now,
+		unsigned int interval, int adaptive)
+{
+	unsigned int ival = interval, jitter;
+
+	if (adaptive) {
+		if (ps->failed)
+			ival = interval / 2;
+		else if (ps->streak >= PROBE_STABLE_STREAK)
+			ival = interval * 2;
+	}
+
+	jitter = ival / 10;
+	if (jitter)
+		ival = ival - jitter + rand() % (2 * jitter + 1);
+
+	ps->next = now + (ival ? ival : 1);
+}
+
+/*! \brief
+ * Checks the cap on the probes waiting for a reply
+ */
+static inline int probe_can_send(stat_var *in_flight, int max_in_flight)
+{
+	return max_in_flight <= 0 || get_stat_val(in_flight) < max_in_flight;
+}
+
+static inline void probe_sent(stat_var *in_flight, struct probe_ctx *ctx)
+{
+	update_stat(in_flight, 1);
+	gettimeofday(&ctx->sent, NULL);
+}
+
+/*! \brief
+ * Accounts the outcome of a probe (or the failure to send it) and returns
+ * the RTT of the probe, in usec
+ */
+static inline unsigned int probe_done(stat_var *in_flight,
+		struct probe_ctx *ctx)
+{
+	update_stat(in_flight, -1);
+	return get_time_diff(&ctx->sent);
+}
+
+/*! \brief
+ * Updates the probing state of a destination with the outcome of a probe
+ */
+static inline void probe_update(struct probe_state *ps, int ok,
+		unsigned int rtt)
+{
+	if ((!ok) != ps->failed) {
+		ps->failed = !ok;
+		ps->streak = 1;
+	} else if (ps->streak < PROBE_STABLE_STREAK) {
+		ps->streak++;
+	}
+
+	/* RFC 6298 style smoothing */
+	if (ok)
+		ps->rtt = ps->rtt ? (7 * ps->rtt + rtt) / 8 : rtt;
+}
+
+#endif /* __LIB_PROBING_H__ */
@@ -28,9 +28,26 @@
 ucontact_t **selected_cts; /* always has an extra terminating NULL ptr */
 int selected_cts_sz = 20;
 
+int reg_lookup_cache;
+
+/* the still valid contacts of a record, in usrloc order, along with their
+ * pre-parsed next hop.  Kept in urecord->lookup_cache, as a single shm chunk
+ * which usrloc drops whenever the contact list changes */
+struct branch_set {
+	time_t valid_until; /* the first expiry among the contacts, 0 = never */
+	int n;
+	struct cached_branch {
+		ucontact_t *ct;
+		str dst_uri;    /* first Path hop or the received URI, if any */
+	} b[0];
+};
+
 static ucontact_t **select_contacts(struct sip_msg *msg, ucontact_t *contacts,
-                        int flags, const str *sip_instance, const str *call_id,
+                        struct branch_set *bs, int flags,
+                        const str *sip_instance, const str *call_id,
                         const regex_t *ua_re, int max_latency, int *ret);
+static int __push_branch(struct sip_msg *msg, ucontact_t *ct,
+                         const str *dst_uri, int *ruri_is_pushed);
 
 
 int reg_init_lookup(void)
@@ -46,6 +63,73 @@ int reg_init_lookup(void)
 }
 
 
+static struct branch_set *get_branch_set(urecord_t *r)
+{
+	struct branch_set *bs = r->lookup_cache;
+	ucontact_t *ct;
+	str *dst;
+	int n;
+
+	if (bs && (!bs->valid_until || bs->valid_until > get_act_time()))
+		return bs;
+
+	drop_lookup_cache(r);
+
+	for (n = 0, ct = r->contacts; ct; ct = ct->next)
+		if (VALID_CONTACT(ct, get_act_time()))
+			n++;
+
+	bs = shm_malloc(sizeof *bs + n * sizeof *bs->b);
+	if (!bs) {
+		LM_ERR("oom\n");
+		return NULL;
+	}
+
+	bs->valid_until = 0;
+	bs->n = 0;
+
+	for (ct = r->contacts; ct; ct = ct->next) {
+		if (!VALID_CONTACT(ct, get_act_time()))
+			continue;
+
+		dst = &bs->b[bs->n].dst_uri;
+		if (!ZSTR(ct->path)) {
+			if (get_path_dst_uri(&ct->path, dst) < 0) {
+				LM_ERR("failed to get dst_uri for Path\n");
+				shm_free(bs);
+				return NULL;
+			}
+		} else {
+			*dst = ct->received;
+		}
+
+		bs->b[bs->n++].ct = ct;
+
+		if (ct->expires && (!bs->valid_until || ct->expires < bs->valid_until))
+			bs->valid_until = ct->expires;
+	}
+
+	r->lookup_cache = bs;
+	return bs;
+}
+
+
+static inline const str *cached_dst_uri(struct branch_set *bs, ucontact_t *ct)
+{
+	int i;
+
+	if (!bs)
+		return NULL;
+
+	/* a handful of contacts per AoR, at most */
+	for (i = 0; i < bs->n; i++)
+		if (bs->b[i].ct == ct)
+			return &bs->b[i].dst_uri;
+
+	return NULL;
+}
+
+
 lookup_rc lookup(struct sip_msg *req, udomain_t *d, const str *sflags, str *aor_uri,
                  int use_domain, int (*aor_update) (str *aor))
 {
@@ -58,6 +142,7 @@ lookup_rc lookup(struct sip_msg *req, udomain_t *d, const str *sflags, str *aor_
 	urecord_t* r;
 	str aor;
 	ucontact_t *ct, **ptr, **pn_cts, **cts;
+	struct branch_set *bs;
 	int max_latency = 0, ruri_is_pushed = 0, regexp_flags = 0;
 	unsigned int flags;
 	int rc, ret = LOOKUP_NO_RESULTS, have_pn_cts = 0, single_branch = 0;
@@ -130,15 +215,22 @@ fetch_urecord:
 
 	print_urecord(r);
 
-	cts = select_contacts(req, r->contacts, flags, &sip_instance, &call_id,
-	                      &ua_re, max_latency, &ret);
+	bs = NULL;
+	if (reg_lookup_cache && ul.have_mem_storage() &&
+	        !(ul.cluster_mode == CM_FEDERATION_CACHEDB
+	          && (flags & REG_LOOKUP_GLOBAL_FLAG)))
+		bs = get_branch_set(r);
+
+	cts = select_contacts(req, r->contacts, bs, flags, &sip_instance,
+	                      &call_id, &ua_re, max_latency, &ret);
 
 	/* do not attempt to push anything to RURI if the flags say so */
 	if (flags & REG_LOOKUP_NO_RURI_FLAG)
 		ruri_is_pushed = 1;
 
 	for (ptr = pn_cts = cts; *ptr; ptr++) {
-		rc = push_branch(req, *ptr, &ruri_is_pushed);
+		rc = __push_branch(req, *ptr, cached_dst_uri(bs, *ptr),
+		                   &ruri_is_pushed);
 		if (rc == -2) {
 			ret = LOOKUP_ERROR;
 			goto done;
@@ -224,16 +316,19 @@ static int cmp_ucontact(const void *_ct1, const void *_ct2)
 
 
 static ucontact_t **select_contacts(struct sip_msg *msg, ucontact_t *contacts,
-                        int flags, const str *sip_instance, const str *call_id,
+                        struct branch_set *bs, int flags,
+                        const str *sip_instance, const str *call_id,
                         const regex_t *ua_re, int max_latency, int *ret)
 {
-	int count = 0, have_gruu = 0;
+	int i = 0, count = 0, have_gruu = 0;
 	ucontact_t *it, *ct, **doubled;
 	regmatch_t ua_match;
 
-	for (ct = contacts; ct; ct = ct->next) {
+	/* if cached, only walk the contacts which are known to be valid */
+	for (ct = bs ? (bs->n ? bs->b[0].ct : NULL) : contacts; ct;
+	        ct = bs ? (++i < bs->n ? bs->b[i].ct : NULL) : ct->next) {
 		LM_DBG("ct: %.*s\n", ct->c.len, ct->c.s);
-		if (!VALID_CONTACT(ct, get_act_time())) {
+		if (!bs && !VALID_CONTACT(ct, get_act_time())) {
 			LM_DBG("skipping expired contact %.*s\n", ct->c.len, ct->c.s);
 			continue;
 		}
@@ -413,6 +508,14 @@ int parse_lookup_flags(const str *input, unsigned int *flags, regex_t *ua_re,
 
 
 int push_branch(struct sip_msg *msg, ucontact_t *ct, int *ruri_is_pushed)
+{
+	return __push_branch(msg, ct, NULL, ruri_is_pushed);
+}
+
+
+/* @dst_uri: the cached first Path hop / received URI (optional) */
+static int __push_branch(struct sip_msg *msg, ucontact_t *ct,
+                         const str *dst_uri, int *ruri_is_pushed)
 {
 	str path_dst;
 	int_str istr;
@@ -450,7 +553,9 @@ int push_branch(struct sip_msg *msg, ucontact_t *ct, int *ruri_is_pushed)
 	 * received-uri because in that case the last hop towards the uac
 	 * has to handle NAT. - agranig */
 	if (ct->path.s && ct->path.len) {
-		if (get_path_dst_uri(&ct->path, &path_dst) < 0) {
+		if (dst_uri) {
+			path_dst = *dst_uri;
+		} else if (get_path_dst_uri(&ct->path, &path_dst) < 0) {
 			LM_ERR("failed to get dst_uri for Path\n");
 			return -2;
 		}
@@ -492,7 +597,10 @@ append_branch:
 
 	} else {
 		path_dst.len = 0;
-		if (!ZSTR(ct->path) && get_path_dst_uri(&ct->path, &path_dst) < 0) {
+		if (dst_uri) {
+			path_dst = *dst_uri;
+		} else if (!ZSTR(ct->path) &&
+		        get_path_dst_uri(&ct->path, &path_dst) < 0) {
 			LM_ERR("failed to get dst_uri for Path\n");
 			return -1;
 		}
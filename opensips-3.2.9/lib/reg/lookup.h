@@ -46,6 +46,9 @@ typedef enum _lookup_rc {
 } lookup_rc;
 
 
+/* keep a per-AoR set of precomputed branches across lookups */
+extern int reg_lookup_cache;
+
 /**
  * Initialize the lookup support
  */
@@ -142,6 +142,7 @@
 #include "version.h"
 #include "mi/mi_core.h"
 #include "db/db_insertq.h"
+#include "evi/evi_dispatch.h"
 #include "cachedb/cachedb.h"
 #include "net/trans.h"
 
@@ -208,6 +209,16 @@ static int main_loop(void)
 		goto error;
 	}
 
+	if (ql_start_writer()!=0) {
+		LM_ERR("failed to fork the DB writer process\n");
+		goto error;
+	}
+
+	if (evi_dispatch_start()!=0) {
+		LM_ERR("failed to fork the event dispatcher processes\n");
+		goto error;
+	}
+
 	if(sroutes->startup.a) {/* if a startup route was defined */
 		startup_done = (int*)shm_malloc(sizeof(int));
 		if(startup_done == NULL) {
@@ -857,6 +868,12 @@ try_again:
 		goto error;
 	}
 
+	/* queues for the transports registered by the modules */
+	if (evi_dispatch_init() != 0) {
+		LM_ERR("failed to init the event dispatcher\n");
+		goto error;
+	}
+
 	/* init xlog */
 	if (init_xlog() < 0) {
 		LM_ERR("error while initializing xlog!\n");
@@ -511,6 +511,49 @@ void acc_db_close(void)
 }
 
 
+/* the insert queues of the tables only known at runtime, per process, each
+ * with its own prepared statement, as the queued rows are only bound to
+ * the statement when the queue is flushed */
+struct acc_table_ql {
+	str table;
+	int cols;
+	query_list_t *ins_list;
+	db_ps_t ps;
+	struct acc_table_ql *next;
+};
+
+static struct acc_table_ql *acc_table_qls;
+
+static struct acc_table_ql *acc_table_ql(str *table, int cols)
+{
+	struct acc_table_ql *it;
+
+	if (query_buffer_size <= 1)
+		return NULL;
+
+	for (it = acc_table_qls; it; it = it->next)
+		if (it->cols == cols && str_match(&it->table, table))
+			return it;
+
+	it = pkg_malloc(sizeof *it + table->len);
+	if (!it) {
+		LM_ERR("no more pkg mem\n");
+		return NULL;
+	}
+
+	it->table.s = (char *)(it + 1);
+	it->table.len = table->len;
+	memcpy(it->table.s, table->s, table->len);
+	it->cols = cols;
+	it->ins_list = NULL;
+	it->ps = NULL;
+
+	it->next = acc_table_qls;
+	acc_table_qls = it;
+
+	return it;
+}
+
 int acc_db_request( struct sip_msg *rq, struct sip_msg *rpl,
 		query_list_t **ins_list, int missed)
 {
@@ -526,6 +569,7 @@ int acc_db_request( struct sip_msg *rq, struct sip_msg *rpl,
 	static db_ps_t my_ps = NULL;
 	static db_ps_t my_ps2 = NULL;
 	static db_ps_t my_ps3 = NULL;
+	struct acc_table_ql *tql = NULL;
 	db_ps_t *ps;
 	int m;
 	int n = 0;
@@ -574,7 +618,11 @@ int acc_db_request( struct sip_msg *rq, struct sip_msg *rpl,
 	}
 
 	acc_dbf.use_table(db_handle, &acc_env.text/*table*/);
-	if (ctx) {
+	/* custom table - the insert queue is looked up by name */
+	if (!ins_list && (tql = acc_table_ql(&acc_env.text, ctx ? n : m))) {
+		ins_list = &tql->ins_list;
+		ps = &tql->ps;
+	} else if (ctx) {
 		if (missed) {
 			if (ins_list)
 				ps = &my_ps_ins; /* normal acc to known missed table */
@@ -654,7 +702,9 @@ int acc_db_cdrs(struct dlg_cell *dlg, struct sip_msg *msg, acc_ctx_t* ctx)
 	struct timeval start_time;
 	str core_s, leg_s, extra_s, table;
 	static db_ps_t my_ps = NULL;
-	static query_list_t *ins_list = NULL;
+	struct acc_table_ql *tql;
+	query_list_t **ins_list = NULL;
+	db_ps_t *ps = &my_ps;
 
 	struct acc_extra* extra;
 
@@ -693,6 +743,12 @@ int acc_db_cdrs(struct dlg_cell *dlg, struct sip_msg *msg, acc_ctx_t* ctx)
 
 	total = ret + 5;
 	acc_dbf.use_table(db_handle, &table);
+	tql = acc_table_ql(&table,
+		ctx->leg_values ? total + nr_leg_vals : total);
+	if (tql) {
+		ins_list = &tql->ins_list;
+		ps = &tql->ps;
+	}
 
 	/* prevent acces for setting variable */
 	accX_lock(&ctx->lock);
@@ -701,10 +757,10 @@ int acc_db_cdrs(struct dlg_cell *dlg, struct sip_msg *msg, acc_ctx_t* ctx)
 		VAL_STR(db_vals+i) = ctx->extra_values[extra->tag_idx].value;
 
 	if (!ctx->leg_values) {
-		if (con_set_inslist(&acc_dbf, db_handle, &ins_list, db_keys, total) < 0) {
+		if (con_set_inslist(&acc_dbf, db_handle, ins_list, db_keys, total) < 0) {
 			CON_RESET_INSLIST(db_handle);
 		}
-		CON_SET_CURR_PS(db_handle, &my_ps);
+		CON_SET_CURR_PS(db_handle, ps);
 		if (acc_dbf.insert(db_handle, db_keys, db_vals, total) < 0) {
 			LM_ERR("failed to insert into database\n");
 			accX_unlock(&ctx->lock);
@@ -719,10 +775,10 @@ int acc_db_cdrs(struct dlg_cell *dlg, struct sip_msg *msg, acc_ctx_t* ctx)
 				VAL_STR(db_vals+ret+j+1) = LEG_VALUE( i, extra, ctx);
 			}
 
-			if (con_set_inslist(&acc_dbf, db_handle, &ins_list, db_keys, total) < 0) {
+			if (con_set_inslist(&acc_dbf, db_handle, ins_list, db_keys, total) < 0) {
 				CON_RESET_INSLIST(db_handle);
 			}
-			CON_SET_CURR_PS(db_handle, &my_ps);
+			CON_SET_CURR_PS(db_handle, ps);
 			if (acc_dbf.insert(db_handle,db_keys,db_vals,total) < 0) {
 				LM_ERR("failed inserting into database\n");
 				accX_unlock(&ctx->lock);
@@ -44,7 +44,6 @@
 #include "cachedb_local_replication.h"
 #include "hash.h"
 
-#include <fnmatch.h>
 
 
 str cache_mod_name = str_init("local");
@@ -52,8 +51,9 @@ static int mod_init(void);
 static int child_init(int rank);
 static void destroy(void);
 
-int cache_clean_period = 600;
+int cache_clean_period = 1;
 int local_exec_threshold = 0;
+int cache_prefix_index = 0;
 
 lcache_col_t* lcache_collection = NULL;
 url_lst_t* url_list=NULL;
@@ -75,6 +75,7 @@ static int store_urls(unsigned int type, void *val);
 static param_export_t params[]={
 	{ "cache_clean_period", INT_PARAM, &cache_clean_period },
 	{ "exec_threshold",     INT_PARAM, &local_exec_threshold },
+	{ "prefix_index",       INT_PARAM, &cache_prefix_index },
 	{ "cache_collections",  STR_PARAM|USE_FUNC_PARAM, (void *)parse_collections },
 	{ "cachedb_url",        STR_PARAM|USE_FUNC_PARAM, (void *)store_urls },
 	{ "cluster_id",INT_PARAM, &cluster_id },
@@ -133,20 +134,15 @@ struct module_exports exports= {
 	0                           /* reload confirm function */
 };
 
-static char *key_buff = NULL;
-static int key_buff_size = 0;
 static char *pat_buff = NULL;
 static int pat_buff_size = 0;
 
 
 static int remove_chunk_f(struct sip_msg* msg, str* col_s, str* pat)
 {
-	int i;
-	lcache_entry_t* me1, *me2;
 	struct timeval start;
-
 	lcache_col_t* col;
-	lcache_t* cache_htable;
+	int rc;
 
 	if ( !col_s ) {
 		/* use default collection; default collection is always first in list */
@@ -163,8 +159,6 @@ static int remove_chunk_f(struct sip_msg* msg, str* col_s, str* pat)
 		}
 	}
 
-	cache_htable = col->col_htable;
-
 	if (pat->len+1 > pat_buff_size) {
 		pat_buff = pkg_realloc(pat_buff,pat->len+1);
 		if (pat_buff == NULL) {
@@ -182,55 +176,12 @@ static int remove_chunk_f(struct sip_msg* msg, str* col_s, str* pat)
 	LM_DBG("trying to remove chunk with pattern [%s]\n",pat_buff);
 	start_expire_timer(start,local_exec_threshold);
 
-	for(i = 0; i< col->size; i++) {
-		lock_get(&cache_htable[i].lock);
-		me1 = cache_htable[i].entries;
-		me2 = NULL;
-
-		while(me1) {
-			if (me1->attr.len + 1 > key_buff_size) {
-				key_buff = pkg_realloc(key_buff,me1->attr.len+1);
-				if (key_buff == NULL) {
-					LM_ERR("No more pkg mem\n");
-					key_buff_size = 0;
-					lock_release(&cache_htable[i].lock);
-					_stop_expire_timer(start,local_exec_threshold,
-						"cachedb_local remove_chunk",pat->s,pat->len,0,
-						cdb_slow_queries, cdb_total_queries);
-					return -1;
-				}
-
-				key_buff_size = me1->attr.len + 1;
-			}
-
-			memcpy(key_buff,me1->attr.s,me1->attr.len);
-			key_buff[me1->attr.len] = 0;
-
-			if(fnmatch(pat_buff,key_buff,0) == 0) {
-				LM_DBG("[%.*s] matches glob [%.*s] - removing from bucket %d\n",
-						me1->attr.len, me1->attr.s,pat_buff_size,pat_buff,i);
-
-				if(me2) {
-					me2->next = me1->next;
-					shm_free(me1);
-					me1 = me2->next;
-				} else{
-					cache_htable[i].entries = me1->next;
-					shm_free(me1);
-					me1 = cache_htable[i].entries;
-				}
-			} else {
-				me2 = me1;
-				me1 = me1->next;
-			}
-		}
-		lock_release(&cache_htable[i].lock);
-	}
+	rc = lcache_htable_remove_chunk(col, pat_buff);
 
 	_stop_expire_timer(start,local_exec_threshold,
 		"cachedb_local remove_chunk",pat->s,pat->len,0,
 		cdb_slow_queries, cdb_total_queries);
-	return 1;
+	return rc;
 }
 
 mi_response_t *mi_cache_remove_chunk(const mi_params_t *params, str *collection)
@@ -338,6 +289,7 @@ static int mod_init(void)
 
 	url_lst_t *it=url_list, *foo=NULL;
 	lcache_col_t *default_col, *col_it;
+	char *stat_name;
 
 	memset(&cde, 0, sizeof cde);
 
@@ -383,10 +335,12 @@ static int mod_init(void)
 			return -1;
 		}
 
+		memset(default_col, 0, sizeof(lcache_col_t));
+
 		default_col->col_name.s = DEFAULT_COLLECTION_NAME;
 		default_col->col_name.len = sizeof(DEFAULT_COLLECTION_NAME) - 1;
 		default_col->size = (1 << HASH_SIZE_DEFAULT);
-		if (lcache_htable_init(&default_col->col_htable, default_col->size) < 0) {
+		if (lcache_htable_init(default_col) < 0) {
 			LM_ERR("failed to initialize for <%s> collection!\n",
 						DEFAULT_COLLECTION_NAME);
 			return -1;
@@ -441,6 +395,20 @@ static int mod_init(void)
 		}
 	}
 
+	/* per collection gauges: "<collection>-entries", "<collection>-memory" */
+	for ( col_it=lcache_collection; col_it; col_it=col_it->next ) {
+		if ( (stat_name=build_stat_name(&col_it->col_name, "entries"))==0 ||
+		register_stat("cachedb_local", stat_name, &col_it->st_entries,
+		STAT_SHM_NAME|STAT_NO_RESET)!=0 ||
+		(stat_name=build_stat_name(&col_it->col_name, "memory"))==0 ||
+		register_stat("cachedb_local", stat_name, &col_it->st_memory,
+		STAT_SHM_NAME|STAT_NO_RESET)!=0 ) {
+			LM_ERR("failed to add the statistics of collection <%.*s>\n",
+					col_it->col_name.len, col_it->col_name.s);
+			return -1;
+		}
+	}
+
 	/* register timer to delete the expired entries */
 	register_timer("localcache-expire",localcache_clean, 0,
 		cache_clean_period, TIMER_FLAG_DELAY_ON_DELAY);
@@ -495,57 +463,17 @@ static void destroy(void)
 	lcache_col_t* it;
 
 	for ( it=lcache_collection; it; it=it->next) {
-		lcache_htable_destroy(&it->col_htable, it->size);
+		lcache_htable_destroy(it);
 	}
 }
 
 void localcache_clean(unsigned int ticks,void *param)
 {
-	int i;
-	lcache_entry_t* me1, *me2;
 	lcache_col_t* it;
-	lcache_t* cache_htable;
-
-	for ( it=lcache_collection; it; it=it->next ) {
-		LM_DBG("start\n");
-		cache_htable = it->col_htable;
-
-		for(i = 0; i< it->size; i++)
-		{
-			lock_get(&cache_htable[i].lock);
-			me1 = cache_htable[i].entries;
-			me2 = NULL;
-
-			while(me1)
-			{
-				if((me1->expires > 0) && (me1->expires < get_ticks()))
-				{
-					LM_DBG("deleted entry attr= [%.*s]\n",
-							me1->attr.len, me1->attr.s);
-
-					if(me2)
-					{
-						me2->next = me1->next;
-						shm_free(me1);
-						me1 = me2->next;
-					}
-					else
-					{
-						cache_htable[i].entries = me1->next;
-						shm_free(me1);
-						me1 = cache_htable[i].entries;
-					}
-				}
-				else
-				{
-					me2 = me1;
-					me1 = me1->next;
-				}
-			}
+	unsigned int now = get_ticks();
 
-			lock_release(&cache_htable[i].lock);
-		}
-	}
+	for ( it=lcache_collection; it; it=it->next )
+		lcache_htable_clean(it, now);
 }
 
 static int parse_collections(unsigned int type, void* val)
@@ -611,7 +539,7 @@ static int parse_collections(unsigned int type, void* val)
 		}
 
 		new_col->size = (1 << coll_size);
-		if (lcache_htable_init(&new_col->col_htable, new_col->size) < 0) {
+		if (lcache_htable_init(new_col) < 0) {
 			LM_ERR("failed to initialize htable for collection <%.*s>!\n",
 					coll.len, coll.s);
 			return -1;
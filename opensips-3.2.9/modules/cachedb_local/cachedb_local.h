@@ -29,6 +29,7 @@
 
 #include "../../cachedb/cachedb.h"
 #include "../../cachedb/cachedb_cap.h"
+#include "../../statistics.h"
 #include "hash.h"
 
 #define HASH_SIZE_DEFAULT 9 /* power of two */
@@ -36,6 +37,7 @@
 
 extern int cache_htable_size;
 extern int local_exec_threshold;
+extern int cache_prefix_index;
 
 typedef struct {
 	struct cachedb_id *id;
@@ -52,6 +54,14 @@ typedef struct lcache_col {
 	lcache_t* col_htable;
 	int size;
 
+	lcache_stripe_t* stripes;
+	int stripes_no;
+	/* all the entries expired up to this second are gone */
+	unsigned int last_clean;
+
+	stat_var *st_entries;
+	stat_var *st_memory;
+
 	/* we need to know somehow if this collection is used or not;
 	 * if not used we'll need to throw an error */
 	int is_used;
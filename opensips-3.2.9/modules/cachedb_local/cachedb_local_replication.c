@@ -173,7 +173,7 @@ int receive_sync_request(int node_id)
                 LM_DBG("Found collection %.*s\n", col->col_name.len, col->col_name.s);
 
                 for (i =0; i < col->size; i++) {
-                        lock_get(&col->col_htable[i].lock);
+                        lock_get(&lcache_stripe(col, i)->lock);
                         data = col->col_htable[i].entries;
                         while(data) {
                                 if (data->expires == 0 || data->expires > get_ticks()) {
@@ -181,7 +181,7 @@ int receive_sync_request(int node_id)
                                                                         cluster_id, node_id, BIN_VERSION);
                                         if (!sync_packet) {
                                                 LM_ERR("Can not create sync packet!\n");
-												lock_release(&col->col_htable[i].lock);
+												lock_release(&lcache_stripe(col, i)->lock);
                                                 return -1;
                                         }
                                         bin_push_str(sync_packet, &col->col_name);
@@ -191,7 +191,7 @@ int receive_sync_request(int node_id)
                                 }
                                 data = data->next;
                         }
-                        lock_release(&col->col_htable[i].lock);
+                        lock_release(&lcache_stripe(col, i)->lock);
                 }
         }
 
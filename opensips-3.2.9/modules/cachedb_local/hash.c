@@ -26,6 +26,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <fnmatch.h>
 
 #include "../../dprint.h"
 #include "../../ut.h"
@@ -36,61 +37,73 @@
 #include "cachedb_local_replication.h"
 #include "hash.h"
 
-void lcache_htable_remove_safe(str attr, lcache_entry_t** it);
+void lcache_htable_remove_safe(lcache_col_t *col, str attr,
+		lcache_entry_t** it);
 
-int lcache_htable_init(lcache_t** cache_htable_p, int size)
+int lcache_htable_init(lcache_col_t *col)
 {
 	int i = 0, j;
-	lcache_t* cache_htable;
 
-	if (cache_htable_p == NULL) {
-		LM_ERR("<null> htable pointer!\n");
+	if (col == NULL) {
+		LM_ERR("<null> collection!\n");
 		return -1;
 	}
 
-	cache_htable = (lcache_t*)shm_malloc(size * sizeof(lcache_t));
-	if(cache_htable == NULL)
+	col->col_htable = (lcache_t*)shm_malloc(col->size * sizeof(lcache_t));
+	if(col->col_htable == NULL)
 	{
 		LM_ERR("no more shared memory\n");
 		return -1;
 	}
-	memset(cache_htable, 0, size * sizeof(lcache_t));
+	memset(col->col_htable, 0, col->size * sizeof(lcache_t));
+
+	col->stripes_no = col->size < LCACHE_STRIPES ? col->size : LCACHE_STRIPES;
+	col->stripes = (lcache_stripe_t*)shm_malloc(
+		col->stripes_no * sizeof(lcache_stripe_t));
+	if(col->stripes == NULL)
+	{
+		LM_ERR("no more shared memory\n");
+		goto error;
+	}
+	memset(col->stripes, 0, col->stripes_no * sizeof(lcache_stripe_t));
 
-	for(i= 0; i< size; i++)
+	for(i= 0; i< col->stripes_no; i++)
 	{
-		if(lock_init(&cache_htable[i].lock)== 0)
+		if(lock_init(&col->stripes[i].lock)== 0)
 		{
 			LM_ERR("failed to initialize lock [%d]\n", i);
 			goto error;
 		}
 	}
 
-	*cache_htable_p = cache_htable;
-
 	return 0;
 
 error:
-	for(j = 0; j< i; j++)
-	{
-		lock_destroy(&cache_htable[j].lock);
+	if (col->stripes) {
+		for(j = 0; j< i; j++)
+			lock_destroy(&col->stripes[j].lock);
+		shm_free(col->stripes);
+		col->stripes = NULL;
 	}
-	shm_free(cache_htable);
-	cache_htable = NULL;
+	shm_free(col->col_htable);
+	col->col_htable = NULL;
 	return -1;
 }
 
-void lcache_htable_destroy(lcache_t** cache_htable_p, int size)
+void lcache_htable_destroy(lcache_col_t *col)
 {
 	int i;
 	lcache_entry_t* me1, *me2;
-	lcache_t* cache_htable = *cache_htable_p;
+	lcache_t* cache_htable = col->col_htable;
 
 	if(cache_htable == NULL)
 		return;
 
-	for(i = 0; i< size; i++)
+	for(i = 0; i< col->stripes_no; i++)
+		lock_destroy(&col->stripes[i].lock);
+
+	for(i = 0; i< col->size; i++)
 	{
-		lock_destroy(&cache_htable[i].lock);
 		me1 = cache_htable[i].entries;
 		while(me1)
 		{
@@ -99,8 +112,150 @@ void lcache_htable_destroy(lcache_t** cache_htable_p, int size)
 			me1 = me2;
 		}
 	}
+	shm_free(col->stripes);
+	col->stripes = NULL;
 	shm_free(cache_htable);
-	*cache_htable_p = NULL;
+	col->col_htable = NULL;
+}
+
+static inline int lcache_entry_size(lcache_entry_t *e)
+{
+	return sizeof(lcache_entry_t) + e->levels * sizeof(lcache_entry_t *) +
+		e->attr.len + e->value.len;
+}
+
+/* @expires: absolute time, 0 if the entry never expires */
+static lcache_entry_t *lcache_new_entry(lcache_col_t *col, str *attr,
+		str *value, unsigned int expires)
+{
+	lcache_entry_t *me;
+	int levels = 0, size;
+
+	if (cache_prefix_index)
+		for (levels = 1; levels < LCACHE_SKIP_LEVELS && (rand() & 3) == 0;
+			levels++);
+
+	size = sizeof(lcache_entry_t) + levels * sizeof(lcache_entry_t *) +
+		attr->len + value->len;
+
+	me = (lcache_entry_t*)shm_malloc(size);
+	if(me == NULL)
+	{
+		LM_ERR("no more shared memory\n");
+		return NULL;
+	}
+	memset(me, 0, size);
+
+	me->levels = levels;
+	me->attr.s = (char *)(lcache_skip(me) + levels);
+	memcpy(me->attr.s, attr->s, attr->len);
+	me->attr.len = attr->len;
+
+	me->value.s = me->attr.s + attr->len;
+	memcpy(me->value.s, value->s, value->len);
+	me->value.len = value->len;
+
+	me->expires = expires;
+	me->hash_code = core_hash(attr, NULL, col->size);
+
+	return me;
+}
+
+static inline int lcache_key_cmp(str *a, str *b)
+{
+	int rc;
+
+	rc = memcmp(a->s, b->s, a->len < b->len ? a->len : b->len);
+	return rc ? rc : a->len - b->len;
+}
+
+/* fills in, for each level, the link to the first entry >= key */
+static void lcache_index_find(lcache_stripe_t *st, str *key,
+		lcache_entry_t ***prev)
+{
+	lcache_entry_t *x = NULL, **p;
+	int l;
+
+	for (l = LCACHE_SKIP_LEVELS - 1; l >= 0; l--) {
+		p = x ? &lcache_skip(x)[l] : &st->index[l];
+		while (*p && lcache_key_cmp(&(*p)->attr, key) < 0) {
+			x = *p;
+			p = &lcache_skip(x)[l];
+		}
+		prev[l] = p;
+	}
+}
+
+/* links a new entry at the head of its bucket, the stripe must be locked */
+static void lcache_link(lcache_col_t *col, lcache_stripe_t *st,
+		lcache_entry_t *me)
+{
+	lcache_entry_t **prev[LCACHE_SKIP_LEVELS], **slot;
+	int l;
+
+	me->next = col->col_htable[me->hash_code].entries;
+	col->col_htable[me->hash_code].entries = me;
+
+	if (me->expires) {
+		slot = &st->wheel[me->expires % LCACHE_WHEEL_SIZE];
+		me->wheel_next = *slot;
+		if (*slot)
+			(*slot)->wheel_prev = &me->wheel_next;
+		me->wheel_prev = slot;
+		*slot = me;
+	}
+
+	if (me->levels) {
+		lcache_index_find(st, &me->attr, prev);
+		for (l = 0; l < me->levels; l++) {
+			lcache_skip(me)[l] = *prev[l];
+			*prev[l] = me;
+		}
+	}
+
+	update_stat(col->st_entries, 1);
+	update_stat(col->st_memory, lcache_entry_size(me));
+}
+
+/* unlinks and frees the entry pointed by @p within its bucket,
+ * the stripe must be locked */
+static void lcache_drop(lcache_col_t *col, lcache_stripe_t *st,
+		lcache_entry_t **p)
+{
+	lcache_entry_t *me = *p, **prev[LCACHE_SKIP_LEVELS];
+	int l;
+
+	*p = me->next;
+
+	if (me->wheel_prev) {
+		*me->wheel_prev = me->wheel_next;
+		if (me->wheel_next)
+			me->wheel_next->wheel_prev = me->wheel_prev;
+	}
+
+	if (me->levels) {
+		lcache_index_find(st, &me->attr, prev);
+		for (l = 0; l < me->levels; l++)
+			if (*prev[l] == me)
+				*prev[l] = lcache_skip(me)[l];
+	}
+
+	update_stat(col->st_entries, -1);
+	update_stat(col->st_memory, -lcache_entry_size(me));
+
+	shm_free(me);
+}
+
+/* same as lcache_drop(), for an entry reached via the wheel or the index */
+static void lcache_drop_entry(lcache_col_t *col, lcache_stripe_t *st,
+		lcache_entry_t *me)
+{
+	lcache_entry_t **p;
+
+	for (p = &col->col_htable[me->hash_code].entries; *p != me;
+		p = &(*p)->next);
+
+	lcache_drop(col, st, p);
 }
 
 int lcache_htable_insert(cachedb_con *con,str* attr, str* value, int expires)
@@ -120,48 +275,27 @@ int lcache_htable_insert(cachedb_con *con,str* attr, str* value, int expires)
 int _lcache_htable_insert(lcache_col_t *cache_col, str* attr, str* value,
 	int expires, int isrepl)
 {
-	lcache_entry_t* me, *it;
-	int hash_code;
-	int size;
+	lcache_entry_t* me;
+	lcache_stripe_t* st;
 	struct timeval start;
-	lcache_t* cache_htable;
-
-	cache_htable = cache_col->col_htable;
-
-	size= sizeof(lcache_entry_t) + attr->len + value->len;
 
-	me = (lcache_entry_t*)shm_malloc(size);
+	me = lcache_new_entry(cache_col, attr, value,
+		expires ? get_ticks() + expires : 0);
 	if(me == NULL)
-	{
-		LM_ERR("no more shared memory\n");
 		return -1;
-	}
-	memset(me, 0, size);
 
 	start_expire_timer(start,local_exec_threshold);
 
-	me->attr.s = (char*)me + (sizeof(lcache_entry_t));
-	memcpy(me->attr.s, attr->s, attr->len);
-	me->attr.len = attr->len;
-
-	me->value.s = (char*)me + (sizeof(lcache_entry_t)) + attr->len;
-	memcpy(me->value.s, value->s, value->len);
-	me->value.len = value->len;
-	if( expires != 0)
-		me->expires = get_ticks() + expires;
-
-	hash_code= core_hash( attr, NULL, cache_col->size);
-	lock_get(&cache_htable[hash_code].lock);
-
-	it = cache_htable[hash_code].entries;
+	st = lcache_stripe(cache_col, me->hash_code);
+	lock_get(&st->lock);
 
 	/* if a previous record for the same attr delete it */
-	lcache_htable_remove_safe( *attr, &it);
+	lcache_htable_remove_safe(cache_col, *attr,
+		&cache_col->col_htable[me->hash_code].entries);
 
-	me->next = it;
-	cache_htable[hash_code].entries = me;
+	lcache_link(cache_col, st, me);
 
-	lock_release(&cache_htable[hash_code].lock);
+	lock_release(&st->lock);
 
 	_stop_expire_timer(start,local_exec_threshold,
 		"cachedb_local insert",attr->s,attr->len,0,
@@ -174,27 +308,19 @@ int _lcache_htable_insert(lcache_col_t *cache_col, str* attr, str* value,
 	return 1;
 }
 
-void lcache_htable_remove_safe(str attr, lcache_entry_t** it_p)
+void lcache_htable_remove_safe(lcache_col_t *col, str attr,
+		lcache_entry_t** it_p)
 {
-	lcache_entry_t* me = NULL, *it= *it_p;
+	lcache_entry_t** p;
 
-	while(it)
+	for (p = it_p; *p; p = &(*p)->next)
 	{
-		if(it->attr.len == attr.len &&
-				(strncmp(it->attr.s, attr.s, attr.len) == 0))
+		if((*p)->attr.len == attr.len &&
+				(strncmp((*p)->attr.s, attr.s, attr.len) == 0))
 		{
-
-			if(me)
-				me->next = it->next;
-			else
-				*it_p = it->next;
-
-			shm_free(it);
-
+			lcache_drop(col, lcache_stripe(col, (*p)->hash_code), p);
 			return;
 		}
-		me = it;
-		it = it->next;
 	}
 	LM_DBG("entry not found\n");
 }
@@ -217,19 +343,18 @@ int _lcache_htable_remove(lcache_col_t *cache_col, str* attr, int isrepl)
 {
 	int hash_code;
 	struct timeval start;
-	lcache_t* cache_htable;
-
-	cache_htable = cache_col->col_htable;
-
+	lcache_stripe_t* st;
 
 	start_expire_timer(start,local_exec_threshold);
 
 	hash_code= core_hash( attr, NULL, cache_col->size);
-	lock_get(&cache_htable[hash_code].lock);
+	st = lcache_stripe(cache_col, hash_code);
+	lock_get(&st->lock);
 
-	lcache_htable_remove_safe( *attr, &cache_htable[hash_code].entries);
+	lcache_htable_remove_safe(cache_col, *attr,
+		&cache_col->col_htable[hash_code].entries);
 
-	lock_release(&cache_htable[hash_code].lock);
+	lock_release(&st->lock);
 
 	_stop_expire_timer(start,local_exec_threshold,
 		"cachedb_local remove",attr->s,attr->len,0,
@@ -244,14 +369,12 @@ int _lcache_htable_remove(lcache_col_t *cache_col, str* attr, int isrepl)
 int lcache_htable_add(cachedb_con *con,str *attr,int val,int expires,int *new_val)
 {
 	int hash_code;
-	lcache_entry_t *it=NULL,*it_prev=NULL;
+	lcache_entry_t **p, *me;
 	int old_value;
-	char *new_value;
-	int new_len;
 	str ins_val;
 	struct timeval start;
 
-	lcache_t* cache_htable;
+	lcache_stripe_t* st;
 	lcache_col_t* cache_col;
 
 	cache_col = ((lcache_con*)con->data)->col;
@@ -261,26 +384,19 @@ int lcache_htable_add(cachedb_con *con,str *attr,int val,int expires,int *new_va
 		return -1;
 	}
 
-	cache_htable = cache_col->col_htable;
-
 	start_expire_timer(start,local_exec_threshold);
 
 	hash_code = core_hash(attr, NULL,cache_col->size);
-	lock_get(&cache_htable[hash_code].lock);
+	st = lcache_stripe(cache_col, hash_code);
+	lock_get(&st->lock);
 
-	it = cache_htable[hash_code].entries;
-	while (it) {
-		if (it->attr.len == attr->len &&
-				memcmp(it->attr.s,attr->s,attr->len) == 0) {
-			if (it->expires !=0 && it->expires < get_ticks()) {
+	for (p = &cache_col->col_htable[hash_code].entries; *p; p = &(*p)->next) {
+		if ((*p)->attr.len == attr->len &&
+				memcmp((*p)->attr.s,attr->s,attr->len) == 0) {
+			if ((*p)->expires !=0 && (*p)->expires < get_ticks()) {
 				/* found an expired entry  -> delete it */
-				if(it_prev)
-					it_prev->next = it->next;
-				else
-					cache_htable[hash_code].entries = it->next;
-
-				shm_free(it);
-				lock_release(&cache_htable[hash_code].lock);
+				lcache_drop(cache_col, st, p);
+				lock_release(&st->lock);
 
 				ins_val.s = sint2str(val,&ins_val.len);
 				if (lcache_htable_insert(con,attr,&ins_val,expires) < 0) {
@@ -301,9 +417,9 @@ int lcache_htable_add(cachedb_con *con,str *attr,int val,int expires,int *new_va
 			}
 
 			/* found our valid entry */
-			if (str2sint(&it->value,&old_value) < 0) {
+			if (str2sint(&(*p)->value,&old_value) < 0) {
 				LM_ERR("not an integer\n");
-				lock_release(&cache_htable[hash_code].lock);
+				lock_release(&st->lock);
 				_stop_expire_timer(start,local_exec_threshold,
 					"cachedb_local add",attr->s,attr->len,0,
 					cdb_slow_queries, cdb_total_queries);
@@ -311,30 +427,23 @@ int lcache_htable_add(cachedb_con *con,str *attr,int val,int expires,int *new_va
 			}
 
 			old_value+=val;
-			expires = it->expires;
-			new_value = sint2str(old_value,&new_len);
-			it = shm_realloc(it,sizeof(lcache_entry_t) + attr->len +new_len);
-			if (it == NULL) {
-				LM_ERR("failed to realloc struct\n");
-				lock_release(&cache_htable[hash_code].lock);
+			ins_val.s = sint2str(old_value,&ins_val.len);
+
+			/* the entry is linked into the wheel and the index as well,
+			 * so replace it instead of resizing it */
+			me = lcache_new_entry(cache_col, attr, &ins_val, (*p)->expires);
+			if (me == NULL) {
+				lock_release(&st->lock);
 				_stop_expire_timer(start,local_exec_threshold,
 					"cachedb_local add",attr->s,attr->len,0,
 					cdb_slow_queries, cdb_total_queries);
 				return -1;
 			}
 
-			if (it_prev)
-				it_prev->next = it;
-			else
-				cache_htable[hash_code].entries = it;
-
-			it->attr.s = (char*)(it + 1);
-			it->value.s =(char *)(it + 1) + attr->len;
-			it->expires = expires;
+			lcache_drop(cache_col, st, p);
+			lcache_link(cache_col, st, me);
 
-			memcpy(it->value.s,new_value,new_len);
-			it->value.len = new_len;
-			lock_release(&cache_htable[hash_code].lock);
+			lock_release(&st->lock);
 			if (new_val)
 				*new_val = old_value;
 			_stop_expire_timer(start,local_exec_threshold,
@@ -342,12 +451,9 @@ int lcache_htable_add(cachedb_con *con,str *attr,int val,int expires,int *new_va
 				cdb_slow_queries, cdb_total_queries);
 			return 0;
 		}
-
-		it_prev = it;
-		it = it->next;
 	}
 
-	lock_release(&cache_htable[hash_code].lock);
+	lock_release(&st->lock);
 
 	/* not found */
 	ins_val.s = sint2str(val,&ins_val.len);
@@ -381,11 +487,11 @@ int lcache_htable_sub(cachedb_con *con,str *attr,int val,int expires,int *new_va
 int lcache_htable_fetch(cachedb_con *con,str* attr, str* res)
 {
 	int hash_code;
-	lcache_entry_t* it = NULL, *it_aux = NULL;
+	lcache_entry_t **p, *it;
 	char* value;
 	struct timeval start;
 
-	lcache_t* cache_htable;
+	lcache_stripe_t* st;
 	lcache_col_t* cache_col;
 
 	cache_col = ((lcache_con*)con->data)->col;
@@ -396,16 +502,14 @@ int lcache_htable_fetch(cachedb_con *con,str* attr, str* res)
 		return -1;
 	}
 
-	cache_htable = cache_col->col_htable;
-
 	start_expire_timer(start,local_exec_threshold);
 
 	hash_code= core_hash( attr, NULL, cache_col->size);
-	lock_get(&cache_htable[hash_code].lock);
+	st = lcache_stripe(cache_col, hash_code);
+	lock_get(&st->lock);
 
-	it = cache_htable[hash_code].entries;
-
-	while(it)
+	for (p = &cache_col->col_htable[hash_code].entries; (it = *p);
+		p = &it->next)
 	{
 		if(it->attr.len == attr->len &&
 				(strncmp(it->attr.s, attr->s, attr->len) == 0))
@@ -413,14 +517,9 @@ int lcache_htable_fetch(cachedb_con *con,str* attr, str* res)
 			if( it->expires != 0 && it->expires < get_ticks())
 			{
 				/* found an expired entry  -> delete it */
-				if(it_aux)
-					it_aux->next = it->next;
-				else
-					cache_htable[hash_code].entries = it->next;
-
-				shm_free(it);
+				lcache_drop(cache_col, st, p);
 
-				lock_release(&cache_htable[hash_code].lock);
+				lock_release(&st->lock);
 				_stop_expire_timer(start,local_exec_threshold,
 					"cachedb_local fetch",attr->s,attr->len,0,
 					cdb_slow_queries, cdb_total_queries);
@@ -430,7 +529,7 @@ int lcache_htable_fetch(cachedb_con *con,str* attr, str* res)
 			if(value == NULL)
 			{
 				LM_ERR("no more memory\n");
-				lock_release(&cache_htable[hash_code].lock);
+				lock_release(&st->lock);
 				_stop_expire_timer(start,local_exec_threshold,
 					"cachedb_local fetch",attr->s,attr->len,0,
 					cdb_slow_queries, cdb_total_queries);
@@ -439,18 +538,15 @@ int lcache_htable_fetch(cachedb_con *con,str* attr, str* res)
 			memcpy(value, it->value.s, it->value.len);
 			res->len = it->value.len;
 			res->s = value;
-			lock_release(&cache_htable[hash_code].lock);
+			lock_release(&st->lock);
 			_stop_expire_timer(start,local_exec_threshold,
 				"cachedb_local fetch",attr->s,attr->len,0,
 				cdb_slow_queries, cdb_total_queries);
 			return 1;
 		}
-
-		it_aux = it;
-		it = it->next;
 	}
 
-	lock_release(&cache_htable[hash_code].lock);
+	lock_release(&st->lock);
 	_stop_expire_timer(start,local_exec_threshold,
 		"cachedb_local fetch",attr->s,attr->len,0,
 		cdb_slow_queries, cdb_total_queries);
@@ -460,11 +556,11 @@ int lcache_htable_fetch(cachedb_con *con,str* attr, str* res)
 int lcache_htable_fetch_counter(cachedb_con* con,str* attr,int *val)
 {
 	int hash_code;
-	lcache_entry_t* it = NULL, *it_aux = NULL;
+	lcache_entry_t **p, *it;
 	int ret;
 	struct timeval start;
 
-	lcache_t* cache_htable;
+	lcache_stripe_t* st;
 	lcache_col_t* cache_col;
 
 	cache_col = ((lcache_con*)con->data)->col;
@@ -474,16 +570,14 @@ int lcache_htable_fetch_counter(cachedb_con* con,str* attr,int *val)
 		return -1;
 	}
 
-	cache_htable = cache_col->col_htable;
-
 	start_expire_timer(start,local_exec_threshold);
 
 	hash_code= core_hash( attr, NULL, cache_col->size);
-	lock_get(&cache_htable[hash_code].lock);
+	st = lcache_stripe(cache_col, hash_code);
+	lock_get(&st->lock);
 
-	it = cache_htable[hash_code].entries;
-
-	while(it)
+	for (p = &cache_col->col_htable[hash_code].entries; (it = *p);
+		p = &it->next)
 	{
 		if(it->attr.len == attr->len &&
 				(strncmp(it->attr.s, attr->s, attr->len) == 0))
@@ -491,14 +585,9 @@ int lcache_htable_fetch_counter(cachedb_con* con,str* attr,int *val)
 			if( it->expires != 0 && it->expires < get_ticks())
 			{
 				/* found an expired entry  -> delete it */
-				if(it_aux)
-					it_aux->next = it->next;
-				else
-					cache_htable[hash_code].entries = it->next;
-
-				shm_free(it);
+				lcache_drop(cache_col, st, p);
 
-				lock_release(&cache_htable[hash_code].lock);
+				lock_release(&st->lock);
 				_stop_expire_timer(start,local_exec_threshold,
 					"cachedb_local fetch_counter",attr->s,attr->len,0,
 					cdb_slow_queries, cdb_total_queries);
@@ -506,7 +595,7 @@ int lcache_htable_fetch_counter(cachedb_con* con,str* attr,int *val)
 			}
 			if (str2sint(&it->value,&ret) != 0) {
 				LM_ERR("Not a counter key\n");
-				lock_release(&cache_htable[hash_code].lock);
+				lock_release(&st->lock);
 				_stop_expire_timer(start,local_exec_threshold,
 					"cachedb_local fetch_counter",attr->s,attr->len,0,
 					cdb_slow_queries, cdb_total_queries);
@@ -514,20 +603,162 @@ int lcache_htable_fetch_counter(cachedb_con* con,str* attr,int *val)
 			}
 			if (val)
 				*val = ret;
-			lock_release(&cache_htable[hash_code].lock);
+			lock_release(&st->lock);
 			_stop_expire_timer(start,local_exec_threshold,
 				"cachedb_local fetch_counter",attr->s,attr->len,0,
 				cdb_slow_queries, cdb_total_queries);
 			return 1;
 		}
-
-		it_aux = it;
-		it = it->next;
 	}
 
-	lock_release(&cache_htable[hash_code].lock);
+	lock_release(&st->lock);
 	_stop_expire_timer(start,local_exec_threshold,
 		"cachedb_local fetch_counter",attr->s,attr->len,0,
 		cdb_slow_queries, cdb_total_queries);
 	return -2;
 }
+
+static char *key_buff = NULL;
+static int key_buff_size = 0;
+
+/* fnmatch() of a (not null terminated) key
+ * return: 0 - match, 1 - no match, -1 - error */
+static int lcache_key_match(char *pattern, str *key)
+{
+	if (key->len + 1 > key_buff_size) {
+		key_buff = pkg_realloc(key_buff, key->len + 1);
+		if (key_buff == NULL) {
+			LM_ERR("No more pkg mem\n");
+			key_buff_size = 0;
+			return -1;
+		}
+
+		key_buff_size = key->len + 1;
+	}
+
+	memcpy(key_buff, key->s, key->len);
+	key_buff[key->len] = 0;
+
+	return fnmatch(pattern, key_buff, 0) == 0 ? 0 : 1;
+}
+
+/* the entries starting with the literal prefix of the pattern, out of the
+ * skip list of each stripe */
+static int lcache_remove_prefix(lcache_col_t *col, char *pattern, str *prefix)
+{
+	lcache_entry_t **prev[LCACHE_SKIP_LEVELS], *me, *next;
+	lcache_stripe_t *st;
+	int i, rc;
+
+	for (i = 0; i < col->stripes_no; i++) {
+		st = &col->stripes[i];
+		lock_get(&st->lock);
+
+		lcache_index_find(st, prefix, prev);
+		for (me = *prev[0]; me && me->attr.len >= prefix->len &&
+			!memcmp(me->attr.s, prefix->s, prefix->len); me = next) {
+			next = lcache_skip(me)[0];
+
+			rc = lcache_key_match(pattern, &me->attr);
+			if (rc < 0) {
+				lock_release(&st->lock);
+				return -1;
+			}
+
+			if (rc == 0) {
+				LM_DBG("[%.*s] matches glob [%s] - removing\n",
+						me->attr.len, me->attr.s, pattern);
+				lcache_drop_entry(col, st, me);
+			}
+		}
+
+		lock_release(&st->lock);
+	}
+
+	return 1;
+}
+
+int lcache_htable_remove_chunk(lcache_col_t *col, char *pattern)
+{
+	lcache_entry_t **p;
+	lcache_stripe_t *st;
+	str prefix;
+	int i, j, rc;
+
+	if (cache_prefix_index) {
+		prefix.s = pattern;
+		prefix.len = strcspn(pattern, "*?[\\");
+		if (prefix.len > 0)
+			return lcache_remove_prefix(col, pattern, &prefix);
+	}
+
+	for (i = 0; i < col->stripes_no; i++) {
+		st = &col->stripes[i];
+		lock_get(&st->lock);
+
+		for (j = i; j < col->size; j += col->stripes_no) {
+			p = &col->col_htable[j].entries;
+
+			while (*p) {
+				rc = lcache_key_match(pattern, &(*p)->attr);
+				if (rc < 0) {
+					lock_release(&st->lock);
+					return -1;
+				}
+
+				if (rc == 0) {
+					LM_DBG("[%.*s] matches glob [%s] - removing from "
+						"bucket %d\n", (*p)->attr.len, (*p)->attr.s, pattern, j);
+					lcache_drop(col, st, p);
+				} else {
+					p = &(*p)->next;
+				}
+			}
+		}
+
+		lock_release(&st->lock);
+	}
+
+	return 1;
+}
+
+/* drops the entries expired before @now, out of the wheel slots of the
+ * seconds passed since the previous run */
+void lcache_htable_clean(lcache_col_t *col, unsigned int now)
+{
+	lcache_entry_t *me, *next;
+	lcache_stripe_t *st;
+	unsigned int t, last;
+	int i;
+
+	/* expired means expires < now */
+	if (now == 0 || now - 1 <= col->last_clean)
+		return;
+	last = now - 1;
+
+	/* each slot is visited once, even after a long delay */
+	t = col->last_clean + 1;
+	if (last - col->last_clean > LCACHE_WHEEL_SIZE)
+		t = last - LCACHE_WHEEL_SIZE + 1;
+
+	for (; t <= last; t++) {
+		for (i = 0; i < col->stripes_no; i++) {
+			st = &col->stripes[i];
+			lock_get(&st->lock);
+
+			for (me = st->wheel[t % LCACHE_WHEEL_SIZE]; me; me = next) {
+				next = me->wheel_next;
+
+				if (me->expires <= last) {
+					LM_DBG("deleted entry attr= [%.*s]\n",
+							me->attr.len, me->attr.s);
+					lcache_drop_entry(col, st, me);
+				}
+			}
+
+			lock_release(&st->lock);
+		}
+	}
+
+	col->last_clean = last;
+}
@@ -32,29 +32,63 @@
 #include "../../lock_ops.h"
 #include "../../cachedb/cachedb.h"
 
+/*
+ * The buckets of a collection are guarded by a set of lock stripes - bucket
+ * i belongs to stripe (i % stripes_no). Besides its lock, each stripe keeps:
+ *   - a wheel of one second slots, where the entries with an expiration
+ *     time are linked by (expires % LCACHE_WHEEL_SIZE), so the cleaning
+ *     timer only walks the slots of the seconds passed since its last run;
+ *   - if prefix_index is enabled, a skip list of its entries, ordered by
+ *     key, used by cache_remove_chunk() for the globs starting with a
+ *     literal prefix.
+ */
+#define LCACHE_STRIPES      64
+#define LCACHE_WHEEL_SIZE   256 /* seconds */
+#define LCACHE_SKIP_LEVELS  16
+
 typedef struct lcache_entry
 {
 	str attr;
 	str value;
 	unsigned int expires;
+	unsigned int hash_code;
 	struct lcache_entry* next;
+	/* the expiration wheel, only if expires is set */
+	struct lcache_entry* wheel_next;
+	struct lcache_entry** wheel_prev;
+	/* number of skip list levels, followed by the level links */
+	int levels;
 }lcache_entry_t;
 
+#define lcache_skip(_e) ((lcache_entry_t **)((_e) + 1))
+
 
 typedef struct lcache
 {
 	lcache_entry_t* entries;
-	gen_lock_t lock;
 }lcache_t;
 
+typedef struct lcache_stripe
+{
+	gen_lock_t lock;
+	lcache_entry_t* wheel[LCACHE_WHEEL_SIZE];
+	lcache_entry_t* index[LCACHE_SKIP_LEVELS];
+}lcache_stripe_t;
+
+#define lcache_stripe(_col, _hash) \
+	(&(_col)->stripes[(_hash) & ((_col)->stripes_no - 1)])
+
+struct lcache_col;
 
-int lcache_htable_init(lcache_t** cache_htable_p, int size);
-void lcache_htable_destroy();
+int lcache_htable_init(struct lcache_col *col);
+void lcache_htable_destroy(struct lcache_col *col);
 int lcache_htable_insert(cachedb_con *con,str* attr, str* value, int expires);
 int lcache_htable_remove(cachedb_con *con,str* attr);
 int lcache_htable_fetch(cachedb_con *con,str* attr, str* val);
 int lcache_htable_add(cachedb_con *con,str *attr,int val,int expires,int *new_val);
 int lcache_htable_sub(cachedb_con *con,str *attr,int val,int expires,int *new_val);
 int lcache_htable_fetch_counter(cachedb_con* con,str* attr,int *val);
+int lcache_htable_remove_chunk(struct lcache_col *col, char *pattern);
+void lcache_htable_clean(struct lcache_col *col, unsigned int now);
 
 #endif
@@ -37,6 +37,7 @@
 
 #include "dbase.h"
 #include "db_mysql.h"
+#include "ps_cache.h"
 
 #include <mysql.h>
 
@@ -76,10 +77,18 @@ static param_export_t params[] = {
 	{"max_db_retries", INT_PARAM, &max_db_retries},
 	{"max_db_queries", INT_PARAM, &max_db_queries},
 	{"ps_max_col_size", INT_PARAM, &ps_max_col_size},
+	{"ps_cache_size", INT_PARAM, &ps_cache_size},
 	{"use_tls", INT_PARAM, &use_tls},
 	{0, 0, 0}
 };
 
+static stat_export_t mod_stats[] = {
+	{"ps_cache_hits",      0, &ps_cache_hits     },
+	{"ps_cache_misses",    0, &ps_cache_misses   },
+	{"ps_cache_evictions", 0, &ps_cache_evictions},
+	{0, 0, 0}
+};
+
 static module_dependency_t *get_deps_use_tls(param_export_t *param)
 {
 	if (*(int *)param->param_pointer == 0)
@@ -108,7 +117,7 @@ struct module_exports exports = {
 	cmds,
 	0,               /* exported async functions */
 	params,          /* module parameters */
-	0,               /* exported statistics */
+	mod_stats,       /* exported statistics */
 	0,               /* exported MI functions */
 	0,               /* exported pseudo-variables */
 	0,				 /* exported transformations */
@@ -146,6 +155,11 @@ static int mysql_mod_init(void)
 		ps_max_col_size = 1024;
 	}
 
+	if (ps_cache_size < 0) {
+		LM_WARN("invalid value for 'ps_cache_size', disabling it\n");
+		ps_cache_size = 0;
+	}
+
 	if (use_tls && load_tls_mgm_api(&tls_api) != 0) {
 		LM_ERR("failed to load tls_mgm API!\n");
 		return -1;
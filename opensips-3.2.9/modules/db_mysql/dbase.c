@@ -38,6 +38,7 @@
 #include "../../mem/mem.h"
 #include "../../dprint.h"
 #include "../../db/db_query.h"
+#include "../../core_stats.h"
 #include "../../db/db_async.h"
 #include "../../db/db_ut.h"
 #include "../../db/db_insertq.h"
@@ -47,6 +48,7 @@
 #include "row.h"
 #include "db_mysql.h"
 #include "dbase.h"
+#include "ps_cache.h"
 
 static str mysql_event_name = str_init("E_MYSQL_CONNECTION");
 static str mysql_url_str = str_init("url");
@@ -346,7 +348,7 @@ static int db_mysql_submit_query(const db_con_t* _h, const str* _s)
 /*
  *	Actually free prep_stmt structure
 */
-static void db_mysql_free_pq(struct prep_stmt *pq_ptr)
+void db_mysql_free_pq(struct prep_stmt *pq_ptr)
 {
 	struct my_stmt_ctx *ctx;
 	struct my_stmt_ctx *ctx2;
@@ -739,10 +741,12 @@ static int db_mysql_do_prepared_query(const db_con_t* conn, const str *query,
 			cols = mysql_num_fields(CON_RESULT(conn));
 		}
 
+		start_hist_timer(start);
 		start_expire_timer(start,db_mysql_exec_query_threshold);
 		code = wrapper_single_mysql_stmt_execute(conn, ctx->stmt);
 		_stop_expire_timer(start, db_mysql_exec_query_threshold, "mysql prep stmt",
 		        query->s, query->len, 0, sql_slow_queries, sql_total_queries);
+		stop_hist_timer(start, db_query_time);
 		if (code < 0) {
 			/* got disconnected during call */
 			switch_state_to_disconnected(conn);
@@ -1310,8 +1314,12 @@ int db_mysql_async_free_result(db_con_t *_h, db_res_t *_r, void *_priv)
  */
 int db_mysql_insert(const db_con_t* _h, const db_key_t* _k, const db_val_t* _v, const int _n)
 {
+	struct my_ps_entry *pse;
 	int ret;
 
+	pse = db_mysql_ps_cache_get(_h, MY_PS_INSERT, _k, NULL, _v, _n,
+		NULL, NULL, 0);
+
 	if (CON_HAS_PS(_h)) {
 		if (CON_HAS_UNINIT_PS(_h)||!has_stmt_ctx(_h,&(CON_MYSQL_PS(_h)->ctx))){
 			ret = db_do_insert(_h, _k, _v, _n, db_mysql_val2str,
@@ -1319,7 +1327,9 @@ int db_mysql_insert(const db_con_t* _h, const db_key_t* _k, const db_val_t* _v,
 			if (ret!=0) goto res_ps;
 		}
 		ret = db_mysql_do_prepared_query(_h, &query_holder, _v, _n, NULL, 0);
-		goto res_ps;
+		if (!db_mysql_ps_cache_failed(_h, pse, ret))
+			goto res_ps;
+		CON_RESET_CURR_PS(_h);
 	}
 
 	ret = db_do_insert(_h, _k, _v, _n, db_mysql_val2str,
@@ -1347,8 +1357,12 @@ res_ins:
 int db_mysql_delete(const db_con_t* _h, const db_key_t* _k, const db_op_t* _o,
 	const db_val_t* _v, const int _n)
 {
+	struct my_ps_entry *pse;
 	int ret;
 
+	pse = db_mysql_ps_cache_get(_h, MY_PS_DELETE, _k, _o, _v, _n,
+		NULL, NULL, 0);
+
 	if (CON_HAS_PS(_h)) {
 		if (CON_HAS_UNINIT_PS(_h)||!has_stmt_ctx(_h,&(CON_MYSQL_PS(_h)->ctx))){
 			ret = db_do_delete(_h, _k, _o, _v, _n, db_mysql_val2str,
@@ -1360,7 +1374,8 @@ int db_mysql_delete(const db_con_t* _h, const db_key_t* _k, const db_op_t* _o,
 		}
 		ret = db_mysql_do_prepared_query(_h, &query_holder, _v, _n, NULL, 0);
 		CON_RESET_CURR_PS(_h);
-		return ret;
+		if (!db_mysql_ps_cache_failed(_h, pse, ret))
+			return ret;
 	}
 	return db_do_delete(_h, _k, _o, _v, _n, db_mysql_val2str,
 		db_mysql_submit_query);
@@ -1383,8 +1398,12 @@ int db_mysql_update(const db_con_t* _h, const db_key_t* _k, const db_op_t* _o,
 	const db_val_t* _v, const db_key_t* _uk, const db_val_t* _uv, const int _n,
 	const int _un)
 {
+	struct my_ps_entry *pse;
 	int ret;
 
+	pse = db_mysql_ps_cache_get(_h, MY_PS_UPDATE, _k, _o, _v, _n,
+		_uk, _uv, _un);
+
 	if (CON_HAS_PS(_h)) {
 		if (CON_HAS_UNINIT_PS(_h)||!has_stmt_ctx(_h,&(CON_MYSQL_PS(_h)->ctx))){
 			ret = db_do_update(_h, _k, _o, _v, _uk, _uv, _n, _un,
@@ -1396,7 +1415,8 @@ int db_mysql_update(const db_con_t* _h, const db_key_t* _k, const db_op_t* _o,
 		}
 		ret = db_mysql_do_prepared_query(_h, &query_holder, _uv, _un, _v, _n);
 		CON_RESET_CURR_PS(_h);
-		return ret;
+		if (!db_mysql_ps_cache_failed(_h, pse, ret))
+			return ret;
 	}
 	return db_do_update(_h, _k, _o, _v, _uk, _uv, _n, _un, db_mysql_val2str,
 		db_mysql_submit_query);
@@ -1413,8 +1433,12 @@ int db_mysql_update(const db_con_t* _h, const db_key_t* _k, const db_op_t* _o,
  */
 int db_mysql_replace(const db_con_t* _h, const db_key_t* _k, const db_val_t* _v, const int _n)
 {
+	struct my_ps_entry *pse;
 	int ret;
 
+	pse = db_mysql_ps_cache_get(_h, MY_PS_REPLACE, _k, NULL, _v, _n,
+		NULL, NULL, 0);
+
 	if (CON_HAS_PS(_h)) {
 		if (CON_HAS_UNINIT_PS(_h)||!has_stmt_ctx(_h,&(CON_MYSQL_PS(_h)->ctx))){
 			ret = db_do_replace(_h, _k, _v, _n, db_mysql_val2str,
@@ -1426,7 +1450,8 @@ int db_mysql_replace(const db_con_t* _h, const db_key_t* _k, const db_val_t* _v,
 		}
 		ret = db_mysql_do_prepared_query(_h, &query_holder, _v, _n, NULL, 0);
 		CON_RESET_CURR_PS(_h);
-		return ret;
+		if (!db_mysql_ps_cache_failed(_h, pse, ret))
+			return ret;
 	}
 	return db_do_replace(_h, _k, _v, _n, db_mysql_val2str,
 		db_mysql_submit_query);
@@ -145,6 +145,12 @@ int db_insert_update(const db_con_t* _h, const db_key_t* _k, const db_val_t* _v,
 int db_mysql_use_table(db_con_t* _h, const str* _t);
 
 
+/*
+ *	Free a prep_stmt structure
+ */
+void db_mysql_free_pq(struct prep_stmt *pq_ptr);
+
+
 /*
  *	Free all allocated prep_stmt structures
  */
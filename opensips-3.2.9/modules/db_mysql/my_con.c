@@ -23,6 +23,7 @@
 #include "my_con.h"
 #include "db_mysql.h"
 #include "dbase.h"
+#include "ps_cache.h"
 #include <mysql.h>
 
 #include "../tls_mgm/api.h"
@@ -192,6 +193,7 @@ void db_mysql_free_connection(struct pool_con* con)
 		_c->tls_dom = NULL;
 	}
 
+	if (_c->ps_cache) db_mysql_ps_cache_free(_c->ps_cache);
 	if (_c->ps_list) db_mysql_free_stmt_list(_c->ps_list);
 	if (_c->res) mysql_free_result(_c->res);
 	if (_c->id) free_db_id(_c->id);
@@ -69,6 +69,8 @@ struct prep_stmt {
 };
 
 
+struct my_ps_cache;
+
 struct my_con {
 	struct db_id* id;        /**< Connection identifier */
 	unsigned int ref;        /**< Reference count */
@@ -83,6 +85,7 @@ struct my_con {
 	unsigned int init;       /* If the mysql conn was initialized */
 
 	struct prep_stmt *ps_list; /* list of prepared statements */
+	struct my_ps_cache *ps_cache; /* statements of the generic queries */
 	unsigned int disconnected; /* (CR_CONNECTION_ERROR) was detected */
 
 	struct tls_domain *tls_dom;;  /* TLS domain */
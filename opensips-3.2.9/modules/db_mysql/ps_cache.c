@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2026 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "../../dprint.h"
+#include "../../hash_func.h"
+#include "../../mem/mem.h"
+#include "../../db/db_insertq.h"
+
+#include "my_con.h"
+#include "dbase.h"
+#include "ps_cache.h"
+
+#define MY_PS_CACHE_HASH  64
+
+struct my_ps_cache {
+	struct my_ps_entry *table[MY_PS_CACHE_HASH];
+	struct my_ps_entry *lru_first;
+	struct my_ps_entry *lru_last;
+	int no;
+};
+
+#define CON_PS_CACHE(db_con) (((struct my_con*)((db_con)->tail))->ps_cache)
+
+int ps_cache_size = 32;
+
+stat_var *ps_cache_hits;
+stat_var *ps_cache_misses;
+stat_var *ps_cache_evictions;
+
+static char *key_buf;
+static int key_buf_len;
+
+
+static inline int key_add(int len, const char *s, int n)
+{
+	char *p;
+	int size;
+
+	if (len + n > key_buf_len) {
+		for (size = key_buf_len ? key_buf_len : 256; size < len + n; size <<= 1);
+		p = pkg_realloc(key_buf, size);
+		if (!p) {
+			LM_ERR("no more pkg mem\n");
+			return -1;
+		}
+		key_buf = p;
+		key_buf_len = size;
+	}
+
+	memcpy(key_buf + len, s, n);
+	return len + n;
+}
+
+static int key_add_cols(int len, const db_key_t *_k, const db_op_t *_o,
+												const db_val_t *_v, int _n)
+{
+	char type;
+	int i;
+
+	for (i = 0; i < _n && len >= 0; i++) {
+		len = key_add(len, _k[i]->s, _k[i]->len);
+		if (len >= 0 && _o)
+			len = key_add(len, _o[i], strlen(_o[i]) + 1);
+		/* the DATETIME binds are sized by the first values */
+		type = (char)VAL_TYPE(_v + i);
+		if (len >= 0)
+			len = key_add(len, &type, 1);
+	}
+
+	return len;
+}
+
+/* the text of the statement only depends on what goes in the key */
+static int build_key(const db_con_t *_h, char op, const db_key_t *_k,
+		const db_op_t *_o, const db_val_t *_v, int _n, const db_key_t *_uk,
+		const db_val_t *_uv, int _un, str *key)
+{
+	char hdr[2];
+	int len;
+
+	hdr[0] = op;
+	hdr[1] = (_h->flags & CON_OR_OPERATOR) ? 1 : 0;
+
+	len = key_add(0, hdr, 2);
+	if (len >= 0)
+		len = key_add(len, CON_TABLE(_h)->s, CON_TABLE(_h)->len + 1);
+	if (len >= 0)
+		len = key_add_cols(len, _k, _o, _v, _n);
+	if (len >= 0 && _un) {
+		len = key_add(len, "\0", 1);
+		if (len >= 0)
+			len = key_add_cols(len, _uk, NULL, _uv, _un);
+	}
+	if (len < 0)
+		return -1;
+
+	key->s = key_buf;
+	key->len = len;
+	return 0;
+}
+
+
+static inline void lru_unlink(struct my_ps_cache *cache, struct my_ps_entry *e)
+{
+	if (e->lru_prev)
+		e->lru_prev->lru_next = e->lru_next;
+	else
+		cache->lru_first = e->lru_next;
+
+	if (e->lru_next)
+		e->lru_next->lru_prev = e->lru_prev;
+	else
+		cache->lru_last = e->lru_prev;
+}
+
+static inline void lru_push(struct my_ps_cache *cache, struct my_ps_entry *e)
+{
+	e->lru_prev = NULL;
+	e->lru_next = cache->lru_first;
+	if (cache->lru_first)
+		cache->lru_first->lru_prev = e;
+	else
+		cache->lru_last = e;
+	cache->lru_first = e;
+}
+
+/* drops the statement of the entry from the connection */
+static void free_entry_ps(const db_con_t *_h, struct my_ps_entry *e)
+{
+	struct prep_stmt **p;
+
+	if (!e->ps)
+		return;
+
+	for (p = &CON_PS_LIST(_h); *p; p = &(*p)->next)
+		if (*p == e->ps) {
+			*p = (*p)->next;
+			break;
+		}
+
+	db_mysql_free_pq(e->ps);
+	e->ps = NULL;
+}
+
+static void evict_lru(const db_con_t *_h, struct my_ps_cache *cache)
+{
+	struct my_ps_entry *e, **p;
+
+	e = cache->lru_last;
+	lru_unlink(cache, e);
+
+	for (p = &cache->table[e->hash % MY_PS_CACHE_HASH]; *p; p = &(*p)->next)
+		if (*p == e) {
+			*p = e->next;
+			break;
+		}
+
+	LM_DBG("evicting statement %p of [%.*s]\n", e->ps,
+		CON_TABLE(_h)->len, CON_TABLE(_h)->s);
+
+	free_entry_ps(_h, e);
+	pkg_free(e);
+	cache->no--;
+
+	update_stat(ps_cache_evictions, 1);
+}
+
+
+struct my_ps_entry *db_mysql_ps_cache_get(const db_con_t *_h, char op,
+		const db_key_t *_k, const db_op_t *_o, const db_val_t *_v, int _n,
+		const db_key_t *_uk, const db_val_t *_uv, int _un)
+{
+	struct my_ps_cache *cache;
+	struct my_ps_entry *e;
+	unsigned int hash;
+	str key;
+
+	if (ps_cache_size <= 0 || CON_HAS_PS(_h) || CON_HAS_INSLIST(_h) ||
+	!_k || !_v || _n <= 0)
+		return NULL;
+
+	cache = CON_PS_CACHE(_h);
+	if (!cache) {
+		cache = pkg_malloc(sizeof *cache);
+		if (!cache) {
+			LM_ERR("no more pkg mem\n");
+			return NULL;
+		}
+		memset(cache, 0, sizeof *cache);
+		CON_PS_CACHE(_h) = cache;
+	}
+
+	if (build_key(_h, op, _k, _o, _v, _n, _uk, _uv, _un, &key) < 0)
+		return NULL;
+
+	hash = core_hash(&key, NULL, 0);
+	for (e = cache->table[hash % MY_PS_CACHE_HASH]; e; e = e->next)
+		if (e->hash == hash && e->key.len == key.len &&
+		!memcmp(e->key.s, key.s, key.len))
+			break;
+
+	if (e) {
+		if (e != cache->lru_first) {
+			lru_unlink(cache, e);
+			lru_push(cache, e);
+		}
+
+		if (e->no_ps)
+			return NULL;
+
+		update_stat(e->ps ? ps_cache_hits : ps_cache_misses, 1);
+		CON_SET_CURR_PS(_h, &e->ps);
+		return e;
+	}
+
+	if (cache->no >= ps_cache_size)
+		evict_lru(_h, cache);
+
+	e = pkg_malloc(sizeof *e + key.len);
+	if (!e) {
+		LM_ERR("no more pkg mem\n");
+		return NULL;
+	}
+	memset(e, 0, sizeof *e);
+
+	e->hash = hash;
+	e->key.s = (char *)(e + 1);
+	e->key.len = key.len;
+	memcpy(e->key.s, key.s, key.len);
+
+	e->next = cache->table[hash % MY_PS_CACHE_HASH];
+	cache->table[hash % MY_PS_CACHE_HASH] = e;
+	lru_push(cache, e);
+	cache->no++;
+
+	update_stat(ps_cache_misses, 1);
+	CON_SET_CURR_PS(_h, &e->ps);
+	return e;
+}
+
+
+int db_mysql_ps_cache_failed(const db_con_t *_h, struct my_ps_entry *pse,
+																	int ret)
+{
+	/* a lost connection is no fault of the statement */
+	if (!pse || ret == 0 || pse->ps || CON_DISCON(_h))
+		return 0;
+
+	/* the statement is only linked to the entry once prepared */
+	LM_WARN("failed to prepare a statement, using plain queries for it\n");
+	pse->no_ps = 1;
+	return 1;
+}
+
+
+void db_mysql_ps_cache_free(struct my_ps_cache *cache)
+{
+	struct my_ps_entry *e, *next;
+
+	if (!cache)
+		return;
+
+	/* the statements are freed along with the ones of the connection */
+	for (e = cache->lru_first; e; e = next) {
+		next = e->lru_next;
+		pkg_free(e);
+	}
+
+	pkg_free(cache);
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2026 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Automatic prepared statements for the writes done through the generic DB
+ * API (insert, update, delete, replace) by callers not providing their own
+ * statement. Each query shape - operation, table, columns, operators and
+ * value types - gets its own server-side statement, kept per connection
+ * (so per process) in a small LRU cache.
+ */
+
+#ifndef DB_MYSQL_PS_CACHE_H
+#define DB_MYSQL_PS_CACHE_H
+
+#include "../../db/db_con.h"
+#include "../../db/db_key.h"
+#include "../../db/db_op.h"
+#include "../../db/db_val.h"
+#include "../../statistics.h"
+
+#define MY_PS_INSERT   'i'
+#define MY_PS_UPDATE   'u'
+#define MY_PS_DELETE   'd'
+#define MY_PS_REPLACE  'r'
+
+struct my_ps_entry {
+	db_ps_t ps;            /* the statement, NULL until prepared */
+	int no_ps;             /* failed to prepare, use plain queries */
+	unsigned int hash;
+	str key;
+	struct my_ps_entry *next;      /* same bucket */
+	struct my_ps_entry *lru_prev;  /* more recently used */
+	struct my_ps_entry *lru_next;  /* less recently used */
+};
+
+struct my_ps_cache;
+
+extern int ps_cache_size;
+
+extern stat_var *ps_cache_hits;
+extern stat_var *ps_cache_misses;
+extern stat_var *ps_cache_evictions;
+
+/* finds (or adds) the entry of the query shape and sets its statement as
+ * the current one of the connection; returns NULL if the query is not to be
+ * run as a cached statement */
+struct my_ps_entry *db_mysql_ps_cache_get(const db_con_t *_h, char op,
+	const db_key_t *_k, const db_op_t *_o, const db_val_t *_v, int _n,
+	const db_key_t *_uk, const db_val_t *_uv, int _un);
+
+/* checks the outcome of a cached statement; returns 1 if the statement
+ * could not be prepared, so the query was not run and should be sent as a
+ * plain query instead */
+int db_mysql_ps_cache_failed(const db_con_t *_h, struct my_ps_entry *pse,
+	int ret);
+
+void db_mysql_ps_cache_free(struct my_ps_cache *cache);
+
+#endif /* DB_MYSQL_PS_CACHE_H */
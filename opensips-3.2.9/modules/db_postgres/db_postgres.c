@@ -33,6 +33,7 @@
 #include "../../db/db_cap.h"
 #include "dbase.h"
 #include "db_postgres.h"
+#include "pg_pipe.h"
 
 int db_postgres_exec_query_threshold = 0;   /* Warning in case DB query
 											takes too long disabled by default*/
@@ -58,6 +59,14 @@ static param_export_t params[] = {
 	{"exec_query_threshold", INT_PARAM, &db_postgres_exec_query_threshold},
 	{"max_db_queries", INT_PARAM, &max_db_queries},
 	{"timeout", INT_PARAM, &pq_timeout},
+	{"async_pipeline_depth", INT_PARAM, &pg_pipeline_depth},
+	{0, 0, 0}
+};
+
+static stat_export_t mod_stats[] = {
+	{"pipelined_queries", 0,             &pg_pipe_queries},
+	{"pipeline_queued",   STAT_NO_RESET, &pg_pipe_queued },
+	{"pipeline_full",     0,             &pg_pipe_full   },
 	{0, 0, 0}
 };
 
@@ -81,7 +90,7 @@ struct module_exports exports = {
 	cmds,            /*  module functions */
 	0,               /*  module async functions */
 	params,          /*  module parameters */
-	0,               /* exported statistics */
+	mod_stats,       /* exported statistics */
 	0,               /* exported MI functions */
 	0,               /* exported pseudo-variables */
 	0,				 /* exported transformations */
@@ -103,6 +112,13 @@ static int mod_init(void)
 		LM_WARN("Invalid number for max_db_queries\n");
 		max_db_queries = 2;
 	}
+
+#ifndef LIBPQ_HAS_PIPELINING
+	if (pg_pipeline_depth > 0) {
+		LM_WARN("libpq has no pipeline mode, ignoring async_pipeline_depth\n");
+		pg_pipeline_depth = 0;
+	}
+#endif
 	
 	return 0;
 }
@@ -77,6 +77,7 @@
 #include "pg_con.h"
 #include "val.h"
 #include "res.h"
+#include "pg_pipe.h"
 
 extern int db_postgres_exec_query_threshold;
 extern int max_db_queries;
@@ -726,6 +727,13 @@ int db_postgres_async_raw_query(db_con_t *_h, const str *_s, void **_priv)
 		return -1;
 	}
 
+	/* no prepared statements support */
+	CON_RESET_CURR_PS(_h);
+
+	code = pg_pipe_query(_h, _s, _priv);
+	if (code >= 0)
+		return code;
+
 	con = (struct my_con *)db_init_async(_h, db_postgres_get_con_fd,
 	                           &fd_ref, (void *)db_postgres_new_async_connection);
 	*_priv = con;
@@ -733,8 +741,6 @@ int db_postgres_async_raw_query(db_con_t *_h, const str *_s, void **_priv)
 		LM_INFO("Failed to open new connection (current: 1 + %d). Running "
 				"in sync mode!\n", ((struct pool_con *)_h->tail)->no_transfers);
 
-	/* no prepared statements support */
-	CON_RESET_CURR_PS(_h);
 	start_expire_timer(start, db_postgres_exec_query_threshold);
 
 	/* async mode */
@@ -776,6 +782,9 @@ int db_postgres_async_resume(db_con_t *_h, int fd, db_res_t **_r, void *_priv)
 	struct pool_con *con = (struct pool_con *)_priv;
 	PGresult *res = NULL;
 
+	if (pg_is_pipe_query(_priv))
+		return pg_pipe_resume(_h, fd, _r, _priv);
+
 #ifdef EXTRA_DEBUG
 	if (!db_match_async_con(fd, _h)) {
 		LM_BUG("no conn match for fd %d", fd);
@@ -831,6 +840,11 @@ int db_postgres_async_free_result(db_con_t *_h, db_res_t *_r, void *_priv)
 		LM_ERR("error while freeing result structure\n");
 	}
 
+	if (pg_is_pipe_query(_priv)) {
+		pg_pipe_free_query(_priv);
+		return 0;
+	}
+
 	PQclear(con->res);
 	con->res = NULL;
 	return 0;
@@ -21,6 +21,7 @@
 
 #include "db_postgres.h"
 #include "pg_con.h"
+#include "pg_pipe.h"
 #include "../../mem/mem.h"
 #include "../../dprint.h"
 #include "../../ut.h"
@@ -167,6 +168,8 @@ void db_postgres_free_connection(struct pool_con* con)
 	struct pg_con * _c;
 	_c = (struct pg_con*)con;
 
+	if (_c->pipe)
+		pg_pipe_destroy(_c->pipe);
 	if (_c->res) {
 		LM_DBG("PQclear(%p)\n", _c->res);
 		PQclear(_c->res);
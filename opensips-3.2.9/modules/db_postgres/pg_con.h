@@ -38,6 +38,8 @@
 #include <time.h>
 #include <libpq-fe.h>
 
+struct pg_pipe;
+
 /*
  * Postgres specific connection data
  */
@@ -55,6 +57,7 @@ struct pg_con {
 	PGresult *res;		/* this is the current result */
 	char**  row;		/* Actual row in the result */
 	time_t timestamp;	/* Timestamp of last query */
+	struct pg_pipe *pipe;	/* pipelined connection for the async queries */
 
 };
 
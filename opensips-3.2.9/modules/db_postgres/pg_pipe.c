@@ -0,0 +1,454 @@
+/*
+ * Copyright (C) 2026 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#include "../../dprint.h"
+#include "../../async.h"
+#include "../../reactor_defs.h"
+#include "../../mem/mem.h"
+#include "../../mem/shm_mem.h"
+
+#include "dbase.h"
+#include "pg_pipe.h"
+
+#ifdef LIBPQ_HAS_PIPELINING
+int pg_pipeline_depth = 32;
+#else
+int pg_pipeline_depth = 0;
+#endif
+
+stat_var *pg_pipe_queries;
+stat_var *pg_pipe_queued;
+stat_var *pg_pipe_full;
+
+/* how long a blocking resume waits for the pipe at a time */
+#define PG_PIPE_WAIT_MS  100
+
+/* the first field of a pipelined query, telling it apart from the async
+ * connection (starting with its db_id) of the classic async queries */
+static char pg_pipe_magic;
+
+struct pg_pipe_query {
+	void *magic;
+	int fd;                  /* the caller polls on it */
+	int done;
+	int got_results;         /* only waiting for its sync point */
+	PGresult *res;
+	struct pg_pipe_query *next;
+};
+
+struct pg_pipe {
+	struct pg_con *owner;    /* the connection of the DB handle */
+	PGconn *con;
+	int fd;
+	int depth;
+	async_ctx *ctx;          /* watching the fd in the reactor */
+	struct pg_pipe_query *first;  /* waiting for results, in query order */
+	struct pg_pipe_query *last;
+};
+
+#define CON_PIPE(db_con)  (((struct pg_con*)((db_con)->tail))->pipe)
+
+
+#ifdef LIBPQ_HAS_PIPELINING
+
+static void pg_pipe_complete(struct pg_pipe_query *q)
+{
+	uint64_t one = 1;
+
+	q->done = 1;
+	if (write(q->fd, &one, sizeof one) < 0)
+		LM_ERR("failed to signal the query: %s\n", strerror(errno));
+}
+
+/* fails all the pending queries and drops the pipelined connection */
+static void pg_pipe_fail(struct pg_pipe *pipe, int watched)
+{
+	struct pg_pipe_query *q, *next;
+
+	for (q = pipe->first; q; q = next) {
+		next = q->next;
+		if (q->res) {
+			PQclear(q->res);
+			q->res = NULL;
+		}
+		pg_pipe_complete(q);
+	}
+	update_stat(pg_pipe_queued, -pipe->depth);
+
+	if (watched)
+		reactor_del_reader(pipe->fd, -1, IO_FD_CLOSING);
+	shm_free(pipe->ctx);
+
+	pipe->owner->pipe = NULL;
+	PQfinish(pipe->con);
+	pkg_free(pipe);
+}
+
+/* reads what is available on the pipe and completes the queries whose
+ * results are all in */
+static int pg_pipe_drain(struct pg_pipe *pipe)
+{
+	struct pg_pipe_query *q;
+	PGresult *res;
+
+	if (!PQconsumeInput(pipe->con) || PQflush(pipe->con) < 0) {
+		LM_ERR("failed to read from the pipelined connection: %s, "
+			"failing %d queries\n", PQerrorMessage(pipe->con), pipe->depth);
+		return -1;
+	}
+
+	while ((q = pipe->first) && !PQisBusy(pipe->con)) {
+		res = PQgetResult(pipe->con);
+
+		if (!q->got_results) {
+			if (res) {
+				/* keep the last one, just like the blocking queries */
+				if (q->res)
+					PQclear(q->res);
+				q->res = res;
+			} else {
+				q->got_results = 1;
+			}
+			continue;
+		}
+
+		if (!res)
+			break;
+
+		if (PQresultStatus(res) != PGRES_PIPELINE_SYNC) {
+			LM_ERR("unexpected %s result in pipeline\n",
+				PQresStatus(PQresultStatus(res)));
+			PQclear(res);
+			continue;
+		}
+		PQclear(res);
+
+		pipe->first = q->next;
+		if (!pipe->first)
+			pipe->last = NULL;
+		pipe->depth--;
+		update_stat(pg_pipe_queued, -1);
+
+		pg_pipe_complete(q);
+	}
+
+	return 0;
+}
+
+static int pg_pipe_read(int fd, void *param)
+{
+	struct pg_pipe *pipe = (struct pg_pipe *)param;
+
+	if (pg_pipe_drain(pipe) < 0) {
+		/* the reactor drops the fd once we return */
+		pg_pipe_fail(pipe, 0);
+		async_status = ASYNC_DONE;
+		return -1;
+	}
+
+	async_status = ASYNC_CONTINUE;
+	return 0;
+}
+
+/* waits a bit for the pipe to bring in the results of the query, for the
+ * callers resuming in a blocking way, without the reactor */
+static void pg_pipe_wait(db_con_t *_h)
+{
+	struct pg_pipe *pipe = CON_PIPE(_h);
+	struct pollfd pfd;
+	int rc;
+
+	if (!pipe)
+		return;
+
+	pfd.fd = pipe->fd;
+	pfd.events = POLLIN;
+
+	rc = poll(&pfd, 1, PG_PIPE_WAIT_MS);
+	if (rc < 0) {
+		if (errno != EINTR)
+			LM_ERR("failed to poll the pipelined connection: %s\n",
+				strerror(errno));
+		return;
+	}
+
+	if (rc > 0 && pg_pipe_drain(pipe) < 0)
+		pg_pipe_fail(pipe, 1);
+}
+
+static struct pg_pipe *pg_pipe_new(db_con_t *_h)
+{
+	struct pg_con *owner = (struct pg_con *)_h->tail;
+	struct pg_con *c;
+	struct pg_pipe *pipe;
+
+	pipe = pkg_malloc(sizeof *pipe);
+	if (!pipe) {
+		LM_ERR("no more pkg mem\n");
+		return NULL;
+	}
+	memset(pipe, 0, sizeof *pipe);
+
+	c = db_postgres_new_async_connection(owner->id);
+	if (!c) {
+		pkg_free(pipe);
+		return NULL;
+	}
+
+	/* only the libpq connection is kept */
+	pipe->con = c->con;
+	pkg_free(c);
+
+	if (!PQenterPipelineMode(pipe->con)) {
+		LM_ERR("failed to enter pipeline mode: %s\n",
+			PQerrorMessage(pipe->con));
+		goto error;
+	}
+
+	pipe->fd = PQsocket(pipe->con);
+
+	/* not through register_async_fd(), so the context can be freed
+	 * along with the pipe */
+	pipe->ctx = shm_malloc(sizeof *pipe->ctx);
+	if (!pipe->ctx) {
+		LM_ERR("no more shm mem\n");
+		goto error;
+	}
+	memset(pipe->ctx, 0, sizeof *pipe->ctx);
+	pipe->ctx->resume_f = pg_pipe_read;
+	pipe->ctx->resume_param = pipe;
+
+	if (reactor_add_reader(pipe->fd, F_FD_ASYNC, RCT_PRIO_ASYNC,
+	pipe->ctx) < 0) {
+		LM_ERR("failed to watch the pipelined connection\n");
+		shm_free(pipe->ctx);
+		goto error;
+	}
+
+	pipe->owner = owner;
+	owner->pipe = pipe;
+	return pipe;
+
+error:
+	PQfinish(pipe->con);
+	pkg_free(pipe);
+	return NULL;
+}
+
+/* tells if the raw query holds more than one statement, which the extended
+ * query protocol of the pipeline rejects. Any ';' outside of the quoted
+ * strings and names followed by something else counts, so some single
+ * statements (e.g. with dollar-quoted bodies) are taken as several -
+ * they just do not get pipelined */
+static int pg_multi_statement(const str *_s)
+{
+	char *p, *end = _s->s + _s->len;
+	char quote = 0;
+
+	for (p = _s->s; p < end; p++) {
+		if (quote) {
+			if (*p == quote)
+				quote = 0;
+		} else if (*p == '\'' || *p == '"') {
+			quote = *p;
+		} else if (*p == ';') {
+			for (p++; p < end; p++)
+				if (*p != ';' && !isspace((unsigned char)*p))
+					return 1;
+			return 0;
+		}
+	}
+
+	return 0;
+}
+
+int pg_pipe_query(db_con_t *_h, const str *_s, void **_priv)
+{
+	struct pg_pipe *pipe;
+	struct pg_pipe_query *q;
+	int rc;
+
+	if (pg_pipeline_depth <= 0)
+		return -1;
+
+	/* sent over a connection of its own, as before */
+	if (pg_multi_statement(_s))
+		return -1;
+
+	pipe = CON_PIPE(_h);
+	if (!pipe && !(pipe = pg_pipe_new(_h)))
+		return -1;
+
+	if (pipe->depth >= pg_pipeline_depth) {
+		update_stat(pg_pipe_full, 1);
+		return -1;
+	}
+
+	q = pkg_malloc(sizeof *q);
+	if (!q) {
+		LM_ERR("no more pkg mem\n");
+		return -1;
+	}
+	memset(q, 0, sizeof *q);
+	q->magic = &pg_pipe_magic;
+
+	q->fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+	if (q->fd < 0) {
+		LM_ERR("failed to create eventfd: %s\n", strerror(errno));
+		pkg_free(q);
+		return -1;
+	}
+
+	/* each query is followed by its own sync point, so a failed query
+	 * does not abort the ones queued after it */
+	if (!PQsendQueryParams(pipe->con, _s->s, 0, NULL, NULL, NULL, NULL, 0) ||
+	!PQpipelineSync(pipe->con))
+		goto broken;
+
+	rc = PQflush(pipe->con);
+	if (rc > 0) {
+		/* the socket is only watched for reading, so push it all out */
+		PQsetnonblocking(pipe->con, 0);
+		rc = PQflush(pipe->con);
+		PQsetnonblocking(pipe->con, 1);
+	}
+	if (rc != 0)
+		goto broken;
+
+	if (pipe->last)
+		pipe->last->next = q;
+	else
+		pipe->first = q;
+	pipe->last = q;
+	pipe->depth++;
+
+	update_stat(pg_pipe_queries, 1);
+	update_stat(pg_pipe_queued, 1);
+
+	LM_DBG("query %p pipelined (%d queued)\n", q, pipe->depth);
+
+	*_priv = q;
+	return q->fd;
+
+broken:
+	LM_ERR("failed to send pipelined query: %s, failing %d queries\n",
+		PQerrorMessage(pipe->con), pipe->depth);
+	close(q->fd);
+	pkg_free(q);
+	pg_pipe_fail(pipe, 1);
+	return -1;
+}
+
+#else
+
+int pg_pipe_query(db_con_t *_h, const str *_s, void **_priv)
+{
+	return -1;
+}
+
+static void pg_pipe_wait(db_con_t *_h)
+{
+}
+
+#endif /* LIBPQ_HAS_PIPELINING */
+
+
+int pg_is_pipe_query(void *_priv)
+{
+	return _priv && ((struct pg_pipe_query *)_priv)->magic == &pg_pipe_magic;
+}
+
+int pg_pipe_resume(db_con_t *_h, int fd, db_res_t **_r, void *_priv)
+{
+	struct pg_pipe_query *q = (struct pg_pipe_query *)_priv;
+	PGresult *old;
+	uint64_t n;
+	int rc;
+
+	if (!q->done) {
+		/* resumed with no reactor behind (e.g. tm running the async
+		 * function in sync mode), so drive the pipe ourselves */
+		pg_pipe_wait(_h);
+
+		if (!q->done) {
+			async_status = ASYNC_CONTINUE;
+			return 1;
+		}
+	}
+
+	if (read(q->fd, &n, sizeof n) < 0 && errno != EAGAIN)
+		LM_ERR("failed to read eventfd: %s\n", strerror(errno));
+
+	if (!q->res) {
+		LM_ERR("pipelined query failed\n");
+		return -1;
+	}
+
+	if (!_r) {
+		rc = PQresultStatus(q->res) == PGRES_FATAL_ERROR ? -1 : 0;
+		if (rc < 0)
+			LM_ERR("query failed: %s\n", PQresultErrorMessage(q->res));
+		PQclear(q->res);
+		q->res = NULL;
+		return rc;
+	}
+
+	/* convert it as the result of the handle's own connection */
+	old = CON_RESULT(_h);
+	CON_RESULT(_h) = q->res;
+	q->res = NULL;
+
+	rc = db_postgres_store_result(_h, _r);
+	CON_RESULT(_h) = old;
+
+	if (rc != 0) {
+		LM_ERR("failed to store result\n");
+		return -2;
+	}
+
+	return 0;
+}
+
+void pg_pipe_free_query(void *_priv)
+{
+	struct pg_pipe_query *q = (struct pg_pipe_query *)_priv;
+
+	if (q->res)
+		PQclear(q->res);
+
+	/* any reactor watching was done through the caller */
+	close(q->fd);
+	pkg_free(q);
+}
+
+void pg_pipe_destroy(struct pg_pipe *pipe)
+{
+#ifdef LIBPQ_HAS_PIPELINING
+	pg_pipe_fail(pipe, 1);
+#endif
+}
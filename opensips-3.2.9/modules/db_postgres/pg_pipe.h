@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2026 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Pipelined async queries: each process keeps, for each DB handle, one extra
+ * connection in libpq pipeline mode, carrying up to "async_pipeline_depth"
+ * async queries at once. Its socket is watched by the reactor of the process
+ * and the results, which come in the order of the queries, are handed to the
+ * waiting queries; each query gets its own eventfd, which is what the caller
+ * of async_raw_query() polls on. Once the pipeline is full (or unusable),
+ * the async queries go back to a connection of their own.
+ */
+
+#ifndef PG_PIPE_H
+#define PG_PIPE_H
+
+#include "../../db/db_con.h"
+#include "../../db/db_res.h"
+#include "../../statistics.h"
+#include "pg_con.h"
+
+struct pg_pipe;
+
+extern int pg_pipeline_depth;
+
+extern stat_var *pg_pipe_queries;
+extern stat_var *pg_pipe_queued;
+extern stat_var *pg_pipe_full;
+
+/* sends the query over the pipeline of the handle, returns the fd to
+ * poll on for its result or -1 if the query is to be run the classic way */
+int pg_pipe_query(db_con_t *_h, const str *_s, void **_priv);
+
+/* is the async query one of the pipeline? */
+int pg_is_pipe_query(void *_priv);
+
+int pg_pipe_resume(db_con_t *_h, int fd, db_res_t **_r, void *_priv);
+
+void pg_pipe_free_query(void *_priv);
+
+void pg_pipe_destroy(struct pg_pipe *pipe);
+
+#endif /* PG_PIPE_H */
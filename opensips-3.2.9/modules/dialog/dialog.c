@@ -615,6 +615,7 @@ int load_dlg( struct dlg_binds *dlgb )
 	dlgb->set_profile = set_dlg_profile;
 	dlgb->unset_profile = unset_dlg_profile;
 	dlgb->get_profile_size = get_profile_size;
+	dlgb->register_profile_cb = register_profile_cb;
 	dlgb->store_dlg_value = store_dlg_value;
 	dlgb->fetch_dlg_value = fetch_dlg_value;
 	dlgb->terminate_dlg = terminate_dlg;
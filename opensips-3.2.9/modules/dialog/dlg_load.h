@@ -45,6 +45,7 @@ struct dlg_binds {
 	set_dlg_profile_f    set_profile;
 	unset_dlg_profile_f  unset_profile;
 	get_profile_size_f   get_profile_size;
+	register_profile_cb_f register_profile_cb;
 	store_dlg_value_f    store_dlg_value;
 	fetch_dlg_value_f    fetch_dlg_value;
 	terminate_dlg_f      terminate_dlg;
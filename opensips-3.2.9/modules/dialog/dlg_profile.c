@@ -654,6 +654,10 @@ static void destroy_linker(struct dlg_profile_link *l, struct dlg_cell *dlg,
 				prof_val_local_dec(dest, &dlg->shtag,
 					l->profile->repl_type==REPL_PROTOBIN);
 
+				if (l->profile->size_cb)
+					l->profile->size_cb(l->profile, &l->value,
+						(unsigned int)(long)*dest, l->profile->size_cb_param);
+
 				if( *dest == 0 )
 				{
 					if (l->profile->repl_type==REPL_PROTOBIN)
@@ -780,6 +784,10 @@ static int link_dlg_profile(struct dlg_profile_link *linker,
 
 			prof_val_local_inc(dest, &dlg->shtag,
 				profile->repl_type == REPL_PROTOBIN);
+
+			if (profile->size_cb)
+				profile->size_cb(profile, &linker->value,
+					(unsigned int)(long)*dest, profile->size_cb_param);
 		}
 		else {
 			if (profile->repl_type == REPL_PROTOBIN && profile_repl_cluster) {
@@ -988,6 +996,24 @@ int is_dlg_in_profile(struct dlg_cell *dlg, struct dlg_profile_table *profile,
 }
 
 
+/* the callback is only accepted for the profiles with values which are
+ * not replicated, as only the local dialogs trigger it */
+int register_profile_cb(struct dlg_profile_table *profile,
+		dlg_profile_cb cb, void *param)
+{
+	if (!profile->has_value || profile->repl_type != REPL_NONE) {
+		LM_DBG("profile <%.*s> has no value or is replicated\n",
+			profile->name.len, profile->name.s);
+		return -1;
+	}
+
+	profile->size_cb_param = param;
+	profile->size_cb = cb;
+
+	return 0;
+}
+
+
 unsigned int get_profile_size(struct dlg_profile_table *profile, str *value)
 {
 	unsigned int n = 0, i;
@@ -53,6 +53,13 @@ struct prof_local_count {
 	struct prof_local_count *next;
 };
 
+struct dlg_profile_table;
+
+/* called, with the profile entry still locked, each time the number of
+ * dialogs having @value in @profile changes; @count is the new number */
+typedef void (*dlg_profile_cb)(struct dlg_profile_table *profile,
+		str *value, unsigned int count, void *param);
+
 enum repl_types {REPL_NONE=0, REPL_CACHEDB=1, REPL_PROTOBIN};
 struct dlg_profile_table {
 	str name;
@@ -73,6 +80,12 @@ struct dlg_profile_table {
 	struct prof_local_count **noval_local_counters;
 	struct prof_rcv_count *noval_rcv_counters;
 
+	/*
+	 * watcher of the per value counters, if any
+	 */
+	dlg_profile_cb size_cb;
+	void *size_cb_param;
+
 	struct dlg_profile_table *next;
 };
 
@@ -92,6 +105,9 @@ typedef unsigned int (*get_profile_size_f)(struct dlg_profile_table *profile,
 
 typedef int (*add_profiles_f)(char* profiles, unsigned int has_value);
 
+typedef int (*register_profile_cb_f)(struct dlg_profile_table *profile,
+										dlg_profile_cb cb, void *param);
+
 typedef struct dlg_profile_table* (*search_dlg_profile_f)(str *name);
 
 struct dlg_profile_value_name {
@@ -125,6 +141,9 @@ int noval_get_local_count(struct dlg_profile_table *profile);
 
 unsigned int get_profile_size(struct dlg_profile_table *profile, str *value);
 
+int register_profile_cb(struct dlg_profile_table *profile,
+		dlg_profile_cb cb, void *param);
+
 mi_response_t *mi_get_profile_1(const mi_params_t *params,
 								struct mi_handler *async_hdl);
 mi_response_t *mi_get_profile_2(const mi_params_t *params,
@@ -131,6 +131,8 @@ static void ds_destroy_data_set( ds_data_t *d)
 			}while(dest);
 			shm_free(sp_curr->dlist);
 		}
+		if (sp_curr->ring)
+			shm_free(sp_curr->ring);
 		shm_free(sp_curr);
 	}
 
@@ -387,14 +389,20 @@ static inline void re_calculate_active_dsts(ds_set_p sp)
 {
 	int j,i;
 	ds_dest_p dst;
-	int oldw;
+	int oldw, has_load;
+
+	sp->load_sum = sp->load_points = 0;
 
 	/* pre-calculate the running weights for each destination */
 	for( j=0,i=-1,sp->active_nr=sp->nr ; j<sp->nr ; j++ ) {
 		dst = &sp->dlist[j];
+		has_load = 0;
 		if (dst->fs_sock && dst->fs_sock->stats.valid) {
 			lock_start_read(dst->fs_sock->stats_lk);
 
+			dst->load = dst->fs_sock->stats.sess;
+			has_load = 1;
+
 			oldw = dst->weight;
 			dst->weight = round(max_freeswitch_weight *
 			(1 - dst->fs_sock->stats.sess /
@@ -418,6 +426,10 @@ static inline void re_calculate_active_dsts(ds_set_p sp)
 			dst->active_running_weight = dst->weight
 				+ ((i==-1) ? 0 : sp->dlist[i].active_running_weight);
 			i = j; /* last active destination */
+			if (has_load) {
+				sp->load_sum += dst->load;
+				sp->load_points += dst->ring_points;
+			}
 		} else {
 			dst->active_running_weight =
 				((i==-1) ? 0 : sp->dlist[i].active_running_weight);
@@ -429,6 +441,93 @@ static inline void re_calculate_active_dsts(ds_set_p sp)
 }
 
 
+/* murmur3 finalizer - ds_get_hash() does not cover the whole 32 bit space */
+static inline unsigned int ds_ring_mix(unsigned int h)
+{
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+static int ring_point_cmp(const void *a, const void *b)
+{
+	const struct ds_ring_point *pa = a, *pb = b;
+
+	if (pa->hash != pb->hash)
+		return pa->hash < pb->hash ? -1 : 1;
+	return (int)pa->dst - (int)pb->dst;
+}
+
+/* places ds_ring_vnodes points per destination (on average) on the ring of
+ * the set, proportionally to the weights. The points only depend on the
+ * destination URIs and weights, so all the instances sharing the same
+ * provisioning build identical rings */
+static int ds_build_ring(ds_set_p sp)
+{
+	unsigned long long wsum = 0;
+	unsigned int base, n, k;
+	int j;
+
+	for (j = 0; j < sp->nr; j++)
+		wsum += sp->dlist[j].weight;
+
+	for (j = 0, n = 0; j < sp->nr; j++) {
+		if (wsum)
+			sp->dlist[j].ring_points = ((unsigned long long)ds_ring_vnodes *
+				sp->dlist[j].weight * sp->nr + wsum / 2) / wsum;
+		else
+			sp->dlist[j].ring_points = ds_ring_vnodes;
+		/* a weighted destination must be on the ring, whatever small */
+		if (sp->dlist[j].ring_points == 0 && (sp->dlist[j].weight || !wsum))
+			sp->dlist[j].ring_points = 1;
+		n += sp->dlist[j].ring_points;
+	}
+
+	sp->ring = shm_malloc(n * sizeof *sp->ring);
+	if (!sp->ring) {
+		LM_ERR("no more shm memory\n");
+		return -1;
+	}
+	sp->ring_size = n;
+
+	for (j = 0, n = 0; j < sp->nr; j++) {
+		base = ds_get_hash(&sp->dlist[j].uri, NULL);
+		for (k = 0; k < sp->dlist[j].ring_points; k++, n++) {
+			sp->ring[n].hash = ds_ring_mix(base + k * 0x9e3779b9);
+			sp->ring[n].dst = j;
+		}
+	}
+
+	qsort(sp->ring, n, sizeof *sp->ring, ring_point_cmp);
+
+	LM_DBG("set %d: %u points on the ring\n", sp->id, n);
+	return 0;
+}
+
+/* the rings are only built for the sets balanced with them: on their first
+ * use, then again on each reload */
+static void ds_inherit_rings(ds_data_t *old_data, ds_data_t *new_data)
+{
+	ds_set_p new_set, old_set;
+
+	for (new_set = new_data->sets; new_set; new_set = new_set->next) {
+		for (old_set = old_data->sets; old_set; old_set = old_set->next)
+			if (new_set->id == old_set->id)
+				break;
+
+		if (!old_set || !old_set->ring || new_set->nr == 0)
+			continue;
+
+		if (ds_build_ring(new_set) == 0)
+			re_calculate_active_dsts(new_set);
+	}
+}
+
+
+
 /* compact destinations from sets for fast access */
 int reindex_dests( ds_data_t *d_data)
 {
@@ -791,6 +890,121 @@ int ds_route_algo(struct sip_msg *msg, ds_set_p set,
 	return cnt;
 }
 
+/* Picks the first usable destination clockwise from the hash on the ring of
+ * the set. Inactive destinations are skipped, so their calls move to the
+ * next points on the ring while the other calls stay where they were.
+ * With ds_ring_load_bound, destinations reporting a load over their share
+ * of the set's load are skipped as well. If failover is requested,
+ * @sorted_set is filled with the destinations in ring order */
+static ds_dest_p ds_ring_algo(ds_set_p set, unsigned int hash,
+											ds_dest_p **sorted_set, int ds_flags)
+{
+	struct ds_ring_point *ring = set->ring;
+	ds_dest_p dst, selected = NULL, overloaded = NULL, *sset;
+	unsigned int lo, hi, mid, k, cap;
+	int use_default, d, cnt, end;
+
+	if (!ring || set->ring_size == 0)
+		return NULL;
+
+	use_default = (ds_flags & DS_USE_DEFAULT) && set->nr > 1;
+	hash = ds_ring_mix(hash);
+
+	/* first point at or after the hash */
+	for (lo = 0, hi = set->ring_size; lo < hi; ) {
+		mid = lo + (hi - lo) / 2;
+		if (ring[mid].hash < hash)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (k = 0; k < set->ring_size; k++) {
+		d = ring[(lo + k) % set->ring_size].dst;
+		if (use_default && d == set->nr - 1)
+			continue;
+
+		dst = &set->dlist[d];
+		if (!dst_is_active(*dst))
+			continue;
+
+		if (ds_ring_load_bound && set->load_points && dst->fs_sock &&
+		dst->fs_sock->stats.valid) {
+			cap = ((unsigned long long)
+				(__atomic_load_n(&set->load_sum, __ATOMIC_RELAXED) + 1) *
+				ds_ring_load_bound * dst->ring_points +
+				100ULL * set->load_points - 1) / (100ULL * set->load_points);
+			if (__atomic_load_n(&dst->load, __ATOMIC_RELAXED) >= cap) {
+				if (!overloaded)
+					overloaded = dst;
+				continue;
+			}
+		}
+
+		selected = dst;
+		break;
+	}
+
+	/* everybody is over the bound - stick to the plain ring choice */
+	if (!selected)
+		selected = overloaded;
+
+	if (!selected) {
+		if (!use_default || !dst_is_active(set->dlist[set->nr - 1]))
+			return NULL;
+		selected = &set->dlist[set->nr - 1];
+	}
+
+	/* account the new call until the next load report */
+	if (ds_ring_load_bound && selected->fs_sock &&
+	selected->fs_sock->stats.valid) {
+		/* other readers may be doing the same */
+		__atomic_add_fetch(&selected->load, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&set->load_sum, 1, __ATOMIC_RELAXED);
+	}
+
+	if (!(ds_flags & DS_FAILOVER_ON))
+		return selected;
+
+	sset = shm_realloc(*sorted_set, set->nr * sizeof(ds_dest_p));
+	if (!sset) {
+		LM_ERR("no more shm memory\n");
+		return NULL;
+	}
+	*sorted_set = sset;
+
+	{
+		unsigned char seen[set->nr];
+
+		memset(seen, 0, set->nr);
+		end = set->nr;
+		if (use_default) {
+			end--;
+			sset[end] = &set->dlist[end];
+			seen[end] = 1;
+		}
+
+		sset[0] = selected;
+		seen[selected - set->dlist] = 1;
+		cnt = 1;
+
+		for (k = 0; k < set->ring_size && cnt < end; k++) {
+			d = ring[(lo + k) % set->ring_size].dst;
+			if (seen[d])
+				continue;
+			seen[d] = 1;
+			sset[cnt++] = &set->dlist[d];
+		}
+
+		/* destinations with no points on the ring (zero weight) */
+		for (d = 0; d < end && cnt < end; d++)
+			if (!seen[d])
+				sset[cnt++] = &set->dlist[d];
+	}
+
+	return selected;
+}
+
 int ds_connect_db(ds_partition_t *partition)
 {
 	if(!partition->db_url.s)
@@ -887,6 +1101,7 @@ static void ds_inherit_state( ds_data_t *old_data , ds_data_t *new_data)
 						new_ds->flags = old_ds->flags;
 						changed = 1;
 					}
+					new_ds->probe = old_ds->probe;
 					break;
 				}
 			}
@@ -1154,6 +1369,11 @@ int ds_reload_db(ds_partition_t *partition)
 
 	lock_start_write( partition->lock );
 
+	/* the new sets are not visible yet, but the lazily built rings of the
+	 * old ones are only stable under the lock */
+	if (*partition->data)
+		ds_inherit_rings(*partition->data, new_data);
+
 	/* no more activ readers -> do the swapping */
 	old_data = *partition->data;
 	*partition->data = new_data;
@@ -1541,6 +1761,29 @@ static inline int ds_get_index(int group, ds_set_p *index,
 	return 0;
 }
 
+/* to be called under the reader's lock, which is briefly swapped for the
+ * writer's one if the ring of the set is still to be built */
+static int ds_ring_prepare(ds_select_ctl_p ds_select_ctl, ds_set_p *idx)
+{
+	ds_partition_t *partition = ds_select_ctl->partition;
+
+	if ((*idx)->ring || (*idx)->nr == 0)
+		return 0;
+
+	lock_stop_read(partition->lock);
+	lock_start_write(partition->lock);
+
+	/* the data may have been reloaded meanwhile */
+	if (ds_get_index(ds_select_ctl->set, idx, partition) == 0 &&
+	!(*idx)->ring && (*idx)->nr && ds_build_ring(*idx) == 0)
+		re_calculate_active_dsts(*idx);
+
+	lock_stop_write(partition->lock);
+	lock_start_read(partition->lock);
+
+	return ds_get_index(ds_select_ctl->set, idx, partition);
+}
+
 
 int ds_update_dst(struct sip_msg *msg, str *uri, struct socket_info *sock,
 																	int mode)
@@ -1677,6 +1920,12 @@ int ds_select_dst(struct sip_msg *msg, ds_select_ctl_p ds_select_ctl,
 		goto error;
 	}
 
+	if (ds_select_ctl->alg == DS_ALG_RING &&
+	ds_ring_prepare(ds_select_ctl, &idx) != 0) {
+		LM_ERR("destination set [%d] not found\n", ds_select_ctl->set);
+		goto error;
+	}
+
 	if (idx->nr == 0) {
 		LM_DBG("destination set [%d] is empty!\n", idx->id);
 		goto error;
@@ -1807,6 +2056,20 @@ int ds_select_dst(struct sip_msg *msg, ds_select_ctl_p ds_select_ctl,
 			selected = sorted_set[0];
 			ds_id = 0;
 		break;
+		case DS_ALG_RING:
+			if ((hash_param_model ? ds_hash_pvar(msg, &ds_hash) :
+			ds_hash_callid(msg, &ds_hash)) != 0) {
+				LM_ERR("can't get the ring hash\n");
+				goto error;
+			}
+			selected = ds_ring_algo(idx, ds_hash, &sorted_set, ds_flags);
+			if (!selected) {
+				LM_DBG("no usable destination on the ring of set [%d]\n",
+					idx->id);
+				goto error;
+			}
+			ds_id = 0;
+		break;
 		default:
 			LM_WARN("dispatching via [%d] with unknown algo [%d]"
 					": defaulting to 0 - first entry\n",
@@ -1958,7 +2221,7 @@ int ds_select_dst(struct sip_msg *msg, ds_select_ctl_p ds_select_ctl,
 			ds_select_ctl->partition->script_attrs_avp_name, 1 /*all*/);
 	}
 
-	if((ds_flags&DS_USE_DEFAULT) && ds_id!=idx->nr-1)
+	if((ds_flags&DS_USE_DEFAULT) && selected!=&idx->dlist[idx->nr-1])
 	{
 		if (push_ds_2_avps( &idx->dlist[idx->nr-1], ds_select_ctl->partition )
 		!= 0 )
@@ -1977,7 +2240,8 @@ int ds_select_dst(struct sip_msg *msg, ds_select_ctl_p ds_select_ctl,
 
 	for(i_unwrapped = ds_id-1+idx->nr; i_unwrapped>ds_id; i_unwrapped--) {
 		i = i_unwrapped % idx->nr;
-		dest = ((ds_select_ctl->alg == 9 || ds_select_ctl->alg == 10) ? 
+		dest = ((ds_select_ctl->alg == 9 || ds_select_ctl->alg == 10 ||
+			ds_select_ctl->alg == DS_ALG_RING) ?
 			sorted_set[i] : 
 			&idx->dlist[i]);
 
@@ -2404,6 +2668,7 @@ int ds_print_mi_list(mi_item_t *part_item, ds_partition_t *partition, int full)
 	char* p;
 	ds_set_p list;
 	mi_item_t *sets_arr, *set_item, *dests_arr, *dest_item, *addr_arr;
+	unsigned long long *ring_arc = NULL;
 
 	if ( (*partition->data)->sets==NULL ) {
 		LM_DBG("empty destination sets\n");
@@ -2417,6 +2682,17 @@ int ds_print_mi_list(mi_item_t *part_item, ds_partition_t *partition, int full)
 	/* access ds data under reader's lock */
 	lock_start_read( partition->lock );
 
+	if (full) {
+		for (i = 0, list = (*partition->data)->sets; list; list = list->next)
+			if (list->nr > i)
+				i = list->nr;
+		ring_arc = pkg_malloc(i * sizeof *ring_arc);
+		if (!ring_arc) {
+			LM_ERR("no more pkg memory\n");
+			goto error;
+		}
+	}
+
 	for(list = (*partition->data)->sets ; list!= NULL; list= list->next) {
 		set_item = add_mi_object(sets_arr, NULL, 0);
 		if (!set_item)
@@ -2429,6 +2705,16 @@ int ds_print_mi_list(mi_item_t *part_item, ds_partition_t *partition, int full)
 		if (!dests_arr)
 			return -1;
 
+		/* the slice of the hash space ending in each point of the ring */
+		if (full && list->ring) {
+			memset(ring_arc, 0, list->nr * sizeof *ring_arc);
+			for (i = 0; i < list->ring_size; i++)
+				ring_arc[list->ring[i].dst] += (i == 0) ?
+					(1ULL<<32) - list->ring[list->ring_size-1].hash +
+						list->ring[0].hash :
+					list->ring[i].hash - list->ring[i-1].hash;
+		}
+
 		for(j=0; j<list->nr; j++)
 		{
 			dest_item = add_mi_object(dests_arr, NULL, 0);
@@ -2483,6 +2769,24 @@ int ds_print_mi_list(mi_item_t *part_item, ds_partition_t *partition, int full)
 					list->dlist[j].priority) < 0)
 					goto error;
 
+				if (list->ring) {
+					if (add_mi_number(dest_item, MI_SSTR("ring_points"),
+						list->dlist[j].ring_points) < 0)
+						goto error;
+
+					if (add_mi_number(dest_item, MI_SSTR("ring_share"),
+						(double)ring_arc[j] * 100 / (1ULL<<32)) < 0)
+						goto error;
+				}
+
+				if (list->dlist[j].fs_sock && add_mi_number(dest_item,
+					MI_SSTR("load"), list->dlist[j].load) < 0)
+					goto error;
+
+				if (list->dlist[j].probe.rtt && add_mi_number(dest_item,
+					MI_SSTR("probe_rtt"), list->dlist[j].probe.rtt) < 0)
+					goto error;
+
 				if (list->dlist[j].description.len)
 					if (add_mi_string(dest_item, MI_SSTR("description"),
 						list->dlist[j].description.s,
@@ -2504,14 +2808,43 @@ int ds_print_mi_list(mi_item_t *part_item, ds_partition_t *partition, int full)
 	}
 
 	lock_stop_read( partition->lock );
+	if (ring_arc)
+		pkg_free(ring_arc);
 	return 0;
 
 error:
 	lock_stop_read( partition->lock );
+	if (ring_arc)
+		pkg_free(ring_arc);
 	return -1;
 }
 
 
+/* accounts the outcome of a probe in the state of its destination */
+static void ds_probe_update(ds_options_callback_param_t *cb_param, str *uri,
+																	int ok)
+{
+	unsigned int rtt;
+	ds_set_p set;
+	int i;
+
+	rtt = probe_done(ds_probes_in_flight, &cb_param->probe);
+
+	lock_start_read( cb_param->partition->lock );
+
+	if (ds_get_index(cb_param->set_id, &set, cb_param->partition) == 0) {
+		for (i = 0; i < set->nr; i++)
+			if (set->dlist[i].uri.len == uri->len &&
+			strncasecmp(set->dlist[i].uri.s, uri->s, uri->len) == 0) {
+				probe_update(&set->dlist[i].probe, ok, rtt);
+				break;
+			}
+	}
+
+	lock_stop_read( cb_param->partition->lock );
+}
+
+
 /**
  * Callback-Function for the OPTIONS-Request
  * This Function is called, as soon as the Transaction is finished
@@ -2545,6 +2878,9 @@ static void ds_options_callback( struct cell *t, int type,
 	LM_DBG("OPTIONS-Request was finished with code %d (to %.*s, group %d)\n",
 			ps->code, uri.len, uri.s, cb_param->set_id);
 
+	ds_probe_update(cb_param, &uri, (ps->code == 200) ||
+		check_options_rplcode(ps->code));
+
 	/* ps->code contains the result-code of the request;
 	 * We accept "200 OK" by default and the custom codes
 	 * defined in options_reply_codes parameter*/
@@ -2586,6 +2922,7 @@ void ds_check_timer(unsigned int ticks, void* param)
 	ds_partition_t *partition;
 	dlg_t *dlg;
 	ds_set_p list;
+	ds_dest_p dst;
 	int_str val;
 	int j;
 
@@ -2605,65 +2942,82 @@ void ds_check_timer(unsigned int ticks, void* param)
 		{
 			for(j=0; j<list->nr; j++)
 			{
+				dst = &list->dlist[j];
+
 				/* If list is probed by this proxy and the Flag of
 				 * the entry has "Probing" set, send a probe: */
-				if ( (!ds_probing_list || in_int_list(ds_probing_list, list->id)==0) &&
-				((list->dlist[j].flags&DS_INACTIVE_DST)==0) &&
-				(ds_probing_mode==1 || (list->dlist[j].flags&DS_PROBING_DST)!=0
-				))
-				{
-					LM_DBG("probing set #%d, URI %.*s\n", list->id,
-							list->dlist[j].uri.len, list->dlist[j].uri.s);
-
-					/* Execute the Dialog using the "request"-Method of the
-					 * TM-Module.*/
-					if (tmb.new_auto_dlg_uac(&ds_ping_from,
-					&list->dlist[j].uri, NULL, NULL,
-					list->dlist[j].sock?list->dlist[j].sock:probing_sock,
-					&dlg) != 0 ) {
-						LM_ERR("failed to create new TM dlg\n");
-						continue;
-					}
-					dlg->state = DLG_CONFIRMED;
+				if ( (ds_probing_list && in_int_list(ds_probing_list, list->id)!=0) ||
+				(dst->flags&DS_INACTIVE_DST)!=0 ||
+				(ds_probing_mode!=1 && (dst->flags&DS_PROBING_DST)==0) ) {
+					/* no longer probed, start over when it is again */
+					dst->probe.next = 0;
+					continue;
+				}
 
-					if (ds_ping_maxfwd>=0) {
-						dlg->mf_enforced = 1;
-						dlg->mf_value = (unsigned short)ds_ping_maxfwd;
-					}
+				if (!probe_is_due(&dst->probe, ticks, ds_ping_interval))
+					continue;
 
-					ds_options_callback_param_t *cb_param =
-								shm_malloc(sizeof(*cb_param));
+				/* over the cap, retry on the next tick */
+				if (!probe_can_send(ds_probes_in_flight, ds_ping_max_inflight))
+					continue;
 
-					if (cb_param == NULL) {
-						LM_CRIT("No more shared memory\n");
-						continue;
-					}
+				probe_reschedule(&dst->probe, ticks, ds_ping_interval,
+					ds_ping_adaptive);
 
-					if (partition->attrs_avp_name>=0) {
-						val.s = list->dlist[j].attrs;
-						dlg->avps = new_avp(
-							AVP_VAL_STR|partition->attrs_avp_type,
-							partition->attrs_avp_name, val);
-						// we do not care if the adding failed, there will
-						// be no attr AVP exposed in local route
-						if (dlg->avps)
-							dlg->avps->next = NULL;
-					}
+				LM_DBG("probing set #%d, URI %.*s\n", list->id,
+						dst->uri.len, dst->uri.s);
 
-					cb_param->partition = partition;
-					cb_param->set_id = list->id;
-					if (tmb.t_request_within(&ds_ping_method,
-							NULL,
-							NULL,
-							dlg,
-							ds_options_callback,
-							(void*)cb_param,
-							osips_shm_free) < 0) {
-						LM_ERR("unable to execute dialog\n");
-						shm_free(cb_param);
-					}
+				/* Execute the Dialog using the "request"-Method of the
+				 * TM-Module.*/
+				if (tmb.new_auto_dlg_uac(&ds_ping_from,
+				&dst->uri, NULL, NULL,
+				dst->sock?dst->sock:probing_sock,
+				&dlg) != 0 ) {
+					LM_ERR("failed to create new TM dlg\n");
+					continue;
+				}
+				dlg->state = DLG_CONFIRMED;
+
+				if (ds_ping_maxfwd>=0) {
+					dlg->mf_enforced = 1;
+					dlg->mf_value = (unsigned short)ds_ping_maxfwd;
+				}
+
+				ds_options_callback_param_t *cb_param =
+							shm_malloc(sizeof(*cb_param));
+
+				if (cb_param == NULL) {
+					LM_CRIT("No more shared memory\n");
 					tmb.free_dlg(dlg);
+					continue;
+				}
+
+				if (partition->attrs_avp_name>=0) {
+					val.s = dst->attrs;
+					dlg->avps = new_avp(
+						AVP_VAL_STR|partition->attrs_avp_type,
+						partition->attrs_avp_name, val);
+					// we do not care if the adding failed, there will
+					// be no attr AVP exposed in local route
+					if (dlg->avps)
+						dlg->avps->next = NULL;
+				}
+
+				cb_param->partition = partition;
+				cb_param->set_id = list->id;
+				probe_sent(ds_probes_in_flight, &cb_param->probe);
+				if (tmb.t_request_within(&ds_ping_method,
+						NULL,
+						NULL,
+						dlg,
+						ds_options_callback,
+						(void*)cb_param,
+						osips_shm_free) < 0) {
+					LM_ERR("unable to execute dialog\n");
+					probe_done(ds_probes_in_flight, &cb_param->probe);
+					shm_free(cb_param);
 				}
+				tmb.free_dlg(dlg);
 			}
 		}
 
@@ -31,6 +31,7 @@
 #include "../freeswitch/fs_api.h"
 #include "../../db/db.h"
 #include "../../rw_locking.h"
+#include "../../lib/probing.h"
 
 #define DS_HASH_USER_ONLY	1  /* use only the uri user part for hashing */
 #define DS_FAILOVER_ON		2  /* store the other dest in avps */
@@ -57,6 +58,8 @@
 
 #define MI_FULL_LISTING (1<<0)
 
+#define DS_ALG_RING  11  /* consistent hashing over the set's ring */
+
 
 extern int ds_persistent_state;
 
@@ -82,10 +85,19 @@ typedef struct _ds_dest
 	unsigned short chosen_count;
 	void *param;
 	int route_algo_value;
+	unsigned int ring_points;   /* virtual nodes on the consistent hash ring */
+	unsigned int load;          /* sessions reported by FreeSWITCH */
+	struct probe_state probe;
 	fs_evs *fs_sock;
 	struct _ds_dest *next;
 } ds_dest_t, *ds_dest_p;
 
+struct ds_ring_point
+{
+	unsigned int hash;
+	unsigned int dst;   /* index in the set's dlist */
+};
+
 typedef struct _ds_set
 {
 	int id;				/* id of dst set */
@@ -94,6 +106,11 @@ typedef struct _ds_set
 	int last;			/* last used item in dst set */
 	int redo_weights;   /* whether at least one item has dynamic weight */
 	ds_dest_p dlist;
+	struct ds_ring_point *ring; /* consistent hash ring, sorted by hash */
+	unsigned int ring_size;
+	/* totals over the active destinations reporting their load */
+	unsigned int load_sum;
+	unsigned int load_points;
 	struct _ds_set *next;
 } ds_set_t, *ds_set_p;
 
@@ -158,6 +175,7 @@ typedef struct
 {
 	ds_partition_t *partition;
 	int set_id;
+	struct probe_ctx probe;
 } ds_options_callback_param_t;
 
 typedef struct _ds_selected_dst
@@ -193,10 +211,17 @@ extern int ds_ping_maxfwd;
 extern int probing_threshold; /* number of failed requests,
 						before a destination is taken into probing */
 extern int ds_probing_mode;
+extern int ds_ping_interval;
+extern int ds_ping_max_inflight;
+extern int ds_ping_adaptive;
+extern stat_var *ds_probes_in_flight;
 
 extern int fetch_freeswitch_stats;
 extern int max_freeswitch_weight;
 
+extern int ds_ring_vnodes;
+extern int ds_ring_load_bound;
+
 int init_ds_db(ds_partition_t *partition);
 int ds_connect_db(ds_partition_t *partition);
 void ds_disconnect_db(ds_partition_t *partition);
@@ -205,6 +230,7 @@ int ds_reload_db(ds_partition_t *partition);
 int init_ds_data(ds_partition_t *partition);
 void ds_destroy_data(ds_partition_t *partition);
 
+unsigned int ds_get_hash(str *x, str *y);
 int ds_update_dst(struct sip_msg *msg, str *uri, struct socket_info *sock, int mode);
 int ds_select_dst(struct sip_msg *msg, ds_select_ctl_p ds_select_ctl, ds_selected_dst_p selected_dst, int ds_flags);
 int ds_next_dst(struct sip_msg *msg, int mode, ds_partition_t *partition);
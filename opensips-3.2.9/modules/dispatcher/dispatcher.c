@@ -69,7 +69,10 @@ int probing_threshold = 3; /* number of failed requests, before a destination
 							   is taken into probing */
 str ds_ping_method = {"OPTIONS",7};
 str ds_ping_from   = {"sip:dispatcher@localhost", 24};
-static int ds_ping_interval = 0;
+int ds_ping_interval = 0;
+int ds_ping_max_inflight = 0;
+int ds_ping_adaptive = 0;
+stat_var *ds_probes_in_flight;
 /* no MAX-FWD enforced from the module */
 int ds_ping_maxfwd = -1;
 int ds_probing_mode = 0;
@@ -156,6 +159,9 @@ event_id_t dispatch_evi_id;
 int fetch_freeswitch_stats;
 int max_freeswitch_weight = 100;
 
+int ds_ring_vnodes = 100;
+int ds_ring_load_bound;
+
 /** module functions */
 static int mod_init(void);
 static int ds_child_init(int rank);
@@ -295,6 +301,8 @@ static param_export_t params[]={
 	{"ds_ping_from",          STR_PARAM, &ds_ping_from.s},
 	{"ds_ping_interval",      INT_PARAM, &ds_ping_interval},
 	{"ds_ping_maxfwd",        INT_PARAM, &ds_ping_maxfwd},
+	{"ds_ping_max_inflight",  INT_PARAM, &ds_ping_max_inflight},
+	{"ds_ping_adaptive",      INT_PARAM, &ds_ping_adaptive},
 	{"ds_probing_mode",       INT_PARAM, &ds_probing_mode},
 	{"options_reply_codes",   STR_PARAM, &options_reply_codes_str.s},
 	{"ds_probing_sock",       STR_PARAM, &probing_sock_s},
@@ -303,12 +311,19 @@ static param_export_t params[]={
 	{"persistent_state",      INT_PARAM, &ds_persistent_state},
 	{"fetch_freeswitch_stats", INT_PARAM, &fetch_freeswitch_stats},
 	{"max_freeswitch_weight", INT_PARAM, &max_freeswitch_weight},
+	{"ring_vnodes",           INT_PARAM, &ds_ring_vnodes},
+	{"ring_load_bound",       INT_PARAM, &ds_ring_load_bound},
 	{"cluster_id",            INT_PARAM, &ds_cluster_id },
 	{"cluster_sharing_tag",   STR_PARAM, &ds_cluster_shtag },
 
 	{0,0,0}
 };
 
+static stat_export_t mod_stats[] = {
+	{"ds_probes_in_flight", STAT_NO_RESET, &ds_probes_in_flight},
+	{0,0,0}
+};
+
 static module_dependency_t *get_deps_ds_ping_interval(param_export_t *param)
 {
 	if (*(int *)param->param_pointer <= 0)
@@ -372,7 +387,7 @@ struct module_exports exports= {
 	cmds,
 	0,
 	params,
-	0,          /* exported statistics */
+	mod_stats,  /* exported statistics */
 	mi_cmds,    /* exported MI functions */
 	0,          /* exported pseudo-variables */
 	0,			/* exported transformations */
@@ -834,6 +849,18 @@ static int mod_init(void)
 		}
 	}
 
+	if (ds_ring_vnodes <= 0) {
+		LM_ERR("invalid ring_vnodes value: %d\n", ds_ring_vnodes);
+		return -1;
+	}
+
+	if (ds_ring_load_bound < 0 ||
+	(ds_ring_load_bound > 0 && ds_ring_load_bound <= 100)) {
+		LM_ERR("ring_load_bound must be 0 (disabled) or over 100, "
+			"not %d\n", ds_ring_load_bound);
+		return -1;
+	}
+
 	if(hash_pvar_param.s && (hash_pvar_param.len=strlen(hash_pvar_param.s))>0){
 		if(pv_parse_format(&hash_pvar_param, &hash_param_model) < 0
 				|| hash_param_model==NULL) {
@@ -963,9 +990,10 @@ next_part:
 			LM_ERR("could not load the TM-functions - disable DS ping\n");
 			return -1;
 		}
-		/* Register the PING-Timer */
+		/* Register the PING-Timer - it runs every second and only sends
+		 * the probes that are due, so they get spread over the interval */
 		if (register_timer("ds-pinger", ds_check_timer, NULL,
-		ds_ping_interval, TIMER_FLAG_DELAY_ON_DELAY)<0) {
+		1, TIMER_FLAG_DELAY_ON_DELAY)<0) {
 			LM_ERR("failed to register timer for probing!\n");
 			return -1;
 		}
@@ -0,0 +1,878 @@
+/*
+ * Copyright (C) 2026 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <arpa/nameser.h>
+#include <resolv.h>
+
+#include "../../dprint.h"
+#include "../../ut.h"
+#include "../../pt.h"
+#include "../../ipc.h"
+#include "../../route.h"
+#include "../../locking.h"
+#include "../../hash_func.h"
+#include "../../resolve.h"
+#include "../../ip_addr.h"
+#include "../../mem/mem.h"
+#include "../../mem/shm_mem.h"
+#include "../../parser/parse_uri.h"
+
+#include "dns_async.h"
+
+#define DNS_PENDING_SIZE   256 /* power of 2, the low bits of the query ids */
+
+/* sends of a query (each to the next nameserver) within async_query_timeout */
+#define DNS_QUERY_TRIES    4
+
+#define DNS_MAX_SERVERS    8
+
+/* how many records a single target may require (NAPTR, SRV, AAAA, A...) */
+#define DNS_MAX_ROUNDS     8
+
+#define DNS_WAKE_ANSWER    0
+#define DNS_WAKE_TIMEOUT   1 /* no (usable) answer, nothing was cached */
+
+struct dns_waiter {
+	int process_no;
+	async_ctx *ctx;
+	int status;
+	struct dns_waiter *next;
+};
+
+/* a query sent by one of the workers, with all the requests waiting for it */
+struct dns_pending {
+	char name[MAX_DNS_NAME];   /* the record, as looked up in the cache */
+	char qname[MAX_DNS_NAME];  /* the name actually queried for it */
+	int type;
+	int search;      /* index of qname in the search list of name */
+	unsigned short id;
+	int owner;       /* the process which sent the query */
+	int server;      /* the nameserver it was last sent to */
+	utime_t started; /* the query of qname */
+	utime_t sent;
+	struct dns_waiter *waiters;
+	struct dns_pending *next;
+};
+
+/* the state of a dns_resolve() call, in the private memory of its worker */
+struct dns_resolve_param {
+	async_ctx *ctx;
+	str host;
+	unsigned short port;
+	unsigned short proto;
+	int is_sips;
+	int rounds;
+	int status;
+	int last_type;
+	char last_name[MAX_DNS_NAME];
+};
+
+int dns_query_timeout = 2000; /* ms */
+char *dns_nameserver = NULL;
+
+stat_var *dns_async_queries;
+stat_var *dns_async_joined;
+stat_var *dns_async_timeouts;
+
+static struct dns_pending **dns_pending_tbl;
+static gen_lock_set_t *dns_pending_locks;
+
+static union sockaddr_union dns_ns[DNS_MAX_SERVERS];
+static int dns_ns_no;
+
+/* the query sockets of the current process, IPv4 and IPv6 */
+static int dns_socks[2] = {-1, -1};
+
+#define dns_sock_idx(_af) ((_af) == AF_INET6)
+
+
+static inline unsigned int dns_pending_hash(char *name, int type)
+{
+	str s;
+
+	s.s = name;
+	s.len = strlen(name);
+	return (core_case_hash(&s, NULL, 0) + type) & (DNS_PENDING_SIZE - 1);
+}
+
+static inline int dns_unqualified(const char *name)
+{
+	int dots = 0, len = strlen(name);
+	const char *p;
+
+	for (p = name; *p; p++)
+		if (*p == '.')
+			dots++;
+
+	return dots < _res.ndots && (!len || name[len - 1] != '.');
+}
+
+int dns_search_name(const char *name, int idx, char *out)
+{
+	int dots = 0, len = strlen(name), trailing, as_is_first;
+	int n_search = 0, dlen, i;
+	const char *p;
+
+	for (p = name; *p; p++)
+		if (*p == '.')
+			dots++;
+	trailing = len && name[len - 1] == '.';
+	as_is_first = dots >= _res.ndots || trailing;
+
+	if ((!dots && (_res.options & RES_DEFNAMES)) ||
+	(dots && !trailing && (_res.options & RES_DNSRCH)))
+		while (n_search < MAXDNSRCH && _res.dnsrch[n_search])
+			n_search++;
+
+	/* -1 and n_search stand for the name as is */
+	for (i = as_is_first ? -1 : 0; i <= n_search; i++) {
+		if (i == -1 || i == n_search) {
+			if (i == n_search && as_is_first)
+				break;
+			if (idx-- == 0) {
+				strcpy(out, name);
+				return 0;
+			}
+			continue;
+		}
+
+		dlen = strlen(_res.dnsrch[i]);
+		if (len + 1 + dlen >= MAX_DNS_NAME)
+			continue;
+		if (idx-- == 0) {
+			memcpy(out, name, len);
+			out[len] = '.';
+			memcpy(out + len + 1, _res.dnsrch[i], dlen + 1);
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+static int dns_add_nameserver(char *ns, int len)
+{
+	struct ip_addr *ip;
+	str host, port_s;
+	unsigned int port = NAMESERVER_PORT;
+	char *p;
+
+	host.s = ns;
+	host.len = len;
+	trim(&host);
+	ns = host.s;
+	len = host.len;
+
+	if (dns_ns_no == DNS_MAX_SERVERS) {
+		LM_ERR("too many nameservers, at most %d\n", DNS_MAX_SERVERS);
+		return -1;
+	}
+
+	if (host.s[0] == '[') {
+		/* [IPv6]:port */
+		p = q_memchr(host.s, ']', host.len);
+		if (!p)
+			goto error;
+		port_s.s = p + 1;
+		port_s.len = host.s + host.len - port_s.s;
+		host.s++;
+		host.len = p - host.s;
+	} else {
+		p = q_memchr(host.s, ':', host.len);
+		port_s.s = p ? p : host.s + host.len;
+		port_s.len = host.s + host.len - port_s.s;
+		host.len = port_s.s - host.s;
+	}
+
+	if (port_s.len) {
+		if (port_s.s[0] != ':')
+			goto error;
+		port_s.s++;
+		port_s.len--;
+		if (str2int(&port_s, &port) < 0 || port == 0 || port > 65535)
+			goto error;
+	}
+
+	if (!(ip = str2ip(&host)) && !(ip = str2ip6(&host)))
+		goto error;
+
+	init_su(&dns_ns[dns_ns_no++], ip, port);
+	return 0;
+
+error:
+	LM_ERR("bad nameserver <%.*s>, expected IP[:port]\n", len, ns);
+	return -1;
+}
+
+int dns_async_init(void)
+{
+	char *p, *next;
+	int i;
+
+	if (dns_nameserver) {
+		for (p = dns_nameserver; p; p = next) {
+			next = strchr(p, ',');
+			if (dns_add_nameserver(p, next ? next - p : strlen(p)) < 0)
+				return -1;
+			if (next)
+				next++;
+		}
+	} else {
+		/* the nameservers of the system resolver */
+		for (i = 0; i < _res.nscount && dns_ns_no < DNS_MAX_SERVERS;
+		i++) {
+			if (_res.nsaddr_list[i].sin_family == AF_INET) {
+				memcpy(&dns_ns[dns_ns_no++].sin,
+					&_res.nsaddr_list[i], sizeof(struct sockaddr_in));
+#ifdef __GLIBC__
+			} else if (_res._u._ext.nsaddrs[i] &&
+			_res._u._ext.nsaddrs[i]->sin6_family == AF_INET6) {
+				/* glibc keeps the IPv6 ones aside */
+				memcpy(&dns_ns[dns_ns_no++].sin6,
+					_res._u._ext.nsaddrs[i], sizeof(struct sockaddr_in6));
+#endif
+			}
+		}
+
+		if (!dns_ns_no)
+			LM_WARN("no nameserver found, dns_resolve() will "
+				"resolve in blocking mode\n");
+	}
+
+	if (dns_query_timeout <= 0) {
+		LM_ERR("bad async_query_timeout %d\n", dns_query_timeout);
+		return -1;
+	}
+
+	dns_pending_tbl = shm_malloc(DNS_PENDING_SIZE * sizeof *dns_pending_tbl);
+	if (!dns_pending_tbl) {
+		LM_ERR("oom\n");
+		return -1;
+	}
+	memset(dns_pending_tbl, 0, DNS_PENDING_SIZE * sizeof *dns_pending_tbl);
+
+	dns_pending_locks = lock_set_alloc(DNS_PENDING_SIZE);
+	if (!dns_pending_locks || !lock_set_init(dns_pending_locks)) {
+		LM_ERR("failed to init the query locks\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/* replays the lookups of sip_resolvehost() against the cache
+ * Returns: 1 - resolved, -1 - failed to resolve,
+ *          0 - a record is missing from the cache (dns_cache_miss_*) */
+static int dns_replay(struct dns_resolve_param *p)
+{
+	unsigned short port = p->port, proto = p->proto;
+	struct hostent *he;
+
+	dns_cache_miss_type = 0;
+	dns_cache_only = 1;
+	he = sip_resolvehost(&p->host, &port, &proto, p->is_sips, NULL);
+	dns_cache_only = 0;
+
+	if (dns_cache_miss_type)
+		return 0;
+
+	return (he && he->h_addr_list[0]) ? 1 : -1;
+}
+
+static struct dns_resolve_param *dns_new_param(str *target)
+{
+	struct dns_resolve_param *p;
+	struct sip_uri uri;
+	str host;
+
+	memset(&uri, 0, sizeof uri);
+	if (parse_uri(target->s, target->len, &uri) == 0) {
+		host = uri.maddr_val.len ? uri.maddr_val : uri.host;
+	} else {
+		/* not a SIP URI, just a host name */
+		memset(&uri, 0, sizeof uri);
+		host = *target;
+	}
+
+	if (host.len == 0 || host.len >= MAX_DNS_NAME) {
+		LM_ERR("bad host to resolve in <%.*s>\n", target->len, target->s);
+		return NULL;
+	}
+
+	p = pkg_malloc(sizeof *p + host.len + 1);
+	if (!p) {
+		LM_ERR("oom\n");
+		return NULL;
+	}
+	memset(p, 0, sizeof *p);
+
+	p->host.s = (char *)(p + 1);
+	p->host.len = host.len;
+	memcpy(p->host.s, host.s, host.len);
+	p->host.s[host.len] = 0;
+
+	p->port = uri.port_no;
+	p->proto = uri.proto;
+	p->is_sips = (uri.type == SIPS_URI_T);
+
+	return p;
+}
+
+
+static int dns_query_socks(void);
+
+static int dns_send_query(struct dns_pending *q)
+{
+	union sockaddr_union *to = &dns_ns[q->server];
+	union dns_query buf;
+	int len;
+
+	len = res_mkquery(QUERY, q->qname, C_IN, q->type, NULL, 0, NULL,
+		buf.buff, sizeof buf);
+	if (len < 0) {
+		LM_ERR("failed to build the query for %s - %d\n", q->qname, q->type);
+		return -1;
+	}
+
+	/* our own id, so that the answers to the pending queries and the late
+	 * answers to the expired ones are told apart */
+	buf.hdr.id = htons(q->id);
+
+	if (sendto(dns_socks[dns_sock_idx(to->s.sa_family)], buf.buff, len, 0,
+	&to->s, sockaddru_len(*to)) < 0) {
+		LM_ERR("failed to send the query for %s - %d (%d: %s)\n",
+			q->qname, q->type, errno, strerror(errno));
+		return -1;
+	}
+
+	q->sent = get_uticks();
+	return 0;
+}
+
+/* sends the query again, to the next nameserver */
+static void dns_retransmit(struct dns_pending *q)
+{
+	q->server = (q->server + 1) % dns_ns_no;
+
+	LM_DBG("querying %s - %d again (id %hu, nameserver %d)\n", q->qname,
+		q->type, q->id, q->server);
+	dns_send_query(q);
+}
+
+static struct dns_pending *dns_own_query(unsigned short id,
+											struct dns_pending ***prev)
+{
+	struct dns_pending *q, **p;
+
+	for (p = &dns_pending_tbl[id & (DNS_PENDING_SIZE - 1)]; (q = *p);
+	p = &q->next)
+		if (q->id == id && q->owner == process_no) {
+			if (prev)
+				*prev = p;
+			return q;
+		}
+
+	return NULL;
+}
+
+static void dns_retransmit_rpc(int sender, void *param)
+{
+	unsigned short id = (unsigned short)(unsigned long)param;
+	unsigned int h = id & (DNS_PENDING_SIZE - 1);
+	struct dns_pending *q;
+
+	lock_set_get(dns_pending_locks, h);
+	q = dns_own_query(id, NULL);
+	if (q)
+		dns_retransmit(q);
+	lock_set_release(dns_pending_locks, h);
+}
+
+/* sends the query for name:type, unless some worker already did it;
+ * the waiter (if any) is queued on the query */
+static int dns_query_record(char *name, int type, struct dns_waiter *w)
+{
+	static unsigned short next_id;
+	struct dns_pending *q;
+	unsigned int h;
+
+	if (dns_query_socks() < 0)
+		return -1;
+
+	h = dns_pending_hash(name, type);
+	lock_set_get(dns_pending_locks, h);
+
+	for (q = dns_pending_tbl[h]; q; q = q->next)
+		if (q->type == type && !strcasecmp(q->name, name))
+			break;
+
+	if (q) {
+		if (w) {
+			w->next = q->waiters;
+			q->waiters = w;
+		}
+		lock_set_release(dns_pending_locks, h);
+
+		update_stat(dns_async_joined, 1);
+		return 0;
+	}
+
+	q = shm_malloc(sizeof *q);
+	if (!q) {
+		lock_set_release(dns_pending_locks, h);
+		LM_ERR("oom\n");
+		return -1;
+	}
+	strcpy(q->name, name);
+	q->type = type;
+	q->search = 0;
+	/* the first name of the search list always fits */
+	dns_search_name(name, 0, q->qname);
+	if (!next_id)
+		next_id = rand();
+	/* the answer tells the slot of the query in its id */
+	q->id = (next_id++ * DNS_PENDING_SIZE) | h;
+	q->owner = process_no;
+	q->server = 0;
+	q->started = get_uticks();
+	q->waiters = w;
+	if (w)
+		w->next = NULL;
+
+	/* sent under the lock, so nobody joins a query which failed */
+	if (dns_send_query(q) < 0) {
+		lock_set_release(dns_pending_locks, h);
+		shm_free(q);
+		return -1;
+	}
+
+	q->next = dns_pending_tbl[h];
+	dns_pending_tbl[h] = q;
+	lock_set_release(dns_pending_locks, h);
+
+	LM_DBG("querying %s - %d (id %hu)\n", q->qname, q->type, q->id);
+	update_stat(dns_async_queries, 1);
+	return 0;
+}
+
+/* queues the request on the query of the missing record */
+static int dns_wait(struct dns_resolve_param *p)
+{
+	struct dns_waiter *w;
+
+	w = shm_malloc(sizeof *w);
+	if (!w) {
+		LM_ERR("oom\n");
+		return -1;
+	}
+	w->process_no = process_no;
+	w->ctx = p->ctx;
+	w->status = DNS_WAKE_ANSWER;
+
+	p->last_type = dns_cache_miss_type;
+	strcpy(p->last_name, dns_cache_miss_name);
+	p->status = DNS_WAKE_ANSWER;
+
+	if (dns_query_record(dns_cache_miss_name, dns_cache_miss_type, w) < 0) {
+		shm_free(w);
+		return -1;
+	}
+
+	return 0;
+}
+
+int dns_async_prefetch(char *name, int type)
+{
+	if (!dns_ns_no || strlen(name) >= MAX_DNS_NAME)
+		return -1;
+
+	return dns_query_record(name, type, NULL);
+}
+
+static void dns_resume_waiter(struct dns_waiter *w)
+{
+	async_ctx *ctx = w->ctx;
+
+	((struct dns_resolve_param *)ctx->resume_param)->status = w->status;
+	shm_free(w);
+
+	async_script_resume_f(ASYNC_FD_NONE, ctx, 0);
+}
+
+static void dns_wake_rpc(int sender, void *param)
+{
+	dns_resume_waiter((struct dns_waiter *)param);
+}
+
+static void dns_wake(struct dns_waiter *w, int status)
+{
+	struct dns_waiter *next;
+
+	for (; w; w = next) {
+		next = w->next;
+		w->status = status;
+
+		if (w->process_no == process_no) {
+			dns_resume_waiter(w);
+		} else if (ipc_send_rpc(w->process_no, dns_wake_rpc, w) < 0) {
+			LM_ERR("failed to resume a request in process %d\n",
+				w->process_no);
+			shm_free(w);
+		}
+	}
+}
+
+static int dns_resume(int fd, struct sip_msg *msg, void *param)
+{
+	struct dns_resolve_param *p = (struct dns_resolve_param *)param;
+	int rc;
+
+	if (p->status == DNS_WAKE_TIMEOUT) {
+		rc = -2;
+		goto done;
+	}
+
+	rc = dns_replay(p);
+	if (rc == 0) {
+		if (dns_cache_miss_type == p->last_type &&
+		!strcasecmp(dns_cache_miss_name, p->last_name)) {
+			/* answered, but not cacheable (TTL 0) - the resolver of the
+			 * core will have to query it again */
+			LM_DBG("%s - %d answered but not cached\n", p->last_name,
+				p->last_type);
+			rc = 1;
+		} else if (++p->rounds < DNS_MAX_ROUNDS && dns_wait(p) == 0) {
+			async_status = ASYNC_CONTINUE;
+			return 1;
+		} else {
+			rc = -1;
+		}
+	}
+
+done:
+	pkg_free(p);
+	return rc;
+}
+
+/*
+ * Returns 1 if the target was resolved, -1 if it does not resolve and -2
+ * if the nameserver did not answer in time (nothing cached)
+ */
+int w_dns_resolve(struct sip_msg *msg, async_ctx *ctx, str *target)
+{
+	struct dns_resolve_param *p;
+	int rc;
+
+	p = dns_new_param(target);
+	if (!p)
+		return -1;
+
+	rc = dns_replay(p);
+	if (rc != 0)
+		goto done;
+
+	if (!dns_ns_no || route_type != REQUEST_ROUTE) {
+		/* no way to wait here, let the resolver block */
+		rc = sip_resolvehost(&p->host, &p->port, &p->proto, p->is_sips,
+			NULL) ? 1 : -1;
+		goto done;
+	}
+
+	p->ctx = ctx;
+	if (dns_wait(p) < 0) {
+		rc = -1;
+		goto done;
+	}
+
+	ctx->resume_f = dns_resume;
+	ctx->resume_param = p;
+	async_status = ASYNC_NO_FD;
+	return 1;
+
+done:
+	pkg_free(p);
+	async_status = ASYNC_NO_IO;
+	return rc;
+}
+
+
+static int dns_known_server(union sockaddr_union *from)
+{
+	int i;
+
+	for (i = 0; i < dns_ns_no; i++)
+		if (su_cmp(from, &dns_ns[i]))
+			return 1;
+
+	return 0;
+}
+
+static void dns_handle_answer(union dns_query *buf, int len,
+												union sockaddr_union *from)
+{
+	char name[MAX_DNS_NAME];
+	struct dns_waiter *waiters;
+	struct dns_pending *q, **prev;
+	unsigned char *p, *end;
+	unsigned short id;
+	struct rdata *head;
+	unsigned int h;
+	int n, type, cache;
+
+	if (len < DNS_HDR_SIZE || !buf->hdr.qr || ntohs(buf->hdr.qdcount) != 1)
+		return;
+
+	if (!dns_known_server(from)) {
+		LM_DBG("DNS answer from unknown source, ignoring\n");
+		return;
+	}
+
+	p = buf->buff + DNS_HDR_SIZE;
+	end = buf->buff + len;
+	n = dn_expand(buf->buff, end, p, name, sizeof name);
+	if (n < 0 || p + n + 4 > end) {
+		LM_DBG("bad question in DNS answer\n");
+		return;
+	}
+	p += n;
+	type = (p[0] << 8) | p[1];
+	id = ntohs(buf->hdr.id);
+
+	h = id & (DNS_PENDING_SIZE - 1);
+	lock_set_get(dns_pending_locks, h);
+
+	q = dns_own_query(id, &prev);
+	if (!q || q->type != type || strcasecmp(q->qname, name)) {
+		lock_set_release(dns_pending_locks, h);
+		LM_DBG("no pending query for %s - %d (id %hu)\n", name, type, id);
+		return;
+	}
+
+	/* not there, try the next name of the search list, like res_search() */
+	if (!buf->hdr.tc &&
+	(buf->hdr.rcode != NOERROR || ntohs(buf->hdr.ancount) == 0) &&
+	dns_search_name(q->name, q->search + 1, name) == 0) {
+		q->search++;
+		strcpy(q->qname, name);
+		q->started = get_uticks();
+
+		LM_DBG("querying %s - %d for %s (id %hu)\n", q->qname, q->type,
+			q->name, q->id);
+		if (dns_send_query(q) == 0) {
+			lock_set_release(dns_pending_locks, h);
+			return;
+		}
+	}
+
+	*prev = q->next;
+	lock_set_release(dns_pending_locks, h);
+
+	waiters = q->waiters;
+	strcpy(name, q->name);
+	shm_free(q);
+
+	if (buf->hdr.tc) {
+		/* no retry over TCP here, leave it to the resolver of the core */
+		LM_DBG("truncated answer for %s - %d\n", name, type);
+		dns_wake(waiters, DNS_WAKE_TIMEOUT);
+		return;
+	}
+
+	cache = 1;
+
+	/* the same outcome as res_search() */
+	if (buf->hdr.rcode != NOERROR || ntohs(buf->hdr.ancount) == 0) {
+		len = -1;
+
+		/* a short name may still resolve differently for the core (other
+		 * resolv.conf options), so do not blacklist it; the waiters find
+		 * it missing and let the core query it */
+		if (dns_unqualified(name)) {
+			LM_DBG("%s - %d not found, not caching it\n", name, type);
+			cache = 0;
+		}
+	}
+
+	/* parsed only to be stored in the cache */
+	if (!cache) {
+		/* nothing */
+	} else if (type == T_A || type == T_AAAA) {
+		parse_he_answer(name, type == T_A ? AF_INET : AF_INET6, buf, len);
+	} else {
+		head = parse_record_answer(name, type, buf, len);
+		if (head)
+			free_rdata_list(head);
+	}
+
+	dns_wake(waiters, DNS_WAKE_ANSWER);
+}
+
+static int dns_read_answers(int fd, void *param)
+{
+	static union dns_query buf;
+	union sockaddr_union from;
+	socklen_t from_len;
+	int len;
+
+	for (;;) {
+		from_len = sizeof from;
+		len = recvfrom(fd, buf.buff, sizeof buf, MSG_DONTWAIT, &from.s,
+			&from_len);
+		if (len < 0)
+			break;
+		dns_handle_answer(&buf, len, &from);
+	}
+
+	if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+		LM_ERR("failed to read DNS answer (%d: %s)\n", errno, strerror(errno));
+
+	async_status = ASYNC_CONTINUE;
+	return 0;
+}
+
+int dns_async_wait(int timeout_ms)
+{
+	struct pollfd pfd[2];
+	int i, n = 0, rc;
+
+	for (i = 0; i < 2; i++)
+		if (dns_socks[i] >= 0) {
+			pfd[n].fd = dns_socks[i];
+			pfd[n++].events = POLLIN;
+		}
+
+	if (!n)
+		return 0;
+
+	rc = poll(pfd, n, timeout_ms);
+	if (rc <= 0)
+		return rc;
+
+	for (i = 0; i < n; i++)
+		if (pfd[i].revents & POLLIN)
+			dns_read_answers(pfd[i].fd, NULL);
+
+	return rc;
+}
+
+/* the query socket of the worker for the nameservers of the family; its
+ * answers are matched against the nameservers */
+static int dns_new_sock(int af)
+{
+	int fd, flags;
+
+	fd = socket(af, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		LM_ERR("failed to create the query socket (%d: %s)\n",
+			errno, strerror(errno));
+		return -1;
+	}
+
+	flags = fcntl(fd, F_GETFL);
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+		LM_ERR("failed to set the query socket as non-blocking\n");
+		goto error;
+	}
+
+	if (register_async_fd(fd, dns_read_answers, NULL) < 0) {
+		LM_ERR("failed to watch the query socket\n");
+		goto error;
+	}
+
+	return fd;
+
+error:
+	close(fd);
+	return -1;
+}
+
+static int dns_query_socks(void)
+{
+	int i, idx;
+
+	for (i = 0; i < dns_ns_no; i++) {
+		idx = dns_sock_idx(dns_ns[i].s.sa_family);
+		if (dns_socks[idx] < 0 &&
+		(dns_socks[idx] = dns_new_sock(dns_ns[i].s.sa_family)) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+
+/* sends again the queries not answered for a while and fails the ones not
+ * answered in time */
+void dns_async_timer(utime_t uticks, void *param)
+{
+	struct dns_pending *q, **prev, *expired = NULL;
+	utime_t now = get_uticks();
+	utime_t timeout = (utime_t)dns_query_timeout * 1000;
+	unsigned int h;
+
+	for (h = 0; h < DNS_PENDING_SIZE; h++) {
+		if (!dns_pending_tbl[h])
+			continue;
+
+		lock_set_get(dns_pending_locks, h);
+		for (prev = &dns_pending_tbl[h]; (q = *prev); ) {
+			if (now - q->started < timeout) {
+				if (now - q->sent >= timeout / DNS_QUERY_TRIES) {
+					/* only its owner may send it, over its own socket */
+					q->sent = now;
+					if (q->owner == process_no)
+						dns_retransmit(q);
+					else if (ipc_send_rpc(q->owner, dns_retransmit_rpc,
+					(void *)(unsigned long)q->id) < 0)
+						LM_ERR("failed to send %s - %d again\n", q->qname,
+							q->type);
+				}
+
+				prev = &q->next;
+				continue;
+			}
+
+			*prev = q->next;
+			q->next = expired;
+			expired = q;
+		}
+		lock_set_release(dns_pending_locks, h);
+	}
+
+	while ((q = expired)) {
+		expired = q->next;
+
+		LM_WARN("no answer for %s - %d in %d ms\n", q->qname, q->type,
+			dns_query_timeout);
+		update_stat(dns_async_timeouts, 1);
+
+		dns_wake(q->waiters, DNS_WAKE_TIMEOUT);
+		shm_free(q);
+	}
+}
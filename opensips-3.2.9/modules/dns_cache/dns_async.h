@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2026 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Non-blocking DNS resolving: the lookups of sip_resolvehost() are first
+ * replayed against the cache only; each record missing from the cache is
+ * queried over a non-blocking UDP socket watched by the reactor of the
+ * worker, while the script waits in async mode. A record already being
+ * queried by any worker is not queried again - the new waiters are simply
+ * queued on the pending query and are all resumed when its answer lands
+ * in the cache.
+ *
+ * A query goes to the first nameserver and, while not answered, again to
+ * the next ones, DNS_QUERY_TRIES times within async_query_timeout. Just
+ * like res_search(), the names are looked up through the search list of
+ * resolv.conf (as the "ndots" option dictates), the answer being cached
+ * under the name asked for.
+ */
+
+#ifndef _DNS_CACHE_ASYNC_H
+#define _DNS_CACHE_ASYNC_H
+
+#include "../../async.h"
+#include "../../statistics.h"
+#include "../../timer.h"
+
+extern int dns_query_timeout;
+extern char *dns_nameserver;
+
+extern stat_var *dns_async_queries;
+extern stat_var *dns_async_joined;
+extern stat_var *dns_async_timeouts;
+
+int dns_async_init(void);
+
+int w_dns_resolve(struct sip_msg *msg, async_ctx *ctx, str *target);
+
+/* queries the record in background, only from the async resolving */
+int dns_async_prefetch(char *name, int type);
+
+void dns_async_timer(utime_t uticks, void *param);
+
+/* the idx-th name res_search() queries when looking up name, -1 if none */
+int dns_search_name(const char *name, int idx, char *out);
+
+/* waits for the answers to the queries of the current process and handles
+ * them, for the processes not watching the query sockets in their reactor
+ * (e.g. the unit tests) */
+int dns_async_wait(int timeout_ms);
+
+#endif
@@ -40,6 +40,9 @@
 #include "../../cachedb/cachedb.h"
 #include "../../cachedb/cachedb_cap.h"
 
+#include "dns_async.h"
+#include "dns_shm.h"
+
 static int mod_init(void);
 static int child_init(int);
 static void destroy(void);
@@ -47,6 +50,7 @@ static void destroy(void);
 int put_dnscache_value(char *name,int r_type,void *record,int rdata_len,
 				int failure,int ttl);
 void* get_dnscache_value(char *name,int r_type,int name_len);
+static void* decode_dnscache_value(char *buf,int len,int r_type);
 
 static cachedb_funcs cdbf;
 static cachedb_con *cdbc = 0;
@@ -57,15 +61,39 @@ static str cachedb_url = {0,0};
 static param_export_t params[]={
 	{ "cachedb_url",                 STR_PARAM, &cachedb_url.s},
 	{ "blacklist_timeout",           INT_PARAM, &blacklist_timeout},
+	{ "async_query_timeout",         INT_PARAM, &dns_query_timeout},
+	{ "async_nameserver",            STR_PARAM, &dns_nameserver},
+	{ "cache_hash_size",             INT_PARAM, &dns_shm_hash_size},
+	{ "prefetch_ratio",              INT_PARAM, &dns_prefetch_ratio},
+	{ "prefetch_min_hits",           INT_PARAM, &dns_prefetch_hits},
+	{0,0,0}
+};
+
+static acmd_export_t acmds[] = {
+	{"dns_resolve", (acmd_function)w_dns_resolve, {
+		{CMD_PARAM_STR, 0, 0}, {0,0,0}}},
+	{0,0,{{0,0,0}}}
+};
+
+static stat_export_t mod_stats[] = {
+	{"async_queries",       0,  &dns_async_queries   },
+	{"async_joined",        0,  &dns_async_joined    },
+	{"async_timeouts",      0,  &dns_async_timeouts  },
+	{"cache_hits",          0,              &dns_shm_hits        },
+	{"cache_misses",        0,              &dns_shm_misses      },
+	{"cache_hit_ratio",     STAT_IS_FUNC,   (stat_var**)dns_shm_hit_ratio },
+	{"cache_entries",       STAT_NO_RESET,  &dns_shm_entries     },
+	{"cache_prefetches",    0,              &dns_shm_prefetches  },
+	{"cache_evictions",     0,              &dns_shm_evictions   },
 	{0,0,0}
 };
 
 static dep_export_t deps = {
 	{ /* OpenSIPS module dependencies */
-		{ MOD_TYPE_CACHEDB, NULL, DEP_ABORT },
 		{ MOD_TYPE_NULL, NULL, 0 },
 	},
 	{ /* modparam dependencies */
+		{ "cachedb_url", get_deps_cachedb_url },
 		{ NULL, NULL },
 	},
 };
@@ -79,9 +107,9 @@ struct module_exports exports= {
 	0,							/* load function */
 	&deps,              /* OpenSIPS module dependencies */
 	0,					/* exported functions */
-	0,					/* exported async functions */
+	acmds,				/* exported async functions */
 	params,					/* exported parameters */
-	0,					/* exported statistics */
+	mod_stats,				/* exported statistics */
 	0,					/* exported MI functions */
 	0,					/* exported pseudo-variables */
 	0,			 		/* exported transformations */
@@ -102,8 +130,18 @@ static int mod_init(void)
 	LM_NOTICE("initializing module dns_cache ...\n");
 
 	if (cachedb_url.s == NULL) {
-		LM_ERR("no cachedb_url set !\n");
-		return -1;
+		LM_DBG("no cachedb_url set, using the shm cache\n");
+
+		if (dns_shm_init(decode_dnscache_value) < 0) {
+			LM_ERR("failed to init the shm cache\n");
+			return -1;
+		}
+
+		if (register_timer("dns-cache-expire", dns_shm_timer, NULL, 1,
+		TIMER_FLAG_DELAY_ON_DELAY) < 0) {
+			LM_ERR("failed to register the cache expiration timer\n");
+			return -1;
+		}
 	} else {
 		cachedb_url.len = strlen(cachedb_url.s);
 		LM_DBG("using CacheDB URL: %s\n", cachedb_url.s);
@@ -113,11 +151,25 @@ static int mod_init(void)
 	dnscache_fetch_func=get_dnscache_value;
 	dnscache_put_func=put_dnscache_value;
 
+	if (dns_async_init() < 0) {
+		LM_ERR("failed to init async resolving\n");
+		return -1;
+	}
+
+	if (register_utimer("dns-async-timeout", dns_async_timer, NULL,
+	100*1000, TIMER_FLAG_DELAY_ON_DELAY) < 0) {
+		LM_ERR("failed to register the query timeout timer\n");
+		return -1;
+	}
+
 	return 0;
 }
 
 static int child_init(int rank)
 {
+	if (cachedb_url.s == NULL)
+		return 0;
+
 	if (cachedb_bind_mod(&cachedb_url, &cdbf) < 0) {
 		LM_ERR("cannot bind functions for db_url %.*s\n",
 				cachedb_url.len, cachedb_url.s);
@@ -383,12 +435,12 @@ static char* serialize_dns_rdata(struct rdata *head,int buf_len,int *len,int do_
 		switch (it->type) {
 			case T_A:
 				/* copy all 4 bytes */
-				memcpy(p,it->rdata,sizeof(struct a_rdata));
+				memcpy(it->rdata,p,sizeof(struct a_rdata));
 				p+=sizeof(struct a_rdata);
 				break;
 			case T_AAAA:
 				/* copy all 16 bytes */
-				memcpy(p,it->rdata,sizeof(struct aaaa_rdata));
+				memcpy(it->rdata,p,sizeof(struct aaaa_rdata));
 				p+=sizeof(struct aaaa_rdata);
 				break;
 			case T_CNAME:
@@ -478,8 +530,8 @@ static unsigned char *dec_rdata_buf=NULL;
 static int dec_rdata_buf_len=0;
 static struct rdata* deserialize_dns_rdata(char *buff,int buf_len,int do_decoding)
 {
-	unsigned char *p;
-	int max_len=0,actual_len=0,entry_len=0;
+	unsigned char *p,*end;
+	int max_len=0,entry_len=0;
 	struct rdata *head,*it,**last;
 	struct naptr_rdata *naptr_rd;
 	struct srv_rdata *srv_rd;
@@ -491,31 +543,27 @@ static struct rdata* deserialize_dns_rdata(char *buff,int buf_len,int do_decodin
 
 	if (do_decoding) {
 		max_len = calc_max_base64_decode_len(buf_len);
-	} else {
-		max_len = buf_len;
-	}
 
-	if (dec_rdata_buf == NULL || max_len > dec_rdata_buf_len) {
-		/* realloc buff if not enough space */
-		dec_rdata_buf = pkg_realloc(dec_rdata_buf,max_len);
-		if (dec_rdata_buf == NULL) {
-			LM_ERR("No more pkg\n");
-			return NULL;
+		if (dec_rdata_buf == NULL || max_len > dec_rdata_buf_len) {
+			/* realloc buff if not enough space */
+			dec_rdata_buf = pkg_realloc(dec_rdata_buf,max_len);
+			if (dec_rdata_buf == NULL) {
+				LM_ERR("No more pkg\n");
+				return NULL;
+			}
+			dec_rdata_buf_len = max_len;
 		}
-		dec_rdata_buf_len = max_len;
-	}
 
-	if (do_decoding) {
 		/* decode base64 buf */
-		actual_len = base64decode(dec_rdata_buf,(unsigned char *)buff,buf_len);
 		p = dec_rdata_buf;
+		end = p + base64decode(dec_rdata_buf,(unsigned char *)buff,buf_len);
 	} else {
-		memcpy(dec_rdata_buf,buff,buf_len);
-		actual_len = buf_len;
-		p = dec_rdata_buf;
+		/* everything is copied out of it, no need for a private copy */
+		p = (unsigned char *)buff;
+		end = p + buf_len;
 	}
 
-	while ( p < dec_rdata_buf+actual_len) {
+	while ( p < end) {
 		it = pkg_malloc(sizeof(struct rdata));
 		if (it == 0) {
 			LM_ERR("no more pkg mem\n");
@@ -760,6 +808,73 @@ int get_dnscache_strvalue(char *name,int r_type,int name_len,str *res)
 #define FAILURE_MARKER		"|"
 #define FAILURE_MARKER_LEN	1
 
+static void* decode_dnscache_value(char *buf,int len,int r_type)
+{
+	if (r_type == T_A || r_type == T_AAAA || r_type == T_PTR)
+		return deserialize_he_rdata(buf,len,0);
+	else
+		return deserialize_dns_rdata(buf,len,0);
+}
+
+static void* get_shm_dnscache_value(char *name,int r_type,int name_len)
+{
+	str key;
+	void *value;
+	/* only the async resolving runs in workers able to wait for an answer
+	 * (see dns_async.c) */
+	int async = dns_cache_only && r_type != T_PTR;
+
+	key.s=create_keyname_for_record(name,r_type,name_len,&key.len);
+	if (key.s == NULL) {
+		LM_ERR("failed to create key\n");
+		return NULL;
+	}
+
+	switch (dns_shm_get(&key,r_type,&value,async)) {
+		case DNS_SHM_HIT:
+			return value;
+		case DNS_SHM_PREFETCH:
+			dns_async_prefetch(name,r_type);
+			return value;
+		case DNS_SHM_FAILED:
+			LM_DBG("blacklisted value %s for type %d\n",name,r_type);
+			return (void *)-1;
+		default:
+			return NULL;
+	}
+}
+
+static int put_shm_dnscache_value(char *name,int r_type,void *record,
+		int rdata_len,int failure,int ttl)
+{
+	str key,value;
+
+	key.s=create_keyname_for_record(name,r_type,rdata_len,&key.len);
+	if (key.s == NULL) {
+		LM_ERR("failed to create key\n");
+		return -1;
+	}
+
+	if (failure) {
+		value.s = NULL;
+		value.len = 0;
+		ttl = blacklist_timeout;
+	} else if (r_type == T_A || r_type == T_AAAA || r_type == T_PTR) {
+		value.s = serialize_he_rdata((struct hostent *)record,&value.len,0);
+	} else {
+		value.s = serialize_dns_rdata((struct rdata *)record,rdata_len,
+			&value.len,0);
+	}
+
+	if (!failure && value.s == NULL) {
+		LM_ERR("failed to serialize the record\n");
+		return -1;
+	}
+
+	LM_DBG("putting key [%.*s] ttl = %d\n",key.len,key.s,ttl);
+	return dns_shm_put(&key,value.s,value.len,failure,ttl);
+}
+
 /* Returns hostent or rdata struct, based on what callers needs */
 void* get_dnscache_value(char *name,int r_type,int name_len)
 {
@@ -767,6 +882,9 @@ void* get_dnscache_value(char *name,int r_type,int name_len)
 	struct hostent *he;
 	struct rdata *head;
 
+	if (cachedb_url.s == NULL)
+		return get_shm_dnscache_value(name,r_type,name_len);
+
 	if (cdbc == NULL) {
 		/* assume dns request before forking - cache is not ready yet */
 		return NULL;
@@ -829,11 +947,6 @@ int put_dnscache_value(char *name,int r_type,void *record,int rdata_len,
 	str key,value;
 	int key_ttl;
 
-	if (cdbc == NULL) {
-		/* assume dns request before forking - cache is not ready yet */
-		return 1;
-	}
-
 	/* avoid caching records with TTL=0 */
 	if (!failure && ttl==0) {
 		/* RFC1035 states : "Zero TTL values are interpreted to mean that
@@ -842,6 +955,15 @@ int put_dnscache_value(char *name,int r_type,void *record,int rdata_len,
 		return 1;
 	}
 
+	if (cachedb_url.s == NULL)
+		return put_shm_dnscache_value(name,r_type,record,rdata_len,
+			failure,ttl);
+
+	if (cdbc == NULL) {
+		/* assume dns request before forking - cache is not ready yet */
+		return 1;
+	}
+
 	/* generate key */
 	key.s=create_keyname_for_record(name,r_type,rdata_len,&key.len);
 	if (key.s == NULL) {
@@ -0,0 +1,326 @@
+/*
+ * Copyright (C) 2026 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "../../dprint.h"
+#include "../../timer.h"
+#include "../../locking.h"
+#include "../../hash_func.h"
+#include "../../mem/shm_mem.h"
+
+#include "dns_shm.h"
+
+#define DNS_WHEEL_SIZE   128 /* seconds */
+#define DNS_SHM_LOCKS    256
+#define DNS_MAX_TTL      (7 * 24 * 3600)
+
+struct dns_entry {
+	unsigned int hash;
+	int key_len;
+	int value_len;
+	unsigned int expires;
+	unsigned int ttl;
+	unsigned int hits;
+	unsigned char failure;
+	unsigned char refreshing;
+	unsigned char dead;       /* no longer in the hash table */
+	struct dns_entry *next;
+	struct dns_entry *wheel_next;
+	/* followed by the key and the value */
+};
+
+#define entry_key(_e)    ((char *)((_e) + 1))
+#define entry_value(_e)  (entry_key(_e) + (_e)->key_len)
+
+struct dns_wheel_slot {
+	gen_lock_t lock;
+	struct dns_entry *first;
+};
+
+int dns_shm_hash_size = 4096;
+int dns_prefetch_ratio = 10; /* % of the TTL */
+int dns_prefetch_hits = 3;
+
+stat_var *dns_shm_hits;
+stat_var *dns_shm_misses;
+stat_var *dns_shm_entries;
+stat_var *dns_shm_prefetches;
+stat_var *dns_shm_evictions;
+
+static struct dns_entry **dns_table;
+static gen_lock_set_t *dns_table_locks;
+static struct dns_wheel_slot *dns_wheel;
+static unsigned int *dns_last_sweep;
+
+static dns_decode_f *dns_decode;
+
+#define dns_bucket(_h)   ((_h) & (dns_shm_hash_size - 1))
+#define dns_lock(_h)     lock_set_get(dns_table_locks, (_h) % DNS_SHM_LOCKS)
+#define dns_unlock(_h)   lock_set_release(dns_table_locks, (_h) % DNS_SHM_LOCKS)
+
+
+int dns_shm_init(dns_decode_f *decode)
+{
+	int i;
+
+	if (dns_shm_hash_size <= 0) {
+		LM_ERR("bad cache_hash_size %d\n", dns_shm_hash_size);
+		return -1;
+	}
+
+	/* round it up to a power of 2 */
+	for (i = 1; i < dns_shm_hash_size; i <<= 1);
+	dns_shm_hash_size = i;
+
+	if (dns_prefetch_ratio < 0 || dns_prefetch_ratio >= 100) {
+		LM_ERR("bad prefetch_ratio %d, expected 0-99\n", dns_prefetch_ratio);
+		return -1;
+	}
+
+	dns_table = shm_malloc(dns_shm_hash_size * sizeof *dns_table +
+		DNS_WHEEL_SIZE * sizeof *dns_wheel + sizeof *dns_last_sweep);
+	if (!dns_table) {
+		LM_ERR("oom\n");
+		return -1;
+	}
+	memset(dns_table, 0, dns_shm_hash_size * sizeof *dns_table +
+		DNS_WHEEL_SIZE * sizeof *dns_wheel + sizeof *dns_last_sweep);
+
+	dns_wheel = (struct dns_wheel_slot *)(dns_table + dns_shm_hash_size);
+	for (i = 0; i < DNS_WHEEL_SIZE; i++)
+		lock_init(&dns_wheel[i].lock);
+
+	dns_last_sweep = (unsigned int *)(dns_wheel + DNS_WHEEL_SIZE);
+	*dns_last_sweep = get_ticks();
+
+	dns_table_locks = lock_set_alloc(DNS_SHM_LOCKS);
+	if (!dns_table_locks || !lock_set_init(dns_table_locks)) {
+		LM_ERR("failed to init the cache locks\n");
+		return -1;
+	}
+
+	dns_decode = decode;
+	return 0;
+}
+
+
+static inline struct dns_entry *dns_lookup(str *key, unsigned int hash)
+{
+	struct dns_entry *e;
+
+	for (e = dns_table[dns_bucket(hash)]; e; e = e->next)
+		if (e->hash == hash && e->key_len == key->len &&
+		!memcmp(entry_key(e), key->s, key->len))
+			return e;
+
+	return NULL;
+}
+
+/* is it worth refreshing the entry before it expires? */
+static inline int dns_hot_entry(struct dns_entry *e, unsigned int now)
+{
+	return dns_prefetch_ratio && !e->failure && !e->refreshing &&
+		e->hits >= dns_prefetch_hits &&
+		(e->expires - now) * 100 <= e->ttl * dns_prefetch_ratio;
+}
+
+int dns_shm_get(str *key, int r_type, void **value, int async_refresh)
+{
+	struct dns_entry *e;
+	unsigned int hash, now = get_ticks();
+	int rc;
+
+	hash = core_hash(key, NULL, 0);
+	dns_lock(hash);
+
+	e = dns_lookup(key, hash);
+	if (!e || e->expires <= now) {
+		dns_unlock(hash);
+		update_stat(dns_shm_misses, 1);
+		return DNS_SHM_MISS;
+	}
+
+	update_stat(dns_shm_hits, 1);
+	e->hits++;
+
+	if (e->failure) {
+		dns_unlock(hash);
+		return DNS_SHM_FAILED;
+	}
+
+	rc = DNS_SHM_HIT;
+	if (dns_hot_entry(e, now)) {
+		e->refreshing = 1;
+		update_stat(dns_shm_prefetches, 1);
+
+		if (!async_refresh) {
+			/* let this caller query it, the others still get it */
+			dns_unlock(hash);
+			LM_DBG("refreshing [%.*s] (%u hits)\n", key->len, key->s,
+				e->hits);
+			return DNS_SHM_MISS;
+		}
+
+		rc = DNS_SHM_PREFETCH;
+	}
+
+	*value = dns_decode(entry_value(e), e->value_len, r_type);
+	dns_unlock(hash);
+
+	if (*value == NULL) {
+		LM_ERR("failed to decode [%.*s]\n", key->len, key->s);
+		return DNS_SHM_MISS;
+	}
+
+	return rc;
+}
+
+
+int dns_shm_put(str *key, char *value, int value_len, int failure, int ttl)
+{
+	struct dns_entry *e, *old, **p;
+	struct dns_wheel_slot *slot;
+	unsigned int now = get_ticks();
+
+	if (ttl <= 0 || ttl > DNS_MAX_TTL)
+		ttl = DNS_MAX_TTL;
+
+	e = shm_malloc(sizeof *e + key->len + value_len);
+	if (!e) {
+		LM_ERR("oom\n");
+		return -1;
+	}
+	memset(e, 0, sizeof *e);
+
+	e->hash = core_hash(key, NULL, 0);
+	e->key_len = key->len;
+	memcpy(entry_key(e), key->s, key->len);
+	e->value_len = value_len;
+	memcpy(entry_value(e), value, value_len);
+	e->failure = failure;
+	e->ttl = ttl;
+	e->expires = now + ttl;
+
+	dns_lock(e->hash);
+
+	/* the new entry replaces the old one, which is only freed by the
+	 * expiration timer */
+	for (p = &dns_table[dns_bucket(e->hash)]; (old = *p); p = &old->next)
+		if (old->hash == e->hash && old->key_len == key->len &&
+		!memcmp(entry_key(old), key->s, key->len)) {
+			if (failure && !old->failure && old->expires > now) {
+				/* a failed refresh - keep the records until they expire */
+				dns_unlock(e->hash);
+				shm_free(e);
+				return 0;
+			}
+
+			*p = old->next;
+			old->dead = 1;
+			update_stat(dns_shm_entries, -1);
+			break;
+		}
+
+	e->next = dns_table[dns_bucket(e->hash)];
+	dns_table[dns_bucket(e->hash)] = e;
+	update_stat(dns_shm_entries, 1);
+
+	dns_unlock(e->hash);
+
+	slot = &dns_wheel[e->expires % DNS_WHEEL_SIZE];
+	lock_get(&slot->lock);
+	e->wheel_next = slot->first;
+	slot->first = e;
+	lock_release(&slot->lock);
+
+	return 0;
+}
+
+
+unsigned long dns_shm_hit_ratio(void *foo)
+{
+	unsigned long hits, total;
+
+	hits = get_stat_val(dns_shm_hits);
+	total = hits + get_stat_val(dns_shm_misses);
+
+	return total ? hits * 100 / total : 0;
+}
+
+
+/* frees the expired entries of a slot, the others are linked back */
+static void dns_sweep_slot(struct dns_wheel_slot *slot, unsigned int now)
+{
+	struct dns_entry *e, *next, *keep = NULL, **p;
+
+	lock_get(&slot->lock);
+	e = slot->first;
+	slot->first = NULL;
+	lock_release(&slot->lock);
+
+	for (; e; e = next) {
+		next = e->wheel_next;
+
+		if (!e->dead && e->expires > now) {
+			e->wheel_next = keep;
+			keep = e;
+			continue;
+		}
+
+		dns_lock(e->hash);
+		if (!e->dead) {
+			for (p = &dns_table[dns_bucket(e->hash)]; *p; p = &(*p)->next)
+				if (*p == e) {
+					*p = e->next;
+					break;
+				}
+			update_stat(dns_shm_entries, -1);
+			update_stat(dns_shm_evictions, 1);
+		}
+		dns_unlock(e->hash);
+
+		shm_free(e);
+	}
+
+	if (!keep)
+		return;
+
+	lock_get(&slot->lock);
+	for (e = keep; e->wheel_next; e = e->wheel_next);
+	e->wheel_next = slot->first;
+	slot->first = keep;
+	lock_release(&slot->lock);
+}
+
+void dns_shm_timer(unsigned int ticks, void *param)
+{
+	unsigned int now = get_ticks(), t;
+
+	/* catch up with the slots skipped while the timer was delayed */
+	t = *dns_last_sweep;
+	if (now - t > DNS_WHEEL_SIZE)
+		t = now - DNS_WHEEL_SIZE;
+
+	for (t++; t <= now; t++)
+		dns_sweep_slot(&dns_wheel[t % DNS_WHEEL_SIZE], now);
+
+	*dns_last_sweep = now;
+}
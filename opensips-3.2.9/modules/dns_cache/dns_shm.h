@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2026 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Native DNS cache, kept in shared memory (used when no cachedb_url is
+ * set). Each record is a single shm chunk - the entry, its key and the
+ * serialized (pointer free) value - found via a hash table and also linked
+ * into a wheel of one second slots, by its expiration time, so the expired
+ * entries are dropped without scanning the whole cache.
+ *
+ * Entries are only freed by the expiration timer: a replaced entry is just
+ * taken out of the hash table and marked as dead, and the timer frees it
+ * when its slot comes up.
+ */
+
+#ifndef _DNS_CACHE_SHM_H
+#define _DNS_CACHE_SHM_H
+
+#include "../../str.h"
+#include "../../statistics.h"
+
+#define DNS_SHM_MISS      0
+#define DNS_SHM_HIT       1  /* the value was decoded */
+#define DNS_SHM_FAILED    2  /* a failed query */
+#define DNS_SHM_PREFETCH  3  /* hit, and the caller must refresh the entry */
+
+/* rebuilds the record out of its serialized value */
+typedef void *(dns_decode_f)(char *buf, int len, int r_type);
+
+extern int dns_shm_hash_size;
+extern int dns_prefetch_ratio;
+extern int dns_prefetch_hits;
+
+extern stat_var *dns_shm_hits;
+extern stat_var *dns_shm_misses;
+extern stat_var *dns_shm_entries;
+extern stat_var *dns_shm_prefetches;
+extern stat_var *dns_shm_evictions;
+
+int dns_shm_init(dns_decode_f *decode);
+
+/* @async_refresh: the caller is able to refresh the entry in background;
+ * if not, the caller chosen to refresh an entry about to expire gets a
+ * miss, while the others still get the cached value */
+int dns_shm_get(str *key, int r_type, void **value, int async_refresh);
+
+int dns_shm_put(str *key, char *value, int value_len, int failure, int ttl);
+
+unsigned long dns_shm_hit_ratio(void *foo);
+
+void dns_shm_timer(unsigned int ticks, void *param);
+
+#endif
@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2026 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <tap.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <arpa/nameser.h>
+#include <resolv.h>
+
+#include "../../../dprint.h"
+#include "../../../resolve.h"
+#include "../../../reactor_defs.h"
+
+#include "../dns_async.h"
+
+/* see opensips.cfg: the first nameserver is a dead one */
+#define NS_PORT        53531
+#define QUERY_TIMEOUT  400    /* ms */
+
+#define HOST_ADDR      "192.0.2.10"
+
+
+static inline long long now_ms(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000LL + tv.tv_usec / 1000;
+}
+
+/*
+ * Stand-in nameserver: "host.corp.test" has an A record, the names starting
+ * with "drop" get no answer at all, anything else does not exist
+ */
+static void ns_serve(int fd)
+{
+	unsigned char buf[512], *p, *end;
+	char name[MAX_DNS_NAME];
+	union sockaddr_union from;
+	socklen_t from_len;
+	HEADER *hdr = (HEADER *)buf;
+	struct in_addr addr;
+	int len, n, type;
+
+	for (;;) {
+		from_len = sizeof from;
+		len = recvfrom(fd, buf, sizeof buf, 0, &from.s, &from_len);
+		if (len < (int)sizeof *hdr)
+			continue;
+
+		p = buf + sizeof *hdr;
+		end = buf + len;
+		n = dn_expand(buf, end, p, name, sizeof name);
+		if (n < 0 || p + n + 4 > end)
+			continue;
+		type = (p[n] << 8) | p[n + 1];
+		end = p + n + 4;
+
+		if (!strncasecmp(name, "drop", 4))
+			continue;
+
+		hdr->qr = 1;
+		hdr->ra = 1;
+		hdr->arcount = hdr->nscount = 0;
+
+		if (!strcasecmp(name, "host.corp.test") && type == T_A) {
+			hdr->rcode = NOERROR;
+			hdr->ancount = htons(1);
+
+			/* the name is a pointer to the question */
+			*end++ = 0xc0;
+			*end++ = sizeof *hdr;
+			NS_PUT16(T_A, end);
+			NS_PUT16(C_IN, end);
+			NS_PUT32(60, end);
+			NS_PUT16(4, end);
+			inet_pton(AF_INET, HOST_ADDR, &addr);
+			memcpy(end, &addr, 4);
+			end += 4;
+		} else {
+			hdr->rcode = NXDOMAIN;
+			hdr->ancount = 0;
+		}
+
+		sendto(fd, buf, end - buf, 0, &from.s, from_len);
+	}
+}
+
+static pid_t ns_start(void)
+{
+	struct sockaddr_in sin;
+	pid_t pid;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		return -1;
+
+	memset(&sin, 0, sizeof sin);
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(NS_PORT);
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(fd, (struct sockaddr *)&sin, sizeof sin) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	pid = fork();
+	if (pid == 0) {
+		ns_serve(fd);
+		_exit(0);
+	}
+
+	close(fd);
+	return pid;
+}
+
+/* the lookups of the worker, as done from its reactor */
+static void *lookup(char *name, int type)
+{
+	long long until = now_ms() + QUERY_TIMEOUT + 200;
+
+	if (dns_async_prefetch(name, type) < 0)
+		return NULL;
+
+	while (now_ms() < until) {
+		dns_async_wait(10);
+		dns_async_timer(0, NULL);
+	}
+
+	return dnscache_fetch_func(name, type, 0);
+}
+
+
+static void test_search_list(void)
+{
+	char name[MAX_DNS_NAME];
+
+	_res.ndots = 1;
+	_res.options |= RES_DEFNAMES|RES_DNSRCH;
+	_res.dnsrch[0] = "corp.test";
+	_res.dnsrch[1] = "test";
+	_res.dnsrch[2] = NULL;
+
+	ok(dns_search_name("host", 0, name) == 0 &&
+	   !strcmp(name, "host.corp.test"), "short name: first search domain");
+	ok(dns_search_name("host", 1, name) == 0 &&
+	   !strcmp(name, "host.test"), "short name: second search domain");
+	ok(dns_search_name("host", 2, name) == 0 &&
+	   !strcmp(name, "host"), "short name: as is, last");
+	ok(dns_search_name("host", 3, name) < 0, "short name: 3 names");
+
+	ok(dns_search_name("sip.example", 0, name) == 0 &&
+	   !strcmp(name, "sip.example"), "enough dots: as is, first");
+	ok(dns_search_name("sip.example", 1, name) == 0 &&
+	   !strcmp(name, "sip.example.corp.test"), "enough dots: then searched");
+	ok(dns_search_name("sip.example", 3, name) < 0, "enough dots: 3 names");
+
+	ok(dns_search_name("sip.example.", 0, name) == 0 &&
+	   !strcmp(name, "sip.example."), "trailing dot: as is");
+	ok(dns_search_name("sip.example.", 1, name) < 0,
+	   "trailing dot: not searched");
+}
+
+static void test_queries(void)
+{
+	struct hostent *he;
+	char ip[INET_ADDRSTRLEN];
+	unsigned long timeouts;
+	pid_t ns;
+	int status;
+
+	/* the query sockets are watched by the reactor of the workers */
+	if (!ok(init_worker_reactor("dns_cache tests", RCT_PRIO_MAX) == 0,
+	"init reactor"))
+		return;
+
+	ns = ns_start();
+	if (!ok(ns > 0, "start the stand-in nameserver"))
+		return;
+
+	/* sent to the dead nameserver first, then to the next one */
+	he = lookup("host", T_A);
+	ok(he && he != (void *)-1 && he->h_addr_list[0] &&
+	   inet_ntop(AF_INET, he->h_addr_list[0], ip, sizeof ip) &&
+	   !strcmp(ip, HOST_ADDR),
+	   "short name resolved through the search list, on the 2nd nameserver");
+
+	ok(lookup("nohost", T_A) == NULL,
+	   "short name not found is not blacklisted");
+
+	ok(lookup("gone.example", T_A) == (void *)-1,
+	   "qualified name not found is blacklisted");
+
+	timeouts = get_stat_val(dns_async_timeouts);
+	ok(lookup("drop.example", T_A) == NULL &&
+	   get_stat_val(dns_async_timeouts) == timeouts + 1,
+	   "unanswered query times out, nothing cached");
+
+	kill(ns, SIGTERM);
+	waitpid(ns, &status, 0);
+}
+
+
+void mod_tests(void)
+{
+	test_search_list();
+	test_queries();
+}
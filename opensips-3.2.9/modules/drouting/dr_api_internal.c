@@ -149,7 +149,7 @@ static void del_tree_api(ptree_t* t)
 	if(NULL == t)
 		return;
 	/* delete all the children */
-	for(i=0; i< ptree_children; i++) {
+	for(i=0; i< t->ptnode_no; i++) {
 		/* shm_free the rg array of rt_info */
 		if(NULL!=t->ptnode[i].rg) {
 			for(j=0;j<t->ptnode[i].rg_pos;j++) {
@@ -163,6 +163,8 @@ static void del_tree_api(ptree_t* t)
 		if(t->ptnode[i].next != NULL)
 			del_tree_api(t->ptnode[i].next);
 	}
+	if (t->ptnode)
+		shm_free(t->ptnode);
 	shm_free(t);
 }
 
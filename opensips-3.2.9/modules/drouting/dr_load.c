@@ -34,6 +34,7 @@
 #include "../../mem/rpm_mem.h"
 #include "../../time_rec.h"
 #include "../../socket_info.h"
+#include "../../ut.h"
 
 #include "dr_load.h"
 #include "routing.h"
@@ -276,11 +277,15 @@ rt_data_t* dr_load_routing_info(struct head_db *part,
 	str s_sock, host;
 	int proto, port;
 	char id_buf[INT2STR_MAX_LEN];
+	struct timeval start;
 
 	res = 0;
 	ri = 0;
 	rdata = 0;
 
+	gettimeofday(&start, NULL);
+	tree_size = 0;
+
 	/* init new data structure */
 	if ( (rdata=build_rt_data(part))==0 ) {
 		LM_ERR("failed to build rdata\n");
@@ -437,6 +442,11 @@ rt_data_t* dr_load_routing_info(struct head_db *part,
 	dr_dbf->free_result(db_hdl, res);
 	res = 0;
 
+	if (build_gw_ip_index(rdata, part->malloc)!=0) {
+		LM_ERR("failed to index the gateways by IP\n");
+		goto error;
+	}
+
 
 	/* read the carriers, if any */
 	if (dr_dbf->use_table( db_hdl, drc_table) < 0) {
@@ -729,6 +739,14 @@ rt_data_t* dr_load_routing_info(struct head_db *part,
 		LM_NOTICE("loaded %d rules in partition '%.*s'\n",
 		     tot_rl, part->partition.len, part->partition.s);
 
+	trim_tree(rdata->pt, part->malloc, part->free);
+
+	rdata->pt_size = tree_size;
+	rdata->load_time = get_time_diff(&start) / 1000;
+	LM_INFO("prefix tree of partition '%.*s' takes %lu bytes, "
+	        "loaded in %u ms\n", part->partition.len, part->partition.s,
+	        rdata->pt_size, rdata->load_time);
+
 	return rdata;
 error:
 	if (res)
@@ -69,6 +69,9 @@
 
 /* probing related stuff */
 static unsigned int dr_prob_interval = 30;
+static int dr_prob_max_inflight = 0;
+static int dr_prob_adaptive = 0;
+static stat_var *dr_probes_in_flight;
 static str dr_probe_replies = {NULL,0};
 struct tm_binds dr_tmb;
 str dr_probe_method = str_init("OPTIONS");
@@ -154,7 +157,7 @@ static int populate_gw_attrs;
 static int populate_carrier_attrs;
 
 /* statistic data */
-int tree_size = 0;
+unsigned long tree_size = 0;
 int inode = 0;
 int unode = 0;
 static str attrs_empty = str_init("");
@@ -193,6 +196,7 @@ struct head_db *head_db_start;
 typedef struct param_prob_callback {
 	struct head_db * current_partition;
 	unsigned int  _id;
+	struct probe_ctx probe;
 }param_prob_callback_t;
 
 typedef struct dr_partition {
@@ -487,6 +491,8 @@ static param_export_t params[] = {
 	{"probing_from",     STR_PARAM, &dr_probe_from.s          },
 	{"probing_socket",   STR_PARAM, &dr_probe_sock_s          },
 	{"probing_reply_codes",STR_PARAM, &dr_probe_replies.s     },
+	{"probing_max_inflight",INT_PARAM, &dr_prob_max_inflight  },
+	{"probing_adaptive", INT_PARAM, &dr_prob_adaptive         },
 	{"persistent_state", INT_PARAM, &dr_persistent_state      },
 	{"rule_tables_query",STR_PARAM|USE_FUNC_PARAM, (void *)set_rule_tables_query },
 	{"no_concurrent_reload",INT_PARAM, &no_concurrent_reload  },
@@ -565,6 +571,11 @@ static mi_export_t mi_cmds[] = {
 	{EMPTY_MI_EXPORT}
 };
 
+static stat_export_t mod_stats[] = {
+	{"dr_probes_in_flight", STAT_NO_RESET, &dr_probes_in_flight},
+	{0,0,0}
+};
+
 static module_dependency_t *get_deps_probing_interval(param_export_t *param)
 {
 	if (*(int *)param->param_pointer <= 0)
@@ -595,7 +606,7 @@ struct module_exports exports = {
 	cmds,            /* Exported functions */
 	0,               /* Exported async functions */
 	params,          /* Exported parameters */
-	0,               /* exported statistics */
+	mod_stats,       /* exported statistics */
 	mi_cmds,         /* exported MI functions */
 	0,               /* exported pseudo-variables */
 	0,			 	 /* exported transformations */
@@ -741,6 +752,7 @@ static void dr_probing_callback( struct cell *t, int type,
 	pgw_t *gw;
 	int _id ;
 	struct head_db * current_partition;
+	unsigned int rtt;
 
 	if (!ps->param || !*ps->param) {
 		LM_CRIT("BUG - reply to a DR probe with no ID (code=%d)\n", ps->code);
@@ -754,6 +766,9 @@ static void dr_probing_callback( struct cell *t, int type,
 
 	current_partition=((param_prob_callback_t*)*ps->param)->current_partition;
 
+	rtt = probe_done(dr_probes_in_flight,
+		&((param_prob_callback_t*)*ps->param)->probe);
+
 	lock_start_read( current_partition->ref_lock );
 
 	_id = ((param_prob_callback_t*)*ps->param)->_id;
@@ -762,6 +777,9 @@ static void dr_probing_callback( struct cell *t, int type,
 	if (gw==NULL)
 		goto end;
 
+	probe_update(&gw->probe, (code == 200) || check_options_rplcode(code),
+		rtt);
+
 	if ((code == 200) || check_options_rplcode(code)) {
 		/* re-enable to DST  (if allowed) */
 		if ( (gw->flags&DR_DST_STAT_NOEN_FLAG)!=0 ||  /* permanently disabled */
@@ -829,9 +847,21 @@ static void dr_prob_handler(unsigned int ticks, void* param)
 						)
 						)
 			   ) {
+				/* no longer probed, start over when it is again */
+				dst->probe.next = 0;
 				continue;
 			}
 
+			if (!probe_is_due(&dst->probe, ticks, dr_prob_interval))
+				continue;
+
+			/* over the cap, retry on the next tick */
+			if (!probe_can_send(dr_probes_in_flight, dr_prob_max_inflight))
+				continue;
+
+			probe_reschedule(&dst->probe, ticks, dr_prob_interval,
+				dr_prob_adaptive);
+
 			memcpy(buff + 4, dst->ip_str.s, dst->ip_str.len);
 			uri.s = buff;
 			uri.len = dst->ip_str.len + 4;
@@ -848,11 +878,14 @@ static void dr_prob_handler(unsigned int ticks, void* param)
 			params = shm_malloc(sizeof(param_prob_callback_t));
 			if( params==0 ) {
 				LM_ERR("no more shm memory!\n");
+				dr_tmb.free_dlg(dlg);
+				lock_stop_read( it->ref_lock );
 				return;
 			}
 			params->_id = dst->_id;
 			params->current_partition = it;
 
+			probe_sent(dr_probes_in_flight, &params->probe);
 			if (dr_tmb.t_request_within(&dr_probe_method, NULL, NULL, dlg,
 			dr_probing_callback, (void*)params, osips_shm_free)<0) {
 				LM_ERR("unable to execute dialog, disabling destination...\n");
@@ -861,6 +894,7 @@ static void dr_prob_handler(unsigned int ticks, void* param)
 					dr_gw_status_changed( it, dst);
 				}
 
+				probe_done(dr_probes_in_flight, &params->probe);
 				shm_free(params);
 			}
 			dr_tmb.free_dlg(dlg);
@@ -1158,6 +1192,7 @@ static inline int dr_reload_data_head(struct head_db *hd,
 			if (old_gw) {
 				gw->flags &= ~DR_DST_STAT_MASK;
 				gw->flags |= old_gw->flags&DR_DST_STAT_MASK;
+				gw->probe = old_gw->probe;
 			}
 		}
 		/* interate new crs and search them into old data */
@@ -1954,8 +1989,10 @@ static int dr_init(void)
 			dr_probe_replies.len = strlen(dr_probe_replies.s);
 
 		/* register pinger function */
+		/* it runs every second and only sends the probes that are due,
+		 * so they get spread over the probing interval */
 		if (register_timer( "dr-pinger", dr_prob_handler, NULL,
-					dr_prob_interval, TIMER_FLAG_DELAY_ON_DELAY)<0) {
+					1, TIMER_FLAG_DELAY_ON_DELAY)<0) {
 			LM_ERR("failed to register probing handler\n");
 			goto error;
 		}
@@ -3943,17 +3980,65 @@ static int prefix_username(struct sip_msg* msg, str *pri)
 }
 
 
+static inline int gw_ip_matches(pgw_t *pgwa, unsigned short j,
+		struct ip_addr *ip, unsigned short port, unsigned short proto)
+{
+	return (pgwa->ports[j]==0 || pgwa->ports[j]==1 || port==0 ||
+			pgwa->ports[j]==port) &&
+		(pgwa->protos[j]==0 || proto==0 || pgwa->protos[j]==proto) &&
+		ip_addr_cmp( &pgwa->ips[j], ip);
+}
+
+
 static int gw_matches_ip(pgw_t *pgwa, struct ip_addr *ip, unsigned short port, unsigned short proto)
 {
 	unsigned short j;
 	for ( j=0 ; j<pgwa->ips_no ; j++)
-		if ( (pgwa->ports[j]==0 || pgwa->ports[j]==1 || port==0 || pgwa->ports[j]==port) &&
-			(pgwa->protos[j]==0 || proto==0 || pgwa->protos[j]==proto) &&
-				ip_addr_cmp( &pgwa->ips[j], ip) ) return 1;
+		if (gw_ip_matches( pgwa, j, ip, port, proto)) return 1;
 	return 0;
 }
 
 
+/*
+ * Finds the first GW (in GW ID order) matching the given IP + PORT + PROTO
+ * and TYPE; uses the IP index, if available
+ */
+static pgw_t *find_dr_gw(rt_data_t *rdata, int type, struct ip_addr *ip,
+		unsigned short port, unsigned short proto)
+{
+	gw_ip_entry_t *e;
+	map_iterator_t gw_it;
+	pgw_t *pgwa;
+	void** dest;
+
+	if (rdata->gw_ip_hash) {
+		for (e = rdata->gw_ip_hash[gw_ip_hash(ip)&(rdata->gw_ip_hash_size-1)];
+				e; e = e->next)
+			if( (type<0 || type==e->gw->type) &&
+					gw_ip_matches( e->gw, e->idx, ip, port, proto) )
+				return e->gw;
+
+		return NULL;
+	}
+
+	for (map_first(rdata->pgw_tree, &gw_it);
+		iterator_is_valid(&gw_it); iterator_next(&gw_it)) {
+
+		dest = iterator_val(&gw_it);
+		if (dest==NULL)
+			break;
+
+		pgwa = (pgw_t*)*dest;
+
+		if( (type<0 || type==pgwa->type) &&
+				gw_matches_ip( pgwa, ip, port, proto) )
+			return pgwa;
+	}
+
+	return NULL;
+}
+
+
 /*
  * Checks if a given IP + PORT is a GW; tests the TYPE too
  * INTERNAL FUNCTION
@@ -3969,7 +4054,7 @@ static int _is_dr_gw(struct sip_msg* msg,
 	int i;
 
 	void** dest;
-	map_iterator_t gw_it, cr_it;
+	map_iterator_t cr_it;
 
 	if(current_partition==NULL || current_partition->rdata==NULL || msg==NULL)
 		return -1;
@@ -3977,82 +4062,71 @@ static int _is_dr_gw(struct sip_msg* msg,
 	lock_start_read( current_partition->ref_lock );
 
 	if(current_partition->rdata!=NULL) {
-		for (map_first(current_partition->rdata->pgw_tree, &gw_it);
-			iterator_is_valid(&gw_it); iterator_next(&gw_it)) {
-
-			dest = iterator_val(&gw_it);
-			if (dest==NULL)
-				break;
-
-			pgwa = (pgw_t*)*dest;
-
-			if( (type<0 || type==pgwa->type) &&
-			gw_matches_ip( pgwa, ip,
-					(flags&DR_IFG_IGNOREPORT_FLAG)?0:port,
-					(flags&DR_IFG_CHECKPROTO_FLAG)?proto:0)
-				) {
-				/* strip ? */
-				if ( (flags&DR_IFG_STRIP_FLAG) && pgwa->strip>0)
-					strip_username(msg, pgwa->strip);
-				/* prefix ? - set it even if it is "" */
-				if ( (flags&DR_IFG_PREFIX_FLAG) && pgwa->pri.s) {
-					/* pri prefix ? */
-					if (current_partition->gw_priprefix_avp!=-1) {
-						val.s = pgwa->pri;
-						if (add_avp(AVP_VAL_STR,
-						current_partition->gw_priprefix_avp, val)!=0)
-							LM_ERR("failed to insert GW pri prefix avp\n");
-					}
-					prefix_username(msg, &pgwa->pri);
+		pgwa = find_dr_gw( current_partition->rdata, type, ip,
+				(flags&DR_IFG_IGNOREPORT_FLAG)?0:port,
+				(flags&DR_IFG_CHECKPROTO_FLAG)?proto:0);
+		if (pgwa) {
+			/* strip ? */
+			if ( (flags&DR_IFG_STRIP_FLAG) && pgwa->strip>0)
+				strip_username(msg, pgwa->strip);
+			/* prefix ? - set it even if it is "" */
+			if ( (flags&DR_IFG_PREFIX_FLAG) && pgwa->pri.s) {
+				/* pri prefix ? */
+				if (current_partition->gw_priprefix_avp!=-1) {
+					val.s = pgwa->pri;
+					if (add_avp(AVP_VAL_STR,
+					current_partition->gw_priprefix_avp, val)!=0)
+						LM_ERR("failed to insert GW pri prefix avp\n");
 				}
+				prefix_username(msg, &pgwa->pri);
+			}
 
-				/* attrs ? */
-				if (gw_attrs_spec) {
-					pv_val.flags = PV_VAL_STR;
-					pv_val.rs = pgwa->attrs.s ? pgwa->attrs : attrs_empty;
-					if (pv_set_value(msg, gw_attrs_spec, 0, &pv_val) != 0)
-						LM_ERR("failed to set value for GW attrs pvar\n");
-				}
+			/* attrs ? */
+			if (gw_attrs_spec) {
+				pv_val.flags = PV_VAL_STR;
+				pv_val.rs = pgwa->attrs.s ? pgwa->attrs : attrs_empty;
+				if (pv_set_value(msg, gw_attrs_spec, 0, &pv_val) != 0)
+					LM_ERR("failed to set value for GW attrs pvar\n");
+			}
 
-				if ( flags & DR_IFG_IDS_FLAG ) {
-					val.s = pgwa->id;
-					if (add_avp(AVP_VAL_STR,
-					current_partition->gw_id_avp, val)!=0)
-						LM_ERR("failed to insert GW attrs avp\n");
-				}
+			if ( flags & DR_IFG_IDS_FLAG ) {
+				val.s = pgwa->id;
+				if (add_avp(AVP_VAL_STR,
+				current_partition->gw_id_avp, val)!=0)
+					LM_ERR("failed to insert GW attrs avp\n");
+			}
 
-				if ( flags & DR_IFG_CARRIERID_FLAG ) {
-					/* lookup first carrier that contains this gw */
-					for (map_first(current_partition->rdata->carriers_tree, &cr_it);
-							iterator_is_valid(&cr_it); iterator_next(&cr_it)) {
+			if ( flags & DR_IFG_CARRIERID_FLAG ) {
+				/* lookup first carrier that contains this gw */
+				for (map_first(current_partition->rdata->carriers_tree, &cr_it);
+						iterator_is_valid(&cr_it); iterator_next(&cr_it)) {
 
-						dest = iterator_val(&cr_it);
-						if (dest==NULL)
-							break;
+					dest = iterator_val(&cr_it);
+					if (dest==NULL)
+						break;
 
-						pcr = (pcr_t*)*dest;
-
-						for (i=0;i<pcr->pgwa_len;i++) {
-							if (pcr->pgwl[i].is_carrier == 0 &&
-									pcr->pgwl[i].dst.gw == pgwa ) {
-								/* found our carrier */
-								if (current_partition->carrier_id_avp!=-1) {
-									val.s = pcr->id;
-									if (add_avp_last(AVP_VAL_STR,
-									current_partition->carrier_id_avp,val)!=0){
-										LM_ERR("failed to add carrier id "
-											"AVP\n");
-									}
+					pcr = (pcr_t*)*dest;
+
+					for (i=0;i<pcr->pgwa_len;i++) {
+						if (pcr->pgwl[i].is_carrier == 0 &&
+								pcr->pgwl[i].dst.gw == pgwa ) {
+							/* found our carrier */
+							if (current_partition->carrier_id_avp!=-1) {
+								val.s = pcr->id;
+								if (add_avp_last(AVP_VAL_STR,
+								current_partition->carrier_id_avp,val)!=0){
+									LM_ERR("failed to add carrier id "
+										"AVP\n");
 								}
-								goto end;
 							}
+							goto end;
 						}
 					}
 				}
-end:
-				lock_stop_read( current_partition->ref_lock );
-				return 1;
 			}
+end:
+			lock_stop_read( current_partition->ref_lock );
+			return 1;
 		}
 	}
 
@@ -4283,6 +4357,14 @@ static inline int mi_dr_print_gw_state(pgw_t *gw, mi_item_t *gw_item)
 					MI_SSTR("Active"));
 }
 
+static inline int mi_dr_print_gw_probe(pgw_t *gw, mi_item_t *gw_item)
+{
+	if (gw->probe.rtt == 0)
+		return 0;
+
+	return add_mi_number(gw_item, MI_SSTR("Probe RTT"), gw->probe.rtt);
+}
+
 static mi_response_t *mi_dr_list_gw(struct head_db *current_partition,
 										str *gw_id)
 {
@@ -4307,6 +4389,9 @@ static mi_response_t *mi_dr_list_gw(struct head_db *current_partition,
 		goto error;
 	}
 
+	if (mi_dr_print_gw_probe(gw, resp_obj) < 0)
+		goto error;
+
 	return resp;
 error:
 	free_mi_response(resp);
@@ -4361,6 +4446,8 @@ static mi_response_t *mi_dr_list_all_gw(struct head_db *current_partition)
 				goto error;
 		if (mi_dr_print_gw_state(gw, gw_item) < 0)
 			goto error;
+		if (mi_dr_print_gw_probe(gw, gw_item) < 0)
+			goto error;
 	}
 
 	lock_stop_read( current_partition->ref_lock );
@@ -5087,6 +5174,15 @@ static int mi_dr_print_rld_status(mi_item_t *part_item, struct head_db * partiti
 		ch_time, strlen(ch_time)-1) < 0)
 		goto error;
 
+	if (partition->rdata) {
+		if (add_mi_number(part_item, MI_SSTR("Prefix tree size"),
+			partition->rdata->pt_size) < 0)
+			goto error;
+		if (add_mi_number(part_item, MI_SSTR("Load time ms"),
+			partition->rdata->load_time) < 0)
+			goto error;
+	}
+
 	lock_stop_read(partition->ref_lock);
 
 	return 0;
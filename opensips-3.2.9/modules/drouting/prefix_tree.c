@@ -71,6 +71,9 @@ int init_prefix_tree( char *extra_prefix_chars )
 					DR_PREFIX_ARRAY_SIZE);
 				continue;
 			}
+			/* a char given twice would waste a child slot */
+			if (IDX_OF_CHAR( extra_prefix_chars[i] ) != -1)
+				continue;
 			IDX_OF_CHAR( extra_prefix_chars[i] ) = ptree_children++;
 		}
 	}
@@ -141,6 +144,7 @@ get_prefix(
 	)
 {
 	rt_info_t *rt = NULL;
+	ptree_node_t *ptn;
 	char *tmp=NULL;
 	char local=0;
 	int idx=0;
@@ -165,11 +169,12 @@ get_prefix(
 			break;
 		}
 		idx = IDX_OF_CHAR(local);
-		if( NULL == ptree->ptnode[idx].next) {
+		ptn = PTREE_SLOT(ptree, idx);
+		if( NULL == ptn || NULL == ptn->next) {
 			/* this is a leaf */
 			break;
 		}
-		ptree = ptree->ptnode[idx].next;
+		ptree = ptn->next;
 		tmp++;
 	}
 	/* go in the tree up to the root trying to match the
@@ -177,9 +182,10 @@ get_prefix(
 	while(ptree !=NULL ) {
 		/* is it a real node or an intermediate one */
 		idx = IDX_OF_CHAR(*tmp);
-		if(NULL != ptree->ptnode[idx].rg) {
+		ptn = PTREE_SLOT(ptree, idx);
+		if(NULL != ptn && NULL != ptn->rg) {
 			/* real node; check the constraints on the routing info*/
-			if( NULL != (rt = internal_check_rt( &(ptree->ptnode[idx]), rgid, rgidx)))
+			if( NULL != (rt = internal_check_rt( ptn, rgid, rgidx)))
 				break;
 		}
 		tmp--;
@@ -242,6 +248,54 @@ get_carrier_by_id(
 
 
 
+/*
+ * Returns the slot of the idx-th child char of the node, allocating it if
+ * not populated yet.  The slots array grows by doubling, so the slots may
+ * move - do not keep pointers to them across calls
+ */
+ptree_node_t*
+get_ptree_slot(
+	ptree_t *ptree,
+	int idx,
+	osips_malloc_f malloc_f,
+	osips_free_f free_f
+)
+{
+	ptree_node_t *slots;
+	int size;
+
+	if (ptree->idx[idx] != PTREE_NO_SLOT)
+		return &ptree->ptnode[ptree->idx[idx]];
+
+	if (ptree->ptnode_no == ptree->ptnode_size) {
+		size = ptree->ptnode_size ? 2 * ptree->ptnode_size : 1;
+		if (size > ptree_children)
+			size = ptree_children;
+
+		slots = (ptree_node_t*)func_malloc(malloc_f,
+			size*sizeof(ptree_node_t));
+		if (NULL == slots) {
+			LM_ERR("no more shm mem\n");
+			return NULL;
+		}
+		tree_size += (size - ptree->ptnode_size)*sizeof(ptree_node_t);
+
+		if (ptree->ptnode) {
+			memcpy(slots, ptree->ptnode,
+				ptree->ptnode_no*sizeof(ptree_node_t));
+			func_free(free_f, ptree->ptnode);
+		}
+		ptree->ptnode = slots;
+		ptree->ptnode_size = size;
+	}
+
+	memset(&ptree->ptnode[ptree->ptnode_no], 0, sizeof(ptree_node_t));
+	ptree->idx[idx] = ptree->ptnode_no;
+
+	return &ptree->ptnode[ptree->ptnode_no++];
+}
+
+
 int
 add_prefix(
 	ptree_t *ptree,
@@ -252,6 +306,7 @@ add_prefix(
 	osips_free_f free_f
 )
 {
+	ptree_node_t *ptn;
 	char* tmp=NULL;
 	int res = 0;
 	if(NULL==ptree) {
@@ -269,13 +324,14 @@ add_prefix(
 			LM_ERR("%c is not valid char in the prefix\n", *tmp);
 			goto err_exit;
 		}
+		ptn = get_ptree_slot(ptree, UIDX_OF_CHAR(*tmp), malloc_f, free_f);
+		if (NULL == ptn)
+			goto err_exit;
 		if( tmp == (prefix->s+prefix->len-1) ) {
 			/* last digit in the prefix string */
 			LM_DBG("adding info %p, %d at: "
-				"%p (%d)\n", r, rg, &(ptree->ptnode[UIDX_OF_CHAR(*tmp)]),
-				IDX_OF_CHAR(*tmp));
-			res = add_rt_info(&(ptree->ptnode[UIDX_OF_CHAR(*tmp)]),
-					r,rg, malloc_f, free_f);
+				"%p (%d)\n", r, rg, ptn, IDX_OF_CHAR(*tmp));
+			res = add_rt_info(ptn, r,rg, malloc_f, free_f);
 			if(res < 0 ) {
                 LM_ERR("adding rt info doesn't work\n");
 				goto err_exit;
@@ -285,13 +341,12 @@ add_prefix(
 			goto ok_exit;
 		}
 		/* process the current digit in the prefix */
-		if(NULL == ptree->ptnode[UIDX_OF_CHAR(*tmp)].next) {
+		if(NULL == ptn->next) {
 			/* allocate new node */
-			INIT_PTREE_NODE(malloc_f, ptree,
-				ptree->ptnode[UIDX_OF_CHAR(*tmp)].next);
-			inode+=10;
+			INIT_PTREE_NODE(malloc_f, ptree, ptn->next);
+			inode++;
 		}
-		ptree = ptree->ptnode[UIDX_OF_CHAR(*tmp)].next;
+		ptree = ptn->next;
 		tmp++;
 	}
 
@@ -302,6 +357,42 @@ err_exit:
 	return -1;
 }
 
+/*
+ * Once the whole tree is loaded, gives back the unused slots left by
+ * the doubling in get_ptree_slot()
+ */
+void
+trim_tree(
+		ptree_t* t,
+		osips_malloc_f malloc_f,
+		osips_free_f free_f
+		)
+{
+	ptree_node_t *slots;
+	int i;
+
+	if(NULL == t)
+		return;
+
+	for(i=0; i< t->ptnode_no; i++)
+		if(t->ptnode[i].next != NULL)
+			trim_tree(t->ptnode[i].next, malloc_f, free_f);
+
+	if (t->ptnode_no == t->ptnode_size)
+		return;
+
+	slots = (ptree_node_t*)func_malloc(malloc_f,
+		t->ptnode_no*sizeof(ptree_node_t));
+	if (NULL == slots)
+		return;
+
+	memcpy(slots, t->ptnode, t->ptnode_no*sizeof(ptree_node_t));
+	func_free(free_f, t->ptnode);
+	tree_size -= (t->ptnode_size - t->ptnode_no)*sizeof(ptree_node_t);
+	t->ptnode = slots;
+	t->ptnode_size = t->ptnode_no;
+}
+
 int
 del_tree(
 		ptree_t* t,
@@ -312,7 +403,7 @@ del_tree(
 	if(NULL == t)
 		goto exit;
 	/* delete all the children */
-	for(i=0; i< ptree_children; i++) {
+	for(i=0; i< t->ptnode_no; i++) {
 		/* shm_free the rg array of rt_info */
 		if(NULL!=t->ptnode[i].rg) {
 			for(j=0;j<t->ptnode[i].rg_pos;j++) {
@@ -326,6 +417,8 @@ del_tree(
 		if(t->ptnode[i].next != NULL)
 			del_tree(t->ptnode[i].next, free_f);
 	}
+	if (t->ptnode)
+		func_free(free_f, t->ptnode);
 	func_free(free_f, t);
 exit:
 	return 0;
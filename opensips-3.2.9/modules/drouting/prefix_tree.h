@@ -29,6 +29,7 @@
 #include "../../time_rec.h"
 #include "../../map.h"
 #include "../../mem/mem_funcs.h"
+#include "../../lib/probing.h"
 
 #include "dr_cb_sorting.h"
 
@@ -36,21 +37,30 @@
 	(((d)>='0') && ((d)<= '9'))
 
 extern int ptree_children;
-extern int tree_size;
+extern unsigned long tree_size;
 struct head_db;
 
+/* marks a child char without a slot in ptree_t.idx; the prefix chars are
+ * ASCII and unique, so there are at most 128 slots per node */
+#define PTREE_NO_SLOT 0xff
+
+/* a node only holds the slots of its populated children, see
+ * get_ptree_slot() / PTREE_SLOT() */
 #define INIT_PTREE_NODE(f, p, n) \
 do {\
-	(n) = (ptree_t*)func_malloc(f, sizeof(ptree_t) +\
-		ptree_children*sizeof(ptree_node_t));\
+	(n) = (ptree_t*)func_malloc(f, sizeof(ptree_t) + ptree_children);\
 	if(NULL == (n))\
 		goto err_exit;\
-	tree_size+=sizeof(ptree_t);\
-	memset((n), 0, sizeof(ptree_t)+ptree_children*sizeof(ptree_node_t));\
+	tree_size+=sizeof(ptree_t) + ptree_children;\
+	memset((n), 0, sizeof(ptree_t));\
+	memset((n)->idx, PTREE_NO_SLOT, ptree_children);\
 	(n)->bp=(p);\
-	(n)->ptnode=(ptree_node_t*)((n)+1);\
 }while(0);
 
+/* the slot of the _i-th child char of the node, NULL if not populated */
+#define PTREE_SLOT(_t, _i) \
+	((_t)->idx[_i] == PTREE_NO_SLOT ? NULL : &(_t)->ptnode[(_t)->idx[_i]])
+
 
 #define DR_DST_PING_DSBL_FLAG   (1<<0)
 #define DR_DST_PING_PERM_FLAG   (1<<1)
@@ -81,6 +91,7 @@ typedef struct pgw_ {
 	unsigned short protos[DR_MAX_IPS];
 	unsigned short ips_no;
 	int flags;
+	struct probe_state probe;
 }pgw_t;
 
 typedef struct pcr_ pcr_t;
@@ -164,7 +175,14 @@ typedef struct ptree_node_ {
 typedef struct ptree_ {
 	/* backpointer */
 	struct ptree_ *bp;
+	/* slots of the populated children only, in insertion order */
 	ptree_node_t *ptnode;
+	/* used and allocated slots */
+	unsigned char ptnode_no;
+	unsigned char ptnode_size;
+	/* char index -> slot index, PTREE_NO_SLOT if no slot (ptree_children
+	 * long) */
+	unsigned char idx[0];
 } ptree_t;
 
 
@@ -181,12 +199,27 @@ print_interim(
 		ptree_t*
 		);
 
+void
+trim_tree(
+	ptree_t *,
+	osips_malloc_f,
+	osips_free_f
+	);
+
 int
 del_tree(
 	ptree_t *,
 	osips_free_f
 	);
 
+ptree_node_t*
+get_ptree_slot(
+	ptree_t*,
+	int,
+	osips_malloc_f,
+	osips_free_f
+	);
+
 int
 add_prefix(
 	ptree_t*,
@@ -699,6 +699,65 @@ err_exit:
 }
 
 
+int
+build_gw_ip_index(rt_data_t *rd, osips_malloc_f mf)
+{
+	map_iterator_t it;
+	gw_ip_entry_t *e, **last;
+	pgw_t *gw;
+	void **val;
+	unsigned int n, size;
+	unsigned short j;
+
+	n = 0;
+	for (map_first(rd->pgw_tree, &it); iterator_is_valid(&it);
+			iterator_next(&it)) {
+		val = iterator_val(&it);
+		if (val==NULL)
+			break;
+		n += ((pgw_t*)*val)->ips_no;
+	}
+
+	/* keep the load factor under 1 */
+	for (size = 16; size < n; size <<= 1);
+
+	/* buckets and entries, all in one chunk */
+	rd->gw_ip_hash = (gw_ip_entry_t**)func_malloc(mf,
+		size*sizeof(gw_ip_entry_t*) + n*sizeof(gw_ip_entry_t));
+	if (rd->gw_ip_hash==NULL) {
+		LM_ERR("no more shm mem (%u GW addresses)\n", n);
+		return -1;
+	}
+	memset(rd->gw_ip_hash, 0, size*sizeof(gw_ip_entry_t*));
+	rd->gw_ip_hash_size = size;
+
+	e = (gw_ip_entry_t*)(rd->gw_ip_hash + size);
+	for (map_first(rd->pgw_tree, &it); iterator_is_valid(&it);
+			iterator_next(&it)) {
+		val = iterator_val(&it);
+		if (val==NULL)
+			break;
+		gw = (pgw_t*)*val;
+
+		for (j=0; j<gw->ips_no; j++, e++) {
+			/* append, so that the first matching GW stays the same as
+			 * when walking the avl */
+			last = &rd->gw_ip_hash[gw_ip_hash(&gw->ips[j]) & (size-1)];
+			while (*last)
+				last = &(*last)->next;
+
+			e->gw = gw;
+			e->idx = j;
+			e->next = NULL;
+			*last = e;
+		}
+	}
+
+	LM_DBG("indexed %u GW addresses in %u buckets\n", n, size);
+	return 0;
+}
+
+
 void destroy_pcr_shm_w(void *pcr_p)
 {
 	pcr_t* pcr = pcr_p;
@@ -753,6 +812,10 @@ free_rt_data(
 		/* del GW list */
 		del_pgw_list(rt_data->pgw_tree);
 		rt_data->pgw_tree = 0 ;
+		if (rt_data->gw_ip_hash) {
+			func_free(free_f, rt_data->gw_ip_hash);
+			rt_data->gw_ip_hash = 0;
+		}
 		/* del prefix tree */
 		del_tree(rt_data->pt, free_f);
 		rt_data->pt = 0 ;
@@ -39,6 +39,15 @@ typedef struct hb_ {
 	struct hb_*next;
 } hb_t;
 
+/* entry of the IP index over the PSTN gw, pointing to one of the
+ * addresses of a gateway */
+typedef struct gw_ip_entry_ {
+	pgw_t *gw;
+	/* position of the address in gw->ips */
+	unsigned short idx;
+	struct gw_ip_entry_ *next;
+} gw_ip_entry_t;
+
 /* routing data is comprised of:
 	- a list of PSTN gw
 	- a hash over routing groups containing
@@ -47,6 +56,10 @@ typedef struct hb_ {
 typedef struct rt_data_ {
 	/* avl of PSTN gw */
 	map_t pgw_tree;
+	/* hash over the IPs of the PSTN gw, used by is_from_gw(); within a
+	 * bucket, the entries keep the order of the avl */
+	gw_ip_entry_t **gw_ip_hash;
+	unsigned int gw_ip_hash_size;
 
 	/* avl of carriers */
 	map_t carriers_tree;
@@ -55,6 +68,10 @@ typedef struct rt_data_ {
 	ptree_node_t noprefix;
 	/* tree with routing prefixes */
 	ptree_t *pt;
+	/* bytes taken by the nodes of the prefix tree */
+	unsigned long pt_size;
+	/* duration of the DB load which built this data, in ms */
+	unsigned int load_time;
 }rt_data_t;
 
 typedef struct _dr_group {
@@ -162,6 +179,21 @@ del_pgw_list(
 
 
 
+/* index the IPs of all the PSTN gw, once they are all loaded */
+int
+build_gw_ip_index(rt_data_t*, osips_malloc_f);
+
+static inline unsigned int gw_ip_hash(struct ip_addr *ip)
+{
+	unsigned int h = 0;
+	int i;
+
+	for (i = 0; i < ip->len / 4; i++)
+		h = (h ^ ip->u.addr32[i]) * 0x9e3779b1;
+
+	return h ^ (h >> 16);
+}
+
 void
 free_rt_data(rt_data_t*, osips_free_f);
 #endif
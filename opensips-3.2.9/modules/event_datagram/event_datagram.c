@@ -98,7 +98,7 @@ static evi_export_t trans_export_udp = {
 	datagram_match,				/* sockets match function */
 	0,							/* no free function */
 	datagram_print,				/* socket print function */
-	DGRAM_UDP_FLAG				/* flags */
+	DGRAM_UDP_FLAG|EVI_DISPATCH	/* flags */
 };
 
 static evi_export_t trans_export_unix = {
@@ -108,7 +108,7 @@ static evi_export_t trans_export_unix = {
 	datagram_match,				/* sockets match function */
 	0,							/* no free function */
 	datagram_print,				/* socket print function */
-	DGRAM_UNIX_FLAG				/* flags */
+	DGRAM_UNIX_FLAG|EVI_DISPATCH	/* flags */
 };
 
 /**
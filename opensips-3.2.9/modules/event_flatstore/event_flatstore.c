@@ -117,7 +117,7 @@ static evi_export_t trans_export_flat = {
 	flat_match,					/* sockets match function */
 	flat_free,					/* free function */
 	flat_print,					/* print socket */
-	FLAT_FLAG					/* flags */
+	FLAT_FLAG|EVI_DISPATCH	/* flags */
 };
 
 /* initialize function */
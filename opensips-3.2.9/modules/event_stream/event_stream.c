@@ -99,7 +99,7 @@ static evi_export_t trans_export_stream = {
 	stream_match,				/* sockets match function */
 	stream_free,				/* free function */
 	stream_print,				/* print function */
-	STREAM_FLAG					/* flags */
+	STREAM_FLAG|EVI_DISPATCH	/* flags */
 };
 
 static int child_init(int rank) {
@@ -103,7 +103,7 @@ static evi_export_t trans_export_xmlrpc = {
 	xmlrpc_match,				/* sockets match function */
 	xmlrpc_free,				/* free function */
 	xmlrpc_print,				/* print function */
-	XMLRPC_FLAG					/* flags */
+	XMLRPC_FLAG|EVI_DISPATCH	/* flags */
 };
 
 static int child_init(int rank) {
@@ -28,6 +28,7 @@
 #include "../../db/db.h"
 #include "../../time_rec.h"
 #include "../../mod_fix.h"
+#include "../../hash_func.h"
 #include "../drouting/dr_api.h"
 #include "../dialog/dlg_load.h"
 
@@ -68,6 +69,24 @@ dr_head_p *dr_head;
 struct dr_binds drb;
 rw_lock_t *frd_data_lock;
 gen_lock_t *frd_seq_calls_lock;
+/* increased with each reload of the rules */
+unsigned int *frd_data_version;
+
+/* per-process cache of the rules matched by the dialed numbers */
+#define FRD_MATCH_MAX_NUMBER 32
+
+typedef struct {
+	unsigned int version;
+	unsigned int minute;
+	int pid;
+	unsigned short matched_len;
+	unsigned short number_len;
+	char number[FRD_MATCH_MAX_NUMBER];
+	rt_info_t *rule;
+} frd_match_t;
+
+static int match_cache_size = 1024;
+static frd_match_t *match_cache;
 
 struct dlg_binds dlgb;
 
@@ -110,6 +129,7 @@ static param_export_t params[]={
 	{"concalls_thresh_crit_col",    STR_PARAM, &concalls_thresh_crit_col.s},
 	{"seqcalls_thresh_warn_col",    STR_PARAM, &seqcalls_thresh_warn_col.s},
 	{"seqcalls_thresh_crit_col",    STR_PARAM, &seqcalls_thresh_crit_col.s},
+	{"match_cache_size",            INT_PARAM, &match_cache_size},
 	{0,0,0}
 };
 
@@ -227,6 +247,19 @@ static int mod_init(void)
 	}
 	*dr_head = NULL;
 
+	frd_data_version = shm_malloc(sizeof *frd_data_version);
+	if (frd_data_version == NULL) {
+		LM_ERR("no more shm memory\n");
+		return -1;
+	}
+	*frd_data_version = 0;
+
+	if (match_cache_size < 0) {
+		LM_WARN("invalid match_cache_size %d, disabling the cache\n",
+			match_cache_size);
+		match_cache_size = 0;
+	}
+
 	set_lengths();
 	if (init_stats_table() != 0) {
 		LM_ERR("failed to init fraud stats table\n");
@@ -242,6 +275,15 @@ static int mod_init(void)
 
 static int child_init(int rank)
 {
+	if (match_cache_size) {
+		match_cache = pkg_malloc(match_cache_size * sizeof *match_cache);
+		if (!match_cache) {
+			LM_ERR("no more pkg memory for the match cache\n");
+			return -1;
+		}
+		memset(match_cache, 0, match_cache_size * sizeof *match_cache);
+	}
+
 	if (rank == 1) {
 
 		if (frd_connect_db() != 0 || frd_reload_data() != 0) {
@@ -259,16 +301,55 @@ static int child_init(int rank)
 static void destroy(void)
 {
 	free_stats_table();
+	if (frd_data_version)
+		shm_free(frd_data_version);
 	frd_destroy_data();
 }
 
+/*
+ * Matches @number against the rules of profile @pid, going through the
+ * per-process cache first. The rules also match on time, with a one minute
+ * granularity, so a cached result is only reused within the same minute
+ * and for the same version of the rules; the misses are cached as well.
+ *
+ * NOTE: must be called under the frd_data_lock read lock
+ */
+static rt_info_t *frd_match_number(int pid, str *number, time_t now,
+		unsigned int *matched_len)
+{
+	frd_match_t *m;
+	unsigned int minute = now / 60;
+
+	if (!match_cache || number->len > FRD_MATCH_MAX_NUMBER)
+		return drb.match_number(*dr_head, pid, number, matched_len);
+
+	m = &match_cache[(core_hash(number, NULL, 0) ^ pid) % match_cache_size];
+	if (m->number_len == number->len && m->pid == pid &&
+			m->minute == minute && m->version == *frd_data_version &&
+			!memcmp(m->number, number->s, number->len)) {
+		*matched_len = m->matched_len;
+		return m->rule;
+	}
+
+	m->rule = drb.match_number(*dr_head, pid, number, matched_len);
+	m->matched_len = m->rule ? *matched_len : 0;
+	m->number_len = number->len;
+	memcpy(m->number, number->s, number->len);
+	m->pid = pid;
+	m->minute = minute;
+	m->version = *frd_data_version;
+
+	return m->rule;
+}
+
 static int check_fraud(struct sip_msg *msg, str *user, str *number, int *pid)
 {
 
 	static const int rc_error = -3, rc_critical_thr = -2, rc_warning_thr = -1,
 				 rc_ok_thr = 1, rc_no_rule = 2;
 	frd_dlg_param *param;
-	int rc = rc_ok_thr, itv_reset = 0;
+	int rc = rc_ok_thr;
+	time_t nowt = time(NULL);
 
 	if (*dr_head == NULL) {
 		/* No data, probably still loading */
@@ -280,7 +361,7 @@ static int check_fraud(struct sip_msg *msg, str *user, str *number, int *pid)
 
 	unsigned int matched_len;
 	lock_start_read(frd_data_lock);
-	rt_info_t *rule = drb.match_number(*dr_head, *pid, number, &matched_len);
+	rt_info_t *rule = frd_match_number(*pid, number, nowt, &matched_len);
 
 	if (rule == NULL) {
 		/* No match */
@@ -304,7 +385,6 @@ static int check_fraud(struct sip_msg *msg, str *user, str *number, int *pid)
 	/* Check if we need to reset the stats */
 
 	struct tm now, then;
-	time_t nowt = time(NULL);
 
 	/* We lock all the stats values */
 	lock_get(&se->lock);
@@ -318,12 +398,10 @@ static int check_fraud(struct sip_msg *msg, str *user, str *number, int *pid)
 
 	if (se->stats.last_matched_time == 0 || se->stats.last_matched_rule != rule->id
 			|| then.tm_yday != now.tm_yday || then.tm_year != now.tm_year) {
-		se->stats.cpm = 0;
 		se->stats.total_calls = 0;
 		se->stats.concurrent_calls = 0;
 		se->stats.seq_calls = 0;
 		se->interval_id++;
-		itv_reset = 1;
 	}
 
 	/* Update the stats */
@@ -348,38 +426,10 @@ static int check_fraud(struct sip_msg *msg, str *user, str *number, int *pid)
 	se->stats.last_matched_rule = rule->id;
 	++se->stats.total_calls;
 
-	/* Calls per FRD_SECS_PER_WINDOW */
-	if (nowt - se->stats.last_matched_time >= 2 * FRD_SECS_PER_WINDOW || itv_reset) {
-		/* outside the range of t0 + 2*WINDOW_SIZE; we can't use any of the
-		 * data since they are too old */
-		se->stats.cpm = 0;
-		memset(se->stats.calls_window, 0,
-				sizeof(unsigned short) * FRD_SECS_PER_WINDOW);
-		se->stats.last_matched_time = nowt;
-	}
-	else if (nowt - se->stats.last_matched_time >= FRD_SECS_PER_WINDOW) {
-		/* more than t0 + WINDOW_SIZE but less than 2 * WINDOW_SIZE
-		 * we can consider calls from t0 + (now - WINDOW_SIZE)
-		 * all cals from t0 to t0 + (now - WINDOW_SIZE) shall be invalidated */
-		unsigned int old_matched_time = se->stats.last_matched_time;
-
-		se->stats.last_matched_time = nowt - FRD_SECS_PER_WINDOW + 1;
-
-		/*interval [old_last_matched_time; current_last_matched_time) shall
-		 * be invalidated */
-		unsigned int i = (se->stats.last_matched_time - 1) % FRD_SECS_PER_WINDOW;
-		unsigned int j = (old_matched_time - 1) % FRD_SECS_PER_WINDOW;
-		for (;i != j; i = (i - 1 + FRD_SECS_PER_WINDOW) % FRD_SECS_PER_WINDOW) {
-			se->stats.cpm -= se->stats.calls_window[i];
-			se->stats.calls_window[i] = 0;
-		}
-	} else {
-		/* less than t0 + WINDOW_SIZE; all we need to do is to increase
-		 * the number of calls for nowt */
-	}
+	se->stats.last_matched_time = nowt;
 
-	++se->stats.cpm;
-	se->stats.calls_window[nowt % FRD_SECS_PER_WINDOW]++;
+	/* Calls in the last FRD_SECS_PER_WINDOW seconds */
+	se->stats.cpm = frd_window_inc(&se->stats.calls_window, nowt);
 
 	++se->stats.concurrent_calls;
 
@@ -480,6 +530,7 @@ mi_response_t *mi_show_stats(const mi_params_t *params,
 
 	lock_get(&se->lock);
 
+	se->stats.cpm = frd_window_get(&se->stats.calls_window, time(NULL));
 	if (add_mi_number(resp_obj, MI_SSTR("cpm"), se->stats.cpm) < 0)
 		goto add_error;
 	if (add_mi_number(resp_obj, MI_SSTR("total_calls"),
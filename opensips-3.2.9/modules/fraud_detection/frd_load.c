@@ -79,6 +79,7 @@ static db_func_t dbf;
 extern dr_head_p *dr_head;
 extern struct dr_binds drb;
 extern rw_lock_t *frd_data_lock;
+extern unsigned int *frd_data_version;
 
 /* List of data kept in dr's attr and freed here - pkg */
 
@@ -480,6 +481,8 @@ int frd_reload_data(void)
 	lock_start_write(frd_data_lock);
 	*dr_head = new_head;
 	free_list = new_list;
+	/* invalidates the matches cached by all processes */
+	(*frd_data_version)++;
 	lock_stop_write(frd_data_lock);
 	frd_destroy_data_unsafe(old_head, old_list);
 	return 0;
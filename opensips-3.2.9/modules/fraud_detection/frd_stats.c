@@ -25,6 +25,7 @@
 */
 
 #include <string.h>
+#include <limits.h>
 #include "frd_stats.h"
 #include "frd_hashmap.h"
 #include "../../ut.h"
@@ -185,3 +186,47 @@ void free_stats_table(void)
 {
 	free_hash_map(&stats_table, destroy_users);
 }
+
+
+/* drops the counters of the seconds which got out of the window */
+static inline void frd_window_advance(frd_window_t *w, unsigned int now)
+{
+	unsigned int s;
+
+	if (now - w->last >= FRD_SECS_PER_WINDOW) {
+		memset(w->buckets, 0, sizeof w->buckets);
+		w->sum = 0;
+	} else {
+		for (s = w->last + 1; s != now + 1; s++) {
+			w->sum -= w->buckets[s % FRD_SECS_PER_WINDOW];
+			w->buckets[s % FRD_SECS_PER_WINDOW] = 0;
+		}
+	}
+
+	w->last = now;
+}
+
+/* NOTE: the window must be locked */
+unsigned int frd_window_get(frd_window_t *w, time_t now)
+{
+	if ((unsigned int)now != w->last)
+		frd_window_advance(w, now);
+
+	return w->sum;
+}
+
+/* NOTE: the window must be locked */
+unsigned int frd_window_inc(frd_window_t *w, time_t now)
+{
+	unsigned short *b;
+
+	frd_window_get(w, now);
+
+	b = &w->buckets[(unsigned int)now % FRD_SECS_PER_WINDOW];
+	if (*b != USHRT_MAX) {
+		(*b)++;
+		w->sum++;
+	}
+
+	return w->sum;
+}
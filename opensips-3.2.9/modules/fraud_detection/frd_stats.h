@@ -35,6 +35,13 @@
 #define FRD_PREFIX_HASH_SIZE 8
 #define FRD_SECS_PER_WINDOW 60
 
+/* sliding window of per-second call counters */
+typedef struct {
+	unsigned int last;      /* second of the last update */
+	unsigned int sum;       /* calls in the last FRD_SECS_PER_WINDOW seconds */
+	unsigned short buckets[FRD_SECS_PER_WINDOW];
+} frd_window_t;
+
 typedef struct {
 	unsigned int cpm;
 	unsigned int total_calls;
@@ -45,7 +52,7 @@ typedef struct {
 
 	unsigned int last_matched_rule;
 	time_t last_matched_time;
-	unsigned short calls_window[FRD_SECS_PER_WINDOW];
+	frd_window_t calls_window;
 } frd_stats_t;
 
 typedef struct _frd_hash_item {
@@ -59,6 +66,9 @@ frd_stats_entry_t* get_stats(str user, str prefix, str *shm_user);
 int stats_exist(str user, str prefix);
 void free_stats_table(void);
 
+unsigned int frd_window_get(frd_window_t *w, time_t now);
+unsigned int frd_window_inc(frd_window_t *w, time_t now);
+
 
 typedef struct {
 	unsigned int warning;
@@ -32,6 +32,7 @@
 #include "../../rw_locking.h"
 #include "lb_parser.h"
 #include "lb_data.h"
+#include "lb_index.h"
 #include "lb_clustering.h"
 #include "lb_db.h"
 
@@ -63,6 +64,12 @@ struct lb_data* load_lb_data(void)
 		return NULL;
 	}
 
+	if (lb_index_build(data)!=0) {
+		LM_ERR("failed to build the load index\n");
+		free_lb_data(data);
+		return NULL;
+	}
+
 	return data;
 }
 
@@ -278,6 +285,7 @@ int add_lb_dsturi( struct lb_data *data, int id, int group, char *uri,
 		2+2*sizeof(struct lb_dst*), "%X", id);
 
 	dst->id = id;
+	dst->idx = data->dst_no;
 	dst->group = group;
 	dst->rmap_no = lb_rl->n;
 	dst->flags = flags;
@@ -381,6 +389,7 @@ void free_lb_data(struct lb_data *data)
 		lbr1 = lbr1->next;
 		if (lbr2->dst_bitmap)
 			shm_free(lbr2->dst_bitmap);
+		lb_index_free(lbr2);
 		if (lbr2->lock) {
 			lock_destroy( lbr2->lock );
 			lock_dealloc( lbr2->lock );
@@ -420,13 +429,9 @@ static int get_dst_load(struct lb_resource **res, unsigned int res_no,
 			return 0;
 		}
 
-		av = 0;
-		if( flags & LB_FLAGS_RELATIVE ) {
-			if( dst->rmap[l].max_load )
-				av = 100 - (100 * lb_dlg_binds.get_profile_size(res[k]->profile, &dst->profile_id) / dst->rmap[l].max_load);
-		} else {
-			av = dst->rmap[l].max_load - lb_dlg_binds.get_profile_size(res[k]->profile, &dst->profile_id);
-		}
+		av = lb_rmap_avail( &dst->rmap[l],
+			lb_dlg_binds.get_profile_size(res[k]->profile, &dst->profile_id),
+			flags & LB_FLAGS_RELATIVE );
 
 		if( (k == 0/*first iteration*/) || (av < *load ) )
 			*load = av;
@@ -440,6 +445,78 @@ static int get_dst_load(struct lb_resource **res, unsigned int res_no,
 }
 
 
+/* The scan done by lb_start()/lb_next() when the destinations are not
+ * indexed: keeps in @dsts (up to @dsts_max of them) the destinations of
+ * @group set in @dst_bitmap with the most free capacity for all the @res
+ * resources, and returns how many were kept. @avail is set to the number
+ * of usable destinations of the group, whatever their capacity.
+ */
+int lb_scan_dsts(struct lb_data *data, struct lb_resource **res, int res_no,
+		int group, unsigned int *dst_bitmap, unsigned int flags,
+		struct lb_dst **dsts, unsigned int dsts_max, int *load, int *avail)
+{
+	struct lb_dst *it_d;
+	unsigned int dsts_no = 0;
+	int i, j, it_l = 0, cond = 0; /* 'cond' is the 'first pass' flag */
+
+	*load = 0;
+	*avail = 0;
+
+	for( i=0,j=0,it_d=data->dsts ; it_d ; it_d=it_d->next ) {
+		if( it_d->group == group ) {
+			if( (dst_bitmap[i] & (1 << j)) &&
+			((it_d->flags & LB_DST_STAT_DSBL_FLAG) == 0) ) {
+				/* valid destination (group & resources & status) */
+				(*avail)++;
+				if( get_dst_load(res, res_no, it_d, flags, &it_l) ) {
+					/* only valid load here */
+					if( (it_l > 0) || (flags & LB_FLAGS_NEGATIVE) ) {
+						/* only allowed load here */
+						if( !cond/*first pass*/ || (it_l > *load)/*new max*/ ) {
+							cond = 1;
+							/* restart buffer */
+							dsts_no = 0;
+						} else if( it_l < *load ) {
+							/* lower availability -> new iteration */
+							if( ++j == (8 * sizeof(unsigned int)) ) { i++; j=0; }
+							continue;
+						}
+
+						/* add destination to to selected destinations buffer,
+						 * if we have a room for it */
+						if( dsts_no < dsts_max ) {
+							*load = it_l;
+							dsts[dsts_no++] = it_d;
+
+							LM_DBG("LB scan - destination %d <%.*s> "
+								"selected for LB set with free=%d\n",
+								it_d->id, it_d->uri.len, it_d->uri.s, it_l
+							);
+						}
+					}
+				} else {
+					LM_WARN("LB scan - skipping destination %d <%.*s> - "
+						"unable to calculate free resources\n",
+						it_d->id, it_d->uri.len, it_d->uri.s
+					);
+				}
+			}
+			else {
+				LM_DBG("LB scan - skipping destination %d <%.*s> "
+					"(filtered=%d , disabled=%d)\n",
+					it_d->id, it_d->uri.len, it_d->uri.s,
+					((dst_bitmap[i] & (1 << j)) ? 0 : 1),
+					((it_d->flags & LB_DST_STAT_DSBL_FLAG) ? 1 : 0)
+				);
+			}
+		}
+		if( ++j == (8 * sizeof(unsigned int)) ) { i++; j=0; }
+	}
+
+	return dsts_no;
+}
+
+
 /* Performce the LB logic. It may return:
  *   0 - success
  *  -1 - generic error
@@ -488,7 +565,7 @@ int lb_route(struct sip_msg *req, int group, struct lb_res_str_list *rl,
 	/* iterators, e.t.c. */
 	struct lb_dst *it_d;
 	struct lb_resource *it_r;
-	int load, it_l;
+	int load;
 	int i, j, cond, cnt_aval_dst;
 
 
@@ -750,62 +827,18 @@ int lb_route(struct sip_msg *req, int group, struct lb_res_str_list *rl,
 	/* do the load-balancing */
 
 	/*  select destinations */
-	cond = 0; /* use it here as a 'first iteration' flag */
-	load = it_l = 0;
+	load = 0;
 	dsts_size_cur = 0;
 	cnt_aval_dst = 0;
-	for( it_d=data->dsts,i=0,j=0 ; it_d ; it_d=it_d->next ) {
-		if( it_d->group == group ) {
-			if( (dst_bitmap_cur[i] & (1 << j)) &&
-			((it_d->flags & LB_DST_STAT_DSBL_FLAG) == 0) ) {
-				/* valid destination (group & resources & status) */
-				cnt_aval_dst++;
-				if( get_dst_load(res_cur, res_cur_n, it_d, flags, &it_l) ) {
-					/* only valid load here */
-					if( (it_l > 0) || (flags & LB_FLAGS_NEGATIVE) ) {
-						/* only allowed load here */
-						if( !cond/*first pass*/ || (it_l > load)/*new max*/ ) {
-							cond = 1;
-							/* restart buffer */
-							dsts_size_cur = 0;
-						} else if( it_l < load ) {
-							/* lower availability -> new iteration */
-							if( ++j == (8 * sizeof(unsigned int)) ) { i++; j=0; }
-							continue;
-						}
-
-						/* add destination to to selected destinations buffer,
-						 * if we have a room for it */
-						if( dsts_size_cur < dsts_size_max ) {
-							load = it_l;
-							dsts_cur[dsts_size_cur++] = it_d;
-
-							LM_DBG("%s call of LB - destination %d <%.*s> "
-								"selected for LB set with free=%d\n",
-								(reuse ? "sequential" : "initial"),
-								it_d->id, it_d->uri.len, it_d->uri.s, it_l
-							);
-						}
-					}
-				} else {
-					LM_WARN("%s call of LB - skipping destination %d <%.*s> - "
-						"unable to calculate free resources\n",
-						(reuse ? "sequential" : "initial"),
-						it_d->id, it_d->uri.len, it_d->uri.s
-					);
-				}
-			}
-			else {
-				LM_DBG("%s call of LB - skipping destination %d <%.*s> "
-					"(filtered=%d , disabled=%d)\n",
-					(reuse ? "sequential" : "initial"),
-					it_d->id, it_d->uri.len, it_d->uri.s,
-					((dst_bitmap_cur[i] & (1 << j)) ? 0 : 1),
-					((it_d->flags & LB_DST_STAT_DSBL_FLAG) ? 1 : 0)
-				);
-			}
-		}
-		if( ++j == (8 * sizeof(unsigned int)) ) { i++; j=0; }
+	if( (res_cur_n == 1) && res_cur[0]->index && res_cur[0]->index->watch ) {
+		/* single resource with the loads pushed by the dialog module -
+		 * the index knows the best destination */
+		dst = lb_index_select( res_cur[0]->index, group, dst_bitmap_cur,
+			flags, &load, &cnt_aval_dst);
+	} else {
+		dsts_size_cur = lb_scan_dsts( data, res_cur, res_cur_n, group,
+			dst_bitmap_cur, flags, dsts_cur, dsts_size_max, &load,
+			&cnt_aval_dst);
 	}
 	/* choose one destination among selected */
 	if( dsts_size_cur > 0 ) {
@@ -834,10 +867,8 @@ int lb_route(struct sip_msg *req, int group, struct lb_res_str_list *rl,
 		}
 
 		/* set dst as used (not selected) */
-		for( it_d=data->dsts,i=0,j=0 ; it_d ; it_d=it_d->next ) {
-			if( it_d == dst ) { dst_bitmap_cur[i] &= ~(1 << j); break; }
-			if( ++j == (8 * sizeof(unsigned int)) ) { i++; j=0; }
-		}
+		dst_bitmap_cur[dst->idx / (8 * sizeof(unsigned int))] &=
+			~(1 << (dst->idx % (8 * sizeof(unsigned int))));
 	} else {
 		LM_DBG("%s call of LB - no destination found\n",
 			(reuse ? "sequential" : "initial"));
@@ -49,12 +49,16 @@
 
 extern rw_lock_t *ref_lock;
 
+struct lb_res_index;
+struct lb_grp_index;
+
 struct lb_resource {
 	str name;
 	gen_lock_t *lock;
 	struct dlg_profile_table *profile;
 	unsigned int bitmap_size;
 	unsigned int *dst_bitmap;
+	struct lb_res_index *index;
 	struct lb_resource *next;
 };
 
@@ -63,11 +67,19 @@ struct lb_resource_map {
 	unsigned int max_load;
 
 	int fs_enabled;
+
+	/* position of the destination in the load index of the resource */
+	struct lb_dst *dst;
+	struct lb_grp_index *grp;
+	unsigned int heap_pos[2];
+	unsigned int load;
+	int load_set;
 };
 
 struct lb_dst {
 	unsigned int group;
 	unsigned int id;
+	unsigned int idx; /* position in the set, also used by the bitmaps */
 	str uri;
 	str profile_id;
 	unsigned int rmap_no;
@@ -97,6 +109,10 @@ int add_lb_dsturi( struct lb_data *data, int id, int group, char *uri,
 
 void free_lb_data(struct lb_data *data);
 
+int lb_scan_dsts(struct lb_data *data, struct lb_resource **res, int res_no,
+		int group, unsigned int *dst_bitmap, unsigned int flags,
+		struct lb_dst **dsts, unsigned int dsts_max, int *load, int *avail);
+
 int do_lb_start(struct sip_msg *req, int group, struct lb_res_str_list *rl,
 		unsigned int flags, struct lb_data *data, str *attrs);
 
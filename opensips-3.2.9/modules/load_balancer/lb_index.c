@@ -0,0 +1,496 @@
+/*
+ * load balancer module - load index of the destinations
+ *
+ * Copyright (C) 2026 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../dprint.h"
+#include "../../ut.h"
+#include "../../mem/mem.h"
+#include "../../mem/shm_mem.h"
+#include "lb_index.h"
+
+/* dialog stuff */
+extern struct dlg_binds lb_dlg_binds;
+
+/* the watched profiles, never released as the dialog module may push
+ * counters up to its very end */
+static struct lb_prof_watch **lb_watches = NULL;
+
+struct lb_sel {
+	unsigned int *bitmap;
+	unsigned int flags;
+	int heap;
+	struct lb_resource_map *best;
+	int load;
+	unsigned int ties;
+};
+
+#define lb_dst_valid(_bitmap, _dst) \
+	(((_bitmap)[(_dst)->idx / (8 * sizeof(unsigned int))] & \
+		(1 << ((_dst)->idx % (8 * sizeof(unsigned int))))) && \
+	(((_dst)->flags & LB_DST_STAT_DSBL_FLAG) == 0))
+
+#define lb_rmap_key(_rm, _h) lb_rmap_avail(_rm, (_rm)->load, _h)
+
+
+/* more free capacity, or the same but earlier in the set */
+static inline int lb_rmap_above(struct lb_resource_map *a,
+									struct lb_resource_map *b, int h)
+{
+	int ka = lb_rmap_key(a, h), kb = lb_rmap_key(b, h);
+
+	return ka > kb || (ka == kb && a->dst->idx < b->dst->idx);
+}
+
+static inline void lb_heap_set(struct lb_grp_index *grp, int h,
+									unsigned int i, struct lb_resource_map *rm)
+{
+	grp->heap[h][i] = rm;
+	rm->heap_pos[h] = i;
+}
+
+static void lb_heap_up(struct lb_grp_index *grp, int h, unsigned int i)
+{
+	struct lb_resource_map *rm = grp->heap[h][i];
+	unsigned int p;
+
+	while (i > 0) {
+		p = (i - 1) / 2;
+		if (!lb_rmap_above(rm, grp->heap[h][p], h))
+			break;
+		lb_heap_set(grp, h, i, grp->heap[h][p]);
+		i = p;
+	}
+	lb_heap_set(grp, h, i, rm);
+}
+
+static void lb_heap_down(struct lb_grp_index *grp, int h, unsigned int i)
+{
+	struct lb_resource_map *rm = grp->heap[h][i];
+	unsigned int c;
+
+	while ((c = 2 * i + 1) < grp->n) {
+		if (c + 1 < grp->n &&
+		lb_rmap_above(grp->heap[h][c + 1], grp->heap[h][c], h))
+			c++;
+		if (!lb_rmap_above(grp->heap[h][c], rm, h))
+			break;
+		lb_heap_set(grp, h, i, grp->heap[h][c]);
+		i = c;
+	}
+	lb_heap_set(grp, h, i, rm);
+}
+
+static inline void lb_heap_fix(struct lb_resource_map *rm)
+{
+	int h;
+
+	for (h = LB_HEAP_ABS; h <= LB_HEAP_REL; h++) {
+		lb_heap_up(rm->grp, h, rm->heap_pos[h]);
+		lb_heap_down(rm->grp, h, rm->heap_pos[h]);
+	}
+}
+
+static inline void lb_set_load(struct lb_resource_map *rm, unsigned int load)
+{
+	rm->load_set = 1;
+	if (rm->load == load)
+		return;
+
+	rm->load = load;
+	lb_heap_fix(rm);
+}
+
+
+/* position of the first destination with @id in the index */
+static unsigned int lb_find_id(struct lb_res_index *index, unsigned int id)
+{
+	unsigned int lo = 0, hi = index->maps_no, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (index->maps[mid]->dst->id < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static void lb_profile_cb(struct dlg_profile_table *profile, str *value,
+										unsigned int count, void *param)
+{
+	struct lb_prof_watch *w = (struct lb_prof_watch *)param;
+	struct lb_res_index *index;
+	unsigned int id, i;
+
+	/* the value is the hex id of the destination */
+	if (hexstr2int(value->s, value->len, &id) < 0)
+		return;
+
+	lock_get(&w->lock);
+
+	index = w->index;
+	if (index)
+		for (i = lb_find_id(index, id);
+		i < index->maps_no && index->maps[i]->dst->id == id; i++)
+			lb_set_load(index->maps[i], count);
+
+	lock_release(&w->lock);
+}
+
+
+int lb_index_init(void)
+{
+	lb_watches = (struct lb_prof_watch **)shm_malloc(sizeof *lb_watches);
+	if (lb_watches == NULL) {
+		LM_ERR("no more shm mem\n");
+		return -1;
+	}
+	*lb_watches = NULL;
+
+	return 0;
+}
+
+
+static struct lb_prof_watch *lb_get_watch(struct dlg_profile_table *profile)
+{
+	struct lb_prof_watch *w;
+
+	for (w = *lb_watches; w; w = w->next)
+		if (w->profile == profile)
+			return w;
+
+	w = (struct lb_prof_watch *)shm_malloc(sizeof *w);
+	if (w == NULL) {
+		LM_ERR("no more shm mem\n");
+		return NULL;
+	}
+	memset(w, 0, sizeof *w);
+	w->profile = profile;
+
+	if (lock_init(&w->lock) == 0) {
+		LM_CRIT("failed to init lock\n");
+		shm_free(w);
+		return NULL;
+	}
+
+	if (lb_dlg_binds.register_profile_cb(profile, lb_profile_cb, w) != 0) {
+		lock_destroy(&w->lock);
+		shm_free(w);
+		return NULL;
+	}
+
+	w->next = *lb_watches;
+	*lb_watches = w;
+
+	return w;
+}
+
+
+static int lb_cmp_group(const void *a, const void *b)
+{
+	struct lb_dst *x = (*(struct lb_resource_map **)a)->dst;
+	struct lb_dst *y = (*(struct lb_resource_map **)b)->dst;
+
+	if (x->group != y->group)
+		return x->group < y->group ? -1 : 1;
+
+	return x->idx < y->idx ? -1 : (x->idx > y->idx);
+}
+
+static int lb_cmp_id(const void *a, const void *b)
+{
+	struct lb_dst *x = (*(struct lb_resource_map **)a)->dst;
+	struct lb_dst *y = (*(struct lb_resource_map **)b)->dst;
+
+	if (x->id != y->id)
+		return x->id < y->id ? -1 : 1;
+
+	return x->idx < y->idx ? -1 : (x->idx > y->idx);
+}
+
+static int lb_build_res_index(struct lb_data *data, struct lb_resource *res)
+{
+	struct lb_res_index *index;
+	struct lb_grp_index *grp;
+	struct lb_resource_map **maps, **heaps;
+	struct lb_dst *dst;
+	unsigned int n, grps_no, i, k;
+	int h;
+
+	for (n = 0, dst = data->dsts; dst; dst = dst->next)
+		for (i = 0; i < dst->rmap_no; i++)
+			if (dst->rmap[i].resource == res)
+				n++;
+	if (n == 0)
+		return 0;
+
+	maps = (struct lb_resource_map **)pkg_malloc(n * sizeof *maps);
+	if (maps == NULL) {
+		LM_ERR("no more pkg mem\n");
+		return -1;
+	}
+
+	for (n = 0, dst = data->dsts; dst; dst = dst->next)
+		for (i = 0; i < dst->rmap_no; i++)
+			if (dst->rmap[i].resource == res) {
+				dst->rmap[i].dst = dst;
+				maps[n++] = &dst->rmap[i];
+			}
+
+	qsort(maps, n, sizeof *maps, lb_cmp_group);
+	for (grps_no = 0, i = 0; i < n; i++)
+		if (i == 0 || maps[i]->dst->group != maps[i - 1]->dst->group)
+			grps_no++;
+
+	/* the heaps of all the groups share the same two arrays */
+	index = (struct lb_res_index *)shm_malloc(sizeof *index +
+		grps_no * sizeof *index->grps + 3 * n * sizeof *maps);
+	if (index == NULL) {
+		LM_ERR("no more shm mem for the index of <%.*s>\n",
+			res->name.len, res->name.s);
+		pkg_free(maps);
+		return -1;
+	}
+	memset(index, 0, sizeof *index + grps_no * sizeof *index->grps);
+	index->grps = (struct lb_grp_index *)(index + 1);
+	index->grps_no = grps_no;
+	index->maps = (struct lb_resource_map **)(index->grps + grps_no);
+	index->maps_no = n;
+	heaps = index->maps + n;
+
+	for (grp = NULL, i = 0; i < n; i++) {
+		if (grp == NULL || maps[i]->dst->group != grp->group) {
+			grp = grp ? grp + 1 : index->grps;
+			grp->group = maps[i]->dst->group;
+			grp->heap[LB_HEAP_ABS] = heaps + i;
+			grp->heap[LB_HEAP_REL] = heaps + n + i;
+		}
+		maps[i]->grp = grp;
+		for (h = LB_HEAP_ABS; h <= LB_HEAP_REL; h++)
+			lb_heap_set(grp, h, grp->n, maps[i]);
+		grp->n++;
+	}
+
+	for (k = 0; k < grps_no; k++)
+		for (h = LB_HEAP_ABS; h <= LB_HEAP_REL; h++)
+			for (i = index->grps[k].n / 2; i-- > 0; )
+				lb_heap_down(&index->grps[k], h, i);
+
+	memcpy(index->maps, maps, n * sizeof *maps);
+	qsort(index->maps, n, sizeof *maps, lb_cmp_id);
+	pkg_free(maps);
+
+	res->index = index;
+	return 0;
+}
+
+
+int lb_index_build(struct lb_data *data)
+{
+	struct lb_resource *res;
+
+	for (res = data->resources; res; res = res->next) {
+		if (res->profile->repl_type != REPL_NONE) {
+			LM_DBG("profile of <%.*s> is replicated, not indexed\n",
+				res->name.len, res->name.s);
+			continue;
+		}
+		if (lb_build_res_index(data, res) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+
+void lb_index_free(struct lb_resource *res)
+{
+	struct lb_res_index *index = res->index;
+
+	if (index == NULL)
+		return;
+
+	if (index->watch) {
+		lock_get(&index->watch->lock);
+		if (index->watch->index == index)
+			index->watch->index = NULL;
+		lock_release(&index->watch->lock);
+	}
+
+	shm_free(index);
+	res->index = NULL;
+}
+
+
+void lb_index_attach(struct lb_data *data)
+{
+	struct lb_resource *res;
+	struct lb_res_index *index;
+	struct lb_resource_map *rm;
+	struct lb_prof_watch *w;
+	unsigned int i, load;
+
+	for (res = data->resources; res; res = res->next) {
+		index = res->index;
+		if (index == NULL)
+			continue;
+
+		w = lb_get_watch(res->profile);
+		if (w == NULL) {
+			LM_WARN("cannot watch profile <%.*s>, the destinations of "
+				"<%.*s> will be scanned\n", res->profile->name.len,
+				res->profile->name.s, res->name.len, res->name.s);
+			continue;
+		}
+
+		lock_get(&w->lock);
+		w->index = index;
+		index->watch = w;
+		lock_release(&w->lock);
+
+		/* catch up with the calls counted so far; a counter pushed after
+		 * attaching is newer than the one read here, so it is kept */
+		for (i = 0; i < index->maps_no; i++) {
+			rm = index->maps[i];
+			load = lb_dlg_binds.get_profile_size(res->profile,
+				&rm->dst->profile_id);
+
+			lock_get(&w->lock);
+			if (!rm->load_set)
+				lb_set_load(rm, load);
+			lock_release(&w->lock);
+		}
+	}
+}
+
+
+void lb_index_set_max_load(struct lb_resource_map *rm, unsigned int max_load)
+{
+	struct lb_prof_watch *w;
+
+	if (rm->grp == NULL) {
+		rm->max_load = max_load;
+		return;
+	}
+
+	w = rm->resource->index->watch;
+	if (w)
+		lock_get(&w->lock);
+	rm->max_load = max_load;
+	lb_heap_fix(rm);
+	if (w)
+		lock_release(&w->lock);
+}
+
+
+static void lb_heap_search(struct lb_grp_index *grp, unsigned int i,
+															struct lb_sel *sel)
+{
+	struct lb_resource_map *rm;
+	int key;
+
+	/* the left subtree is searched recursively, the right one in place */
+	for ( ; i < grp->n; i = 2 * i + 2) {
+		rm = grp->heap[sel->heap][i];
+		key = lb_rmap_key(rm, sel->heap);
+
+		/* nothing below may do better than this node */
+		if (key <= 0 && !(sel->flags & LB_FLAGS_NEGATIVE))
+			return;
+		if (sel->best && (key < sel->load || (key == sel->load &&
+		!(sel->flags & LB_FLAGS_RANDOM) && rm->dst->idx > sel->best->dst->idx)))
+			return;
+
+		if (lb_dst_valid(sel->bitmap, rm->dst)) {
+			if (sel->best == NULL || key > sel->load) {
+				sel->best = rm;
+				sel->load = key;
+				sel->ties = 1;
+			} else if (!(sel->flags & LB_FLAGS_RANDOM)) {
+				/* same load, earlier in the set */
+				sel->best = rm;
+			} else if (rand() % ++sel->ties == 0) {
+				sel->best = rm;
+			}
+		}
+
+		lb_heap_search(grp, 2 * i + 1, sel);
+	}
+}
+
+/* Picks the destination of @group with the most free capacity, among the
+ * ones set in @dst_bitmap and not disabled, just like lb_start() does when
+ * scanning them. @avail is set if there is any such destination, even if
+ * none has capacity left.
+ */
+struct lb_dst *lb_index_select(struct lb_res_index *index, unsigned int group,
+		unsigned int *dst_bitmap, unsigned int flags, int *load, int *avail)
+{
+	struct lb_grp_index *grp;
+	struct lb_sel sel;
+	unsigned int lo, hi, mid, i;
+
+	*avail = 0;
+
+	for (lo = 0, hi = index->grps_no; lo < hi; ) {
+		mid = (lo + hi) / 2;
+		if (index->grps[mid].group < group)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == index->grps_no || index->grps[lo].group != group)
+		return NULL;
+	grp = &index->grps[lo];
+
+	memset(&sel, 0, sizeof sel);
+	sel.bitmap = dst_bitmap;
+	sel.flags = flags;
+	sel.heap = (flags & LB_FLAGS_RELATIVE) ? LB_HEAP_REL : LB_HEAP_ABS;
+
+	if (index->watch)
+		lock_get(&index->watch->lock);
+
+	lb_heap_search(grp, 0, &sel);
+
+	if (sel.best == NULL) {
+		for (i = 0; i < grp->n; i++)
+			if (lb_dst_valid(dst_bitmap, grp->heap[LB_HEAP_ABS][i]->dst)) {
+				*avail = 1;
+				break;
+			}
+	}
+
+	if (index->watch)
+		lock_release(&index->watch->lock);
+
+	if (sel.best == NULL)
+		return NULL;
+
+	*avail = 1;
+	*load = sel.load;
+	return sel.best->dst;
+}
@@ -0,0 +1,93 @@
+/*
+ * load balancer module - load index of the destinations
+ *
+ * Copyright (C) 2026 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * For each resource, the destinations of each group are kept in two
+ * max-heaps, ordered by their free capacity - absolute and relative - and
+ * then by their position in the set. The number of calls of each
+ * destination is pushed by the dialog module, each time its profile
+ * counter changes, so lb_start() no longer has to look up the profile of
+ * every destination in the group.
+ *
+ * The index is built with each data set and attached to the (persistent)
+ * watcher of the dialog profile of the resource when the set becomes the
+ * active one. Only the profiles kept locally can be
+ * watched - the resources counted via cachedb or replicated profiles have
+ * no index and are balanced by scanning the destinations, as before.
+ *
+ * Lock ordering: profile lock -> watch lock, resource lock -> watch lock.
+ */
+
+#ifndef LB_LB_INDEX_H_
+#define LB_LB_INDEX_H_
+
+#include "../../locking.h"
+#include "lb_data.h"
+
+#define LB_HEAP_ABS  0
+#define LB_HEAP_REL  1
+
+struct lb_prof_watch {
+	struct dlg_profile_table *profile;
+	gen_lock_t lock;
+	struct lb_res_index *index; /* of the active data set, if any */
+	struct lb_prof_watch *next;
+};
+
+struct lb_grp_index {
+	unsigned int group;
+	unsigned int n;
+	struct lb_resource_map **heap[2];
+};
+
+struct lb_res_index {
+	struct lb_prof_watch *watch;
+	unsigned int grps_no;
+	struct lb_grp_index *grps;   /* ordered by group */
+	unsigned int maps_no;
+	struct lb_resource_map **maps; /* ordered by destination id */
+};
+
+/* free capacity of a destination, as computed by lb_start() */
+static inline int lb_rmap_avail(struct lb_resource_map *rm,
+											unsigned int load, int relative)
+{
+	if (relative)
+		return rm->max_load ? 100 - (100 * load / rm->max_load) : 0;
+
+	return rm->max_load - load;
+}
+
+int lb_index_init(void);
+
+int lb_index_build(struct lb_data *data);
+
+void lb_index_free(struct lb_resource *res);
+
+void lb_index_attach(struct lb_data *data);
+
+void lb_index_set_max_load(struct lb_resource_map *rm, unsigned int max_load);
+
+struct lb_dst *lb_index_select(struct lb_res_index *index, unsigned int group,
+		unsigned int *dst_bitmap, unsigned int flags, int *load, int *avail);
+
+#endif
@@ -36,6 +36,7 @@
 #include "lb_parser.h"
 #include "lb_db.h"
 #include "lb_data.h"
+#include "lb_index.h"
 #include "lb_clustering.h"
 #include "lb_prober.h"
 #include "lb_bl.h"
@@ -330,6 +331,9 @@ static inline int lb_reload_data( void )
 	old_data = *curr_data;
 	*curr_data = new_data;
 
+	/* have the dialog module push the loads into the new index */
+	lb_index_attach( new_data );
+
 	lock_stop_write( ref_lock );
 
 	/* destroy old data */
@@ -381,6 +385,11 @@ static int mod_init(void)
 		return -1;
 	}
 
+	if (lb_index_init()!=0) {
+		LM_ERR("failed to init the load index\n");
+		return -1;
+	}
+
 	if (init_lb_bls()) {
 		LM_ERR("BL INIT failed\n");
 		return -1;
@@ -804,14 +813,14 @@ static void lb_update_max_loads(unsigned int ticks, void *param)
 				 * subtracted from the remote "max sessions" value
 				 */
 				if (psz < dst->fs_sock->stats.max_sess) {
-					dst->rmap[ri].max_load =
+					lb_index_set_max_load(&dst->rmap[ri],
 					(dst->fs_sock->stats.id_cpu / (float)100) *
 						(dst->fs_sock->stats.max_sess -
-						 (dst->fs_sock->stats.sess - psz));
+						 (dst->fs_sock->stats.sess - psz)));
 				} else {
-					dst->rmap[ri].max_load =
+					lb_index_set_max_load(&dst->rmap[ri],
 					(dst->fs_sock->stats.id_cpu / (float)100) *
-						dst->fs_sock->stats.max_sess;
+						dst->fs_sock->stats.max_sess);
 				}
 				LM_DBG("load update on FS (%p) %s:%d: "
 				       "%d -> %d (%d %d %.3f), prof=%d\n",
@@ -885,7 +894,7 @@ mi_response_t *mi_lb_resize(const mi_params_t *params,
 			return init_mi_error( 404,
 				MI_SSTR("Destination has no such resource"));
 		} else {
-			dst->rmap[n].max_load = size;
+			lb_index_set_max_load(&dst->rmap[n], size);
 		}
 	}
 
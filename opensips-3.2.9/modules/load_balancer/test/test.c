@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2026 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <tap.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "../../../dprint.h"
+#include "../../../mem/shm_mem.h"
+#include "../../../ut.h"
+
+#include "../lb_data.h"
+#include "../lb_index.h"
+
+#define GROUPS        3
+#define UPDATES       200000
+#define SELECTS       100000
+#define BITS          (8 * sizeof(unsigned int))
+
+extern struct dlg_binds lb_dlg_binds;
+
+static str bench_profile = str_init("lbXbench");
+
+
+static inline long long now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+/* builds a set of @n destinations, spread over GROUPS groups, all having
+ * the "bench" resource, with random capacities */
+static struct lb_data *bench_data(unsigned int n,
+										struct dlg_profile_table *profile)
+{
+	struct lb_data *data;
+	struct lb_resource *res;
+	struct lb_dst *dst;
+	unsigned int i;
+
+	data = shm_malloc(sizeof *data + sizeof *res);
+	if (!data)
+		return NULL;
+	memset(data, 0, sizeof *data + sizeof *res);
+
+	res = (struct lb_resource *)(data + 1);
+	res->name.s = "bench";
+	res->name.len = 5;
+	res->profile = profile;
+	data->resources = res;
+	data->res_no = 1;
+
+	for (i = 0; i < n; i++) {
+		dst = shm_malloc(sizeof *dst + sizeof *dst->rmap + 12);
+		if (!dst)
+			return NULL;
+		memset(dst, 0, sizeof *dst + sizeof *dst->rmap);
+
+		dst->id = 1000 + i;
+		dst->idx = i;
+		/* the same group for a few neighbours, like most setups */
+		dst->group = (i / 7) % GROUPS;
+		dst->rmap_no = 1;
+		dst->rmap = (struct lb_resource_map *)(dst + 1);
+		dst->rmap->resource = res;
+		dst->rmap->max_load = 50 + rand() % 150;
+		dst->profile_id.s = (char *)(dst->rmap + 1);
+		dst->profile_id.len = sprintf(dst->profile_id.s, "%X", dst->id);
+
+		if (data->last_dst)
+			data->last_dst->next = dst;
+		else
+			data->dsts = dst;
+		data->last_dst = dst;
+		data->dst_no++;
+	}
+
+	return data;
+}
+
+static void free_bench_data(struct lb_data *data)
+{
+	struct lb_dst *dst;
+
+	lb_index_free(data->resources);
+	while ((dst = data->dsts)) {
+		data->dsts = dst->next;
+		shm_free(dst);
+	}
+	shm_free(data);
+}
+
+/* the calls of each destination, as counted by the dialog profile */
+static unsigned int *prof_loads;
+
+static unsigned int prof_size(struct dlg_profile_table *profile, str *value)
+{
+	unsigned int id;
+
+	/* the profile value of a destination is its id, in hex */
+	if (hexstr2int(value->s, value->len, &id) != 0)
+		return 0;
+
+	return prof_loads[id - 1000];
+}
+
+static void push_load(struct lb_dst *dst, unsigned int load)
+{
+	struct dlg_profile_table *p = dst->rmap->resource->profile;
+
+	prof_loads[dst->idx] = load;
+	p->size_cb(p, &dst->profile_id, load, p->size_cb_param);
+}
+
+
+/*
+ * Random load changes, pushed through the dialog callback, and random
+ * lb_start() calls: the index must always pick what the scan of the
+ * profiles picks
+ */
+static void test_index(unsigned int n, struct dlg_profile_table *profile)
+{
+	static const unsigned int flag_sets[] = {
+		LB_FLAGS_DEFAULT, LB_FLAGS_RELATIVE, LB_FLAGS_NEGATIVE,
+		LB_FLAGS_RELATIVE|LB_FLAGS_NEGATIVE, LB_FLAGS_RANDOM,
+		LB_FLAGS_RELATIVE|LB_FLAGS_RANDOM,
+	};
+	get_profile_size_f get_profile_size = lb_dlg_binds.get_profile_size;
+	struct lb_data *data;
+	struct lb_dst **dsts, **sel, *dst, *got;
+	unsigned int *bitmap, i, k, flags, group, sel_max, exp_no;
+	int exp_load = 0, got_load = 0, exp_avail, got_avail;
+	int bad = 0, full = 0;
+
+	data = bench_data(n, profile);
+	dsts = malloc(n * sizeof *dsts);
+	sel = malloc(n * sizeof *sel);
+	bitmap = malloc((n / BITS + 1) * sizeof *bitmap);
+	prof_loads = calloc(n, sizeof *prof_loads);
+	if (!ok(data && dsts && sel && bitmap && prof_loads,
+	"init %u destinations", n))
+		return;
+	for (i = 0, dst = data->dsts; dst; dst = dst->next)
+		dsts[i++] = dst;
+
+	/* the scan reads the loads from the profile */
+	lb_dlg_binds.get_profile_size = prof_size;
+
+	ok(lb_index_build(data) == 0, "build the index (%u)", n);
+	lb_index_attach(data);
+	if (!ok(data->resources->index && data->resources->index->watch &&
+	profile->size_cb, "index attached to the profile (%u)", n))
+		goto out;
+
+	for (i = 0; i < UPDATES; i++) {
+		dst = dsts[rand() % n];
+		/* also overload some of them */
+		push_load(dst, rand() % (dst->rmap->max_load + 20));
+
+		if (rand() % 50 == 0)
+			dst->flags ^= LB_DST_STAT_DSBL_FLAG;
+
+		if (i % 4)
+			continue;
+
+		/* some destinations were already tried by lb_next() */
+		for (k = 0; k <= n / BITS; k++)
+			bitmap[k] = (rand() % 4) ? ~0U : ~(1U << (rand() % BITS));
+
+		flags = flag_sets[rand() % (sizeof flag_sets / sizeof *flag_sets)];
+		group = rand() % GROUPS;
+
+		/* as lb_route() does, all the best ones are kept if random */
+		sel_max = (flags & LB_FLAGS_RANDOM) ? n : 1;
+		exp_no = lb_scan_dsts(data, &data->resources, 1, group, bitmap,
+			flags, sel, sel_max, &exp_load, &exp_avail);
+		got = lb_index_select(data->resources->index, group, bitmap, flags,
+			&got_load, &got_avail);
+
+		if (!exp_no)
+			full++;
+
+		for (k = 0; k < exp_no && sel[k] != got; k++) ;
+
+		if (!exp_no != !got || (got && (k == exp_no ||
+		exp_load != got_load)) || !exp_avail != !got_avail)
+			bad++;
+	}
+
+	ok(bad == 0, "index matches the scan (%u dsts, %d mismatches, "
+		"%d without capacity)", n, bad, full);
+
+	/* every load comes back to 0 */
+	for (i = 0; i < n; i++)
+		push_load(dsts[i], 0);
+	got = lb_index_select(data->resources->index, 0, bitmap,
+		LB_FLAGS_DEFAULT, &got_load, &got_avail);
+	exp_no = lb_scan_dsts(data, &data->resources, 1, 0, bitmap,
+		LB_FLAGS_DEFAULT, sel, 1, &exp_load, &exp_avail);
+	ok(exp_no ? got == sel[0] : got == NULL, "back to idle (%u)", n);
+
+out:
+	lb_dlg_binds.get_profile_size = get_profile_size;
+	free_bench_data(data);
+	free(dsts);
+	free(sel);
+	free(bitmap);
+	free(prof_loads);
+	prof_loads = NULL;
+}
+
+
+/*
+ * lb_start() cost for a group: the index vs the scan of the profile
+ */
+static void test_bench(unsigned int n, struct dlg_profile_table *profile)
+{
+	struct lb_data *data;
+	struct lb_dst *dst, *sel;
+	unsigned int *bitmap, i, group;
+	int load = 0, avail;
+	long long start, took_idx, took_scan;
+
+	data = bench_data(n, profile);
+	bitmap = malloc((n / BITS + 1) * sizeof *bitmap);
+	prof_loads = calloc(n, sizeof *prof_loads);
+	if (!ok(data && bitmap && prof_loads && lb_index_build(data) == 0,
+	"init bench of %u destinations", n))
+		return;
+	memset(bitmap, 0xff, (n / BITS + 1) * sizeof *bitmap);
+	lb_index_attach(data);
+
+	for (dst = data->dsts; dst; dst = dst->next)
+		push_load(dst, rand() % dst->rmap->max_load);
+
+	/* each selected destination gets one more call */
+	start = now_us();
+	for (i = 0; i < SELECTS; i++) {
+		group = i % GROUPS;
+		sel = lb_index_select(data->resources->index, group, bitmap,
+			LB_FLAGS_RELATIVE, &load, &avail);
+		if (sel)
+			push_load(sel, sel->rmap->load + 1);
+		if (i % 8 == 0) {
+			/* and some calls end */
+			dst = data->last_dst;
+			if (dst->rmap->load)
+				push_load(dst, dst->rmap->load - 1);
+		}
+	}
+	took_idx = now_us() - start;
+
+	/* the scan looks up the dialog profile itself */
+	start = now_us();
+	for (i = 0; i < SELECTS; i++)
+		lb_scan_dsts(data, &data->resources, 1, i % GROUPS, bitmap,
+			LB_FLAGS_RELATIVE, &sel, 1, &load, &avail);
+	took_scan = now_us() - start;
+
+	diag("%u destinations: index %.0f ns/call, scan %.0f ns/call",
+		n, took_idx * 1000.0 / SELECTS, took_scan * 1000.0 / SELECTS);
+
+	free_bench_data(data);
+	free(bitmap);
+	free(prof_loads);
+	prof_loads = NULL;
+}
+
+
+void mod_tests(void)
+{
+	struct dlg_profile_table *profile;
+
+	profile = lb_dlg_binds.search_profile(&bench_profile);
+	if (!ok(profile != NULL, "profile <%.*s> defined", bench_profile.len,
+	bench_profile.s))
+		return;
+
+	test_index(10, profile);
+	test_index(300, profile);
+	test_bench(300, profile);
+	test_bench(3000, profile);
+}
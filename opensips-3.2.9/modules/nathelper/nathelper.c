@@ -46,7 +46,11 @@
  * 2010-09-23 Remove force-rtp-proxy function
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* we need this for sendmmsg() */
+#endif
 #include <sys/types.h>
+#include <sys/socket.h>
 #include <netinet/in.h>
 #ifndef __USE_BSD
 #define  __USE_BSD
@@ -107,6 +111,13 @@ static int sipping_latency_flag = -1;  /* by the code imported by sip_pinger*/
 #define SKIP_OLDORIGIP		(1<<0)
 #define SKIP_OLDMEDIAIP		(1<<1)
 
+/* max number of UDP keepalives pushed to the kernel with one syscall */
+#define NH_PING_BATCH 64
+
+#if defined(__OS_linux) && defined(MSG_WAITFORONE)
+#define NH_HAVE_SENDMMSG
+#endif
+
 #define STORE_BRANCH_CTID \
 	(sipping_flag && (rm_on_to_flag || sipping_latency_flag))
 
@@ -132,6 +143,7 @@ static mi_response_t *mi_enable_natping_1(const mi_params_t *params,
 //static
 usrloc_api_t ul;
 static int cblen = 0;
+static void *cbuf = NULL; /* kept across timer runs, grows on demand */
 static str nortpproxy_str = str_init("a=nortpproxy:yes");
 static int natping_interval = 0;
 struct socket_info* force_socket = 0;
@@ -213,6 +225,18 @@ static unsigned int raw_ip = 0;
 static unsigned short raw_port = 0;
 int skip_oldip=0;
 
+/* plain UDP keepalives queued for a batched send */
+struct nh_ping_batch {
+	int fd;
+	unsigned int n;
+	union sockaddr_union to[NH_PING_BATCH];
+#ifdef NH_HAVE_SENDMMSG
+	struct iovec iov[NH_PING_BATCH];
+	struct mmsghdr msgs[NH_PING_BATCH];
+#endif
+};
+static struct nh_ping_batch ping_batch;
+
 /*0-> disabled, 1 ->enabled*/
 unsigned int *natping_state=0;
 
@@ -1259,11 +1283,93 @@ static int send_raw(const char *buf, int buf_len, union sockaddr_union *to,
 }
 
 
+/*
+ * Pushes all the queued UDP keepalives out of the pending batch
+ */
+static void nh_flush_pings(void)
+{
+	struct nh_ping_batch *b = &ping_batch;
+	unsigned int i;
+#ifdef NH_HAVE_SENDMMSG
+	unsigned int failed;
+	int rc;
+#endif
+
+	if (b->n == 0)
+		return;
+
+#ifdef NH_HAVE_SENDMMSG
+	for (i = 0; i < b->n; i++) {
+		b->iov[i].iov_base = (void *)sbuf;
+		b->iov[i].iov_len = sizeof(sbuf);
+		memset(&b->msgs[i], 0, sizeof b->msgs[i]);
+		b->msgs[i].msg_hdr.msg_name = &b->to[i].s;
+		b->msgs[i].msg_hdr.msg_namelen = sockaddru_len(b->to[i]);
+		b->msgs[i].msg_hdr.msg_iov = &b->iov[i];
+		b->msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	for (i = 0, failed = 0; i < b->n; ) {
+		rc = sendmmsg(b->fd, &b->msgs[i], b->n - i, 0);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			/* the error is for the first message only - skip it and
+			 * keep sending the rest of the batch */
+			LM_DBG("sendmmsg() failed for ping %u: %s\n", i, strerror(errno));
+			failed++;
+			rc = 1;
+		}
+		i += rc;
+	}
+
+	if (failed)
+		LM_ERR("failed to send %u out of %u pings\n", failed, b->n);
+#else
+	for (i = 0; i < b->n; i++)
+		if (sendto(b->fd, sbuf, sizeof(sbuf), 0, &b->to[i].s,
+		sockaddru_len(b->to[i])) < 0)
+			LM_ERR("sendto() failed: %s\n", strerror(errno));
+#endif
+
+	b->n = 0;
+}
+
+/*
+ * Queues a plain UDP keepalive; the batch is flushed when full or
+ * when the sending socket changes
+ */
+static inline void nh_queue_ping(struct socket_info *sock,
+												union sockaddr_union *to)
+{
+	struct nh_ping_batch *b = &ping_batch;
+	str buf;
+
+	/* the same raw processing as msg_send() does - a keepalive changed
+	 * by the callbacks is sent on its own */
+	buf.s = (char *)sbuf;
+	buf.len = sizeof(sbuf);
+	run_post_raw_processing_cb(POST_RAW_PROCESSING, &buf, NULL);
+	if (buf.s != sbuf || buf.len != sizeof(sbuf)) {
+		if (protos[PROTO_UDP].tran.send(sock, buf.s, buf.len, to, 0) < 0)
+			LM_ERR("sip msg_send failed!\n");
+		if (buf.s != sbuf)
+			pkg_free(buf.s);
+		return;
+	}
+
+	if (b->n && (b->fd != sock->socket || b->n == NH_PING_BATCH))
+		nh_flush_pings();
+
+	b->fd = sock->socket;
+	memcpy(&b->to[b->n++], to, sizeof *to);
+}
+
+
 static void
 nh_timer(unsigned int ticks, void *timer_idx)
 {
 	int rval;
-	void *buf = NULL;
 	void *cp;
 	str c;
 	str opt;
@@ -1278,18 +1384,10 @@ nh_timer(unsigned int ticks, void *timer_idx)
 	udomain_t *d;
 
 	if ( (*natping_state) == 0 || !nh_cluster_shtag_is_active() )
-		goto done;
-
-	if (cblen > 0) {
-		buf = pkg_malloc(cblen);
-		if (buf == NULL) {
-			LM_ERR("out of pkg memory\n");
-			goto done;
-		}
-	}
+		return;
 
 	for ( d=ul.get_next_udomain(NULL); d; d=ul.get_next_udomain(d)) {
-		rval = ul.get_domain_ucontacts(d, buf, cblen, (ping_nated_only?ul.nat_flag:0),
+		rval = ul.get_domain_ucontacts(d, cbuf, cblen, (ping_nated_only?ul.nat_flag:0),
 			((unsigned int)(unsigned long)timer_idx)*natping_interval+
 			(ticks%natping_interval), natping_partitions*natping_interval,
 			STORE_BRANCH_CTID?1:0);
@@ -1299,16 +1397,19 @@ nh_timer(unsigned int ticks, void *timer_idx)
 			goto done;
 		}
 		if (rval > 0) {
-			if (buf != NULL)
-				pkg_free(buf);
+			/* the buffer is only ever grown, so that a steady contact
+			 * set costs no allocations at all on the following runs */
+			if (cbuf != NULL)
+				pkg_free(cbuf);
 			cblen += rval + 128 /*some extra*/;
-			buf = pkg_malloc(cblen);
-			if (buf == NULL) {
+			cbuf = pkg_malloc(cblen);
+			if (cbuf == NULL) {
 				LM_ERR("out of pkg memory\n");
+				cblen = 0;
 				goto done;
 			}
 
-			rval = ul.get_domain_ucontacts(d, buf, cblen, (ping_nated_only?ul.nat_flag:0),
+			rval = ul.get_domain_ucontacts(d, cbuf, cblen, (ping_nated_only?ul.nat_flag:0),
 				((unsigned int)(unsigned long)timer_idx)*natping_interval+
 				(ticks%natping_interval), natping_partitions*natping_interval,
 				STORE_BRANCH_CTID?1:0);
@@ -1317,12 +1418,12 @@ nh_timer(unsigned int ticks, void *timer_idx)
 			}
 		}
 
-		if (buf == NULL)
+		if (cbuf == NULL)
 			goto done;
 
 		tcp_no_new_conn = 1;
 
-		cp = buf;
+		cp = cbuf;
 		while (1) {
 			memcpy(&(c.len), cp, sizeof(c.len));
 			if (c.len == 0)
@@ -1383,6 +1484,9 @@ nh_timer(unsigned int ticks, void *timer_idx)
 				if (send_raw((char*)sbuf, sizeof(sbuf), &to, raw_ip, raw_port)<0) {
 					LM_ERR("send_raw failed\n");
 				}
+			} else if (next_hop.proto == PROTO_UDP &&
+			send_sock->proto == PROTO_UDP) {
+				nh_queue_ping(send_sock, &to);
 			} else {
 				if (msg_send(send_sock, next_hop.proto, &to, 0,
 				             (char *)sbuf, sizeof(sbuf), NULL) < 0) {
@@ -1392,11 +1496,9 @@ nh_timer(unsigned int ticks, void *timer_idx)
 		}
 	}
 
-	tcp_no_new_conn = 0;
-
 done:
-	if (buf)
-		pkg_free(buf);
+	nh_flush_pings();
+	tcp_no_new_conn = 0;
 }
 
 
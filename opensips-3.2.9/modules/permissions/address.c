@@ -327,6 +327,9 @@ int reload_address_table(struct pm_part_struct *part_struct)
 
 	part_struct->perm_dbf.free_result(part_struct->db_handle, res);
 
+	if (subnet_table_build_index(new_subnet_table) != 0)
+		LM_WARN("failed to index the subnet table, using linear scans\n");
+
 	*part_struct->hash_table = new_hash_table;
 	*part_struct->subnet_table = new_subnet_table;
 	LM_DBG("address table reloaded successfully.\n");
@@ -323,6 +323,8 @@ void pm_empty_hash(struct address_list** table) {
 }
 
 
+int max_subnets = 128;
+
 /*
  * Create and initialize a subnet table
  */
@@ -341,6 +343,7 @@ struct subnet* new_subnet_table(void)
     }
 
     ptr[PERM_MAX_SUBNETS].grp = 0;
+    ptr[PERM_MAX_SUBNETS].index = NULL;
     return ptr;
 }
 
@@ -359,7 +362,7 @@ int subnet_table_insert(struct subnet* table, unsigned int grp,
     count = table[PERM_MAX_SUBNETS].grp;
 
     if (count == PERM_MAX_SUBNETS) {
-		LM_CRIT("subnet table is full\n");
+		LM_CRIT("subnet table is full (see the max_subnets parameter)\n");
 		return 0;
     }
 
@@ -416,6 +419,158 @@ int subnet_table_insert(struct subnet* table, unsigned int grp,
 }
 
 
+static inline int subnet_mask_len(struct net *net)
+{
+	int r, len = 0;
+
+	for (r = 0; r < net->mask.len / 4; r++)
+		len += __builtin_popcount(net->mask.u.addr32[r]);
+
+	return len;
+}
+
+
+/*
+ * Hash of the network address of @ip, masked to @bitlen bits
+ */
+static inline unsigned int subnet_hash(struct ip_addr *ip, int bitlen)
+{
+	unsigned int h = bitlen, mask;
+	int r;
+
+	for (r = 0; r < ip->len / 4; r++, bitlen -= 32) {
+		if (bitlen >= 32)
+			mask = 0xffffffff;
+		else if (bitlen <= 0)
+			mask = 0;
+		else
+			mask = htonl(~0U << (32 - bitlen));
+
+		h = (h ^ (ip->u.addr32[r] & mask)) * 0x9e3779b1;
+	}
+
+	return h ^ (h >> 16);
+}
+
+
+int subnet_table_build_index(struct subnet* table)
+{
+	struct subnet_index *idx;
+	char used4[33], used6[129];
+	unsigned int count, size, h;
+	int i, len;
+
+	count = table[PERM_MAX_SUBNETS].grp;
+	if (count == 0)
+		return 0;
+
+	for (size = 16; size < count; size <<= 1);
+
+	idx = (struct subnet_index *)shm_malloc(sizeof *idx +
+		(size + count) * sizeof(unsigned int));
+	if (!idx) {
+		LM_ERR("no shm memory for the subnet index\n");
+		return -1;
+	}
+	memset(idx, 0, sizeof *idx + size * sizeof(unsigned int));
+	idx->size = size;
+	idx->buckets = (unsigned int *)(idx + 1);
+	idx->next = idx->buckets + size;
+
+	memset(used4, 0, sizeof used4);
+	memset(used6, 0, sizeof used6);
+
+	/* walk backwards, so each bucket lists its subnets in table order */
+	for (i = count - 1; i >= 0; i--) {
+		idx->next[i] = 0;
+		if (!table[i].subnet)
+			continue;
+
+		len = subnet_mask_len(table[i].subnet);
+		if (table[i].subnet->ip.af == AF_INET)
+			used4[len] = 1;
+		else
+			used6[len] = 1;
+
+		h = subnet_hash(&table[i].subnet->ip, len) & (size - 1);
+		idx->next[i] = idx->buckets[h];
+		idx->buckets[h] = i + 1;
+	}
+
+	for (len = 32; len >= 0; len--)
+		if (used4[len])
+			idx->lens4[idx->lens4_no++] = len;
+	for (len = 128; len >= 0; len--)
+		if (used6[len])
+			idx->lens6[idx->lens6_no++] = len;
+
+	table[PERM_MAX_SUBNETS].index = idx;
+	return 0;
+}
+
+
+struct subnet_filter {
+	unsigned int grp;
+	unsigned int port;
+	int proto;
+	char *pattern;
+};
+
+typedef int (subnet_filter_f)(struct subnet *s, struct subnet_filter *f);
+
+static int subnet_filter_match(struct subnet *s, struct subnet_filter *f)
+{
+	return (s->grp == f->grp || s->grp == GROUP_ANY
+				|| f->grp == GROUP_ANY) &&
+		(s->port == f->port || s->port == PORT_ANY
+				|| f->port == PORT_ANY) &&
+		(s->proto == f->proto || s->proto == PROTO_NONE
+				|| f->proto == PROTO_NONE) &&
+		(!s->pattern || !f->pattern ||
+				fnmatch(s->pattern, f->pattern, FNM_PERIOD) == 0);
+}
+
+
+static int subnet_filter_port(struct subnet *s, struct subnet_filter *f)
+{
+	return s->port == f->port || s->port == 0;
+}
+
+
+/*
+ * Returns the first subnet of the table (same as a linear scan would)
+ * which contains @ip and passes the filter, or -1 if none found
+ */
+static int subnet_index_lookup(struct subnet* table, struct ip_addr *ip,
+		subnet_filter_f *filter, struct subnet_filter *f)
+{
+	struct subnet_index *idx = table[PERM_MAX_SUBNETS].index;
+	unsigned char *lens;
+	unsigned int i, best = (unsigned int)-1;
+	int l, lens_no;
+
+	if (ip->af == AF_INET) {
+		lens = idx->lens4;
+		lens_no = idx->lens4_no;
+	} else {
+		lens = idx->lens6;
+		lens_no = idx->lens6_no;
+	}
+
+	for (l = 0; l < lens_no; l++) {
+		for (i = idx->buckets[subnet_hash(ip, lens[l]) & (idx->size - 1)];
+				i && i - 1 < best; i = idx->next[i - 1])
+			if (matchnet(ip, table[i - 1].subnet) == 1 &&
+					filter(&table[i - 1], f)) {
+				best = i - 1;
+				break;
+			}
+	}
+
+	return best == (unsigned int)-1 ? -1 : (int)best;
+}
+
+
 /*
  * Check if an entry exists in subnet table that matches given group, ip_addr,
  * and port.  Port 0 in subnet table matches any port.
@@ -424,9 +579,10 @@ int match_subnet_table(struct sip_msg *msg, struct subnet* table,
 			unsigned int grp, struct ip_addr *ip, unsigned int port, int proto,
 			char *pattern, pv_spec_t *info)
 {
-        unsigned int count, i;
+	struct subnet_filter f = {grp, port, proto, pattern};
+	unsigned int count;
 	pv_value_t pvt;
-	int match_res, found_group = 0;
+	int i, found_group = 0;
 
 	count = table[PERM_MAX_SUBNETS].grp;
 
@@ -451,55 +607,38 @@ int match_subnet_table(struct sip_msg *msg, struct subnet* table,
 		}
 	}
 
-	i = 0;
-	do {
-		if ((table[i].grp == grp || table[i].grp == GROUP_ANY
-				|| grp == GROUP_ANY) &&
-			(table[i].port == port || table[i].port == PORT_ANY
-				|| port == PORT_ANY) &&
-			(table[i].proto == proto || table[i].proto == PROTO_NONE
-			 	|| proto == PROTO_NONE))
-			{
-
-				match_res = matchnet(ip, table[i].subnet);
-
-				if (match_res != 1) {
-					i++;
-					continue;
-				}
-
-				if (table[i].pattern && pattern) {
-					match_res = fnmatch(table[i].pattern, pattern, FNM_PERIOD);
-
-					if (match_res) {
-						i++;
-						continue;
-					}
-				}
-
-				if (info) {
-					pvt.flags = PV_VAL_STR;
-					pvt.rs.s = table[i].info;
-					pvt.rs.len = table[i].info ? strlen(table[i].info) : 0;
+	if (table[PERM_MAX_SUBNETS].index) {
+		i = subnet_index_lookup(table, ip, subnet_filter_match, &f);
+		if (i >= 0)
+			goto found;
+	} else {
+		for (i = 0; i < count; i++) {
+			if (matchnet(ip, table[i].subnet) == 1 &&
+					subnet_filter_match(&table[i], &f))
+				goto found;
 
-					if (pv_set_value(msg, info, (int)EQ_T, &pvt) < 0) {
-						LM_ERR("setting of avp failed\n");
-						return -1;
-	    			}
-				}
+			if (table[i].grp > grp && grp != GROUP_ANY)
+				break;
+		}
+	}
 
-				LM_DBG("match found in the subnet table\n");
-				return 1;
-			}
+	LM_DBG("no match in the subnet table\n");
+	return -1;
 
-		if (table[i].grp > grp && grp != GROUP_ANY)
-			break;
-		i++;
+found:
+	if (info) {
+		pvt.flags = PV_VAL_STR;
+		pvt.rs.s = table[i].info;
+		pvt.rs.len = table[i].info ? strlen(table[i].info) : 0;
 
-	} while (i < count);
+		if (pv_set_value(msg, info, (int)EQ_T, &pvt) < 0) {
+			LM_ERR("setting of avp failed\n");
+			return -1;
+		}
+	}
 
-	LM_DBG("no match in the subnet table\n");
-    return -1;
+	LM_DBG("match found in the subnet table\n");
+	return 1;
 }
 
 
@@ -584,7 +723,14 @@ int subnet_table_mi_print(struct subnet* table, mi_item_t *part_item,
 int find_group_in_subnet_table(struct subnet* table,
 		                   struct ip_addr *ip, unsigned int port)
 {
+	struct subnet_filter f = {GROUP_ANY, port, PROTO_NONE, NULL};
 	unsigned int count, i, match_res;
+	int idx;
+
+	if (table[PERM_MAX_SUBNETS].index) {
+		idx = subnet_index_lookup(table, ip, subnet_filter_port, &f);
+		return idx < 0 ? -1 : table[idx].grp;
+	}
 
 	count = table[PERM_MAX_SUBNETS].grp;
 
@@ -626,6 +772,11 @@ void empty_subnet_table(struct subnet *table)
 	}
 
 	table[PERM_MAX_SUBNETS].grp = 0;
+
+	if (table[PERM_MAX_SUBNETS].index) {
+		shm_free(table[PERM_MAX_SUBNETS].index);
+		table[PERM_MAX_SUBNETS].index = NULL;
+	}
 }
 
 
@@ -102,7 +102,24 @@ int find_group_in_hash_table(struct address_list** table,
 
 
 
-#define PERM_MAX_SUBNETS 128
+/* size of the subnet tables, see the "max_subnets" modparam */
+extern int max_subnets;
+#define PERM_MAX_SUBNETS max_subnets
+
+/*
+ * Index over a subnet table: the subnets are hashed by their network
+ * address, separately for each mask length in use, so a lookup only
+ * costs one probe per distinct mask length
+ */
+struct subnet_index {
+	unsigned int size;          /* number of buckets, power of 2 */
+	unsigned int *buckets;      /* 1 + first subnet of the bucket, or 0 */
+	unsigned int *next;         /* 1 + next subnet in the bucket, or 0 */
+	unsigned char lens4[33];    /* IPv4 mask lengths in use */
+	unsigned char lens4_no;
+	unsigned char lens6[129];   /* IPv6 mask lengths in use */
+	unsigned char lens6_no;
+};
 
 /*
  * Structure used to store a subnet
@@ -114,6 +131,7 @@ struct subnet {
 	char *pattern;              /* Pattern matching From header field */
 	unsigned int port;       /* port or 0 */
 	char *info;				 /* extra information */
+	struct subnet_index *index; /* in last record only, may be NULL */
 };
 
 
@@ -162,6 +180,12 @@ int subnet_table_insert(struct subnet* table, unsigned int grp,
 		str* pattern, str *info);
 
 
+/*
+ * Index the subnets of the table, once all of them are inserted
+ */
+int subnet_table_build_index(struct subnet* table);
+
+
 /*
  * Print subnets stored in subnet table
  */
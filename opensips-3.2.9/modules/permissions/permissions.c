@@ -162,6 +162,7 @@ static param_export_t params[] = {
 	{"grp_col",            STR_PARAM, &grp_col.s         },
 	{"mask_col",           STR_PARAM, &mask_col.s        },
 	{"port_col",           STR_PARAM, &port_col.s        },
+	{"max_subnets",        INT_PARAM, &max_subnets       },
 	{0, 0, 0}
 };
 
@@ -596,6 +597,11 @@ static int mod_init(void)
 {
 	LM_DBG("initializing...\n");
 
+	if (max_subnets <= 0) {
+		LM_ERR("invalid max_subnets value: %d\n", max_subnets);
+		return -1;
+	}
+
 	allow[0].filename = get_pathname(default_allow_file);
 	allow[0].rules = parse_config_file(allow[0].filename);
 
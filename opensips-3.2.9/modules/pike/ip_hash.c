@@ -0,0 +1,367 @@
+/*
+ * Copyright (C) 2026 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <string.h>
+#include <limits.h>
+#include <sched.h>
+
+#include "../../dprint.h"
+#include "../../mem/shm_mem.h"
+#include "ip_hash.h"
+
+#define PREV_POS 0
+#define CURR_POS 1
+
+#define SLOT_EMPTY  0	/* never used - ends the probing */
+#define SLOT_FREE   1	/* expired address */
+#define SLOT_BUSY   2	/* the address is being written */
+#define SLOT_USED   3
+
+/*
+ * layout of the slot word:
+ *   bits  0-15  hits of the current unit
+ *   bits 16-31  hits of the previous unit
+ *   bit  32     RED flag
+ *   bits 33-34  slot state
+ *   bits 35-42  generation
+ *   bits 43-63  sampling unit of the hits
+ */
+#define W_CURR(_w)    ((unsigned int)((_w) & 0xffff))
+#define W_PREV(_w)    ((unsigned int)(((_w) >> 16) & 0xffff))
+#define W_RED         (1ULL << 32)
+#define W_STATE(_w)   ((unsigned int)(((_w) >> 33) & 0x3))
+#define W_GEN(_w)     ((unsigned int)(((_w) >> 35) & 0xff))
+#define W_UNIT(_w)    ((unsigned int)((_w) >> 43))
+
+#define UNIT_MASK     ((1U << 21) - 1)
+#define MAX_HITS      0xffff
+
+/* how many times a hit is retried when racing with other processes */
+#define MAX_RETRIES   8
+
+struct ip_slot {
+	volatile unsigned long long w;
+	unsigned char len;
+	unsigned char addr[16];
+};
+
+struct ip_hash {
+	struct ip_slot *slots;
+	unsigned int mask;
+	unsigned int max_hits;
+};
+
+
+static inline unsigned long long mkw(unsigned int unit, unsigned int gen,
+		unsigned int state, int red, unsigned int prev, unsigned int curr)
+{
+	return ((unsigned long long)(unit & UNIT_MASK) << 43) |
+		((unsigned long long)(gen & 0xff) << 35) |
+		((unsigned long long)state << 33) | (red ? W_RED : 0) |
+		(prev << 16) | curr;
+}
+
+#define cas_slot(_s, _old, _new) \
+	__sync_bool_compare_and_swap(&(_s)->w, _old, _new)
+
+/* reads the word of a slot, waiting for any address being written in it */
+static inline unsigned long long load_slot(struct ip_slot *s)
+{
+	unsigned long long w;
+	int spins = 0;
+
+	while (W_STATE(w = __atomic_load_n(&s->w, __ATOMIC_ACQUIRE)) ==
+			SLOT_BUSY)
+		if (++spins % 64 == 0)
+			sched_yield();
+
+	return w;
+}
+
+static inline unsigned int hash_ip(struct ip_addr *ip)
+{
+	unsigned int h = ip->len, v;
+	int i;
+
+	for (i = 0; i + 4 <= ip->len; i += 4) {
+		memcpy(&v, ip->u.addr + i, 4);
+		h = (h ^ v) * 0x9e3779b1;
+	}
+
+	return h ^ (h >> 16);
+}
+
+static inline int slot_has_ip(struct ip_slot *s, struct ip_addr *ip)
+{
+	return s->len == ip->len && !memcmp(s->addr, ip->u.addr, ip->len);
+}
+
+static inline void slot_ip(struct ip_slot *s, struct ip_addr *ip)
+{
+	memset(ip, 0, sizeof *ip);
+	ip->af = (s->len == 16) ? AF_INET6 : AF_INET;
+	ip->len = s->len;
+	memcpy(ip->u.addr, s->addr, s->len);
+}
+
+/* the hits of a slot word, as seen during @unit */
+static inline void aged_hits(unsigned long long w, unsigned int unit,
+		unsigned int hits[2])
+{
+	switch ((unit - W_UNIT(w)) & UNIT_MASK) {
+	case 0:
+		hits[PREV_POS] = W_PREV(w);
+		hits[CURR_POS] = W_CURR(w);
+		break;
+	case 1:
+		hits[PREV_POS] = W_CURR(w);
+		hits[CURR_POS] = 0;
+		break;
+	default:
+		hits[PREV_POS] = hits[CURR_POS] = 0;
+	}
+}
+
+#define is_hot(_t, _hits) \
+	( (_hits)[PREV_POS]>=(_t)->max_hits ||\
+	  (_hits)[CURR_POS]>=(_t)->max_hits ||\
+	  (((_hits)[PREV_POS]+(_hits)[CURR_POS])>>1)>=(_t)->max_hits )
+
+
+struct ip_hash *new_ip_hash(unsigned int size, int max_hits)
+{
+	struct ip_hash *t;
+	unsigned int n;
+
+	for (n = IP_HASH_PROBES; n < size; n <<= 1) ;
+
+	/* one extra cache line, to align the slots */
+	t = shm_malloc(sizeof *t + 64 + n * sizeof(struct ip_slot));
+	if (!t) {
+		LM_ERR("no more shm mem for %u addresses\n", n);
+		return NULL;
+	}
+	t->slots = (struct ip_slot *)(((unsigned long)(t + 1) + 63) & ~63UL);
+	memset(t->slots, 0, n * sizeof(struct ip_slot));
+
+	t->mask = n - 1;
+	t->max_hits = max_hits;
+
+	LM_DBG("table of %u addresses, %lu bytes\n", n,
+		(unsigned long)(n * sizeof(struct ip_slot)));
+	return t;
+}
+
+
+void free_ip_hash(struct ip_hash *t)
+{
+	shm_free(t);
+}
+
+
+unsigned int ip_hash_unit(unsigned int ticks, unsigned int time_unit)
+{
+	return (ticks / time_unit) & UNIT_MASK;
+}
+
+
+int mark_ip(struct ip_hash *t, struct ip_addr *ip, unsigned int unit)
+{
+	struct ip_slot *s, *victim;
+	unsigned long long w, vw = 0;
+	unsigned int h, i, gen, score, vscore, hits[2];
+	int retries = 0, red;
+
+	h = hash_ip(ip);
+
+retry:
+	/* look for the address, remembering where it may be added */
+	victim = NULL;
+	vscore = UINT_MAX;
+	for (i = 0; i < IP_HASH_PROBES; i++) {
+		s = &t->slots[(h + i) & t->mask];
+		w = load_slot(s);
+
+		if (W_STATE(w) == SLOT_USED) {
+			if (slot_has_ip(s, ip))
+				goto found;
+			/* the least active slot may be recycled, but never a RED one */
+			if (vscore && !(w & W_RED)) {
+				aged_hits(w, unit, hits);
+				score = hits[PREV_POS] + hits[CURR_POS];
+				if (score < vscore) {
+					victim = s;
+					vw = w;
+					vscore = score;
+				}
+			}
+			continue;
+		}
+
+		if (vscore) {
+			victim = s;
+			vw = w;
+			vscore = 0;
+		}
+		if (W_STATE(w) == SLOT_EMPTY)
+			break;
+	}
+
+	if (!victim) {
+		LM_DBG("no slot left for %s\n", ip_addr2a(ip));
+		return 0;
+	}
+
+	/* take over the slot; another process may do it first */
+	gen = W_GEN(vw) + 1;
+	if (!cas_slot(victim, vw, mkw(unit, gen, SLOT_BUSY, 0, 0, 0))) {
+		if (++retries < MAX_RETRIES)
+			goto retry;
+		return 0;
+	}
+
+	victim->len = ip->len;
+	memcpy(victim->addr, ip->u.addr, ip->len);
+
+	hits[PREV_POS] = 0;
+	hits[CURR_POS] = 1;
+	red = is_hot(t, hits);
+	__atomic_store_n(&victim->w, mkw(unit, gen, SLOT_USED, red, 0, 1),
+		__ATOMIC_RELEASE);
+
+	return red ? (RED_NODE|NEWRED_NODE) : 0;
+
+found:
+	gen = W_GEN(w);
+	for (;;) {
+		aged_hits(w, unit, hits);
+		if (hits[CURR_POS] < MAX_HITS)
+			hits[CURR_POS]++;
+		/* once RED, the address is only unblocked by the cleaner */
+		red = (w & W_RED) || is_hot(t, hits);
+		if (cas_slot(s, w, mkw(unit, gen, SLOT_USED, red,
+				hits[PREV_POS], hits[CURR_POS])))
+			break;
+
+		w = load_slot(s);
+		if (W_STATE(w) != SLOT_USED || W_GEN(w) != gen) {
+			/* the slot was recycled meanwhile */
+			if (++retries < MAX_RETRIES)
+				goto retry;
+			return 0;
+		}
+	}
+
+	if (!red)
+		return 0;
+	return (w & W_RED) ? RED_NODE : (RED_NODE|NEWRED_NODE);
+}
+
+
+void clean_ip_hash(struct ip_hash *t, unsigned int unit,
+		unsigned int max_idle, ip_hash_cb *unblock_cb)
+{
+	struct ip_slot *s;
+	struct ip_addr ip;
+	unsigned long long w;
+	unsigned int i, hits[2];
+
+	for (i = 0; i <= t->mask; i++) {
+		s = &t->slots[i];
+		w = __atomic_load_n(&s->w, __ATOMIC_ACQUIRE);
+		if (W_STATE(w) != SLOT_USED)
+			continue;
+
+		aged_hits(w, unit, hits);
+		if (w & W_RED) {
+			if (is_hot(t, hits))
+				continue;
+			/* read the address before the slot may be recycled */
+			slot_ip(s, &ip);
+			if (!cas_slot(s, w, w & ~W_RED))
+				continue; /* just hit, check it on the next run */
+			if (unblock_cb)
+				unblock_cb(&ip, hits, NULL);
+			w &= ~W_RED;
+		}
+
+		if (((unit - W_UNIT(w)) & UNIT_MASK) > max_idle)
+			cas_slot(s, w, mkw(0, W_GEN(w), SLOT_FREE, 0, 0, 0));
+	}
+}
+
+
+int for_each_red_ip(struct ip_hash *t, unsigned int unit, ip_hash_cb *cb,
+		void *param)
+{
+	struct ip_slot *s;
+	struct ip_addr ip;
+	unsigned long long w;
+	unsigned int i, hits[2];
+
+	for (i = 0; i <= t->mask; i++) {
+		s = &t->slots[i];
+		w = __atomic_load_n(&s->w, __ATOMIC_ACQUIRE);
+		if (W_STATE(w) != SLOT_USED || !(w & W_RED))
+			continue;
+
+		slot_ip(s, &ip);
+		/* make sure the address was not replaced while copying it */
+		if (W_GEN(__atomic_load_n(&s->w, __ATOMIC_ACQUIRE)) != W_GEN(w))
+			continue;
+
+		aged_hits(w, unit, hits);
+		if (cb(&ip, hits, param) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+
+int unblock_ip(struct ip_hash *t, struct ip_addr *ip)
+{
+	struct ip_slot *s;
+	unsigned long long w;
+	unsigned int h, i;
+
+	h = hash_ip(ip);
+	for (i = 0; i < IP_HASH_PROBES; i++) {
+		s = &t->slots[(h + i) & t->mask];
+		w = load_slot(s);
+		if (W_STATE(w) == SLOT_EMPTY)
+			break;
+		if (W_STATE(w) != SLOT_USED || !slot_has_ip(s, ip))
+			continue;
+
+		do {
+			if (!(w & W_RED))
+				return -2;
+			/* reset the hits too, or the next one would block it again */
+			if (cas_slot(s, w, mkw(W_UNIT(w), W_GEN(w), SLOT_USED, 0, 0, 0)))
+				return 0;
+			w = load_slot(s);
+		} while (W_STATE(w) == SLOT_USED && slot_has_ip(s, ip));
+
+		return -1;
+	}
+
+	return -1;
+}
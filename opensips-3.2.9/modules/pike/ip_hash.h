@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2026 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * Lock-free table of the monitored IP addresses.
+ *
+ * The table is an open addressing hash of fixed size, holding the whole
+ * IPv4/IPv6 addresses. All the state of a slot (the hit counters of the
+ * current and previous sampling units, the unit they belong to, the RED
+ * flag and the slot state) is packed in a single 64 bit word, updated
+ * with compare-and-swap - there are no locks on the packet path. The
+ * counters are aged lazily, by comparing the unit of the slot with the
+ * current one, so no timer has to walk the table at each unit for the
+ * counting to work.
+ *
+ * Each time a slot is (re)assigned to an address, its generation is
+ * increased, so a process still holding the old address can't update it.
+ * When no slot is available in the probing window of an address, the
+ * least active (non RED) slot of the window is recycled.
+ */
+
+#ifndef _PIKE_IP_HASH_H
+#define _PIKE_IP_HASH_H
+
+#include "../../ip_addr.h"
+
+#define RED_NODE    (1<<0)
+#define NEWRED_NODE (1<<1)
+
+/* how many consecutive slots may hold the addresses of a hash value */
+#define IP_HASH_PROBES   16
+
+struct ip_hash;
+
+typedef int (ip_hash_cb)(struct ip_addr *ip, unsigned int hits[2],
+		void *param);
+
+struct ip_hash *new_ip_hash(unsigned int size, int max_hits);
+void free_ip_hash(struct ip_hash *t);
+
+/* current sampling unit, for a time unit of @time_unit seconds */
+unsigned int ip_hash_unit(unsigned int ticks, unsigned int time_unit);
+
+/* counts a new hit of @ip during @unit; returns RED_NODE/NEWRED_NODE */
+int  mark_ip(struct ip_hash *t, struct ip_addr *ip, unsigned int unit);
+
+/* unblocks the RED addresses which cooled down and frees the addresses
+ * idle for more than @max_idle units; calls @unblock_cb for each
+ * unblocked address */
+void clean_ip_hash(struct ip_hash *t, unsigned int unit,
+		unsigned int max_idle, ip_hash_cb *unblock_cb);
+
+/* runs @cb for each RED address */
+int  for_each_red_ip(struct ip_hash *t, unsigned int unit, ip_hash_cb *cb,
+		void *param);
+
+/* returns 0 on success, -1 if the address is unknown, -2 if not RED */
+int  unblock_ip(struct ip_hash *t, struct ip_addr *ip);
+
+#endif
@@ -44,9 +44,7 @@
 #include "../../mem/shm_mem.h"
 #include "../../evi/evi_modules.h"
 #include "../../timer.h"
-#include "../../locking.h"
-#include "ip_tree.h"
-#include "timer.h"
+#include "ip_hash.h"
 #include "pike_mi.h"
 #include "pike_funcs.h"
 
@@ -60,15 +58,15 @@ static int pike_exit(void);
 
 
 /* parameters */
-static int time_unit = 2;
+int time_unit = 2;
 static int max_reqs  = 30;
+static unsigned int hash_size = 65536;
 static char *pike_route_s = NULL;
 int timeout   = 120;
 int pike_log_level = L_WARN;
 
 /* global variables */
-gen_lock_t*             timer_lock=0;
-struct list_link*       timer = 0;
+struct ip_hash*         pike_ips = 0;
 
 /* event id */
 static str pike_block_event = str_init("E_PIKE_BLOCKED");
@@ -86,15 +84,16 @@ static param_export_t params[]={
 	{"remove_latency",        INT_PARAM,  &timeout},
 	{"pike_log_level",        INT_PARAM,  &pike_log_level},
 	{"check_route",           STR_PARAM,  &pike_route_s},
+	{"hash_size",             INT_PARAM,  &hash_size},
 	{0,0,0}
 };
 
 static mi_export_t mi_cmds [] = {
-	{MI_PIKE_LIST, "lists the nodes in the pike tree", 0, 0, {
+	{MI_PIKE_LIST, "lists the blocked IPs", 0, 0, {
 		{mi_pike_list, {0}},
 		{EMPTY_MI_RECIPE}}
 	},
-	{MI_PIKE_RM, "remove a node from the tree", 0, 0, {
+	{MI_PIKE_RM, "unblocks an IP", 0, 0, {
 		{mi_pike_rm, {"ip", 0}},
 		{EMPTY_MI_RECIPE}}
 	},
@@ -133,6 +132,11 @@ static int pike_init(void)
 
 	LM_INFO("initializing...\n");
 
+	if (time_unit <= 0) {
+		LM_ERR("invalid sampling_time_unit %d\n", time_unit);
+		return -1;
+	}
+
 	if (timeout <= time_unit) {
 		LM_WARN("remove_latency smaller than sampling_time_unit! "
 				"Having a smaller or equal value for remove_latency may "
@@ -141,37 +145,19 @@ static int pike_init(void)
 		LM_NOTICE("Forcing remove_latency to %ds\n", timeout);
 	}
 
-	/* alloc the timer lock */
-	timer_lock=lock_alloc();
-	if (timer_lock==0) {
-		LM_ERR(" alloc locks failed!\n");
-		goto error1;
-	}
-	/* init the lock */
-	if (lock_init(timer_lock)==0){
-		LM_ERR(" init lock failed\n");
-		goto error1;
-	}
-
-	/* init the IP tree */
-	if ( init_ip_tree(max_reqs)!=0 ) {
-		LM_ERR(" ip_tree creation failed!\n");
-		goto error2;
+	/* init the IP table */
+	pike_ips = new_ip_hash(hash_size, max_reqs);
+	if ( pike_ips==0 ) {
+		LM_ERR(" ip table creation failed!\n");
+		return -1;
 	}
 
-	/* init timer list */
-	timer = (struct list_link*)shm_malloc(sizeof(struct list_link));
-	if (timer==0) {
-		LM_ERR(" cannot alloc shm mem for timer!\n");
-		goto error3;
-	}
-	timer->next = timer->prev = timer;
-
 	/* registering timing functions  */
-	register_timer( "pike-clean", clean_routine , 0, 1 ,
-		TIMER_FLAG_DELAY_ON_DELAY);
-	register_timer( "pike-swap", swap_routine , 0, time_unit,
-		TIMER_FLAG_DELAY_ON_DELAY );
+	if (register_timer( "pike-clean", clean_routine , 0, time_unit,
+	TIMER_FLAG_DELAY_ON_DELAY)<0) {
+		LM_ERR("failed to register timer\n");
+		goto error;
+	}
 
 	if (pike_route_s && *pike_route_s) {
 		rt = get_script_route_ID_by_name(pike_route_s,sroutes->request,RT_NO);
@@ -184,20 +170,16 @@ static int pike_init(void)
 		if (register_script_cb( run_pike_route ,
 		PARSE_ERR_CB|REQ_TYPE_CB|RPL_TYPE_CB|PRE_SCRIPT_CB, (void*)(long)rt )!=0 ) {
 			LM_ERR("failed to register script callbacks\n");
-			goto error3;
+			goto error;
 		}
 	}
 	if((pike_event_id = evi_publish_event(pike_block_event)) == EVI_ERROR)
 		LM_ERR("cannot register pike flood start event\n");
 
 	return 0;
-error3:
-	destroy_ip_tree();
-error2:
-	lock_destroy(timer_lock);
-error1:
-	if (timer_lock) lock_dealloc(timer_lock);
-	timer_lock = 0;
+error:
+	free_ip_hash(pike_ips);
+	pike_ips = 0;
 	return -1;
 }
 
@@ -207,21 +189,12 @@ static int pike_exit(void)
 {
 	LM_INFO("destroying...\n");
 
-	/* destroy semaphore */
-	if (timer_lock) {
-		lock_destroy(timer_lock);
-		lock_dealloc(timer_lock);
+	/* destroy the IP table */
+	if (pike_ips) {
+		free_ip_hash(pike_ips);
+		pike_ips = 0;
 	}
 
-	/* empty the timer list head */
-	if (timer) {
-		shm_free(timer);
-		timer = 0;
-	}
-
-	/* destroy the IP tree */
-	destroy_ip_tree();
-
 	return 0;
 }
 
@@ -23,7 +23,6 @@
 #define _PIKE_FUNCS_H
 
 #include "../../parser/msg_parser.h"
-#include "../../locking.h"
 
 
 int  pike_check_req(struct sip_msg *msg);
@@ -31,7 +30,6 @@ int run_pike_route( struct sip_msg *msg, void *param );
 
 
 void clean_routine(unsigned int, void*);
-void swap_routine(unsigned int, void*);
 
 
 #endif
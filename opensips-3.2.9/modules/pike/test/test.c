@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2026 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <tap.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "../../../dprint.h"
+#include "../../../ip_addr.h"
+
+#include "../ip_hash.h"
+
+#define MAX_HITS      30
+#define FLOOD_PPS     200000   /* distinct sources per sampling unit */
+#define FLOOD_UNITS   5
+#define ATTACK_EVERY  2000     /* the attacker sends 100 packets per unit */
+#define PROCS_NO      4
+#define PROC_HITS     10000
+
+
+static inline long long now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+static inline void set_ip(struct ip_addr *ip, unsigned int n)
+{
+	memset(ip, 0, sizeof *ip);
+	ip->af = AF_INET;
+	ip->len = 4;
+	ip->u.addr[0] = 10;
+	ip->u.addr[1] = (n >> 16) & 0xff;
+	ip->u.addr[2] = (n >> 8) & 0xff;
+	ip->u.addr[3] = n & 0xff;
+}
+
+
+/*
+ * Replay FLOOD_UNITS sampling units of a flood from FLOOD_PPS distinct
+ * sources per unit, with a single source going over the limit
+ */
+static void test_flood_replay(unsigned int size)
+{
+	struct ip_hash *t;
+	struct ip_addr ip, attacker;
+	unsigned int unit, i, n = 0;
+	int flags, false_red = 0, new_red = 0, missed = 0, detected = 0;
+	long long start, took;
+
+	t = new_ip_hash(size, MAX_HITS);
+	if (!ok(t != NULL, "init table of %u", size))
+		return;
+
+	set_ip(&attacker, 0xfffffe);
+
+	start = now_us();
+	for (unit = 1; unit <= FLOOD_UNITS; unit++) {
+		for (i = 0; i < FLOOD_PPS; i++, n++) {
+			set_ip(&ip, n);
+			if (mark_ip(t, &ip, unit) & RED_NODE)
+				false_red++;
+
+			if (i % ATTACK_EVERY)
+				continue;
+
+			flags = mark_ip(t, &attacker, unit);
+			if (flags & NEWRED_NODE)
+				new_red++;
+			if (flags & RED_NODE)
+				detected = 1;
+			else if (detected)
+				missed++;
+		}
+	}
+	took = now_us() - start;
+
+	ok(false_red == 0, "no false positives (table: %u)", size);
+	ok(new_red == 1 && detected && missed == 0,
+	   "flooding source blocked once and for good (table: %u)", size);
+
+	diag("table: %u, %u packets in %lld us (%.1f ns/packet, %.0f pps)",
+	     size, n, took, took * 1000.0 / n, n * 1000000.0 / took);
+
+	/* the flood is over: the attacker gets unblocked, the rest forgotten */
+	clean_ip_hash(t, unit + 2, 1, NULL);
+	ok(!(mark_ip(t, &attacker, unit + 2) & RED_NODE),
+	   "attacker unblocked");
+
+	free_ip_hash(t);
+}
+
+
+static int get_hits(struct ip_addr *ip, unsigned int hits[2], void *param)
+{
+	*(unsigned int *)param = hits[1];
+	return 0;
+}
+
+/*
+ * PROCS_NO processes hitting the same address concurrently, among a flood
+ * of distinct ones: no hit may be lost, the address is blocked only once
+ */
+static void test_concurrency(void)
+{
+	struct ip_hash *t;
+	struct ip_addr ip, hot;
+	unsigned int hits = 0;
+	int i, p, status, new_red = 0;
+	pid_t pids[PROCS_NO];
+
+	t = new_ip_hash(1 << 16, MAX_HITS);
+	if (!ok(t != NULL, "init shared table"))
+		return;
+	set_ip(&hot, 0xabcdef);
+
+	for (p = 0; p < PROCS_NO; p++) {
+		pids[p] = fork();
+		if (pids[p] < 0)
+			break;
+		if (pids[p] == 0) {
+			status = 0;
+			for (i = 0; i < PROC_HITS; i++) {
+				set_ip(&ip, p * PROC_HITS + i);
+				mark_ip(t, &ip, 1);
+				if (mark_ip(t, &hot, 1) & NEWRED_NODE)
+					status++;
+			}
+			_exit(status);
+		}
+	}
+
+	for (i = 0; i < p; i++)
+		if (waitpid(pids[i], &status, 0) == pids[i] && WIFEXITED(status))
+			new_red += WEXITSTATUS(status);
+
+	ok(p == PROCS_NO, "forked %d processes", PROCS_NO);
+	ok(new_red == 1, "address blocked once (%d)", new_red);
+
+	for_each_red_ip(t, 1, get_hits, &hits);
+	ok(hits == PROCS_NO * PROC_HITS, "no hits lost (%u/%d)", hits,
+	   PROCS_NO * PROC_HITS);
+
+	free_ip_hash(t);
+}
+
+
+void mod_tests(void)
+{
+	test_flood_replay(1 << 18);
+	/* far more sources than slots */
+	test_flood_replay(1 << 14);
+	test_concurrency();
+}
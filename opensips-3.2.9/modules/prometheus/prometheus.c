@@ -228,6 +228,128 @@ static void fill_stats_name(str *stat_name, str *page)
 	page->len += stat_name->len;
 }
 
+#define PROM_APPEND(_s, _len) \
+	do { \
+		memcpy(page->s + page->len, (_s), (_len)); \
+		page->len += (_len); \
+	} while (0)
+
+/* prints the labels of a histogram line, with an optional "le" one */
+static inline void prom_print_hist_labels(str *m, str *le, str *page)
+{
+	if (prom_grp_mode != PROM_GROUP_MODE_LABEL && !le)
+		return;
+
+	PROM_APPEND("{", 1);
+	if (prom_grp_mode == PROM_GROUP_MODE_LABEL) {
+		PROM_APPEND(prom_grp_label.s, prom_grp_label.len);
+		PROM_APPEND("=\"", 2);
+		PROM_APPEND(prom_grp_prefix.s, prom_grp_prefix.len);
+		PROM_APPEND(m->s, m->len);
+		PROM_APPEND("\"", 1);
+		if (le)
+			PROM_APPEND(",", 1);
+	}
+	if (le) {
+		PROM_APPEND("le=\"", 4);
+		PROM_APPEND(le->s, le->len);
+		PROM_APPEND("\"", 1);
+	}
+	PROM_APPEND("}", 1);
+}
+
+/* a histogram goes out as cumulative "_bucket" series - one for each power
+ * of two of the values, plus "+Inf" - followed by "_sum" and "_count" */
+static int prom_print_hist(stat_var *stat, str *stat_name,
+		str *page, int max_len)
+{
+	static str inf = str_init("+Inf");
+	str *m = get_stat_module_name(stat);
+	str prefix = prom_prefix;
+	stat_hist_val hv;
+	str v, le, name;
+	unsigned long n = 0;
+	int i, line_len;
+
+	if (prom_prefix.len == 0 && prom_delimiter.len == 0 &&
+			prom_grp_mode == PROM_GROUP_MODE_NONE &&
+			stat_name->s[0] >= '0' && stat_name->s[0] <= '9') {
+		prefix.s = "_";
+		prefix.len = 1;
+	}
+
+	name.len = prefix.len + prom_delimiter.len + stat_name->len;
+	if (prom_grp_mode == PROM_GROUP_MODE_NAME)
+		name.len += prom_grp_prefix.len + m->len + prom_delimiter.len;
+
+	line_len = name.len + 7 /* '_bucket' */ + 2 /* '{' and '}' */ +
+		6 /* 'le=""' and ',' */ + INT2STR_MAX_LEN + 1 /* ' ' */ +
+		INT2STR_MAX_LEN + 1 /* '\n' */;
+	if (prom_grp_mode == PROM_GROUP_MODE_LABEL)
+		line_len += prom_grp_label.len + 3 /* '=""' */ +
+			prom_grp_prefix.len + m->len;
+
+	if (page->len + 7 /* '# TYPE ' */ + name.len + 11 /* ' histogram\n' */ +
+			(STAT_HIST_BUCKETS / STAT_HIST_SUB + 3) * line_len >= max_len)
+		return -1;
+
+	get_stat_hist_val(stat, &hv);
+
+	PROM_APPEND("# TYPE ", 7);
+	name.s = page->s + page->len;
+	PROM_APPEND(prefix.s, prefix.len);
+	PROM_APPEND(prom_delimiter.s, prom_delimiter.len);
+	if (prom_grp_mode == PROM_GROUP_MODE_NAME) {
+		PROM_APPEND(prom_grp_prefix.s, prom_grp_prefix.len);
+		PROM_APPEND(m->s, m->len);
+		PROM_APPEND(prom_delimiter.s, prom_delimiter.len);
+	}
+	fill_stats_name(stat_name, page);
+	PROM_APPEND(" histogram\n", 11);
+
+	for (i = 0; i < STAT_HIST_BUCKETS; i++) {
+		n += hv.buckets[i];
+		/* only the last bucket of each power of two */
+		if (i % STAT_HIST_SUB != STAT_HIST_SUB - 1 &&
+				i != STAT_HIST_BUCKETS - 1)
+			continue;
+
+		if (i == STAT_HIST_BUCKETS - 1) {
+			le = inf;
+		} else {
+			le.s = int2str(stat_hist_bucket_max(i), &le.len);
+		}
+
+		PROM_APPEND(name.s, name.len);
+		PROM_APPEND("_bucket", 7);
+		prom_print_hist_labels(m, &le, page);
+		v.s = int2str(n, &v.len);
+		PROM_APPEND(" ", 1);
+		PROM_APPEND(v.s, v.len);
+		PROM_APPEND("\n", 1);
+	}
+
+	PROM_APPEND(name.s, name.len);
+	PROM_APPEND("_sum", 4);
+	prom_print_hist_labels(m, NULL, page);
+	v.s = int2str(hv.sum, &v.len);
+	PROM_APPEND(" ", 1);
+	PROM_APPEND(v.s, v.len);
+	PROM_APPEND("\n", 1);
+
+	PROM_APPEND(name.s, name.len);
+	PROM_APPEND("_count", 6);
+	prom_print_hist_labels(m, NULL, page);
+	v.s = int2str(hv.count, &v.len);
+	PROM_APPEND(" ", 1);
+	PROM_APPEND(v.s, v.len);
+	PROM_APPEND("\n", 1);
+
+	return 0;
+}
+
+#undef PROM_APPEND
+
 static inline int prom_print_stat(stat_var *stat, str *stat_name,
 		str *page, int max_len, int *skip_type)
 {
@@ -240,6 +362,9 @@ static inline int prom_print_stat(stat_var *stat, str *stat_name,
 	if (stat->flags & STAT_HIDDEN)
 		return 0;
 
+	if (stat->flags & STAT_IS_HIST)
+		return prom_print_hist(stat, stat_name, page, max_len);
+
 	v.s = int2str(get_stat_val(stat), &v.len);
 
 	/* if the first char of the stat is a number, and we have no prefix, we
@@ -45,8 +45,6 @@
 #include "hep.h"
 #include "../compression/compression_api.h"
 
-#include "../../lib/cJSON.h"
-
 #define GENERIC_VENDOR_ID 0x0000
 #define HEP_PROTO_SIP  0x01
 
@@ -937,6 +935,47 @@ static trace_message create_hep12_message(union sockaddr_union* from_su, union s
 }
 
 
+#define HEP3_CHUNK_HDR(_c, _type) \
+	do { \
+		(_c).chunk.vendor_id = htons(GENERIC_VENDOR_ID); \
+		(_c).chunk.type_id   = htons(_type); \
+		(_c).chunk.length    = htons(sizeof(_c)); \
+	} while (0)
+
+/* the constant part of the HEPv3 messages, built once per process */
+static hep_generic_t hep3_hg_tmpl;
+static struct ip4_addr hep3_ip4_tmpl;
+static struct ip6_addr hep3_ip6_tmpl;
+static int hep3_tmpl_ready;
+
+static void hep3_init_templates(void)
+{
+	memset(&hep3_hg_tmpl, 0, sizeof hep3_hg_tmpl);
+	memcpy(hep3_hg_tmpl.header.id, HEP_HEADER_ID, HEP_HEADER_ID_LEN);
+
+	HEP3_CHUNK_HDR(hep3_hg_tmpl.ip_family, HEP_PROTO_FAMILY);
+	HEP3_CHUNK_HDR(hep3_hg_tmpl.ip_proto, HEP_PROTO_ID);
+	HEP3_CHUNK_HDR(hep3_hg_tmpl.src_port, HEP_SRC_PORT);
+	HEP3_CHUNK_HDR(hep3_hg_tmpl.dst_port, HEP_DST_PORT);
+	HEP3_CHUNK_HDR(hep3_hg_tmpl.time_sec, HEP_TIMESTAMP);
+	HEP3_CHUNK_HDR(hep3_hg_tmpl.time_usec, HEP_TIMESTAMP_US);
+	HEP3_CHUNK_HDR(hep3_hg_tmpl.proto_t, HEP_PROTO_TYPE);
+	HEP3_CHUNK_HDR(hep3_hg_tmpl.capt_id, HEP_AGENT_ID);
+	hep3_hg_tmpl.capt_id.data = htonl(hep_capture_id);
+
+	memset(&hep3_ip4_tmpl, 0, sizeof hep3_ip4_tmpl);
+	HEP3_CHUNK_HDR(hep3_ip4_tmpl.src_ip4, HEP_IPV4_SRC);
+	HEP3_CHUNK_HDR(hep3_ip4_tmpl.dst_ip4, HEP_IPV4_DST);
+
+	memset(&hep3_ip6_tmpl, 0, sizeof hep3_ip6_tmpl);
+	HEP3_CHUNK_HDR(hep3_ip6_tmpl.src_ip6, HEP_IPV6_SRC);
+	HEP3_CHUNK_HDR(hep3_ip6_tmpl.dst_ip6, HEP_IPV6_DST);
+
+	hep3_tmpl_ready = 1;
+}
+
+#undef HEP3_CHUNK_HDR
+
 static trace_message create_hep3_message(union sockaddr_union* from_su, union sockaddr_union* to_su,
 		int net_proto, str* payload, int proto)
 {
@@ -962,104 +1001,40 @@ static trace_message create_hep3_message(union sockaddr_union* from_su, union so
 
 	gettimeofday(&tvb, NULL);
 
-	/* header set */
-	memcpy(hep_msg->u.hepv3.hg.header.id, HEP_HEADER_ID, HEP_HEADER_ID_LEN);
+	if (!hep3_tmpl_ready)
+		hep3_init_templates();
 
-	/* IP proto */
-	hep_msg->u.hepv3.hg.ip_family.chunk.vendor_id = htons(GENERIC_VENDOR_ID);
-	hep_msg->u.hepv3.hg.ip_family.chunk.type_id   = htons(0x0001);
+	/* the chunk headers never change, only fill in the data */
+	memcpy(&hep_msg->u.hepv3.hg, &hep3_hg_tmpl, sizeof hep3_hg_tmpl);
 	hep_msg->u.hepv3.hg.ip_family.data = from_su->s.sa_family;
-	hep_msg->u.hepv3.hg.ip_family.chunk.length = htons(sizeof(hep_msg->u.hepv3.hg.ip_family));
-
-	/* Proto ID */
-	hep_msg->u.hepv3.hg.ip_proto.chunk.vendor_id = htons(GENERIC_VENDOR_ID);
-	hep_msg->u.hepv3.hg.ip_proto.chunk.type_id   = htons(0x0002);
 	hep_msg->u.hepv3.hg.ip_proto.data = net_proto;
-	hep_msg->u.hepv3.hg.ip_proto.chunk.length = htons(sizeof(hep_msg->u.hepv3.hg.ip_proto));
-
 
 	/* IPv4 */
 	if(from_su->s.sa_family == AF_INET) {
-		/* SRC IP */
-		hep_msg->u.hepv3.addr.ip4_addr.src_ip4.chunk.vendor_id = htons(GENERIC_VENDOR_ID);
-		hep_msg->u.hepv3.addr.ip4_addr.src_ip4.chunk.type_id   = htons(0x0003);
+		memcpy(&hep_msg->u.hepv3.addr.ip4_addr, &hep3_ip4_tmpl,
+			sizeof hep3_ip4_tmpl);
 		hep_msg->u.hepv3.addr.ip4_addr.src_ip4.data = from_su->sin.sin_addr;
-		hep_msg->u.hepv3.addr.ip4_addr.src_ip4.chunk.length = htons(sizeof(hep_msg->u.hepv3.addr.ip4_addr.src_ip4));
-
-		/* DST IP */
-		hep_msg->u.hepv3.addr.ip4_addr.dst_ip4.chunk.vendor_id = htons(GENERIC_VENDOR_ID);
-		hep_msg->u.hepv3.addr.ip4_addr.dst_ip4.chunk.type_id   = htons(0x0004);
 		hep_msg->u.hepv3.addr.ip4_addr.dst_ip4.data = to_su->sin.sin_addr;
-		hep_msg->u.hepv3.addr.ip4_addr.dst_ip4.chunk.length = htons(sizeof(hep_msg->u.hepv3.addr.ip4_addr.dst_ip4));
+		iplen = sizeof(struct ip4_addr);
 
-		iplen = sizeof(hep_msg->u.hepv3.addr.ip4_addr.dst_ip4) + sizeof(hep_msg->u.hepv3.addr.ip4_addr.src_ip4);
-
-		/* SRC PORT */
-		hep_msg->u.hepv3.hg.src_port.chunk.vendor_id = htons(GENERIC_VENDOR_ID);
-		hep_msg->u.hepv3.hg.src_port.chunk.type_id   = htons(0x0007);
 		hep_msg->u.hepv3.hg.src_port.data = from_su->sin.sin_port;
-		hep_msg->u.hepv3.hg.src_port.chunk.length = htons(sizeof(hep_msg->u.hepv3.hg.src_port));
-
-		/* DST PORT */
-		hep_msg->u.hepv3.hg.dst_port.chunk.vendor_id = htons(GENERIC_VENDOR_ID);
-		hep_msg->u.hepv3.hg.dst_port.chunk.type_id   = htons(0x0008);
 		hep_msg->u.hepv3.hg.dst_port.data = to_su->sin.sin_port;
-		hep_msg->u.hepv3.hg.dst_port.chunk.length = htons(sizeof(hep_msg->u.hepv3.hg.dst_port));
 	}
 	/* IPv6 */
 	else if(from_su->s.sa_family == AF_INET6) {
-		/* SRC IPv6 */
-		hep_msg->u.hepv3.addr.ip6_addr.src_ip6.chunk.vendor_id = htons(GENERIC_VENDOR_ID);
-		hep_msg->u.hepv3.addr.ip6_addr.src_ip6.chunk.type_id   = htons(0x0005);
+		memcpy(&hep_msg->u.hepv3.addr.ip6_addr, &hep3_ip6_tmpl,
+			sizeof hep3_ip6_tmpl);
 		hep_msg->u.hepv3.addr.ip6_addr.src_ip6.data = from_su->sin6.sin6_addr;
-		hep_msg->u.hepv3.addr.ip6_addr.src_ip6.chunk.length = htons(sizeof(hep_msg->u.hepv3.addr.ip6_addr.src_ip6));
-
-		/* DST IPv6 */
-		hep_msg->u.hepv3.addr.ip6_addr.dst_ip6.chunk.vendor_id = htons(GENERIC_VENDOR_ID);
-		hep_msg->u.hepv3.addr.ip6_addr.dst_ip6.chunk.type_id   = htons(0x0006);
 		hep_msg->u.hepv3.addr.ip6_addr.dst_ip6.data = to_su->sin6.sin6_addr;
-		hep_msg->u.hepv3.addr.ip6_addr.dst_ip6.chunk.length = htons(sizeof(hep_msg->u.hepv3.addr.ip6_addr.dst_ip6));
-
-		iplen = sizeof(hep_msg->u.hepv3.addr.ip6_addr.dst_ip6) + sizeof(hep_msg->u.hepv3.addr.ip6_addr.src_ip6);
+		iplen = sizeof(struct ip6_addr);
 
-		/* SRC PORT */
-		hep_msg->u.hepv3.hg.src_port.chunk.vendor_id = htons(GENERIC_VENDOR_ID);
-		hep_msg->u.hepv3.hg.src_port.chunk.type_id   = htons(0x0007);
 		hep_msg->u.hepv3.hg.src_port.data = from_su->sin6.sin6_port;
-		hep_msg->u.hepv3.hg.src_port.chunk.length = htons(sizeof(hep_msg->u.hepv3.hg.src_port));
-
-		/* DST PORT */
-		hep_msg->u.hepv3.hg.dst_port.chunk.vendor_id = htons(GENERIC_VENDOR_ID);
-		hep_msg->u.hepv3.hg.dst_port.chunk.type_id   = htons(0x0008);
 		hep_msg->u.hepv3.hg.dst_port.data = to_su->sin6.sin6_port;
-		hep_msg->u.hepv3.hg.dst_port.chunk.length = htons(sizeof(hep_msg->u.hepv3.hg.dst_port));
 	}
 
-	/* TIMESTAMP SEC */
-	hep_msg->u.hepv3.hg.time_sec.chunk.vendor_id = htons(GENERIC_VENDOR_ID);
-	hep_msg->u.hepv3.hg.time_sec.chunk.type_id   = htons(0x0009);
 	hep_msg->u.hepv3.hg.time_sec.data = htonl(tvb.tv_sec);
-	hep_msg->u.hepv3.hg.time_sec.chunk.length = htons(sizeof(hep_msg->u.hepv3.hg.time_sec));
-
-
-	/* TIMESTAMP USEC */
-	hep_msg->u.hepv3.hg.time_usec.chunk.vendor_id = htons(GENERIC_VENDOR_ID);
-	hep_msg->u.hepv3.hg.time_usec.chunk.type_id   = htons(0x000a);
 	hep_msg->u.hepv3.hg.time_usec.data = htonl(tvb.tv_usec);
-	hep_msg->u.hepv3.hg.time_usec.chunk.length = htons(sizeof(hep_msg->u.hepv3.hg.time_usec));
-
-	/* Protocol TYPE */
-	hep_msg->u.hepv3.hg.proto_t.chunk.vendor_id = htons(GENERIC_VENDOR_ID);
-	hep_msg->u.hepv3.hg.proto_t.chunk.type_id   = htons(0x000b);
 	hep_msg->u.hepv3.hg.proto_t.data = proto;
-	hep_msg->u.hepv3.hg.proto_t.chunk.length = htons(sizeof(hep_msg->u.hepv3.hg.proto_t));
-
-	/* Capture ID */
-	hep_msg->u.hepv3.hg.capt_id.chunk.vendor_id = htons(GENERIC_VENDOR_ID);
-	hep_msg->u.hepv3.hg.capt_id.chunk.type_id   = htons(0x000c);
-	/* */
-	hep_msg->u.hepv3.hg.capt_id.data = htonl(hep_capture_id);
-	hep_msg->u.hepv3.hg.capt_id.chunk.length = htons(sizeof(hep_msg->u.hepv3.hg.capt_id));
 
 	hep_msg->u.hepv3.payload_chunk.chunk.vendor_id = htons(GENERIC_VENDOR_ID);
 	hep_msg->u.hepv3.payload_chunk.chunk.type_id   = payload_compression ? htons(0x0010) : htons(0x000f);
@@ -1233,14 +1208,115 @@ static char* build_hep12_buf(struct hep_desc* hep_msg, int* len)
 
 }
 
-static inline char* JSON_toString(void* root)
+/* the JSON objects of the extra payload and of the correlation are written
+ * straight in their final form, as members get added; the closing brace is
+ * only put when building the packet */
+struct hep_json {
+	str buf;
+	int size;
+};
+
+static int hep_json_escaped_len(const char *s, int len)
 {
-	return cJSON_Print(root);
+	int i, n = len;
+
+	for (i = 0; i < len; i++)
+		switch (s[i]) {
+			case '"': case '\\': case '\b': case '\f':
+			case '\n': case '\r': case '\t':
+				n++;
+				break;
+			default:
+				if ((unsigned char)s[i] < 0x20)
+					n += 5;
+		}
+
+	return n;
+}
+
+static char *hep_json_escape(char *p, const char *s, int len)
+{
+	static const char hex[] = "0123456789abcdef";
+	int i;
+
+	for (i = 0; i < len; i++) {
+		switch (s[i]) {
+			case '"':  *p++ = '\\'; *p++ = '"';  continue;
+			case '\\': *p++ = '\\'; *p++ = '\\'; continue;
+			case '\b': *p++ = '\\'; *p++ = 'b';  continue;
+			case '\f': *p++ = '\\'; *p++ = 'f';  continue;
+			case '\n': *p++ = '\\'; *p++ = 'n';  continue;
+			case '\r': *p++ = '\\'; *p++ = 'r';  continue;
+			case '\t': *p++ = '\\'; *p++ = 't';  continue;
+		}
+
+		if ((unsigned char)s[i] < 0x20) {
+			memcpy(p, "\\u00", 4);
+			p[4] = hex[(unsigned char)s[i] >> 4];
+			p[5] = hex[s[i] & 0xf];
+			p += 6;
+		} else {
+			*p++ = s[i];
+		}
+	}
+
+	return p;
+}
+
+static int hep_json_add(void **root, const char *name, int name_len, str *value)
+{
+	struct hep_json *json = *root;
+	int len, size;
+	char *p;
+
+	/* ,"name":"value" plus the closing brace */
+	len = 6 + hep_json_escaped_len(name, name_len) +
+		hep_json_escaped_len(value->s, value->len) + 1;
+
+	if (!json) {
+		for (size = 128; size < len; size <<= 1);
+		json = pkg_malloc(sizeof *json + size);
+		if (!json) {
+			LM_ERR("no more pkg mem!\n");
+			return -1;
+		}
+		json->buf.s = (char *)(json + 1);
+		json->buf.len = 0;
+		json->size = size;
+		*root = json;
+	} else if (json->buf.len + len > json->size) {
+		for (size = json->size << 1; size < json->buf.len + len; size <<= 1);
+		json = pkg_realloc(json, sizeof *json + size);
+		if (!json) {
+			LM_ERR("no more pkg mem!\n");
+			return -1;
+		}
+		json->buf.s = (char *)(json + 1);
+		json->size = size;
+		*root = json;
+	}
+
+	p = json->buf.s + json->buf.len;
+	*p++ = json->buf.len ? ',' : '{';
+	*p++ = '"';
+	p = hep_json_escape(p, name, name_len);
+	*p++ = '"';
+	*p++ = ':';
+	*p++ = '"';
+	p = hep_json_escape(p, value->s, value->len);
+	*p++ = '"';
+
+	json->buf.len = p - json->buf.s;
+	return 0;
 }
 
-static inline void JSON_free(void* root)
+static inline str *hep_json_close(void *root)
 {
-	cJSON_Delete(root);
+	struct hep_json *json = root;
+
+	/* room for it was left by hep_json_add() */
+	json->buf.s[json->buf.len] = '}';
+	return &json->buf;
 }
 
 static char* build_hep3_buf(struct hep_desc* hep_msg, int* len)
@@ -1260,6 +1336,7 @@ static char* build_hep3_buf(struct hep_desc* hep_msg, int* len)
 	int rem, hdr_len, pld_len, corr_len=0;
 	char* buf;
 	str* h5_buf;
+	str* json;
 
 	generic_chunk_t *it, *corr_chunk, correlation;
 
@@ -1274,10 +1351,11 @@ static char* build_hep3_buf(struct hep_desc* hep_msg, int* len)
 		if ( !homer5_on ) {
 			rem -= hep_msg->u.hepv3.payload_chunk.chunk.length;
 
-			hep_msg->u.hepv3.payload_chunk.data = JSON_toString(hep_msg->fPayload);
+			json = hep_json_close(hep_msg->fPayload);
+			hep_msg->u.hepv3.payload_chunk.data = json->s;
 
 			hep_msg->u.hepv3.payload_chunk.chunk.length =
-				strlen(hep_msg->u.hepv3.payload_chunk.data) + sizeof(hep_chunk_t);
+				json->len + 1 + sizeof(hep_chunk_t);
 
 			rem += hep_msg->u.hepv3.payload_chunk.chunk.length;
 		} else {
@@ -1300,8 +1378,9 @@ static char* build_hep3_buf(struct hep_desc* hep_msg, int* len)
 			correlation.chunk.type_id = htons(HEP_EXTRA_CORRELATION);
 			correlation.chunk.length = sizeof(hep_chunk_t);
 
-			correlation.data = JSON_toString(hep_msg->correlation);
-			corr_len += strlen(correlation.data);
+			json = hep_json_close(hep_msg->correlation);
+			correlation.data = json->s;
+			corr_len += json->len + 1;
 
 			correlation.chunk.length += corr_len;
 			rem += correlation.chunk.length;
@@ -1387,9 +1466,6 @@ static char* build_hep3_buf(struct hep_desc* hep_msg, int* len)
 
 			/* can't get the correlation length from header since it's in htons form */
 			HEP3_BUF_APPEND(buf + *len, correlation.data, corr_len);
-
-			/* just dumped the string - no need to keep it further on */
-			cJSON_PurgeString((char *)correlation.data);
 		}
 	}
 
@@ -1541,7 +1617,6 @@ int add_hep_chunk(trace_message message, void* data, int len, int type, int data
 
 int add_hep_correlation(trace_message message, str* corr_name, str* corr_value)
 {
-	cJSON* root;
 	struct hep_desc* hep_msg;
 	str* sip_correlation;
 
@@ -1558,19 +1633,11 @@ int add_hep_correlation(trace_message message, str* corr_name, str* corr_value)
 	}
 
 	if ( !homer5_on ) {
-		if ( hep_msg->correlation) {
-			root = (cJSON *) hep_msg->correlation;
-		} else {
-			root = cJSON_CreateObject();
-			if ( !root ) {
-				LM_ERR("failed to create correlation object!\n");
-				return -1;
-			}
-
-			hep_msg->correlation = root;
+		if (hep_json_add(&hep_msg->correlation, corr_name->s, corr_name->len,
+				corr_value) < 0) {
+			LM_ERR("failed to add to the correlation object!\n");
+			return -1;
 		}
-
-		_cJSON_AddStrToObject( root, corr_name, corr_value->s, corr_value->len);
 	} else {
 		if ( !memcmp( corr_name->s, "sip", sizeof("sip") - 1 ) ) {
 			/* we'll save sip correlation id as the actual correlation */
@@ -1593,7 +1660,6 @@ int add_hep_correlation(trace_message message, str* corr_name, str* corr_value)
 
 int add_hep_payload(trace_message message, char* pld_name, str* pld_value)
 {
-	cJSON* root;
 	struct hep_desc* hep_msg;
 
 	str* homer5_buf;
@@ -1611,18 +1677,11 @@ int add_hep_payload(trace_message message, char* pld_name, str* pld_value)
 	}
 
 	if ( !homer5_on ) {
-		if ( hep_msg->fPayload ) {
-			root = (cJSON *) hep_msg->fPayload;
-		} else {
-			root = cJSON_CreateObject();
-			if ( !root ) {
-				LM_ERR("failed to create correlation object!\n");
-				return -1;
-			}
-			hep_msg->fPayload = root;
+		if (hep_json_add(&hep_msg->fPayload, pld_name, strlen(pld_name),
+				pld_value) < 0) {
+			LM_ERR("failed to add to the payload object!\n");
+			return -1;
 		}
-
-		cJSON_AddStrToObject( root, pld_name, pld_value->s, pld_value->len);
 	} else {
 		if ( hep_msg->fPayload ) {
 			homer5_buf = hep_msg->fPayload;
@@ -1695,6 +1754,15 @@ int send_hep_message(trace_message message, trace_dest dest, struct socket_info*
 		}
 	}
 
+	/* left to the sender process; a full queue is reported by the drop
+	 * counters, not as a tracing error */
+	if (hep_dest->queue) {
+		hep_queue_push(hep_dest->queue, send_sock, buf, len);
+		pkg_free(buf);
+		ret = 0;
+		goto end;
+	}
+
 	/* */
 	p=mk_proxy( &hep_dest->ip, hep_dest->port_no ? hep_dest->port_no : HEP_PORT, hep_dest->transport, 0);
 	if (p == NULL) {
@@ -1752,8 +1820,7 @@ void free_hep_message(trace_message message)
 		/* free JSON payload if there */
 		if ( hep_msg->fPayload ) {
 			if ( !homer5_on ) {
-				cJSON_PurgeString( hep_msg->u.hepv3.payload_chunk.data );
-				JSON_free( hep_msg->fPayload );
+				pkg_free( hep_msg->fPayload );
 			} else {
 				if ( ((str *)hep_msg->fPayload)->s )
 					pkg_free( ((str *)hep_msg->fPayload)->s );
@@ -1764,7 +1831,7 @@ void free_hep_message(trace_message message)
 		/* free JSON correlation if there */
 		if ( hep_msg->correlation ) {
 			if ( !homer5_on ) {
-				JSON_free( hep_msg->correlation );
+				pkg_free( hep_msg->correlation );
 			} else {
 				pkg_free( hep_msg->correlation );
 			}
@@ -1801,6 +1868,16 @@ trace_dest new_trace_dest(str *name, str *uri)
 		goto end;
 	el->dynamic = 1;
 
+	if (hep_queue_size > 0) {
+		el->queue = hep_queue_new(&el->name, &el->ip,
+			el->port_no ? el->port_no : HEP_PORT, el->transport);
+		if (!el->queue) {
+			shm_free(el);
+			el = NULL;
+			goto end;
+		}
+	}
+
 	/* add the new element to the hep id list */
 	if (*hid_dyn_list == NULL) {
 		*hid_dyn_list = el;
@@ -2038,6 +2115,26 @@ int init_hep_id(void)
 	return 0;
 }
 
+int init_hep_queues(void)
+{
+	hid_list_p it;
+
+	if (hep_queue_init() < 0)
+		return -1;
+
+	if (hep_queue_size <= 0)
+		return 0;
+
+	for (it=hid_list; it; it=it->next) {
+		it->queue = hep_queue_new(&it->name, &it->ip,
+			it->port_no ? it->port_no : HEP_PORT, it->transport);
+		if (!it->queue)
+			return -1;
+	}
+
+	return 0;
+}
+
 void destroy_hep_id(void)
 {
 	hid_list_p it, next;
@@ -27,6 +27,7 @@
 
 #include "../../ip_addr.h"
 #include "../../trace_api.h"
+#include "hep_queue.h"
 
 /* first and last version of hep protocol */
 #define HEP_FIRST 1
@@ -254,8 +255,11 @@ struct hep_context {
 	do { \
 		if ((_h)->dynamic) { \
 			(_h)->ref--; \
-			if ((_h)->ref == 0) \
+			if ((_h)->ref == 0) { \
+				if ((_h)->queue) \
+					hep_queue_close((_h)->queue); \
 				shm_free(_h); \
+			} \
 		} \
 	} while (0)
 
@@ -276,6 +280,8 @@ typedef struct _hid_list {
 	char transport;
 	char dynamic;
 
+	struct hep_queue *queue;  /* with hep_queue_size, the sender's queue */
+
 	struct _hid_list* next;
 } hid_list_t, *hid_list_p;
 
@@ -285,6 +291,7 @@ int unpack_hep(char *buf, int len, int version, struct hep_desc* h);
 void free_extra_chunks(struct hep_desc* h);
 
 int init_hep_id(void);
+int init_hep_queues(void);
 void destroy_hep_id(void);
 int parse_hep_id(unsigned int type, void *val);
 
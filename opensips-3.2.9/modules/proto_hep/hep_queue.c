@@ -0,0 +1,501 @@
+/*
+ * Copyright (C) 2026 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#define _GNU_SOURCE /* we need this for sendmmsg() */
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+#include "../../dprint.h"
+#include "../../locking.h"
+#include "../../mem/mem.h"
+#include "../../mem/shm_mem.h"
+#include "../../proxy.h"
+#include "../../resolve.h"
+#include "../../forward.h"
+
+#include "hep.h"
+#include "hep_queue.h"
+
+#if defined(__OS_linux) && defined(MSG_WAITFORONE)
+#define HEP_HAVE_SENDMMSG
+#endif
+
+/* how much of a TCP queue is put together in a single write */
+#define HEP_TCP_COALESCE  65536
+
+/* how long the sender sleeps with nothing to send, in ms */
+#define HEP_SENDER_IDLE   1000
+
+int hep_queue_size = 0;
+int hep_batch_size = 32;
+
+stat_var *hep_queued;
+stat_var *hep_dropped;
+stat_var *hep_batches;
+
+struct hep_packet {
+	struct socket_info *send_sock;
+	int len;
+	struct hep_packet *next;
+	char buf[0];
+};
+
+struct hep_queue {
+	str name;
+	str host;
+	unsigned short port;
+	int proto;
+
+	gen_lock_t lock;
+	struct hep_packet *first;
+	struct hep_packet *last;
+	int len;
+	int closed;
+
+	unsigned long sent;
+	unsigned long dropped;
+
+	struct hep_queue *next;
+};
+
+/* the queues are only unlinked and freed by the sender */
+struct hep_queues {
+	gen_lock_t lock;
+	struct hep_queue *list;
+	int sleeping;
+	int fd;
+};
+
+static struct hep_queues *hep_queues;
+
+#ifdef HEP_HAVE_SENDMMSG
+static struct iovec *hep_iov;
+static struct mmsghdr *hep_msgs;
+#endif
+static char *hep_tcp_buf;
+
+
+int hep_queue_init(void)
+{
+	if (hep_queue_size <= 0)
+		return 0;
+
+	if (hep_batch_size <= 0) {
+		LM_WARN("bad hep_batch_size %d, using 1\n", hep_batch_size);
+		hep_batch_size = 1;
+	}
+
+	hep_queues = shm_malloc(sizeof *hep_queues);
+	if (!hep_queues) {
+		LM_ERR("no more shm!\n");
+		return -1;
+	}
+	memset(hep_queues, 0, sizeof *hep_queues);
+
+	if (!lock_init(&hep_queues->lock)) {
+		LM_ERR("failed to init the HEP queues lock\n");
+		return -1;
+	}
+
+	hep_queues->fd = eventfd(0, EFD_CLOEXEC);
+	if (hep_queues->fd < 0) {
+		LM_ERR("failed to create eventfd: %s\n", strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+struct hep_queue *hep_queue_new(str *name, str *host, unsigned short port,
+		int proto)
+{
+	struct hep_queue *q;
+
+	if (!hep_queues)
+		return NULL;
+
+	q = shm_malloc(sizeof *q + name->len + host->len);
+	if (!q) {
+		LM_ERR("no more shm!\n");
+		return NULL;
+	}
+	memset(q, 0, sizeof *q);
+
+	if (!lock_init(&q->lock)) {
+		LM_ERR("failed to init the queue lock\n");
+		shm_free(q);
+		return NULL;
+	}
+
+	q->name.s = (char *)(q + 1);
+	q->name.len = name->len;
+	memcpy(q->name.s, name->s, name->len);
+
+	q->host.s = q->name.s + q->name.len;
+	q->host.len = host->len;
+	memcpy(q->host.s, host->s, host->len);
+
+	q->port = port;
+	q->proto = proto;
+
+	lock_get(&hep_queues->lock);
+	q->next = hep_queues->list;
+	hep_queues->list = q;
+	lock_release(&hep_queues->lock);
+
+	LM_DBG("queueing the packets of hep id <%.*s>\n", name->len, name->s);
+	return q;
+}
+
+void hep_queue_close(struct hep_queue *q)
+{
+	lock_get(&q->lock);
+	q->closed = 1;
+	lock_release(&q->lock);
+}
+
+int hep_queue_push(struct hep_queue *q, struct socket_info *send_sock,
+		char *buf, int len)
+{
+	struct hep_packet *pkt;
+	uint64_t one = 1;
+
+	if (q->len >= hep_queue_size)
+		goto drop;
+
+	pkt = shm_malloc(sizeof *pkt + len);
+	if (!pkt) {
+		LM_ERR("no more shm!\n");
+		goto drop;
+	}
+	pkt->send_sock = send_sock;
+	pkt->len = len;
+	pkt->next = NULL;
+	memcpy(pkt->buf, buf, len);
+
+	lock_get(&q->lock);
+	if (q->len >= hep_queue_size) {
+		lock_release(&q->lock);
+		shm_free(pkt);
+		goto drop;
+	}
+	if (q->last)
+		q->last->next = pkt;
+	else
+		q->first = pkt;
+	q->last = pkt;
+	q->len++;
+	lock_release(&q->lock);
+
+	update_stat(hep_queued, 1);
+
+	if (__atomic_exchange_n(&hep_queues->sleeping, 0, __ATOMIC_SEQ_CST) &&
+	write(hep_queues->fd, &one, sizeof one) < 0)
+		LM_ERR("failed to wake up the HEP sender: %s\n", strerror(errno));
+
+	return 0;
+
+drop:
+	__atomic_add_fetch(&q->dropped, 1, __ATOMIC_RELAXED);
+	update_stat(hep_dropped, 1);
+	LM_DBG("queue of hep id <%.*s> full, dropping packet\n",
+		q->name.len, q->name.s);
+	return -1;
+}
+
+
+static inline int hep_send_fd(struct socket_info *send_sock,
+		union sockaddr_union *to)
+{
+	if (!send_sock)
+		send_sock = get_send_socket(0, to, PROTO_HEP_UDP);
+	if (!send_sock) {
+		LM_ERR("no sending socket found for hep_udp\n");
+		return -1;
+	}
+
+	return send_sock->socket;
+}
+
+/* sends the packets with the same socket as the first one, returns the
+ * number of packets sent or -1 if none could be sent */
+static int hep_flush_udp(struct hep_packet *pkts, union sockaddr_union *to)
+{
+	struct hep_packet *pkt;
+	int fd, n, rc;
+
+	fd = hep_send_fd(pkts->send_sock, to);
+	if (fd < 0)
+		return -1;
+
+#ifdef HEP_HAVE_SENDMMSG
+	for (n = 0, pkt = pkts; pkt && n < hep_batch_size &&
+	pkt->send_sock == pkts->send_sock; pkt = pkt->next, n++) {
+		hep_iov[n].iov_base = pkt->buf;
+		hep_iov[n].iov_len = pkt->len;
+		memset(&hep_msgs[n], 0, sizeof hep_msgs[n]);
+		hep_msgs[n].msg_hdr.msg_name = &to->s;
+		hep_msgs[n].msg_hdr.msg_namelen = sockaddru_len(*to);
+		hep_msgs[n].msg_hdr.msg_iov = &hep_iov[n];
+		hep_msgs[n].msg_hdr.msg_iovlen = 1;
+	}
+
+again:
+	rc = sendmmsg(fd, hep_msgs, n, 0);
+#else
+	n = 1;
+again:
+	rc = sendto(fd, pkts->buf, pkts->len, 0, &to->s, sockaddru_len(*to));
+	if (rc >= 0)
+		rc = 1;
+#endif
+	if (rc < 0) {
+		if (errno == EINTR || errno == EAGAIN)
+			goto again;
+		LM_ERR("failed to send %d HEP packets: %s(%d)\n", n,
+			strerror(errno), errno);
+		return -1;
+	}
+
+	update_stat(hep_batches, 1);
+	return rc;
+}
+
+/* writes the packets with the same socket as the first one at once */
+static int hep_flush_tcp(struct hep_packet *pkts, union sockaddr_union *to)
+{
+	struct hep_packet *pkt;
+	int n, len;
+
+	if (pkts->len > HEP_TCP_COALESCE || !pkts->next ||
+	pkts->next->send_sock != pkts->send_sock) {
+		if (msg_send(pkts->send_sock, PROTO_HEP_TCP, to, 0,
+		pkts->buf, pkts->len, NULL) < 0)
+			return -1;
+		update_stat(hep_batches, 1);
+		return 1;
+	}
+
+	for (n = 0, len = 0, pkt = pkts; pkt && pkt->send_sock == pkts->send_sock
+	&& len + pkt->len <= HEP_TCP_COALESCE; pkt = pkt->next, n++) {
+		memcpy(hep_tcp_buf + len, pkt->buf, pkt->len);
+		len += pkt->len;
+	}
+
+	if (msg_send(pkts->send_sock, PROTO_HEP_TCP, to, 0,
+	hep_tcp_buf, len, NULL) < 0)
+		return -1;
+
+	update_stat(hep_batches, 1);
+	return n;
+}
+
+static inline void hep_free_packets(struct hep_packet *pkt)
+{
+	struct hep_packet *next;
+
+	for (; pkt; pkt = next) {
+		next = pkt->next;
+		shm_free(pkt);
+	}
+}
+
+static void hep_queue_flush(struct hep_queue *q, struct hep_packet *pkts,
+		int len)
+{
+	union sockaddr_union to;
+	struct hep_packet *next;
+	struct proxy_l *p;
+	int n;
+
+	update_stat(hep_queued, -len);
+
+	/* resolved once for all the queued packets */
+	p = mk_proxy(&q->host, q->port, q->proto, 0);
+	if (!p) {
+		LM_ERR("bad hep host name <%.*s>!\n", q->host.len, q->host.s);
+		goto drop;
+	}
+	hostent2su(&to, &p->host, p->addr_idx, p->port ? p->port : HEP_PORT);
+
+	while (pkts) {
+		if (q->proto == PROTO_HEP_UDP)
+			n = hep_flush_udp(pkts, &to);
+		else
+			n = hep_flush_tcp(pkts, &to);
+
+		if (n < 0) {
+			if (get_next_su(p, &to, 0) == 0)
+				continue;
+			LM_ERR("cannot send HEP packets to hep id <%.*s>\n",
+				q->name.len, q->name.s);
+			break;
+		}
+
+		__atomic_add_fetch(&q->sent, n, __ATOMIC_RELAXED);
+		len -= n;
+		for (; n; n--, pkts = next) {
+			next = pkts->next;
+			shm_free(pkts);
+		}
+	}
+
+	free_proxy(p);
+	pkg_free(p);
+
+drop:
+	if (pkts) {
+		__atomic_add_fetch(&q->dropped, len, __ATOMIC_RELAXED);
+		update_stat(hep_dropped, len);
+	}
+	hep_free_packets(pkts);
+}
+
+/* returns the number of packets flushed */
+static int hep_queues_flush(void)
+{
+	struct hep_queue *q, **pq, *next;
+	struct hep_packet *pkts;
+	int len, closed, total = 0;
+
+	lock_get(&hep_queues->lock);
+	q = hep_queues->list;
+	lock_release(&hep_queues->lock);
+
+	/* new queues only go in front, so the rest of the list is ours */
+	for (; q; q = next) {
+		next = q->next;
+
+		lock_get(&q->lock);
+		pkts = q->first;
+		len = q->len;
+		q->first = q->last = NULL;
+		q->len = 0;
+		closed = q->closed;
+		lock_release(&q->lock);
+
+		if (pkts) {
+			hep_queue_flush(q, pkts, len);
+			total += len;
+		}
+
+		if (!closed)
+			continue;
+
+		lock_get(&hep_queues->lock);
+		for (pq = &hep_queues->list; *pq != q; pq = &(*pq)->next);
+		*pq = next;
+		lock_release(&hep_queues->lock);
+
+		LM_DBG("releasing the queue of hep id <%.*s>\n",
+			q->name.len, q->name.s);
+		lock_destroy(&q->lock);
+		shm_free(q);
+	}
+
+	return total;
+}
+
+void hep_sender_process(int rank)
+{
+	struct pollfd pfd;
+	uint64_t n;
+
+#ifdef HEP_HAVE_SENDMMSG
+	hep_iov = pkg_malloc(hep_batch_size * sizeof *hep_iov);
+	hep_msgs = pkg_malloc(hep_batch_size * sizeof *hep_msgs);
+	if (!hep_iov || !hep_msgs) {
+		LM_ERR("no more pkg memory\n");
+		return;
+	}
+#endif
+	hep_tcp_buf = pkg_malloc(HEP_TCP_COALESCE);
+	if (!hep_tcp_buf) {
+		LM_ERR("no more pkg memory\n");
+		return;
+	}
+
+	pfd.fd = hep_queues->fd;
+	pfd.events = POLLIN;
+
+	for (;;) {
+		if (hep_queues_flush())
+			continue;
+
+		__atomic_store_n(&hep_queues->sleeping, 1, __ATOMIC_SEQ_CST);
+		if (hep_queues_flush()) {
+			__atomic_store_n(&hep_queues->sleeping, 0, __ATOMIC_RELAXED);
+			continue;
+		}
+
+		/* the timeout also takes care of the closed queues */
+		if (poll(&pfd, 1, HEP_SENDER_IDLE) > 0 &&
+		read(hep_queues->fd, &n, sizeof n) < 0 && errno != EINTR)
+			LM_ERR("failed to read eventfd: %s\n", strerror(errno));
+	}
+}
+
+
+mi_response_t *mi_hep_queues(const mi_params_t *params,
+		struct mi_handler *async_hdl)
+{
+	mi_response_t *resp;
+	mi_item_t *resp_obj, *arr, *item;
+	struct hep_queue *q;
+
+	resp = init_mi_result_object(&resp_obj);
+	if (!resp)
+		return 0;
+
+	arr = add_mi_array(resp_obj, MI_SSTR("Queues"));
+	if (!arr)
+		goto error;
+
+	if (!hep_queues)
+		return resp;
+
+	lock_get(&hep_queues->lock);
+	for (q = hep_queues->list; q; q = q->next) {
+		if (q->closed)
+			continue;
+
+		item = add_mi_object(arr, NULL, 0);
+		if (!item ||
+		add_mi_string(item, MI_SSTR("name"), q->name.s, q->name.len) < 0 ||
+		add_mi_number(item, MI_SSTR("queued"), q->len) < 0 ||
+		add_mi_number(item, MI_SSTR("sent"), q->sent) < 0 ||
+		add_mi_number(item, MI_SSTR("dropped"), q->dropped) < 0) {
+			lock_release(&hep_queues->lock);
+			goto error;
+		}
+	}
+	lock_release(&hep_queues->lock);
+
+	return resp;
+
+error:
+	free_mi_response(resp);
+	return 0;
+}
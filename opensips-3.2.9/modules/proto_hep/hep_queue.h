@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2026 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * HEP send queues: with "hep_queue_size" set, each HEP id gets a queue of up
+ * to that many packets in shm, and the processes tracing only copy the built
+ * packets there; the "HEP sender" process empties all the queues, sending the
+ * packets of a destination in batches - sendmmsg() for UDP, a single write of
+ * the packets put together for TCP. The packets not fitting in a queue are
+ * dropped and counted.
+ */
+
+#ifndef _HEP_QUEUE_H
+#define _HEP_QUEUE_H
+
+#include "../../str.h"
+#include "../../socket_info.h"
+#include "../../statistics.h"
+#include "../../mi/mi.h"
+
+struct hep_queue;
+
+extern int hep_queue_size;
+extern int hep_batch_size;
+
+extern stat_var *hep_queued;
+extern stat_var *hep_dropped;
+extern stat_var *hep_batches;
+
+int hep_queue_init(void);
+
+/* a queue for the packets of a HEP id; the strings are copied */
+struct hep_queue *hep_queue_new(str *name, str *host, unsigned short port,
+		int proto);
+
+/* the HEP id is gone - the queue is freed by the sender once empty */
+void hep_queue_close(struct hep_queue *q);
+
+/* copies the packet to the queue, dropping it if the queue is full */
+int hep_queue_push(struct hep_queue *q, struct socket_info *send_sock,
+		char *buf, int len);
+
+void hep_sender_process(int rank);
+
+mi_response_t *mi_hep_queues(const mi_params_t *params,
+		struct mi_handler *async_hdl);
+
+#endif
@@ -123,9 +123,33 @@ static param_export_t params[] = {
 	{ "hep_id",						 STR_PARAM|USE_FUNC_PARAM, parse_hep_id },
 	{ "homer5_on",						 INT_PARAM, &homer5_on              },
 	{ "homer5_delim",					 STR_PARAM, &homer5_delim.s },
+	{ "hep_queue_size",					 INT_PARAM, &hep_queue_size         },
+	{ "hep_batch_size",					 INT_PARAM, &hep_batch_size         },
 	{0, 0, 0}
 };
 
+static stat_export_t mod_stats[] = {
+	{"hep_queued",  STAT_NO_RESET, &hep_queued  },
+	{"hep_dropped", 0,             &hep_dropped },
+	{"hep_batches", 0,             &hep_batches },
+	{0, 0, 0}
+};
+
+static mi_export_t mi_cmds[] = {
+	{ "hep_queues", "lists the send queues of the HEP ids", 0, 0, {
+		{mi_hep_queues, {0}},
+		{EMPTY_MI_RECIPE}}
+	},
+	{EMPTY_MI_EXPORT}
+};
+
+/* only started with hep_queue_size set */
+static proc_export_t procs[] = {
+	{"HEP sender", 0, 0, hep_sender_process, 0,
+		PROC_FLAG_INITCHILD|PROC_FLAG_HAS_IPC},
+	{0, 0, 0, 0, 0, 0}
+};
+
 
 static module_dependency_t *get_deps_compression(param_export_t *param)
 {
@@ -160,11 +184,11 @@ struct module_exports exports = {
 	cmds,       /* exported functions */
 	0,          /* exported async functions */
 	params,     /* module parameters */
-	0,          /* exported statistics */
-	0,          /* exported MI functions */
+	mod_stats,  /* exported statistics */
+	mi_cmds,    /* exported MI functions */
 	0,          /* exported pseudo-variables */
 	0,			/* exported transformations */
-	0,          /* extra processes */
+	procs,      /* extra processes */
 	0,          /* module pre-initialization function */
 	mod_init,   /* module initialization function */
 	0,          /* response function */
@@ -186,6 +210,13 @@ static int mod_init(void)
 		return -1;
 	}
 
+	if (init_hep_queues() < 0) {
+		LM_ERR("could not initialize the HEP send queues!\n");
+		return -1;
+	}
+	if (hep_queue_size > 0)
+		procs[0].no = 1;
+
 	if (payload_compression) {
 		load_compression =
 			(load_compression_f)find_export("load_compression", 0);
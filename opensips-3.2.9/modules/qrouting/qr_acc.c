@@ -131,31 +131,23 @@ error:
 
 /* a call for this gateway returned 200OK */
 static inline void qr_add_200OK(qr_gw_t *gw) {
-	lock_get(gw->acc_lock);
-	++(gw->current_interval.stats.as);
-	++(gw->current_interval.stats.cc);
-	lock_release(gw->acc_lock);
+	++(qr_shard(gw)->stats.as);
+	++(qr_shard(gw)->stats.cc);
 }
 
 /* a call for this gateway returned 4XX */
 static inline void qr_add_4xx(qr_gw_t *gw) {
-	lock_get(gw->acc_lock);
-	++(gw->current_interval.stats.cc);
-	lock_release(gw->acc_lock);
+	++(qr_shard(gw)->stats.cc);
 }
 
 static inline void qr_add_pdd(qr_gw_t *gw, double pdd_tm) {
-	lock_get(gw->acc_lock); /* protect the statistics */
-	++(gw->current_interval.n.pdd);
-	gw->current_interval.stats.pdd += pdd_tm;
-	lock_release(gw->acc_lock);
+	++(qr_shard(gw)->n.pdd);
+	qr_shard(gw)->stats.pdd += pdd_tm;
 }
 
 static inline void qr_add_setup(qr_gw_t *gw, double st) {
-	lock_get(gw->acc_lock); /* protect the statistics */
-	++(gw->current_interval.n.setup);
-	gw->current_interval.stats.st += st;
-	lock_release(gw->acc_lock);
+	++(qr_shard(gw)->n.setup);
+	qr_shard(gw)->stats.st += st;
 }
 
 /*
@@ -207,10 +199,8 @@ static void qr_call_ended(struct dlg_cell*dlg, int type,
 		return;
 	}
 
-	lock_get(dialog_prop->gw->acc_lock); /* protect the statistics */
-	++(dialog_prop->gw->current_interval.n.cd);
-	dialog_prop->gw->current_interval.stats.cd += cd;
-	lock_release(dialog_prop->gw->acc_lock);
+	++(qr_shard(dialog_prop->gw)->n.cd);
+	qr_shard(dialog_prop->gw)->stats.cd += cd;
 }
 
 /*
@@ -299,11 +289,8 @@ void qr_check_reply_tmcb(struct cell *cell, int type, struct tmcb_params *ps)
 	}
 
 	/* 1XX should not be accounted - provisional responses */
-	if (ps->code >= 200) {
-		lock_get(trans_prop->gw->acc_lock);
-		++(trans_prop->gw->current_interval.n.ok);
-		lock_release(trans_prop->gw->acc_lock);
-	}
+	if (ps->code >= 200)
+		++(qr_shard(trans_prop->gw)->n.ok);
 }
 
 /* adds/removes two qr_n_calls_t structures */
@@ -383,12 +370,21 @@ void show_stats(qr_gw_t *gw) {
 /* update the statistics for a gateway */
 void update_gw_stats(qr_gw_t *gw)
 {
-	qr_stats_t diff;
+	qr_stats_t total, current, diff;
+	int i;
+
+	/* the shards only grow, so the calls of the interval are the
+	 * difference from their previous sum - no sample is ever lost */
+	memset(&total, 0, sizeof total);
+	for (i = 0; i < counted_max_processes; i++)
+		add_stats(&total, &gw->shards[i], '+');
 
-	lock_get(gw->acc_lock);
+	current = total;
+	add_stats(&current, &gw->merged, '-');
+	gw->merged = total;
 
 	/* prepare a diff of current/last stat samples */
-	diff = gw->current_interval;
+	diff = current;
 	add_stats(&diff, &gw->lru_interval->calls, '-');
 
 	/* apply the diff to the summed stats */
@@ -398,22 +394,22 @@ void update_gw_stats(qr_gw_t *gw)
 	lock_stop_write(gw->ref_lock);
 
 	/* rotate the sampling window */
-	gw->lru_interval->calls = gw->current_interval;
+	gw->lru_interval->calls = current;
 //	show_stats(gw);
-	memset(&gw->current_interval, 0, sizeof(qr_stats_t));
 	gw->lru_interval = gw->lru_interval->next; /* the 'oldest' sample interval
 													becomes the 'newest' */
-	lock_release(gw->acc_lock);
 }
 
 
 /* update the statistics for a group of gateways */
-void update_grp_stats(qr_grp_t grp)
+void update_grp_stats(qr_grp_t *grp)
 {
 	int i;
 
-	for (i = 0; i < grp.n; i++)
-		update_gw_stats(grp.gw[i]);
+	for (i = 0; i < grp->n; i++)
+		update_gw_stats(grp->gw[i]);
 
-	grp.state |= QR_STATUS_DIRTY;
+	lock_start_write(grp->ref_lock);
+	grp->state |= QR_STATUS_DIRTY;
+	lock_stop_write(grp->ref_lock);
 }
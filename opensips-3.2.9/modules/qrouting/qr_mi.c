@@ -421,22 +421,28 @@ int qr_set_dst_state(qr_rule_t *rules, int rule_id, str *dst_name,
 		return -1;
 	}
 
-	lock_start_write(dst->gw->ref_lock);
-
-	if (dst->type == QR_DST_GW)
+	if (dst->type == QR_DST_GW) {
+		lock_start_write(dst->gw->ref_lock);
 		if (active) {
 			dst->gw->state &= ~QR_STATUS_DSBL;
 		} else {
 			dst->gw->state |= QR_STATUS_DSBL;
 		}
-	else
+		dst->gw->state |= QR_STATUS_DIRTY;
+		lock_stop_write(dst->gw->ref_lock);
+	} else {
+		lock_start_write(dst->grp.ref_lock);
 		if (active) {
 			dst->grp.state &= ~QR_STATUS_DSBL;
 		} else {
 			dst->grp.state |= QR_STATUS_DSBL;
 		}
+		dst->grp.state |= QR_STATUS_DIRTY;
+		lock_stop_write(dst->grp.ref_lock);
+	}
 
-	lock_stop_write(dst->gw->ref_lock);
+	/* do not wait for the next sampling to route accordingly */
+	qr_new_sort_round();
 
 	return 0;
 }
@@ -19,6 +19,10 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#include <math.h>
+
+#include "../../ut.h"
+
 #include "qrouting.h"
 #include "qr_sort.h"
 #include "qr_acc.h"
@@ -37,8 +41,8 @@
 	log_thr_exceeded("crit", thr_name, _val, _cmp, _lim)
 
 
-static inline void qr_weight_based_sort(unsigned short *dsts,
-                                        const double *scores, int n);
+static inline int qr_weight_based_sort(unsigned short *dsts,
+                                       const double *scores, int n);
 
 static inline double _qr_score_gw(qr_gw_t *gw, qr_profile_t *prof,
                                   str *part, int rule_id, int *disabled)
@@ -232,208 +236,246 @@ static inline double qr_score_grp(qr_grp_t *grp, const qr_rule_t *rule,
 static double *qr_scores;
 static int qr_scores_sz;
 
-/* a higher score (weight) is better */
-static int qr_cmp_dst(const void *d1, const void *d2)
-{
-	double s1 = qr_scores[*(unsigned short *)d1],
-	       s2 = qr_scores[*(unsigned short *)d2];
+struct qr_key {
+	double key;
+	unsigned short dst;
+	unsigned short pos;
+};
 
-	if (s1 == -1) {
-		if (s2 == -1)
-			return 0;
+static struct qr_key *qr_keys;
+static int qr_keys_sz;
 
-		return 1;
-	}
+static inline int qr_grow_scores(int n)
+{
+	double *new_scores;
+
+	if (n <= qr_scores_sz)
+		return 0;
 
-	if (s2 == -1)
+	new_scores = pkg_realloc(qr_scores, n * sizeof *new_scores);
+	if (!new_scores) {
+		LM_ERR("oom\n");
 		return -1;
+	}
 
-	return s1 > s2 ? -1 : (s1 == s2 ? 0 : 1);
+	qr_scores = new_scores;
+	qr_scores_sz = n;
+	return 0;
 }
 
-void qr_sort_best_dest_first(void *param)
+/* a higher score (weight) is better; ties keep the provisioning order */
+static int qr_cmp_dst(const void *d1, const void *d2)
 {
-	struct dr_sort_params *srp = (struct dr_sort_params *)param;
-	unsigned short dst_idx;
-	int i, disabled = 0, ndst;
-	unsigned short *sorted_dst;
-	double *new_scores;
-	qr_profile_t prof;
-	qr_rule_t *rule;
-
-	rule = drb.get_qr_rule_handle(srp->dr_rule);
-	if (!rule) {
-		LM_ERR("No qr rule provided for sorting (qr_handle needed)\n");
-		goto error;
-	}
+	unsigned short i1 = *(unsigned short *)d1, i2 = *(unsigned short *)d2;
+	double s1 = qr_scores[i1], s2 = qr_scores[i2];
 
-	sorted_dst = srp->sorted_dst;
-	dst_idx = srp->dst_idx;
+	if (s1 != s2)
+		return s1 > s2 ? -1 : 1;
 
-	if (!sorted_dst) {
-		LM_ERR("no array provided to save destination indexes to\n");
-		goto error;
-	}
+	return i1 - i2;
+}
 
-	if (dst_idx == (unsigned short)-1)
-		ndst = rule->n;
-	else
-		ndst = rule->dest[dst_idx].grp.n;
+/*
+ * Computes the order of the destinations of a rule (@grp == NULL) or of the
+ * gateways of one of its carriers, for the current sampling round.  Only
+ * the enabled destinations are kept, sorted by their score if @by_score.
+ *
+ * NOTE: must be called under the write lock of @srt
+ */
+static int qr_sort_dst(qr_sorted_t *srt, qr_rule_t *rule, qr_grp_t *grp,
+                       int ndst, int by_score)
+{
+	struct timeval start;
+	qr_profile_t prof, *pprof = NULL;
+	int i, n;
 
-	for (i = 0; i < ndst; i++)
-		sorted_dst[i] = i;
+	gettimeofday(&start, NULL);
 
-	if (ndst > qr_scores_sz) {
-		new_scores = pkg_realloc(qr_scores, ndst * sizeof *new_scores);
-		if (!new_scores) {
-			LM_ERR("oom\n");
-			goto error;
-		}
+	if (qr_grow_scores(ndst) != 0)
+		return -1;
 
-		qr_scores = new_scores;
-		qr_scores_sz = ndst;
+	if (rule->profile) {
+		lock_start_read(qr_profiles_rwl);
+		prof = *rule->profile;
+		lock_stop_read(qr_profiles_rwl);
+		pprof = &prof;
 	}
 
-	lock_start_read(qr_profiles_rwl);
-	prof = *rule->profile;
-	lock_stop_read(qr_profiles_rwl);
-
 	/* compute the score of each destination.  A carrier's final score will be
 	 * the average score of all of their active gateways */
-	for (i = 0; i < ndst; i++) {
-		if (rule->dest[i].type & QR_DST_GW)
-			qr_scores[i] = qr_score_gw(rule->dest[i].gw, rule, &prof);
+	for (i = 0, n = 0; i < ndst; i++) {
+		if (grp)
+			qr_scores[i] = qr_score_gw(grp->gw[i], rule, pprof);
+		else if (rule->dest[i].type & QR_DST_GW)
+			qr_scores[i] = qr_score_gw(rule->dest[i].gw, rule, pprof);
 		else
-			qr_scores[i] = qr_score_grp(&rule->dest[i].grp, rule, &prof);
+			qr_scores[i] = qr_score_grp(&rule->dest[i].grp, rule, pprof);
 
-		LM_DBG("score for dst type %d, i: %d is %lf\n",
-		       rule->dest[i].type, i, qr_scores[i]);
+		LM_DBG("score for dst %d (grp: %p) is %lf\n", i, grp, qr_scores[i]);
 
-		if (qr_scores[i] == -1)
-			disabled++;
+		if (qr_scores[i] != -1)
+			srt->dst[n++] = i;
 	}
 
-	qsort(sorted_dst, ndst, sizeof *sorted_dst, qr_cmp_dst);
+	if (by_score)
+		qsort(srt->dst, n, sizeof *srt->dst, qr_cmp_dst);
 
-	/* mark the disabled destinations with -1 */
-	memset(sorted_dst + ndst - disabled, -1, disabled * sizeof *sorted_dst);
-
-	srp->rc = 0;
-	return;
+	for (i = 0; i < n; i++)
+		srt->score[i] = qr_scores[srt->dst[i]];
+	srt->n_enabled = n;
 
-error:
-	srp->rc = -1;
+	update_stat(qr_sort_usec, get_time_diff(&start));
+	update_stat(qr_sort_runs, 1);
+	return 0;
 }
 
-void qr_sort_dynamic_weights(void *param)
+/*
+ * Fills in the enabled destinations of the rule/carrier, as cached for the
+ * current sampling round, followed by -1 for each disabled one.  If @scores,
+ * their scores are also returned, in the same order
+ */
+static int qr_get_sorted(struct dr_sort_params *srp, int by_score,
+                         double **scores)
 {
-	struct dr_sort_params *srp = (struct dr_sort_params *)param;
-	unsigned short dst_idx;
-	int i, j, di, ndst, ndisabled;
-	unsigned short *sorted_dst;
-	double *new_scores;
-	qr_profile_t prof;
 	qr_rule_t *rule;
+	qr_grp_t *grp = NULL;
+	qr_sorted_t *srt;
+	unsigned int round;
+	int ndst, n, rc = 0;
 
 	rule = drb.get_qr_rule_handle(srp->dr_rule);
 	if (!rule) {
 		LM_ERR("No qr rule provided for sorting (qr_handle needed)\n");
-		goto error;
+		return -1;
 	}
 
-	sorted_dst = srp->sorted_dst;
-	dst_idx = srp->dst_idx;
-
-	if (!sorted_dst) {
+	if (!srp->sorted_dst) {
 		LM_ERR("no array provided to save destination indexes to\n");
-		goto error;
+		return -1;
 	}
 
-	if (dst_idx == (unsigned short)-1)
+	if (srp->dst_idx == (unsigned short)-1) {
 		ndst = rule->n;
-	else
-		ndst = rule->dest[dst_idx].grp.n;
+		srt = &rule->sorted;
+	} else {
+		grp = &rule->dest[srp->dst_idx].grp;
+		ndst = grp->n;
+		srt = &grp->sorted;
+	}
 
-	if (ndst > qr_scores_sz) {
-		new_scores = pkg_realloc(qr_scores, ndst * sizeof *new_scores);
-		if (!new_scores) {
-			LM_ERR("oom\n");
-			goto error;
+	round = __atomic_load_n(qr_sort_round, __ATOMIC_RELAXED);
+
+	lock_start_read(srt->lock);
+	if (srt->round != round) {
+		lock_stop_read(srt->lock);
+
+		lock_start_write(srt->lock);
+		/* another process may have sorted them meanwhile */
+		if (srt->round != round) {
+			rc = qr_sort_dst(srt, rule, grp, ndst, by_score);
+			srt->round = rc == 0 ? round : 0;
 		}
+		lock_stop_write(srt->lock);
 
-		qr_scores = new_scores;
-		qr_scores_sz = ndst;
+		lock_start_read(srt->lock);
+	} else {
+		update_stat(qr_sort_hits, 1);
 	}
 
-	lock_start_read(qr_profiles_rwl);
-	prof = *rule->profile;
-	lock_stop_read(qr_profiles_rwl);
-
-	/* compute the score of each destination.  A carrier's final score will be
-	 * the average score of all of their active gateways */
-	for (i = 0, j = 0, di = ndst - 1; i < ndst; i++, j++) {
-		if (rule->dest[i].type & QR_DST_GW)
-			qr_scores[j] = qr_score_gw(rule->dest[i].gw, rule, &prof);
-		else
-			qr_scores[j] = qr_score_grp(&rule->dest[i].grp, rule, &prof);
+	if (rc == 0 && scores && qr_grow_scores(srt->n_enabled) != 0)
+		rc = -1;
 
-		LM_DBG("score for dst type %d, i: %d is %lf\n",
-		       rule->dest[i].type, i, qr_scores[j]);
+	if (rc != 0) {
+		lock_stop_read(srt->lock);
+		return -1;
+	}
 
-		/* if it's disabled, place it towards the end */
-		if (qr_scores[j] == -1) {
-			j--;
-			sorted_dst[di--] = i;
-		} else {
-			sorted_dst[j] = i;
-		}
+	n = srt->n_enabled;
+	memcpy(srp->sorted_dst, srt->dst, n * sizeof *srt->dst);
+	if (scores) {
+		memcpy(qr_scores, srt->score, n * sizeof *srt->score);
+		*scores = qr_scores;
 	}
+	lock_stop_read(srt->lock);
 
-	ndisabled = ndst - 1 - di;
+	/* mark the disabled destinations with -1 */
+	memset(srp->sorted_dst + n, -1, (ndst - n) * sizeof *srp->sorted_dst);
 
-	qr_weight_based_sort(sorted_dst, qr_scores, ndst - ndisabled);
+	return n;
+}
 
-	/* mark the disabled destinations with -1 */
-	memset(sorted_dst + ndst - ndisabled, -1, ndisabled * sizeof *sorted_dst);
+void qr_sort_best_dest_first(void *param)
+{
+	struct dr_sort_params *srp = (struct dr_sort_params *)param;
 
-	srp->rc = 0;
-	return;
+	srp->rc = qr_get_sorted(srp, 1, NULL) < 0 ? -1 : 0;
+}
+
+void qr_sort_dynamic_weights(void *param)
+{
+	struct dr_sort_params *srp = (struct dr_sort_params *)param;
+	double *scores;
+	int n;
 
-error:
-	srp->rc = -1;
+	n = qr_get_sorted(srp, 0, &scores);
+	if (n < 0) {
+		srp->rc = -1;
+		return;
+	}
+
+	srp->rc = qr_weight_based_sort(srp->sorted_dst, scores, n);
 }
 
-static inline void qr_weight_based_sort(unsigned short *dsts,
-                                        const double *scores, int n)
+static int qr_cmp_key(const void *k1, const void *k2)
 {
-	double running_sum[n], sum, rnd, aux;
-	int i, first = 0;
+	const struct qr_key *a = k1, *b = k2;
 
-	while (first < n - 1) {
-		for (i = first, sum = 0; i < n; i++) {
-			sum += scores[i];
-			running_sum[i] = sum;
-		}
+	if (a->key != b->key)
+		return a->key > b->key ? -1 : 1;
 
-		if (sum) {
-			rnd = sum * ((float)rand() / (float)RAND_MAX);
+	return a->pos - b->pos;
+}
 
-			for (i = first; i < n; i++)
-				if (running_sum[i] > rnd)
-					break;
+/*
+ * Random ordering of @dsts, where each position is drawn among the remaining
+ * destinations with a probability proportional to their score.  Instead of
+ * drawing them one by one, each destination gets a random key of
+ * log(u)/score and they are sorted by key (Efraimidis-Spirakis), in
+ * O(n*log(n)).  The destinations with no score keep their order, at the end.
+ */
+static inline int qr_weight_based_sort(unsigned short *dsts,
+                                       const double *scores, int n)
+{
+	struct qr_key *new_keys;
+	double u;
+	int i;
 
-			if (i == n) {
-				LM_BUG("bug encountered during weight based sort!");
-				return;
-			}
+	if (n > qr_keys_sz) {
+		new_keys = pkg_realloc(qr_keys, n * sizeof *new_keys);
+		if (!new_keys) {
+			LM_ERR("oom\n");
+			return -1;
+		}
+
+		qr_keys = new_keys;
+		qr_keys_sz = n;
+	}
 
+	for (i = 0; i < n; i++) {
+		if (scores[i] > 0) {
+			u = (rand() + 1.0) / ((double)RAND_MAX + 1.0);
+			qr_keys[i].key = log(u) / scores[i];
 		} else {
-			i = first;
+			qr_keys[i].key = -HUGE_VAL;
 		}
-
-		aux = dsts[first];
-		dsts[first] = dsts[i];
-		dsts[i] = aux;
-		first++;
+		qr_keys[i].dst = dsts[i];
+		qr_keys[i].pos = i;
 	}
+
+	qsort(qr_keys, n, sizeof *qr_keys, qr_cmp_key);
+
+	for (i = 0; i < n; i++)
+		dsts[i] = qr_keys[i].dst;
+
+	return 0;
 }
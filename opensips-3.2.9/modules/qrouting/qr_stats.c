@@ -78,11 +78,13 @@ qr_gw_t *qr_create_gw(void *dst)
 	}
 	memset(gw, 0, sizeof *gw);
 
-	gw->acc_lock = lock_alloc();
-	if (!lock_init(gw->acc_lock)) {
-		LM_ERR("failed to init lock\n");
+	gw->shards = shm_malloc(counted_max_processes * sizeof *gw->shards);
+	if (!gw->shards) {
+		LM_ERR("oom\n");
 		goto error;
 	}
+	memset(gw->shards, 0, counted_max_processes * sizeof *gw->shards);
+
 	if (!(gw->ref_lock = lock_init_rw())) {
 		LM_ERR("failed to init RW lock\n");
 		goto error;
@@ -106,10 +108,8 @@ void qr_free_gw(qr_gw_t * gw)
 {
 	shm_free_all(gw->lru_interval);
 
-	if (gw->acc_lock) {
-		lock_destroy(gw->acc_lock);
-		lock_dealloc(gw->acc_lock);
-	}
+	if (gw->shards)
+		shm_free(gw->shards);
 
 	if (gw->ref_lock)
 		lock_destroy_rw(gw->ref_lock);
@@ -117,6 +117,38 @@ void qr_free_gw(qr_gw_t * gw)
 	shm_free(gw);
 }
 
+int qr_init_sorted(qr_sorted_t *sorted, int n)
+{
+	memset(sorted, 0, sizeof *sorted);
+
+	if (!(sorted->lock = lock_init_rw())) {
+		LM_ERR("failed to init RW lock\n");
+		return -1;
+	}
+
+	/* both arrays in a single chunk, the scores first, for alignment */
+	sorted->score = shm_malloc(n * (sizeof *sorted->score +
+	                                sizeof *sorted->dst));
+	if (n && !sorted->score) {
+		LM_ERR("oom\n");
+		lock_destroy_rw(sorted->lock);
+		sorted->lock = NULL;
+		return -1;
+	}
+	sorted->dst = (unsigned short *)(sorted->score + n);
+
+	return 0;
+}
+
+void qr_free_sorted(qr_sorted_t *sorted)
+{
+	if (sorted->lock)
+		lock_destroy_rw(sorted->lock);
+
+	if (sorted->score)
+		shm_free(sorted->score);
+}
+
 void qr_free_grp(qr_grp_t *grp)
 {
 	int i;
@@ -128,6 +160,8 @@ void qr_free_grp(qr_grp_t *grp)
 
 	if (grp->ref_lock)
 		lock_destroy_rw(grp->ref_lock);
+
+	qr_free_sorted(&grp->sorted);
 }
 
 void qr_free_dst(qr_dst_t *dst)
@@ -146,6 +180,7 @@ void qr_free_rule(qr_rule_t *rule)
 		qr_free_dst(&rule->dest[i]);
 
 	shm_free(rule->dest);
+	qr_free_sorted(&rule->sorted);
 	shm_free(rule);
 }
 
@@ -286,6 +321,12 @@ void qr_rld_create_rule(void *param)
 		return;
 	}
 
+	if (qr_init_sorted(&new->sorted, irp->n_dst) != 0) {
+		shm_free(new->dest);
+		shm_free(new);
+		return;
+	}
+
 	new->n = irp->n_dst; /* save the number of destinations for
 										 this rule, as rcvd from dr*/
 	new->r_id = r_id;
@@ -354,6 +395,9 @@ void qr_rld_dst_is_grp(void *param)
 		goto error;
 	}
 
+	if (qr_init_sorted(&rule->dest[n_dst].grp.sorted, n_gws) != 0)
+		goto error;
+
 	rule->dest[n_dst].grp.n = n_gws;
 	rule->dest[n_dst].grp.dr_cr = grp;
 
@@ -369,8 +413,10 @@ void qr_rld_dst_is_grp(void *param)
 
 	return;
 error:
-	if (rule->dest[n_dst].grp.gw)
+	if (rule->dest[n_dst].grp.gw) {
 		shm_free(rule->dest[n_dst].grp.gw);
+		rule->dest[n_dst].grp.gw = NULL;
+	}
 }
 
 /* link a rule into the current partition */
@@ -24,6 +24,7 @@
 
 #include "../../rw_locking.h"
 #include "../../locking.h"
+#include "../../pt.h"
 #include "../drouting/prefix_tree.h"
 #include "../drouting/dr_cb.h"
 
@@ -88,6 +89,15 @@ typedef struct qr_profile {
 	qr_xstat_t xstats[QR_MAX_XSTATS];
 } qr_profile_t;
 
+/* the order of the destinations of a rule/carrier, for a sampling round */
+typedef struct qr_sorted {
+	unsigned int round; /* the sampling round of the order, 0 if none yet */
+	int n_enabled; /* the enabled destinations are placed first */
+	unsigned short *dst;
+	double *score; /* the score of each destination from @dst */
+	rw_lock_t *lock;
+} qr_sorted_t;
+
 /* history for gateway: sum of sampled intervals */
 typedef struct qr_gw {
 	/* circular list of sampled stats (constant size),
@@ -95,14 +105,19 @@ typedef struct qr_gw {
 	qr_sample_t *lru_interval;
 
 	void  *dr_gw; /* pointer to the gateway from drouting*/
-	qr_stats_t current_interval; /* the current interval */
+	/* per-process counters, only ever increased by their own process and
+	 * merged by the sampling timer; there are no locks on the call path */
+	qr_stats_t *shards;
+	qr_stats_t merged; /* the sum of the @shards, at the last sampling */
 	qr_stats_t summed_stats; /* the sum of the @lru_interval list */
 	char state;
 	double score; /* score of the gateway, based on thresholds & penalties */
 	rw_lock_t *ref_lock; /* lock for protecting the overall statistics (history) */
-	gen_lock_t *acc_lock; /* lock for protecting the current interval */
 } qr_gw_t;
 
+/* the counters of the current process for a gateway */
+#define qr_shard(_gw) (&(_gw)->shards[process_no])
+
 /* destination that are grouped (e.g.: carriers) */
 typedef struct qr_grp {
 	qr_gw_t **gw;
@@ -112,6 +127,7 @@ typedef struct qr_grp {
 	char state;
 	rw_lock_t *ref_lock;
 	int n;
+	qr_sorted_t sorted;
 } qr_grp_t;
 
 
@@ -131,6 +147,7 @@ typedef struct qr_rule {
 	int r_id;/* rule_id */
 	char sort_method; /* sorting for the rule */
 	int n;
+	qr_sorted_t sorted;
 	str *part_name; /* backpointer, don't free */
 	struct qr_rule *next;
 } qr_rule_t;
@@ -147,6 +164,16 @@ extern rw_lock_t *qr_main_list_rwl;
 extern qr_profile_t **qr_profiles;
 extern int *qr_profiles_n;
 extern qr_partitions_t **qr_main_list;
+/* increased after each sampling or change of the destinations' state */
+extern unsigned int *qr_sort_round;
+
+/* invalidates the destination orders cached for all rules */
+static inline void qr_new_sort_round(void)
+{
+	/* zero stands for "never sorted" */
+	if (__sync_add_and_fetch(qr_sort_round, 1) == 0)
+		__sync_add_and_fetch(qr_sort_round, 1);
+}
 
 extern str qr_param_part;
 extern str qr_param_rule_id;
@@ -160,6 +187,8 @@ qr_gw_t *qr_search_gw(qr_rule_t *list, str *gw_name);
 
 qr_gw_t *  qr_create_gw(void *);
 void qr_free_gw(qr_gw_t *);
+int qr_init_sorted(qr_sorted_t *sorted, int n);
+void qr_free_sorted(qr_sorted_t *sorted);
 void free_qr_list(qr_partitions_t *qr_parts);
 
 void qr_rld_prepare_part(void *param);
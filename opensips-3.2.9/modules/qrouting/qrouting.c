@@ -28,6 +28,7 @@
 #include "../../str.h"
 #include "../../ipc.h"
 #include "../../timer.h"
+#include "../../statistics.h"
 #include "../../lib/csv.h"
 
 #include "qrouting.h"
@@ -63,6 +64,14 @@ static char *qr_xstats_s;
 
 qr_partitions_t **qr_main_list; /* the history itself */
 rw_lock_t *qr_main_list_rwl; /* protection during dr_reload */
+unsigned int *qr_sort_round;
+
+/* statistics */
+stat_var *qr_merge_usec;
+stat_var *qr_merge_runs;
+stat_var *qr_sort_usec;
+stat_var *qr_sort_runs;
+stat_var *qr_sort_hits;
 
 qr_profile_t **qr_profiles;
 int *qr_profiles_n;
@@ -159,6 +168,15 @@ static param_export_t params[] = {
 	{0, 0, 0}
 };
 
+static stat_export_t mod_stats[] = {
+	{"merge_usec",      0, &qr_merge_usec},
+	{"merge_runs",      0, &qr_merge_runs},
+	{"sort_usec",       0, &qr_sort_usec},
+	{"sort_runs",       0, &qr_sort_runs},
+	{"sort_cache_hits", 0, &qr_sort_hits},
+	{0, 0, 0}
+};
+
 #define HLP1 "Params: [partition [, rule_id [, dst_name]]]; List QR statistics"
 #define HLP2 "Params: [partition] rule_id dst_name; Remove a gateway/carrier from routing"
 #define HLP3 "Params: [partition] rule_id dst_name; Re-introduce a gateway/carrier into routing"
@@ -216,7 +234,7 @@ struct module_exports exports = {
 	cmds,            /* Exported functions */
 	0,               /* Exported async functions */
 	params,          /* Exported parameters */
-	0,               /* exported statistics */
+	mod_stats,       /* exported statistics */
 	mi_cmds,         /* exported MI functions */
 	0,               /* exported pseudo-variables */
 	0,               /* exported transformations */
@@ -317,10 +335,12 @@ static int qr_exit(void)
 static void qr_rotate_samples(unsigned int ticks, void *param)
 {
 	qr_rule_t *it;
+	struct timeval start;
 	int i, j;
 
 	LM_DBG("rotating samples for all (prefix, destination) pairs...\n");
 
+	gettimeofday(&start, NULL);
 	lock_start_read(qr_main_list_rwl);
 
 	if (*qr_main_list) {
@@ -331,7 +351,7 @@ static void qr_rotate_samples(unsigned int ticks, void *param)
 					if (it->dest[i].type == QR_DST_GW)
 						update_gw_stats(it->dest[i].gw);
 					else
-						update_grp_stats(it->dest[i].grp);
+						update_grp_stats(&it->dest[i].grp);
 				}
 			}
 		}
@@ -339,6 +359,12 @@ static void qr_rotate_samples(unsigned int ticks, void *param)
 
 	lock_stop_read(qr_main_list_rwl);
 
+	/* all the cached destination orders are now stale */
+	qr_new_sort_round();
+
+	update_stat(qr_merge_usec, get_time_diff(&start));
+	update_stat(qr_merge_runs, 1);
+
 	LM_DBG("done!\n");
 }
 
@@ -515,6 +541,13 @@ static int qr_init_globals(void)
 	}
 	*qr_main_list = NULL;
 
+	qr_sort_round = shm_malloc(sizeof *qr_sort_round);
+	if (!qr_sort_round) {
+		LM_ERR("oom\n");
+		return -1;
+	}
+	*qr_sort_round = 1;
+
 	qr_profiles = shm_malloc(sizeof *qr_profiles);
 	if (!qr_profiles) {
 		LM_ERR("oom\n");
@@ -635,10 +668,8 @@ static int qr_set_xstat(qr_rule_t *rules, int rule_id, str *gw_name,
 		return -1;
 	}
 
-	lock_get(gw->acc_lock);
-	gw->current_interval.n.xtot[stat_idx] += inc_total;
-	gw->current_interval.stats.xsum[stat_idx] += inc_by;
-	lock_release(gw->acc_lock);
+	qr_shard(gw)->n.xtot[stat_idx] += inc_total;
+	qr_shard(gw)->stats.xsum[stat_idx] += inc_by;
 
 	LM_DBG("successfully updated (rule %d, gw %.*s)\n", rule_id,
 	       gw_name->len, gw_name->s);
@@ -22,6 +22,7 @@
 #define __QROUTING_H__
 
 #include "../../str.h"
+#include "../../statistics.h"
 
 typedef enum qr_algo {
 	QR_ALGO_INVALID,
@@ -54,4 +55,8 @@ extern int qr_min_samples_pdd;
 extern int qr_min_samples_ast;
 extern int qr_min_samples_acd;
 
+extern stat_var *qr_sort_usec;
+extern stat_var *qr_sort_runs;
+extern stat_var *qr_sort_hits;
+
 #endif /* __QROUTING_H__ */
@@ -71,6 +71,7 @@ struct clusterer_binds clusterer_api;
 
 int rl_window_size=10;   /* how many seconds the window shall hold*/
 int rl_slot_period=200;  /* how many milisecs a slot from the window has  */
+int rl_token_batch=0;    /* max tokens of a TAILDROP pipe borrowed at once */
 
 static str db_url = {0,0};
 str db_prefix = str_init("rl_pipe_");
@@ -150,6 +151,7 @@ static param_export_t params[] = {
 	{ "window_size",            INT_PARAM,  &rl_window_size},
 	{ "slot_period",            INT_PARAM,  &rl_slot_period},
 	{ "limit_per_interval",     INT_PARAM,  &rl_limit_per_interval},
+	{ "token_batch",            INT_PARAM,  &rl_token_batch},
 	{ 0, 0, 0}
 };
 
@@ -397,6 +399,11 @@ static int mod_init(void)
 	RL_SHM_MALLOC(drop_rate, sizeof(int));
 	RL_SHM_MALLOC(rl_feedback_limit, sizeof(int));
 
+	if (rl_token_batch < 0) {
+		LM_WARN("invalid token_batch %d - disabling it\n", rl_token_batch);
+		rl_token_batch = 0;
+	}
+
 	/* init ki value for feedback algo */
 	*pid_ki = -25.0;
 
@@ -482,6 +489,10 @@ void mod_destroy(void)
 		rl_htable.locks = 0;
 		rl_htable.locks_no = 0;
 	}
+	if (rl_htable.active) {
+		shm_free(rl_htable.active);
+		rl_htable.active = 0;
+	}
 	if (rl_lock) {
 		lock_destroy(rl_lock);
 		lock_dealloc(rl_lock);
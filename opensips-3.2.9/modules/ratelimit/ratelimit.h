@@ -30,6 +30,9 @@
 #define RL_HASHSIZE			1024
 #define RL_TIMER_INTERVAL	10
 #define RL_PIPE_PENDING		(1<<0)
+#define RL_PIPE_ACTIVE		(1<<1)	/* linked in the active list of its map */
+#define RL_PIPE_TOUCHED		(1<<2)	/* used since the last timer run */
+#define RL_PIPE_IDLE		(1<<3)	/* unused during the last timer interval */
 #define BIN_VERSION         1
 
 #ifndef RL_DEBUG_PIPES
@@ -45,6 +48,7 @@
 
 
 #include "../../map.h"
+#include "../../lib/list.h"
 #include "../clusterer/api.h"
 #include "../../forward.h"
 
@@ -77,9 +81,7 @@ typedef struct rl_window {
 } rl_window_t;
 
 typedef struct rl_pipe {
-#ifdef RL_DEBUG_PIPES
 	str name;
-#endif
 	int limit;					/* limit used by algorithm */
 	int counter;				/* countes the accesses */
 	int my_counter;				/* countes the accesses of this instance */
@@ -91,6 +93,9 @@ typedef struct rl_pipe {
 	time_t last_local_used;		/* timestamp when the pipe was last locally accessed */
 	rl_repl_counter_t *dsts;	/* counters per destination */
 	rl_window_t rwin;			/* window of requests */
+	int flags;
+	unsigned int period;		/* timer intervals since the pipe was created */
+	struct list_head active;	/* in the active list of its map */
 } rl_pipe_t;
 
 typedef struct rl_repl_dst {
@@ -106,6 +111,10 @@ typedef struct {
 	map_t * maps;
 	gen_lock_set_t *locks;
 	unsigned int locks_no;
+	struct list_head *active;	/* pipes used lately, per map */
+	struct list_head *graveyard;	/* expired pipes, freed on the next run */
+	unsigned int *epoch;		/* bumped each time pipes are expired */
+	unsigned int *sweep_idx;	/* next map to look for expired pipes */
 } rl_big_htable;
 
 extern gen_lock_t * rl_lock;
@@ -122,6 +131,7 @@ extern str db_prefix;
 extern int rl_repl_cluster;
 extern int rl_window_size;
 extern int rl_slot_period;
+extern int rl_token_batch;
 
 extern struct clusterer_binds clusterer_api;
 
@@ -261,6 +261,21 @@ int init_rl_table(unsigned int size)
 	LM_DBG("%d locks allocated for %d hashsize\n",
 		rl_htable.locks_no, rl_htable.size);
 
+	/* the active lists, the graveyard, the epoch and the sweep index */
+	rl_htable.active = shm_malloc(sizeof(struct list_head) * (size + 1) +
+		2 * sizeof(unsigned int));
+	if (!rl_htable.active) {
+		LM_ERR("no more shm memory\n");
+		goto error;
+	}
+	for (i = 0; i <= size; i++)
+		INIT_LIST_HEAD(&rl_htable.active[i]);
+	rl_htable.graveyard = &rl_htable.active[size];
+	rl_htable.epoch = (unsigned int *)(rl_htable.graveyard + 1);
+	rl_htable.sweep_idx = rl_htable.epoch + 1;
+	*rl_htable.epoch = 0;
+	*rl_htable.sweep_idx = 0;
+
 	return 0;
 error:
 	mod_destroy();
@@ -317,9 +332,7 @@ rl_pipe_t *rl_create_pipe(int limit, rl_algo_t algo, str *name)
 	if (algo == PIPE_ALGO_HISTORY)
 		size += (rl_window_size * 1000) / rl_slot_period * sizeof(long int);
 
-#ifdef RL_DEBUG_PIPES
 	size += name->len;
-#endif
 
 	pipe = shm_malloc(size);
 	if (!pipe) {
@@ -337,19 +350,126 @@ rl_pipe_t *rl_create_pipe(int limit, rl_algo_t algo, str *name)
 		/* everything else is already cleared */
 	}
 
-#ifdef RL_DEBUG_PIPES
 	pipe->name.s = ((char *)pipe) + size - name->len;
 	memcpy(pipe->name.s, name->s, name->len);
 	pipe->name.len = name->len;
-#endif
+	INIT_LIST_HEAD(&pipe->active);
 	return pipe;
 }
 
+/* NOTE: assumes that the pipe has been locked */
+static inline void rl_pipe_touch(rl_pipe_t *pipe, unsigned int hash_idx)
+{
+	if (!(pipe->flags & RL_PIPE_ACTIVE)) {
+		list_add_tail(&pipe->active, &rl_htable.active[hash_idx]);
+		pipe->flags |= RL_PIPE_ACTIVE;
+	}
+	pipe->flags = (pipe->flags | RL_PIPE_TOUCHED) & ~RL_PIPE_IDLE;
+}
+
+/*
+ * Per-process cache of the TAILDROP pipes, used to admit requests without
+ * locking the pipe. Each time the pipe is locked, the process borrows a
+ * batch of tokens from the pipe's budget of the current interval (by
+ * increasing the pipe's counter), then consumes them locally. The tokens
+ * are only valid for the timer interval they were borrowed in, so the
+ * limit is never exceeded - at worst, some borrowed tokens are not used.
+ */
+#define RL_LOCAL_SIZE	2048
+/* never borrow more than 1/RL_BORROW_SHARE of the budget left */
+#define RL_BORROW_SHARE	16
+
+struct rl_local_pipe {
+	rl_pipe_t *pipe;
+	str name;
+	unsigned int period;
+	int limit;
+	int tokens;
+};
+
+static struct rl_local_pipe *rl_local;
+static unsigned int rl_local_epoch;
+
+static struct rl_local_pipe *rl_local_get(str *name)
+{
+	unsigned int i;
+
+	if (!rl_local) {
+		rl_local = pkg_malloc(RL_LOCAL_SIZE * sizeof *rl_local);
+		if (!rl_local) {
+			LM_ERR("no more pkg memory\n");
+			return NULL;
+		}
+		memset(rl_local, 0, RL_LOCAL_SIZE * sizeof *rl_local);
+		rl_local_epoch = *rl_htable.epoch;
+	} else if (rl_local_epoch != *rl_htable.epoch) {
+		/* some pipes were deleted - forget all of them */
+		for (i = 0; i < RL_LOCAL_SIZE; i++)
+			rl_local[i].pipe = NULL;
+		rl_local_epoch = *rl_htable.epoch;
+	}
+
+	return &rl_local[core_hash(name, NULL, RL_LOCAL_SIZE)];
+}
+
+/* consumes a local token, if there is any left for the pipe */
+static inline int rl_local_take(struct rl_local_pipe *lp, str *name, int limit)
+{
+	if (!lp->pipe || lp->tokens <= 0 || lp->limit != limit ||
+			lp->period != lp->pipe->period || lp->name.len != name->len ||
+			memcmp(lp->name.s, name->s, name->len))
+		return 0;
+
+	lp->tokens--;
+	lp->pipe->last_used = lp->pipe->last_local_used = time(0);
+	return 1;
+}
+
+/* NOTE: assumes that the (TAILDROP) pipe has been locked */
+static int rl_borrow_tokens(rl_pipe_t *pipe, struct rl_local_pipe *lp,
+		str *name, int limit)
+{
+	int left, chunk;
+
+	left = limit * (rl_limit_per_interval ? 1 : rl_timer_interval) -
+		rl_get_all_counters(pipe);
+	if (left <= 0) {
+		pipe->counter++;
+		return -1;
+	}
+
+	chunk = left / RL_BORROW_SHARE;
+	if (chunk > rl_token_batch)
+		chunk = rl_token_batch;
+	if (chunk < 1)
+		chunk = 1;
+	pipe->counter += chunk;
+
+	lp->pipe = NULL;
+	if (lp->name.len < name->len) {
+		lp->name.s = pkg_realloc(lp->name.s, name->len);
+		if (!lp->name.s) {
+			LM_ERR("no more pkg memory\n");
+			lp->name.len = 0;
+			return 1;
+		}
+	}
+	memcpy(lp->name.s, name->s, name->len);
+	lp->name.len = name->len;
+	lp->pipe = pipe;
+	lp->period = pipe->period;
+	lp->limit = limit;
+	lp->tokens = chunk - 1;
+
+	return 1;
+}
+
 int w_rl_check(struct sip_msg *_m, str *name, int *limit, str *algorithm)
 {
 	int ret = 1, should_update = 0;
 	unsigned int hash_idx;
 	rl_pipe_t **pipe;
+	struct rl_local_pipe *lp = NULL;
 
 	rl_algo_t algo = -1;
 
@@ -380,6 +500,13 @@ int w_rl_check(struct sip_msg *_m, str *name, int *limit, str *algorithm)
 		lock_release(rl_lock);
 	}
 
+	if (rl_token_batch > 1 && (algo == PIPE_ALGO_TAILDROP ||
+			(algo == PIPE_ALGO_NOP && rl_default_algo == PIPE_ALGO_TAILDROP))) {
+		lp = rl_local_get(name);
+		if (lp && rl_local_take(lp, name, *limit))
+			goto end;
+	}
+
 	hash_idx = RL_GET_INDEX(*name);
 	RL_GET_LOCK(hash_idx);
 
@@ -414,12 +541,19 @@ int w_rl_check(struct sip_msg *_m, str *name, int *limit, str *algorithm)
 	(*pipe)->last_used = time(0);
 	/* set the last 'local' used time: */
 	(*pipe)->last_local_used = time(0);
+	rl_pipe_touch(*pipe, hash_idx);
 	if (RL_USE_CDB(*pipe)) {
 		/* release the counter for a while */
 		if (rl_change_counter(name, *pipe, 1) < 0) {
 			LM_ERR("cannot increase counter\n");
 			goto release;
 		}
+	} else if (lp && (*pipe)->algo == PIPE_ALGO_TAILDROP) {
+		ret = rl_borrow_tokens(*pipe, lp, name, *limit);
+		LM_DBG("Pipe %.*s counter:%d limit:%d local tokens:%d should %sbe "
+			"blocked (%p)\n", name->len, name->s, (*pipe)->counter,
+			(*pipe)->limit, lp->tokens, ret == 1 ? "NOT " : "", *pipe);
+		goto release;
 	} else {
 		(*pipe)->counter++;
 	}
@@ -441,12 +575,50 @@ end:
 	return ret;
 }
 
+/* NOTE: assumes that the pipe has been locked */
+static void rl_pipe_reset(rl_pipe_t *pipe)
+{
+	/* leave the lock if a cachedb query should be done*/
+	if (RL_USE_CDB(pipe)) {
+		if (rl_get_counter(&pipe->name, pipe) < 0) {
+			LM_ERR("cannot get pipe counter\n");
+			return;
+		}
+	}
+	switch (pipe->algo) {
+	case PIPE_ALGO_NETWORK:
+		/* handle network algo */
+		pipe->load = (*rl_network_load > pipe->limit) ? -1 : 1;
+		break;
+
+	case PIPE_ALGO_RED:
+		if (pipe->limit && rl_timer_interval)
+			pipe->load = pipe->counter / (pipe->limit *
+				(rl_limit_per_interval ? 1 : rl_timer_interval));
+		break;
+	default:
+		break;
+	}
+	pipe->my_last_counter = pipe->counter;
+	pipe->last_counter = rl_get_all_counters(pipe);
+	if (RL_USE_CDB(pipe)) {
+		if (rl_change_counter(&pipe->name, pipe, 0) < 0) {
+			LM_ERR("cannot reset counter\n");
+		}
+	} else {
+		pipe->counter = 0;
+	}
+	/* invalidates the tokens borrowed during the last interval */
+	pipe->period++;
+}
+
 /* timer housekeeping, invoked each timer interval to reset counters */
 void rl_timer(unsigned int ticks, void *param)
 {
-	unsigned int i = 0;
+	unsigned int i = 0, n, deleted = 0;
 	map_iterator_t it, del;
-	rl_pipe_t **pipe;
+	struct list_head *l, *tmp;
+	rl_pipe_t **pipe, *p;
 	str *key;
 	void *value;
 	unsigned long now = time(0);
@@ -468,8 +640,44 @@ void rl_timer(unsigned int ticks, void *param)
 		*rl_network_load = get_total_bytes_waiting(PROTO_NONE);
 	lock_release(rl_lock);
 
-	/* iterate through each map */
+	/* the pipes expired during the previous run are no longer referenced */
+	list_for_each_safe(l, tmp, rl_htable.graveyard) {
+		list_del(l);
+		shm_free(list_entry(l, rl_pipe_t, active));
+	}
+
+	/* only the pipes used lately need their counters reset */
 	for (i = 0; i < rl_htable.size; i++) {
+		if (list_empty(&rl_htable.active[i]))
+			continue;
+		RL_GET_LOCK(i);
+		list_for_each_safe(l, tmp, &rl_htable.active[i]) {
+			p = list_entry(l, rl_pipe_t, active);
+			rl_pipe_reset(p);
+			if (p->flags & RL_PIPE_TOUCHED) {
+				p->flags &= ~RL_PIPE_TOUCHED;
+			} else if (!(p->flags & RL_PIPE_IDLE) ||
+					p->algo == PIPE_ALGO_NETWORK) {
+				/* keep it one more interval, to replicate its last counter */
+				p->flags |= RL_PIPE_IDLE;
+			} else {
+				list_del(&p->active);
+				p->flags &= ~(RL_PIPE_ACTIVE|RL_PIPE_IDLE);
+			}
+		}
+		RL_RELEASE_LOCK(i);
+	}
+
+	/* look for expired pipes in a slice of the maps, such as the whole
+	 * table is checked once per expire_time */
+	n = rl_htable.size;
+	if (rl_expire_time > rl_timer_interval)
+		n = (rl_htable.size * rl_timer_interval + rl_expire_time - 1) /
+			rl_expire_time;
+	for (; n; n--) {
+		i = (*rl_htable.sweep_idx)++ % rl_htable.size;
+		if (map_size(rl_htable.maps[i]) == 0)
+			continue;
 		RL_GET_LOCK(i);
 		/* iterate through all the entries */
 		if (map_first(rl_htable.maps[i], &it) < 0) {
@@ -502,43 +710,16 @@ void rl_timer(unsigned int ticks, void *param)
 				LM_DBG("Deleting ratelimit pipe key \"%.*s\"\n",
 					key->len, key->s);
 				value = iterator_delete(&del);
-				/* free resources */
-				if (value)
-					shm_free(value);
-				continue;
-			} else {
-				/* leave the lock if a cachedb query should be done*/
-				if (RL_USE_CDB(*pipe)) {
-					if (rl_get_counter(key, *pipe) < 0) {
-						LM_ERR("cannot get pipe counter\n");
-						goto next_pipe;
-					}
-				}
-				switch ((*pipe)->algo) {
-				case PIPE_ALGO_NETWORK:
-					/* handle network algo */
-					(*pipe)->load =
-						(*rl_network_load > (*pipe)->limit) ? -1 : 1;
-					break;
-
-				case PIPE_ALGO_RED:
-					if ((*pipe)->limit && rl_timer_interval)
-						(*pipe)->load = (*pipe)->counter /
-						((*pipe)->limit *
-							(rl_limit_per_interval ? 1 : rl_timer_interval));
-					break;
-				default:
-					break;
-				}
-				(*pipe)->my_last_counter = (*pipe)->counter;
-				(*pipe)->last_counter = rl_get_all_counters(*pipe);
-				if (RL_USE_CDB(*pipe)) {
-					if (rl_change_counter(key, *pipe, 0) < 0) {
-						LM_ERR("cannot reset counter\n");
-					}
-				} else {
-					(*pipe)->counter = 0;
+				/* the pipe may still be cached by the workers, so only
+				 * free it on the next run */
+				if (value) {
+					p = (rl_pipe_t *)value;
+					if (p->flags & RL_PIPE_ACTIVE)
+						list_del(&p->active);
+					list_add(&p->active, rl_htable.graveyard);
+					deleted++;
 				}
+				continue;
 			}
 next_pipe:
 			if (iterator_next(&it) < 0)
@@ -547,6 +728,10 @@ next_pipe:
 next_map:
 		RL_RELEASE_LOCK(i);
 	}
+
+	/* have the workers drop their cached pipes */
+	if (deleted)
+		(*rl_htable.epoch)++;
 }
 
 static int rl_map_print(void *param, str key, void *value)
@@ -807,6 +992,7 @@ void rl_rcv_bin(bin_packet_t *packet)
 		}
 		/* set the last used time */
 		(*pipe)->last_used = time(0);
+		rl_pipe_touch(*pipe, hash_idx);
 		/* set the destination's counter */
 		destination = find_destination(*pipe, packet->src_id);
 		if (!destination)
@@ -911,9 +1097,8 @@ error:
 void rl_timer_repl(utime_t ticks, void *param)
 {
 	unsigned int i = 0;
-	map_iterator_t it;
-	rl_pipe_t **pipe;
-	str *key;
+	struct list_head *l;
+	rl_pipe_t *pipe;
 	int nr = 0;
 	int ret = 0;
 	bin_packet_t packet;
@@ -924,60 +1109,43 @@ void rl_timer_repl(utime_t ticks, void *param)
 		return;
 	}
 
-	/* iterate through each map */
+	/* the pipes that are not in the active lists were not used locally
+	 * during the last two intervals, so there is nothing to replicate */
 	for (i = 0; i < rl_htable.size; i++) {
+		if (list_empty(&rl_htable.active[i]))
+			continue;
 		RL_GET_LOCK(i);
-		/* iterate through all the entries */
-		if (map_first(rl_htable.maps[i], &it) < 0) {
-			LM_ERR("map doesn't exist\n");
-			goto next_map;
-		}
-		for (; iterator_is_valid(&it);) {
-			pipe = (rl_pipe_t **) iterator_val(&it);
-			if (!pipe || !*pipe) {
-				LM_ERR("[BUG] bogus map[%d] state\n", i);
-				goto next_pipe;
-			}
+		list_for_each(l, &rl_htable.active[i]) {
+			pipe = list_entry(l, rl_pipe_t, active);
 			/* ignore cachedb replicated stuff */
-			if (RL_USE_CDB(*pipe))
-				goto next_pipe;
+			if (RL_USE_CDB(pipe))
+				continue;
 
 			/* do not replicate if about to expire */
-			if ((*pipe)->last_local_used + rl_expire_time < now)
-				goto next_pipe;
-
-			key = iterator_key(&it);
-			if (!key) {
-				LM_ERR("cannot retrieve pipe key\n");
-				goto next_pipe;
-			}
+			if (pipe->last_local_used + rl_expire_time < now)
+				continue;
 
-			if (bin_push_str(&packet, key) < 0)
+			if (bin_push_str(&packet, &pipe->name) < 0)
 				goto error;
 
-			if (bin_push_int(&packet, (*pipe)->algo) < 0)
+			if (bin_push_int(&packet, pipe->algo) < 0)
 				goto error;
 
-			if (bin_push_int(&packet, (*pipe)->limit) < 0)
+			if (bin_push_int(&packet, pipe->limit) < 0)
 				goto error;
 
 			/*
 			 * for the SBT algorithm it is safe to replicate the current
 			 * counter, since it is always updating according to the window
 			 */
-			RL_DBG(*pipe, "replicate=%d", ((*pipe)->algo == PIPE_ALGO_HISTORY ?
-						 (*pipe)->counter : (*pipe)->my_last_counter));
+			RL_DBG(pipe, "replicate=%d", (pipe->algo == PIPE_ALGO_HISTORY ?
+						 pipe->counter : pipe->my_last_counter));
 			if ((ret = bin_push_int(&packet,
-						((*pipe)->algo == PIPE_ALGO_HISTORY ?
-						 (*pipe)->counter : (*pipe)->my_last_counter))) < 0)
+						(pipe->algo == PIPE_ALGO_HISTORY ?
+						 pipe->counter : pipe->my_last_counter))) < 0)
 				goto error;
 			nr++;
-
-next_pipe:
-			if (iterator_next(&it) < 0)
-				break;
 		}
-next_map:
 		RL_RELEASE_LOCK(i);
 		if (ret > rl_buffer_th) {
 			/* send the buffer */
@@ -202,6 +202,7 @@ static param_export_t params[] = {
 	{"attr_avp",           STR_PARAM, &attr_avp_param        },
 	{"gruu_secret",        STR_PARAM, &gruu_secret.s         },
 	{"disable_gruu",       INT_PARAM, &disable_gruu          },
+	{"lookup_cache",       INT_PARAM, &reg_lookup_cache      },
 
 	/* common registrar modparams */
 	reg_modparams,
@@ -30,7 +30,6 @@
 #include "../../trim.h"
 #include "../../pvar.h"
 #include "../../locking.h"
-#include "../../rw_locking.h"
 #include "../../timer.h"
 #include "../../ipc.h"
 #include "sql_cacher.h"
@@ -56,6 +55,7 @@ static str columns_delimiter = str_init(DEFAULT_COLUMNS_DELIM);
 static int fetch_nr_rows = DEFAULT_FETCH_NR_ROWS;
 static int full_caching_expire = DEFAULT_FULL_CACHING_EXPIRE;
 static int reload_interval = DEFAULT_RELOAD_INTERVAL;
+static int delta_refresh_interval = DEFAULT_DELTA_REFRESH_INTERVAL;
 
 static cache_entry_t **entry_list;
 static struct queried_key **queries_in_progress;
@@ -73,6 +73,7 @@ static param_export_t mod_params[] = {
 	{"sql_fetch_nr_rows", INT_PARAM, &fetch_nr_rows},
 	{"full_caching_expire", INT_PARAM, &full_caching_expire},
 	{"reload_interval", INT_PARAM, &reload_interval},
+	{"delta_refresh_interval", INT_PARAM, &delta_refresh_interval},
 	{"cache_table", STR_PARAM|USE_FUNC_PARAM, (void *)&parse_cache_entry},
 	{0,0,0}
 };
@@ -169,7 +170,13 @@ static int parse_cache_entry(unsigned int type, void *val)
 		new_entry->nr_ints = 0;
 		new_entry->nr_strs = 0;
 		new_entry->column_types = 0;
-		new_entry->ref_lock = NULL;
+		new_entry->refresh_col.s = NULL;
+		new_entry->refresh_col.len = 0;
+		new_entry->deleted_col.s = NULL;
+		new_entry->deleted_col.len = 0;
+		new_entry->has_refresh_mark = 0;
+		new_entry->loaded = 0;
+		new_entry->load_lock = NULL;
 
 #define PARSE_TOKEN(_ptr1, _ptr2, field, field_name_str, field_name_len) \
 	do { \
@@ -413,8 +420,14 @@ static int parse_cache_entry(unsigned int type, void *val)
 
 		/* parse expire parameter */
 		if (!memcmp(p1, EXPIRE_STR, EXPIRE_STR_LEN)) {
+			tmp = memchr(p2 + 1, spec_delimiter.s[0],
+					parse_str.len - (p2 - parse_str.s + 1));
 			str str_val;
-			str_val.len = parse_str.len - (p2 - parse_str.s + 1);
+			if (!tmp) /* delimiter not found, reached the end of the string to parse */
+				str_val.len = parse_str.len - (p2 - parse_str.s + 1);
+			else
+				str_val.len = tmp - p2 - 1;
+
 			if (str_val.len <= 0) {
 				LM_ERR("expected value of: %.*s\n", EXPIRE_STR_LEN, EXPIRE_STR);
 				goto parse_err;
@@ -425,7 +438,56 @@ static int parse_cache_entry(unsigned int type, void *val)
 						EXPIRE_STR_LEN, EXPIRE_STR, str_val.len, str_val.s);
 				goto parse_err;
 			}
-		} else if (parse_str.len - (p1 - parse_str.s) > 0) {
+
+			if (!tmp) /* delimiter not found, reached the end of the string to parse */
+				goto end_parsing;
+			else {
+				p1 = tmp + 1;
+				p2 = memchr(p1, '=', parse_str.len - (p1 - parse_str.s));
+				if (!p2) {
+					LM_ERR("expected: '='\n");
+					goto parse_err;
+				}
+			}
+		}
+
+#define PARSE_OPT_TOKEN(field, field_name_str, field_name_len) \
+	do { \
+		if (memcmp(p1, (field_name_str), (field_name_len)) || \
+			*(p1 + (field_name_len)) != '=') \
+			break; \
+		tmp = memchr(p2 + 1, spec_delimiter.s[0], \
+				parse_str.len - (p2 - parse_str.s + 1)); \
+		if (!tmp) /* delimiter not found, reached the end of the string */ \
+			new_entry->field.len = parse_str.len - (p2 - parse_str.s + 1); \
+		else \
+			new_entry->field.len = tmp - p2 - 1; \
+		if (new_entry->field.len <= 0) { \
+			LM_ERR("expected value of: %.*s\n", (field_name_len), (field_name_str)); \
+			goto parse_err; \
+		} \
+		new_entry->field.s = shm_malloc(new_entry->field.len); \
+		if (!new_entry->field.s) { \
+			LM_ERR("No more shm memory\n"); \
+			goto parse_err; \
+		} \
+		memcpy(new_entry->field.s, p2 + 1, new_entry->field.len); \
+		if (!tmp) \
+			goto end_parsing; \
+		p1 = tmp + 1; \
+		p2 = memchr(p1, '=', parse_str.len - (p1 - parse_str.s)); \
+		if (!p2) { \
+			LM_ERR("expected: '='\n"); \
+			goto parse_err; \
+		} \
+	} while (0)
+
+		/* parse the incremental refresh columns, if present */
+		PARSE_OPT_TOKEN(refresh_col, REFRESH_COL_STR, REFRESH_COL_STR_LEN);
+		PARSE_OPT_TOKEN(deleted_col, DELETED_COL_STR, DELETED_COL_STR_LEN);
+#undef PARSE_OPT_TOKEN
+
+		if (parse_str.len - (p1 - parse_str.s) > 0) {
 			LM_ERR("unknown parameter: %.*s\n",
 				(int)(parse_str.len - (p1 - parse_str.s)), p1);
 			goto parse_err;
@@ -561,26 +623,79 @@ static unsigned int get_cdb_val_size(cache_entry_t *c_entry, db_val_t *values, i
 	return len;
 }
 
+/* the buffers of the cachedb keys and values are reused for all the rows */
+static str cdb_key_buf = STR_NULL;
+static str cdb_val_buf = STR_NULL;
+
+/* builds the cachedb key (the entry id followed by the SQL key) in
+ * cdb_key_buf */
+static int build_cdb_key(cache_entry_t *c_entry, db_val_t *key, str *cdb_key)
+{
+	int int_val, int_key_len = 0;
+	char *int_key_buf = NULL;
+	str str_key = STR_NULL;
+
+	/* make sure the key is string */
+	switch (VAL_TYPE(key)) {
+		case DB_STRING:
+			str_key.s = (char *)VAL_STRING(key);
+			str_key.len = strlen(str_key.s);
+			break;
+		case DB_STR:
+			str_key = VAL_STR(key);
+			break;
+		case DB_BLOB:
+			str_key = VAL_BLOB(key);
+			break;
+		case DB_INT:
+			int_key_buf = sint2str(VAL_INT(key), &int_key_len);
+			break;
+		case DB_BIGINT:
+			int_val = (int)VAL_BIGINT(key);
+			int_key_buf = sint2str(int_val, &int_key_len);
+			break;
+		case DB_DOUBLE:
+			int_val = (int)VAL_DOUBLE(key);
+			int_key_buf = sint2str(int_val, &int_key_len);
+			break;
+		default:
+			LM_ERR("Unsupported type for SQL DB key column\n");
+			return -1;
+	}
+	if (int_key_len) {
+		str_key.s = int_key_buf;
+		str_key.len = int_key_len;
+	}
+
+	if (pkg_str_extend(&cdb_key_buf, c_entry->id.len + str_key.len) < 0) {
+		LM_ERR("No more pkg memory\n");
+		return -1;
+	}
+	cdb_key->s = cdb_key_buf.s;
+	cdb_key->len = c_entry->id.len + str_key.len;
+	memcpy(cdb_key->s, c_entry->id.s, c_entry->id.len);
+	memcpy(cdb_key->s + c_entry->id.len, str_key.s, str_key.len);
+
+	return 0;
+}
+
 static int insert_in_cachedb(cache_entry_t *c_entry, db_handlers_t *db_hdls,
 			db_val_t *key, db_val_t *values, int reload_version, int nr_columns)
 {
 	unsigned int i, offset = 0, strs_offset = 0;
 	int int_val;
-	int int_key_len = 0, rc = 0;
 	char int_buf[4], int_enc_buf[INT_B64_ENC_LEN];
-	char *int_key_buf = NULL;
 	str str_val;
 	db_type_t val_type;
-	str str_key = STR_NULL;
 	str cdb_val;
-	str cdb_key = STR_NULL;
+	str cdb_key;
 
 	cdb_val.len = get_cdb_val_size(c_entry, values, nr_columns);
-	cdb_val.s = pkg_malloc(cdb_val.len);
-	if (!cdb_val.s) {
+	if (pkg_str_extend(&cdb_val_buf, cdb_val.len) < 0) {
 		LM_ERR("No more pkg memory\n");
 		return -1;
 	}
+	cdb_val.s = cdb_val_buf.s;
 
 	/* store the reload version (base64 encoded) */
 	memcpy(int_buf, &reload_version, 4);
@@ -651,60 +766,33 @@ static int insert_in_cachedb(cache_entry_t *c_entry, db_handlers_t *db_hdls,
 		strs_offset += str_val.len;
 	}
 
-	/* make sure the key is string */
-	val_type = VAL_TYPE(key);
-	switch (val_type) {
-		case DB_STRING:
-			str_key.s = (char *)VAL_STRING(key);
-			str_key.len = strlen(str_key.s);
-			break;
-		case DB_STR:
-			str_key = VAL_STR(key);
-			break;
-		case DB_BLOB:
-			str_key = VAL_BLOB(key);
-			break;
-		case DB_INT:
-			int_key_buf = sint2str(VAL_INT(key), &int_key_len);
-			break;
-		case DB_BIGINT:
-			int_val = (int)VAL_BIGINT(key);
-			int_key_buf = sint2str(int_val, &int_key_len);
-			break;
-		case DB_DOUBLE:
-			int_val = (int)VAL_DOUBLE(key);
-			int_key_buf = sint2str(int_val, &int_key_len);
-			break;
-		default:
-			LM_ERR("Unsupported type for SQL DB key column\n");
-			rc = -1;
-			goto out;
-	}
-	if (int_key_len) {
-		str_key.s = int_key_buf;
-		str_key.len = int_key_len;
-	}
-
-	cdb_key.len = c_entry->id.len + str_key.len;
-	cdb_key.s = pkg_malloc(cdb_key.len);
-	if (!cdb_key.s) {
-		LM_ERR("No more pkg memory\n");
-		rc = -1;
-		goto out;
-	}
-	memcpy(cdb_key.s, c_entry->id.s, c_entry->id.len);
-	memcpy(cdb_key.s + c_entry->id.len, str_key.s, str_key.len);
+	if (build_cdb_key(c_entry, key, &cdb_key) < 0)
+		return -1;
 
 	if (db_hdls->cdbf.set(db_hdls->cdbcon, &cdb_key, &cdb_val, c_entry->expire) < 0) {
 		LM_ERR("Failed to insert the values for key: %.*s in cachedb\n",
-			str_key.len, str_key.s);
-		rc = -1;
+			cdb_key.len - c_entry->id.len, cdb_key.s + c_entry->id.len);
+		return -1;
 	}
 
-out:
-	pkg_free(cdb_key.s);
-	pkg_free(cdb_val.s);
-	return rc;
+	return 0;
+}
+
+static int remove_from_cachedb(cache_entry_t *c_entry, db_handlers_t *db_hdls,
+			db_val_t *key)
+{
+	str cdb_key;
+
+	if (build_cdb_key(c_entry, key, &cdb_key) < 0)
+		return -1;
+
+	if (db_hdls->cdbf.remove(db_hdls->cdbcon, &cdb_key) < 0) {
+		LM_ERR("Failed to remove key: %.*s from cachedb\n",
+			cdb_key.len - c_entry->id.len, cdb_key.s + c_entry->id.len);
+		return -1;
+	}
+
+	return 0;
 }
 
 static db_handlers_t *db_init_test_conn(cache_entry_t *c_entry)
@@ -867,17 +955,88 @@ static int inc_cache_rld_vers(db_handlers_t *db_hdls, int *rld_vers)
 	return 0;
 }
 
-static int load_entire_table(cache_entry_t *c_entry, db_handlers_t *db_hdls,
-								int inc_rld_vers)
+static int get_rld_vers_from_cache(cache_entry_t *c_entry, db_handlers_t *db_hdls)
+{
+	str rld_vers_key;
+	int rld_vers = -1;
+
+	rld_vers_key.len = c_entry->id.len + 23;
+	rld_vers_key.s = pkg_malloc(rld_vers_key.len);
+	if (!rld_vers_key.s) {
+		LM_ERR("No more pkg memory\n");
+		return -1;
+	}
+	memcpy(rld_vers_key.s, c_entry->id.s, c_entry->id.len);
+	memcpy(rld_vers_key.s + c_entry->id.len, "_sql_cacher_reload_vers", 23);
+
+	if (db_hdls->cdbf.get_counter(db_hdls->cdbcon, &rld_vers_key, &rld_vers) < 0) {
+		LM_ERR("Failed to get reload version integer from cachedb\n");
+		pkg_free(rld_vers_key.s);
+		return -1;
+	}
+
+	pkg_free(rld_vers_key.s);
+
+	return rld_vers;
+}
+
+/* the value of the refresh column, as an integer */
+static inline int get_refresh_val(db_val_t *val, long long *ival)
+{
+	switch (VAL_TYPE(val)) {
+		case DB_INT:
+			*ival = VAL_INT(val);
+			return 0;
+		case DB_BIGINT:
+			*ival = VAL_BIGINT(val);
+			return 0;
+		case DB_DATETIME:
+			*ival = VAL_TIME(val);
+			return 0;
+		default:
+			return -1;
+	}
+}
+
+static inline int is_deleted_row(db_val_t *val)
+{
+	if (VAL_NULL(val))
+		return 0;
+
+	switch (VAL_TYPE(val)) {
+		case DB_INT:
+			return VAL_INT(val) != 0;
+		case DB_BIGINT:
+			return VAL_BIGINT(val) != 0;
+		default:
+			return 0;
+	}
+}
+
+/* streams the rows of the table (all of them or, if @delta, only the ones
+ * changed since the previous load) into the cachedb, in chunks of
+ * sql_fetch_nr_rows rows; the caller must hold the load lock */
+static int load_table_rows(cache_entry_t *c_entry, db_handlers_t *db_hdls,
+								int reload_vers, int delta)
 {
 	db_key_t *query_cols = NULL;
+	db_key_t where_col;
+	db_op_t where_op = OP_GEQ;
+	db_val_t where_val;
 	db_res_t *sql_res = NULL;
 	db_row_t *row;
 	db_val_t *values;
-	int i;
-	int reload_vers = 0;
+	int i, nr_cols, refresh_idx = -1, deleted_idx = -1, n_where = 0;
+	int has_mark = 0, bad_type = 0;
+	long long mark = 0, ival;
+
+	nr_cols = c_entry->nr_columns + 1;
+	if (c_entry->refresh_col.s)
+		refresh_idx = nr_cols++;
+	if (c_entry->deleted_col.s)
+		deleted_idx = nr_cols++;
 
-	query_cols = pkg_malloc((c_entry->nr_columns + 1) * sizeof(db_key_t));
+	query_cols = pkg_malloc(nr_cols * sizeof(db_key_t));
 	if (!query_cols) {
 		LM_ERR("No more pkg memory\n");
 		return -1;
@@ -885,8 +1044,30 @@ static int load_entire_table(cache_entry_t *c_entry, db_handlers_t *db_hdls,
 	query_cols[0] = &(c_entry->key);
 	for (i=0; i < c_entry->nr_columns; i++)
 		query_cols[i+1] = &((*c_entry->columns[i]));
+	if (refresh_idx > 0)
+		query_cols[refresh_idx] = &c_entry->refresh_col;
+	if (deleted_idx > 0)
+		query_cols[deleted_idx] = &c_entry->deleted_col;
+
+	/* the rows changed in the same second as the previous mark may have
+	 * been missed, so they are loaded again */
+	if (delta && c_entry->has_refresh_mark) {
+		where_col = &c_entry->refresh_col;
+		VAL_NULL(&where_val) = 0;
+		VAL_TYPE(&where_val) = c_entry->refresh_type;
+		if (c_entry->refresh_type == DB_DATETIME)
+			VAL_TIME(&where_val) = (time_t)c_entry->refresh_mark;
+		else if (c_entry->refresh_type == DB_BIGINT)
+			VAL_BIGINT(&where_val) = c_entry->refresh_mark;
+		else
+			VAL_INT(&where_val) = (int)c_entry->refresh_mark;
+		n_where = 1;
+
+		has_mark = 1;
+		mark = c_entry->refresh_mark;
+	}
 
-	/* query the entire table */
+	/* query the table */
 	if (db_hdls->db_funcs.use_table(db_hdls->db_con, &c_entry->table) < 0) {
 		LM_ERR("Invalid table name: %.*s\n", c_entry->table.len, c_entry->table.s);
 		db_hdls->db_funcs.close(db_hdls->db_con);
@@ -895,8 +1076,9 @@ static int load_entire_table(cache_entry_t *c_entry, db_handlers_t *db_hdls,
 		return -1;
 	}
 	if (DB_CAPABILITY(db_hdls->db_funcs, DB_CAP_FETCH)) {
-		if (db_hdls->db_funcs.query(db_hdls->db_con, NULL, 0, NULL,
-						query_cols, 0, c_entry->nr_columns + 1, 0, 0) != 0) {
+		if (db_hdls->db_funcs.query(db_hdls->db_con, n_where ? &where_col : NULL,
+				n_where ? &where_op : NULL, n_where ? &where_val : NULL,
+				query_cols, n_where, nr_cols, 0, 0) != 0) {
 			LM_ERR("Failure to issue query to SQL DB: %.*s\n",
 			c_entry->db_url.len, c_entry->db_url.s);
 			pkg_free(query_cols);
@@ -910,8 +1092,9 @@ static int load_entire_table(cache_entry_t *c_entry, db_handlers_t *db_hdls,
 			goto error;
 		}
 	} else {
-		if (db_hdls->db_funcs.query(db_hdls->db_con, NULL, 0, NULL,
-						query_cols, 0, c_entry->nr_columns + 1, 0, &sql_res) != 0) {
+		if (db_hdls->db_funcs.query(db_hdls->db_con, n_where ? &where_col : NULL,
+				n_where ? &where_op : NULL, n_where ? &where_val : NULL,
+				query_cols, n_where, nr_cols, 0, &sql_res) != 0) {
 			LM_ERR("Failure to issue query to SQL DB: %.*s\n",
 			c_entry->db_url.len, c_entry->db_url.s);
 			pkg_free(query_cols);
@@ -921,45 +1104,58 @@ static int load_entire_table(cache_entry_t *c_entry, db_handlers_t *db_hdls,
 
 	pkg_free(query_cols);
 
-	lock_start_write(db_hdls->c_entry->ref_lock);
-
-	if (inc_rld_vers && inc_cache_rld_vers(db_hdls, &reload_vers) < 0) {
-		lock_stop_write(db_hdls->c_entry->ref_lock);
-		goto error;
-	}
-
 	/* anything loaded ? if not, we can do a quick exit here */
 	if (RES_ROW_N(sql_res) == 0) {
-		lock_stop_write(db_hdls->c_entry->ref_lock);
 		db_hdls->db_funcs.free_result(db_hdls->db_con, sql_res);
 		return 0;
 	}
 
+	/* the column types of a full load are always refreshed */
 	row = RES_ROWS(sql_res);
 	values = ROW_VALUES(row);
-	if (get_column_types(c_entry, values + 1, ROW_N(row) - 1) < 0) {
-		lock_stop_write(db_hdls->c_entry->ref_lock);
+	if ((!delta || c_entry->nr_ints + c_entry->nr_strs == 0) &&
+		get_column_types(c_entry, values + 1, c_entry->nr_columns) < 0)
 		goto error;
-	}
 
 	/* load the rows into the cahchedb */
 	do {
 		for (i=0; i < RES_ROW_N(sql_res); i++) {
 			row = RES_ROWS(sql_res) + i;
 			values = ROW_VALUES(row);
-			if (!VAL_NULL(values))
-				if (insert_in_cachedb(c_entry, db_hdls, values ,values + 1,
-					reload_vers, ROW_N(row) - 1) < 0) {
-					lock_stop_write(db_hdls->c_entry->ref_lock);
-					return -1;
+			if (VAL_NULL(values))
+				continue;
+
+			if (refresh_idx > 0 && !VAL_NULL(values + refresh_idx)) {
+				if (get_refresh_val(values + refresh_idx, &ival) < 0) {
+					if (!bad_type)
+						LM_ERR("Unsupported type: %d for refresh column: %.*s\n",
+							VAL_TYPE(values + refresh_idx),
+							c_entry->refresh_col.len, c_entry->refresh_col.s);
+					bad_type = 1;
+				} else if (!has_mark || ival > mark) {
+					c_entry->refresh_type = VAL_TYPE(values + refresh_idx);
+					mark = ival;
+					has_mark = 1;
 				}
+			}
+
+			if (deleted_idx > 0 && is_deleted_row(values + deleted_idx)) {
+				/* on a full load, the row simply does not get the new
+				 * reload version */
+				if (delta && remove_from_cachedb(c_entry, db_hdls, values) < 0)
+					goto error;
+				continue;
+			}
+
+			if (insert_in_cachedb(c_entry, db_hdls, values ,values + 1,
+				reload_vers, c_entry->nr_columns) < 0)
+				goto error;
 		}
 
 		if (DB_CAPABILITY(db_hdls->db_funcs, DB_CAP_FETCH)) {
 			if (db_hdls->db_funcs.fetch_result(db_hdls->db_con,&sql_res,fetch_nr_rows)<0) {
 				LM_ERR("Error fetching rows (1) from SQL DB: %.*s\n",
 					c_entry->db_url.len, c_entry->db_url.s);
-				lock_stop_write(db_hdls->c_entry->ref_lock);
 				goto error;
 			}
 		} else {
@@ -967,9 +1163,13 @@ static int load_entire_table(cache_entry_t *c_entry, db_handlers_t *db_hdls,
 		}
 	} while (RES_ROW_N(sql_res) > 0);
 
-	lock_stop_write(db_hdls->c_entry->ref_lock);
-
 	db_hdls->db_funcs.free_result(db_hdls->db_con, sql_res);
+
+	if (has_mark && !bad_type) {
+		c_entry->refresh_mark = mark;
+		c_entry->has_refresh_mark = 1;
+	}
+
 	return 0;
 
 error:
@@ -978,6 +1178,66 @@ error:
 	return -1;
 }
 
+static int load_entire_table(cache_entry_t *c_entry, db_handlers_t *db_hdls,
+								int inc_rld_vers)
+{
+	int reload_vers = 0, rc;
+
+	lock_get(c_entry->load_lock);
+
+	/* the rows are written with the next reload version, which only becomes
+	 * the current one after the whole table is loaded - until then, the
+	 * readers accept both versions, so they are never blocked by a reload
+	 * and the rows gone from the table expire only at the end */
+	if (inc_rld_vers) {
+		reload_vers = get_rld_vers_from_cache(c_entry, db_hdls);
+		if (reload_vers < 0) {
+			lock_release(c_entry->load_lock);
+			return -1;
+		}
+		reload_vers++;
+	}
+
+	rc = load_table_rows(c_entry, db_hdls, reload_vers, 0);
+
+	/* also switched to if the load failed partway, as it was before the
+	 * version was only bumped at the end: the next attempt must not reuse
+	 * the version of the rows written so far, or the ones deleted from the
+	 * table meanwhile would look fresh again */
+	if (inc_rld_vers && inc_cache_rld_vers(db_hdls, &reload_vers) < 0)
+		rc = -1;
+
+	if (rc == 0)
+		c_entry->loaded = 1;
+
+	lock_release(c_entry->load_lock);
+	return rc;
+}
+
+/* applies the rows changed since the previous load, with the current
+ * reload version */
+static int load_table_delta(cache_entry_t *c_entry, db_handlers_t *db_hdls)
+{
+	int reload_vers, rc;
+
+	/* nothing to apply before the initial load */
+	if (!c_entry->loaded)
+		return 0;
+
+	lock_get(c_entry->load_lock);
+
+	reload_vers = get_rld_vers_from_cache(c_entry, db_hdls);
+	if (reload_vers < 0) {
+		lock_release(c_entry->load_lock);
+		return -1;
+	}
+
+	rc = load_table_rows(c_entry, db_hdls, reload_vers, 1);
+
+	lock_release(c_entry->load_lock);
+	return rc;
+}
+
 /*  return:
  *  0 - succes
  * -1 - error
@@ -1066,41 +1326,30 @@ out_error:
 	return -1;
 }
 
-static int get_rld_vers_from_cache(cache_entry_t *c_entry, db_handlers_t *db_hdls)
+void reload_timer(unsigned int ticks, void *param)
 {
-	str rld_vers_key;
-	int rld_vers = -1;
+	db_handlers_t *db_hdls;
 
-	rld_vers_key.len = c_entry->id.len + 23;
-	rld_vers_key.s = pkg_malloc(rld_vers_key.len);
-	if (!rld_vers_key.s) {
-		LM_ERR("No more pkg memory\n");
-		return -1;
-	}
-	memcpy(rld_vers_key.s, c_entry->id.s, c_entry->id.len);
-	memcpy(rld_vers_key.s + c_entry->id.len, "_sql_cacher_reload_vers", 23);
+	for (db_hdls = db_hdls_list; db_hdls; db_hdls = db_hdls->next) {
+		if (db_hdls->c_entry->on_demand)
+			continue;
 
-	if (db_hdls->cdbf.get_counter(db_hdls->cdbcon, &rld_vers_key, &rld_vers) < 0) {
-		LM_ERR("Failed to get reload version integer from cachedb\n");
-		pkg_free(rld_vers_key.s);
-		return -1;
+		if (load_entire_table(db_hdls->c_entry, db_hdls, 1) < 0)
+			LM_ERR("Failed to reload table %.*s\n", db_hdls->c_entry->table.len,
+				db_hdls->c_entry->table.s);
 	}
-
-	pkg_free(rld_vers_key.s);
-
-	return rld_vers;
 }
 
-void reload_timer(unsigned int ticks, void *param)
+void delta_refresh_timer(unsigned int ticks, void *param)
 {
 	db_handlers_t *db_hdls;
 
 	for (db_hdls = db_hdls_list; db_hdls; db_hdls = db_hdls->next) {
-		if (db_hdls->c_entry->on_demand)
+		if (db_hdls->c_entry->on_demand || !db_hdls->c_entry->refresh_col.s)
 			continue;
 
-		if (load_entire_table(db_hdls->c_entry, db_hdls, 1) < 0)
-			LM_ERR("Failed to reload table %.*s\n", db_hdls->c_entry->table.len,
+		if (load_table_delta(db_hdls->c_entry, db_hdls) < 0)
+			LM_ERR("Failed to refresh table %.*s\n", db_hdls->c_entry->table.len,
 				db_hdls->c_entry->table.s);
 	}
 }
@@ -1259,7 +1508,7 @@ static int mod_init(void)
 {
 	cache_entry_t *c_entry;
 	db_handlers_t *db_hdls;
-	char use_timer = 0;
+	char use_timer = 0, use_delta_timer = 0;
 
 	if (full_caching_expire <= 0) {
 		full_caching_expire = DEFAULT_FULL_CACHING_EXPIRE;
@@ -1306,11 +1555,18 @@ static int mod_init(void)
 		if (!c_entry->on_demand) {
 			use_timer = 1;
 			c_entry->expire = full_caching_expire;
-			c_entry->ref_lock = lock_init_rw();
-			if (!c_entry->ref_lock) {
-				LM_ERR("Failed to init readers-writers lock\n");
-				continue;
+			c_entry->load_lock = lock_alloc();
+			if (!c_entry->load_lock || !lock_init(c_entry->load_lock)) {
+				LM_ERR("Failed to init the load lock\n");
+				return -1;
 			}
+
+			if (c_entry->refresh_col.s)
+				use_delta_timer = 1;
+		} else if (c_entry->refresh_col.s) {
+			LM_WARN("%.*s: %.*s is only used in full caching mode\n",
+				c_entry->id.len, c_entry->id.s,
+				REFRESH_COL_STR_LEN, REFRESH_COL_STR);
 		}
 
 		db_hdls->db_funcs.close(db_hdls->db_con);
@@ -1329,6 +1585,20 @@ static int mod_init(void)
 		return -1;
 	}
 
+	if (use_delta_timer) {
+		if (delta_refresh_interval <= 0) {
+			delta_refresh_interval = DEFAULT_DELTA_REFRESH_INTERVAL;
+			LM_WARN("Invalid delta_refresh_interval parameter, "
+				"setting default value: %d sec\n", DEFAULT_DELTA_REFRESH_INTERVAL);
+		}
+
+		if (register_timer("sql_cacher_delta-timer", delta_refresh_timer, NULL,
+			delta_refresh_interval, TIMER_FLAG_DELAY_ON_DELAY) < 0) {
+			LM_ERR("failed to register timer\n");
+			return -1;
+		}
+	}
+
 	return 0;
 }
 
@@ -1412,7 +1682,9 @@ static int cdb_val_decode(pv_name_fix_t *pv_name, str *cdb_val, int reload_versi
 		goto error;
 	memcpy(&int_val, int_buf, 4);
 
-	if (reload_version != int_val)
+	/* a full reload in progress already writes the next version */
+	if (reload_version != int_val && (pv_name->c_entry->on_demand ||
+		reload_version + 1 != int_val))
 		return 3;
 
 	/* null integer value in db */
@@ -1842,26 +2114,19 @@ int pv_get_sql_cached_value(struct sip_msg *msg,  pv_param_t *param, pv_value_t
 		}
 	}
 
-	if (!pv_name->c_entry->on_demand)
-		lock_start_read(pv_name->c_entry->ref_lock);
-
 	rc = cdb_fetch(pv_name, &cdb_res, &entry_rld_vers);
 	if (rc == -1) {
 		LM_ERR("Error fetching from cachedb\n");
-		if (!pv_name->c_entry->on_demand)
-			lock_stop_read(pv_name->c_entry->ref_lock);
 		return pv_get_null(msg, param, res);
 	}
 
 	if (!pv_name->c_entry->on_demand) {
 		if (rc == -2) {
 			LM_DBG("key: %.*s not found\n", pv_name->key.len, pv_name->key.s);
-			lock_stop_read(pv_name->c_entry->ref_lock);
 			return pv_get_null(msg, param, res);
 		} else {
 			if (cdb_res.len == 0 || !cdb_res.s) {
 				LM_ERR("Cache fetch result should not be empty\n");
-				lock_stop_read(pv_name->c_entry->ref_lock);
 				pkg_free(cdb_res.s);
 				return pv_get_null(msg, param, res);
 			}
@@ -1871,8 +2136,6 @@ int pv_get_sql_cached_value(struct sip_msg *msg,  pv_param_t *param, pv_value_t
 			rc2 = cdb_val_decode(pv_name, &cdb_res, entry_rld_vers, &str_res,
 									&int_res);
 
-			lock_stop_read(pv_name->c_entry->ref_lock);
-
 			if (rc2 == 2)
 				goto out_free_null;
 			if (rc2 == 3) {
@@ -1975,7 +2238,14 @@ static void free_c_entry(cache_entry_t *c)
 		shm_free(c->columns[i]);
 	}
 	shm_free(c->columns);
-	lock_destroy_rw(c->ref_lock);
+	if (c->refresh_col.s)
+		shm_free(c->refresh_col.s);
+	if (c->deleted_col.s)
+		shm_free(c->deleted_col.s);
+	if (c->load_lock) {
+		lock_destroy(c->load_lock);
+		lock_dealloc(c->load_lock);
+	}
 	shm_free(c);
 }
 
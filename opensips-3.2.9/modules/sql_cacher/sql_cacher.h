@@ -51,6 +51,10 @@
 #define ONDEMAND_STR_LEN ((int)(sizeof(ONDEMAND_STR) - 1))
 #define EXPIRE_STR "expire"
 #define EXPIRE_STR_LEN ((int)(sizeof(EXPIRE_STR) - 1))
+#define REFRESH_COL_STR "refresh_column"
+#define REFRESH_COL_STR_LEN ((int)(sizeof(REFRESH_COL_STR) - 1))
+#define DELETED_COL_STR "deleted_column"
+#define DELETED_COL_STR_LEN ((int)(sizeof(DELETED_COL_STR) - 1))
 
 #define TYPE_STR_STR "string"
 #define TYPE_STR_LEN ((int)(sizeof(TYPE_STR_STR) - 1))
@@ -60,6 +64,7 @@
 #define DEFAULT_ON_DEMAND_EXPIRE 3600
 #define DEFAULT_FULL_CACHING_EXPIRE 86400 /* 24h */
 #define DEFAULT_RELOAD_INTERVAL 60
+#define DEFAULT_DELTA_REFRESH_INTERVAL 60
 #define DEFAULT_FETCH_NR_ROWS 100
 #define TEST_QUERY_STR "sql_cacher_test_query_key"
 #define TEST_QUERY_INT 555666555
@@ -85,7 +90,16 @@ typedef struct _cache_entry {
 	unsigned int expire;
 	unsigned int nr_ints, nr_strs;
 	long long column_types;
-	rw_lock_t *ref_lock;
+	/* incremental refresh: only the rows with refresh_col >= refresh_mark
+	 * (the highest value loaded so far) are queried again */
+	str refresh_col;
+	str deleted_col;
+	db_type_t refresh_type;
+	int has_refresh_mark;
+	long long refresh_mark;
+	int loaded;
+	/* serializes the (full or incremental) loads of the table */
+	gen_lock_t *load_lock;
 	struct _cache_entry *next;
 } cache_entry_t;
 
@@ -45,6 +45,7 @@ extern stat_var *tm_trans_4xx;
 extern stat_var *tm_trans_5xx;
 extern stat_var *tm_trans_6xx;
 extern stat_var *tm_trans_inuse;
+extern stat_var *tm_relay_time;
 
 
 #ifdef STATISTICS
@@ -174,6 +174,7 @@ stat_var *tm_trans_4xx;
 stat_var *tm_trans_5xx;
 stat_var *tm_trans_6xx;
 stat_var *tm_trans_inuse;
+stat_var *tm_relay_time;
 
 static dep_export_t deps = {
 	{ /* OpenSIPS module dependencies */
@@ -330,6 +331,7 @@ static stat_export_t mod_stats[] = {
 	{"5xx_transactions" ,    0,              &tm_trans_5xx   },
 	{"6xx_transactions" ,    0,              &tm_trans_6xx   },
 	{"inuse_transactions" ,  STAT_NO_RESET,  &tm_trans_inuse },
+	{"relay_time" ,          STAT_IS_HIST,   &tm_relay_time  },
 	{0,0,0}
 };
 
@@ -1194,7 +1196,8 @@ static inline int t_relay_inerr2scripterr(void)
 }
 
 
-static int w_t_relay( struct sip_msg  *p_msg , void *flags, struct proxy_l *proxy)
+static inline int _w_t_relay( struct sip_msg  *p_msg , void *flags,
+														struct proxy_l *proxy)
 {
 	struct proxy_l *p = NULL;
 	struct cell *t;
@@ -1271,6 +1274,21 @@ route_err:
 	return 0;
 }
 
+static int w_t_relay( struct sip_msg  *p_msg , void *flags, struct proxy_l *proxy)
+{
+	struct timeval start;
+	int ret;
+
+	if (!tm_enable_stats)
+		return _w_t_relay(p_msg, flags, proxy);
+
+	start_hist_timer(start);
+	ret = _w_t_relay(p_msg, flags, proxy);
+	stop_hist_timer(start, tm_relay_time);
+
+	return ret;
+}
+
 
 static int t_cancel_trans(struct cell *t, str *extra_hdrs)
 {
@@ -1045,6 +1045,12 @@ unsigned long get_number_of_users(void* foo)
  *		* clean up any in-memory expired contacts or empty records
  */
 int _synchronize_all_udomains(void)
+{
+	return synchronize_udomains(0, 1);
+}
+
+
+int synchronize_udomains(unsigned int part_idx, unsigned int part_max)
 {
 	int res = 0;
 	dlist_t* ptr;
@@ -1052,11 +1058,12 @@ int _synchronize_all_udomains(void)
 	get_act_time(); /* Get and save actual time */
 
 	if (cluster_mode == CM_SQL_ONLY) {
-		for( ptr=root ; ptr ; ptr=ptr->next)
-			res |= db_timer_udomain(ptr->d);
+		if (part_idx == 0)
+			for( ptr=root ; ptr ; ptr=ptr->next)
+				res |= db_timer_udomain(ptr->d);
 	} else if (have_mem_storage()) {
 		for( ptr=root ; ptr ; ptr=ptr->next)
-			res |= mem_timer_udomain(ptr->d);
+			res |= mem_timer_udomain(ptr->d, part_idx, part_max);
 	} /* TODO: add a form of cleanup here, or implement cache API TTLs */
 
 	return res;
@@ -1211,6 +1218,8 @@ int delete_ucontact_from_coords(udomain_t *d, ucontact_coords ct_coords,
 		run_ul_callbacks( UL_CONTACT_DELETE, c);
 	}
 
+	drop_lookup_cache(r);
+
 	if (st_delete_ucontact(c) > 0) {
 		if (sql_wmode == SQL_WRITE_THROUGH) {
 			if (db_delete_ucontact(c) < 0) {
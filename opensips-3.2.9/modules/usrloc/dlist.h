@@ -74,6 +74,13 @@ void free_all_udomains(void);
 int _synchronize_all_udomains(void);
 
 
+/*! \brief
+ * Same as above, but only for the hash slots of each domain
+ * where (slot % @part_max) == @part_idx
+ */
+int synchronize_udomains(unsigned int part_idx, unsigned int part_max);
+
+
 /*! \brief
  * Get contacts to all registered users
  */
@@ -27,11 +27,21 @@
 
 
 
+#include "../../mem/shm_mem.h"
 #include "hslot.h"
 
 int ul_locks_no=4;
 gen_lock_set_t* ul_locks=0;
 
+/* if enabled, each slot also indexes its records in an open-addressing
+ * table, so AoR lookups skip the string compares of the AVL map walk */
+int ul_aor_index=0;
+
+#define UL_IDX_MIN_SIZE 8
+/* the low bits of the hash already select the slot, so probe starting
+ * from the high ones */
+#define ul_idx_pos(_h, _size) ((((_h) >> 16) | ((_h) << 16)) & ((_size) - 1))
+
 /*! \brief
  * Initialize locks
  */
@@ -106,6 +116,9 @@ int init_slot(struct udomain* _d, hslot_t* _s, int n)
 {
 	_s->records = map_create( AVLMAP_SHARED | AVLMAP_NO_DUPLICATE);
 	_s->next_label = 0;
+	_s->idx = NULL;
+	_s->idx_size = 0;
+	_s->idx_used = 0;
 
 	if( _s->records == NULL )
 		return -1;
@@ -133,10 +146,123 @@ void free_value_urecord( void * val )
 void deinit_slot(hslot_t* _s)
 {
 	map_destroy(_s->records , free_value_urecord);
+	if (_s->idx) {
+		shm_free(_s->idx);
+		_s->idx = NULL;
+		_s->idx_size = _s->idx_used = 0;
+	}
 	_s->d = 0;
 }
 
 
+static inline void idx_put(ul_idx_entry_t *idx, unsigned int size,
+										unsigned int hash, struct urecord *r)
+{
+	unsigned int i;
+
+	for (i = ul_idx_pos(hash, size); idx[i].r; i = (i + 1) & (size - 1)) ;
+
+	idx[i].hash = hash;
+	idx[i].r = r;
+}
+
+
+/*! \brief
+ * (Re)build the slot index with @size buckets; done with the slot lock
+ * held, so each resize only costs the records of a single slot
+ */
+static int idx_resize(hslot_t* _s, unsigned int size)
+{
+	ul_idx_entry_t *idx;
+	unsigned int i;
+
+	idx = shm_malloc(size * sizeof *idx);
+	if (!idx) {
+		LM_ERR("oom\n");
+		return -1;
+	}
+	memset(idx, 0, size * sizeof *idx);
+
+	for (i = 0; i < _s->idx_size; i++)
+		if (_s->idx[i].r)
+			idx_put(idx, size, _s->idx[i].hash, _s->idx[i].r);
+
+	if (_s->idx)
+		shm_free(_s->idx);
+
+	_s->idx = idx;
+	_s->idx_size = size;
+	return 0;
+}
+
+
+static int idx_add(hslot_t* _s, struct urecord* _r)
+{
+	/* keep the load factor under 3/4 */
+	if (4 * (_s->idx_used + 1) > 3 * _s->idx_size &&
+	        idx_resize(_s, _s->idx_size ? 2 * _s->idx_size : UL_IDX_MIN_SIZE) < 0)
+		return -1;
+
+	idx_put(_s->idx, _s->idx_size, _r->aorhash, _r);
+	_s->idx_used++;
+	return 0;
+}
+
+
+static void idx_rem(hslot_t* _s, struct urecord* _r)
+{
+	unsigned int i, j, k, mask;
+
+	if (!_s->idx_used)
+		return;
+
+	mask = _s->idx_size - 1;
+	for (i = ul_idx_pos(_r->aorhash, _s->idx_size); _s->idx[i].r != _r;
+	        i = (i + 1) & mask)
+		if (!_s->idx[i].r)
+			return;
+
+	/* backward-shift deletion: no tombstones, so probe chains stay short */
+	for (j = (i + 1) & mask; _s->idx[j].r; j = (j + 1) & mask) {
+		k = ul_idx_pos(_s->idx[j].hash, _s->idx_size);
+		if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+			_s->idx[i] = _s->idx[j];
+			i = j;
+		}
+	}
+
+	_s->idx[i].r = NULL;
+	_s->idx[i].hash = 0;
+	_s->idx_used--;
+
+	if (_s->idx_size > UL_IDX_MIN_SIZE && 8 * _s->idx_used < _s->idx_size)
+		idx_resize(_s, _s->idx_size / 2);
+}
+
+
+struct urecord* slot_find(hslot_t* _s, const str* _aor, unsigned int _hash)
+{
+	struct urecord **r;
+	unsigned int i;
+
+	if (!ul_aor_index) {
+		r = (struct urecord **)map_find(_s->records, *_aor);
+		return r ? *r : NULL;
+	}
+
+	if (!_s->idx_used)
+		return NULL;
+
+	for (i = ul_idx_pos(_hash, _s->idx_size); _s->idx[i].r;
+	        i = (i + 1) & (_s->idx_size - 1))
+		if (_s->idx[i].hash == _hash && _s->idx[i].r->aor.len == _aor->len &&
+		        !memcmp(_s->idx[i].r->aor.s, _aor->s, _aor->len))
+			return _s->idx[i].r;
+
+	return NULL;
+}
+
+
 /*! \brief
  * Add an element to an slot's linked list
  */
@@ -153,6 +279,10 @@ int slot_add(hslot_t* _s, struct urecord* _r)
 		return -1;
 	}
 
+	if (ul_aor_index && idx_add(_s, _r) < 0) {
+		map_remove(_s->records, _r->aor);
+		return -1;
+	}
 
 	*dest = _r;
 
@@ -169,5 +299,7 @@ void slot_rem(hslot_t* _s, struct urecord* _r)
 {
 
 	map_remove( _s->records, _r->aor );
+	if (ul_aor_index)
+		idx_rem(_s, _r);
 	_r->slot = 0;
 }
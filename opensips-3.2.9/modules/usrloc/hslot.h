@@ -40,11 +40,25 @@ struct udomain;
 struct urecord;
 
 
+/*! \brief
+ * Open-addressing AoR index entry; the full AoR hash is kept next to the
+ * record pointer, so most probes are resolved without touching the record
+ */
+typedef struct ul_idx_entry {
+	unsigned int hash;
+	struct urecord* r;
+} ul_idx_entry_t;
+
+
 typedef struct hslot {
 
 	map_t records;
 	unsigned int next_label;
 
+	ul_idx_entry_t* idx;    /*!< optional AoR index (aor_index modparam) */
+	unsigned int idx_size;  /*!< number of index buckets (power of 2) */
+	unsigned int idx_used;  /*!< number of indexed records */
+
 	struct udomain* d;      /*!< Domain we belong to */
 #ifdef GEN_LOCK_T_PREFERED
 	gen_lock_t *lock;       /*!< Lock for hash entry - fastlock */
@@ -76,6 +90,14 @@ int slot_add(hslot_t* _s, struct urecord* _r);
  */
 void slot_rem(hslot_t* _s, struct urecord* _r);
 
+
+/*! \brief
+ * Look up an AoR in the slot, given its core_hash() value
+ */
+struct urecord* slot_find(hslot_t* _s, const str* _aor, unsigned int _hash);
+
+extern int ul_aor_index;
+
 int ul_init_locks();
 void ul_unlock_locks();
 void ul_destroy_locks();
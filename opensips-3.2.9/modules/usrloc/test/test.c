@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2026 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <tap.h>
+#include <sys/time.h>
+
+#include "../../../dprint.h"
+#include "../../../hash_func.h"
+#include "../../../mem/shm_mem.h"
+
+#include "../hslot.h"
+#include "../urecord.h"
+
+#define AOR_NO     50000
+#define SLOTS_NO   512
+#define LOOKUP_NO  (4 * AOR_NO)
+
+static str dom = str_init("location");
+
+
+static inline long long now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+
+/*
+ * Fill a hash table with AOR_NO records, look them all up a few times,
+ * then remove every other one, both with and without the AoR index
+ */
+static void test_aor_index(int use_index)
+{
+	static char buf[32];
+	hslot_t *slots;
+	urecord_t *r, **recs;
+	str aor;
+	unsigned int h;
+	long long start, took;
+	unsigned long idx_mem = 0;
+	int i, misses = 0, found = 0;
+
+	ul_aor_index = use_index;
+
+	slots = shm_malloc(SLOTS_NO * sizeof *slots);
+	recs = shm_malloc(AOR_NO * sizeof *recs);
+	if (!ok(slots && recs, "alloc test table"))
+		return;
+
+	for (i = 0; i < SLOTS_NO; i++)
+		init_slot(NULL, &slots[i], i);
+
+	for (i = 0; i < AOR_NO; i++) {
+		aor.s = buf;
+		aor.len = sprintf(buf, "user-%d@example.com", i);
+		if (new_urecord(&dom, &aor, &recs[i]) < 0 ||
+		        slot_add(&slots[recs[i]->aorhash & (SLOTS_NO - 1)], recs[i]) < 0)
+			break;
+	}
+	ok(i == AOR_NO, "insert %d AoRs (index: %d)", AOR_NO, use_index);
+
+	start = now_us();
+	for (i = 0; i < LOOKUP_NO; i++) {
+		aor = recs[i % AOR_NO]->aor;
+		h = core_hash(&aor, NULL, 0);
+		r = slot_find(&slots[h & (SLOTS_NO - 1)], &aor, h);
+		if (r != recs[i % AOR_NO])
+			misses++;
+	}
+	took = now_us() - start;
+	ok(misses == 0, "lookup all AoRs (index: %d)", use_index);
+
+	if (use_index)
+		for (i = 0; i < SLOTS_NO; i++)
+			idx_mem += slots[i].idx_size * sizeof(ul_idx_entry_t);
+
+	diag("index: %d, %d lookups in %lld us (%.1f ns/lookup), "
+	     "index overhead: %.1f bytes/AoR", use_index, LOOKUP_NO, took,
+	     took * 1000.0 / LOOKUP_NO, (double)idx_mem / AOR_NO);
+
+	for (i = 0; i < AOR_NO; i += 2)
+		slot_rem(recs[i]->slot, recs[i]);
+
+	for (i = 0; i < AOR_NO; i++) {
+		aor = recs[i]->aor;
+		h = core_hash(&aor, NULL, 0);
+		r = slot_find(&slots[h & (SLOTS_NO - 1)], &aor, h);
+		if ((i % 2 == 0 && r) || (i % 2 == 1 && r != recs[i]))
+			break;
+		if (r)
+			found++;
+	}
+	ok(i == AOR_NO && found == AOR_NO / 2,
+	   "lookups after removing half the AoRs (index: %d)", use_index);
+
+	for (i = 0; i < AOR_NO; i += 2)
+		free_urecord(recs[i]);
+
+	/* frees the remaining records */
+	for (i = 0; i < SLOTS_NO; i++)
+		deinit_slot(&slots[i]);
+
+	shm_free(recs);
+	shm_free(slots);
+	ul_aor_index = 0;
+}
+
+
+void mod_tests(void)
+{
+	test_aor_index(0);
+	test_aor_index(1);
+}
@@ -974,6 +974,7 @@ int update_ucontact(struct urecord* _r, ucontact_t* _c, ucontact_info_t* _ci,
 		LM_ERR("failed to update memory\n");
 		return -1;
 	}
+	drop_lookup_cache(_r);
 
 	if (skip_replication && _c->kv_storage)
 		restore_urecord_kv_store(_r, _c);
@@ -37,6 +37,7 @@
 #include "utime.h"
 #include "ul_cluster.h"
 #include "ul_callback.h"
+#include "ul_timer.h"
 #include "usrloc.h"
 
 
@@ -1135,7 +1136,8 @@ void mem_delete_urecord(udomain_t* _d, struct urecord* _r)
 }
 
 
-int mem_timer_udomain(udomain_t* _d)
+int mem_timer_udomain(udomain_t* _d, unsigned int part_idx,
+                      unsigned int part_max)
 {
 	struct urecord* ptr;
 	void ** dest;
@@ -1143,7 +1145,7 @@ int mem_timer_udomain(udomain_t* _d)
 	map_iterator_t it,prev;
 
 	cid_len = 0;
-	for(i=0; i<_d->size; i++)
+	for(i=part_idx; i<_d->size; i+=part_max)
 	{
 		lock_ulslot(_d, i);
 
@@ -1194,6 +1196,7 @@ int mem_timer_udomain(udomain_t* _d)
 	}
 
 	/* delete all the contacts left pending in the "to-be-delete" buffer */
+	update_stat(ul_flushed_contacts, cid_len);
 	if (cid_len &&
 	db_multiple_ucontact_delete(_d->name, cid_keys, cid_vals, cid_len) < 0) {
 		LM_ERR("failed to delete contacts from database\n");
@@ -1387,13 +1390,11 @@ int insert_urecord(udomain_t* _d, str* _aor, struct urecord** _r,
 static inline urecord_t *find_mem_urecord(udomain_t *_d, const str *_aor)
 {
 	unsigned int sl, aorhash;
-	urecord_t **r;
 
 	aorhash = core_hash(_aor, NULL, 0);
 	sl = aorhash & (_d->size - 1);
 
-	r = (urecord_t **)map_find(_d->table[sl].records, *_aor);
-	return r ? *r : NULL;
+	return slot_find(&_d->table[sl], _aor, aorhash);
 }
 
 /*! \brief
@@ -103,7 +103,8 @@ int db_timer_udomain(udomain_t* _d);
 /*! \brief
  * Timer handler for given domain
  */
-int mem_timer_udomain(udomain_t* _d);
+int mem_timer_udomain(udomain_t* _d, unsigned int part_idx,
+                      unsigned int part_max);
 
 /*! \brief
  * Insert record into domain
@@ -23,6 +23,7 @@
 #include "../../forward.h"
 
 #include "ul_cluster.h"
+#include "ul_snapshot.h"
 #include "ul_mod.h"
 #include "dlist.h"
 #include "kv_store.h"
@@ -67,12 +68,16 @@ int ul_init_cluster(void)
 
 /* packet sending */
 
-static inline void bin_push_urecord(bin_packet_t *packet, urecord_t *r)
+/* returns < 0 if anything did not fit into the packet */
+int bin_push_urecord(bin_packet_t *packet, urecord_t *r)
 {
-	bin_push_str(packet, r->domain);
-	bin_push_str(packet, &r->aor);
-	bin_push_int(packet, r->label);
-	bin_push_int(packet, r->next_clabel);
+	if (bin_push_str(packet, r->domain) < 0 ||
+	        bin_push_str(packet, &r->aor) < 0 ||
+	        bin_push_int(packet, r->label) < 0 ||
+	        bin_push_int(packet, r->next_clabel) < 0)
+		return -1;
+
+	return 0;
 }
 
 void replicate_urecord_insert(urecord_t *r)
@@ -154,20 +159,25 @@ error:
 	bin_free_packet(&packet);
 }
 
-void bin_push_ctmatch(bin_packet_t *packet, const struct ct_match *match)
+int bin_push_ctmatch(bin_packet_t *packet, const struct ct_match *match)
 {
 	str_list *param;
 	int np = 0;
 
-	bin_push_int(packet, match->mode);
+	if (bin_push_int(packet, match->mode) < 0)
+		return -1;
 	if (match->mode != CT_MATCH_PARAMS)
-		return;
+		return 0;
 
 	for (param = match->match_params; param; param = param->next, np++) {}
 
-	bin_push_int(packet, np);
+	if (bin_push_int(packet, np) < 0)
+		return -1;
 	for (param = match->match_params; param; param = param->next)
-		bin_push_str(packet, &param->s);
+		if (bin_push_str(packet, &param->s) < 0)
+			return -1;
+
+	return 0;
 }
 
 /* NOTICE: remember to free @match->match_params when done with it! */
@@ -198,49 +208,54 @@ void bin_pop_ctmatch(bin_packet_t *packet, struct ct_match *match)
 	}
 }
 
-void bin_push_contact(bin_packet_t *packet, urecord_t *r, ucontact_t *c,
+/* returns < 0 if anything did not fit into the packet */
+int bin_push_contact(bin_packet_t *packet, urecord_t *r, ucontact_t *c,
         const struct ct_match *match)
 {
 	str st;
+	int rc = 0;
 
-	bin_push_str(packet, r->domain);
-	bin_push_str(packet, &r->aor);
-	bin_push_str(packet, &c->c);
+	rc |= bin_push_str(packet, r->domain) < 0;
+	rc |= bin_push_str(packet, &r->aor) < 0;
+	rc |= bin_push_str(packet, &c->c) < 0;
 
 	st.s = (char *)&c->contact_id;
 	st.len = sizeof c->contact_id;
-	bin_push_str(packet, &st);
+	rc |= bin_push_str(packet, &st) < 0;
 
-	bin_push_str(packet, &c->callid);
-	bin_push_str(packet, &c->user_agent);
-	bin_push_str(packet, &c->path);
-	bin_push_str(packet, &c->attr);
-	bin_push_str(packet, &c->received);
-	bin_push_str(packet, &c->instance);
+	rc |= bin_push_str(packet, &c->callid) < 0;
+	rc |= bin_push_str(packet, &c->user_agent) < 0;
+	rc |= bin_push_str(packet, &c->path) < 0;
+	rc |= bin_push_str(packet, &c->attr) < 0;
+	rc |= bin_push_str(packet, &c->received) < 0;
+	rc |= bin_push_str(packet, &c->instance) < 0;
 
 	st.s = (char *) &c->expires;
 	st.len = sizeof c->expires;
-	bin_push_str(packet, &st);
+	rc |= bin_push_str(packet, &st) < 0;
 
 	st.s = (char *) &c->q;
 	st.len = sizeof c->q;
-	bin_push_str(packet, &st);
+	rc |= bin_push_str(packet, &st) < 0;
 
-	bin_push_str(packet, c->sock?get_socket_internal_name(c->sock):NULL);
-	bin_push_int(packet, c->cseq);
-	bin_push_int(packet, c->flags);
-	bin_push_int(packet, c->cflags);
-	bin_push_int(packet, c->methods);
+	rc |= bin_push_str(packet,
+	        c->sock?get_socket_internal_name(c->sock):NULL) < 0;
+	rc |= bin_push_int(packet, c->cseq) < 0;
+	rc |= bin_push_int(packet, c->flags) < 0;
+	rc |= bin_push_int(packet, c->cflags) < 0;
+	rc |= bin_push_int(packet, c->methods) < 0;
 
 	st.s   = (char *)&c->last_modified;
 	st.len = sizeof c->last_modified;
-	bin_push_str(packet, &st);
+	rc |= bin_push_str(packet, &st) < 0;
 
 	st = store_serialize(c->kv_storage);
-	bin_push_str(packet, &st);
+	rc |= bin_push_str(packet, &st) < 0;
 	store_free_buffer(&st);
 
-	bin_push_ctmatch(packet, match);
+	rc |= bin_push_ctmatch(packet, match) < 0;
+
+	return rc ? -1 : 0;
 }
 
 void replicate_ucontact_insert(urecord_t *r, str *contact, ucontact_t *c,
@@ -584,7 +599,7 @@ static int receive_ucontact_insert(bin_packet_t *packet)
 	else
 		bin_pop_ctmatch(packet, &cmatch);
 
-	if (skip_replicated_db_ops)
+	if (skip_replicated_db_ops && !ul_restoring)
 		ci.flags |= FL_MEM;
 
 	unpack_indexes(ci.contact_id, &_, &rlabel, &clabel);
@@ -654,6 +669,10 @@ static int receive_ucontact_insert(bin_packet_t *packet)
 			unlock_udomain(domain, &aor);
 			goto error;
 		}
+
+		/* keep the DB sync state the contact was snapshotted with */
+		if (ul_restoring)
+			contact->state = ul_restored_state;
 		break;
 	}
 
@@ -922,6 +941,30 @@ static int receive_sync_packet(bin_packet_t *packet)
 	return rc;
 }
 
+int receive_snapshot_packet(bin_packet_t *packet)
+{
+	int is_contact;
+	int rc = 0;
+
+	if (packet->type != UL_SNAPSHOT_PACKET) {
+		LM_ERR("invalid usrloc snapshot packet type: %d\n", packet->type);
+		return -1;
+	}
+
+	while (packet->front_pointer < packet->buffer.s + packet->buffer.len) {
+		bin_pop_int(packet, &is_contact);
+		if (is_contact) {
+			bin_pop_int(packet, &ul_restored_state);
+			if (receive_ucontact_insert(packet) != 0)
+				rc = -1;
+		} else
+			if (receive_urecord_insert(packet) != 0)
+				rc = -1;
+	}
+
+	return rc;
+}
+
 void receive_binary_packets(bin_packet_t *packet)
 {
 	int rc;
@@ -65,7 +65,12 @@ void replicate_ucontact_update(urecord_t *r, ucontact_t *ct,
 void replicate_ucontact_delete(urecord_t *r, ucontact_t *c,
         const struct ct_match *match);
 
+int bin_push_urecord(bin_packet_t *packet, urecord_t *r);
+int bin_push_contact(bin_packet_t *packet, urecord_t *r, ucontact_t *c,
+        const struct ct_match *match);
+
 void receive_binary_packets(bin_packet_t *packet);
+int receive_snapshot_packet(bin_packet_t *packet);
 void receive_cluster_event(enum clusterer_event ev, int node_id);
 
 #endif /* _USRLOC_CLUSTER_H_ */
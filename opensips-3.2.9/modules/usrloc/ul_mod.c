@@ -60,6 +60,7 @@
 #include "ul_evi.h"
 #include "ul_mi.h"
 #include "ul_callback.h"
+#include "ul_snapshot.h"
 #include "usrloc.h"
 
 #define CONTACTID_COL  "contact_id"
@@ -207,6 +208,10 @@ static param_export_t params[] = {
 	{"db_url",             STR_PARAM, &db_url.s          },
 	{"cachedb_url",        STR_PARAM, &cdb_url.s         },
 	{"timer_interval",     INT_PARAM, &timer_interval    },
+	{"timer_spread",       INT_PARAM, &timer_spread      },
+	{"snapshot_file",      STR_PARAM, &ul_snapshot_file.s   },
+	{"snapshot_interval",  INT_PARAM, &ul_snapshot_interval },
+	{"snapshot_max_age",   INT_PARAM, &ul_snapshot_max_age  },
 
 	/* runtime behavior selection */
 	{"db_mode",            INT_PARAM, &db_mode           }, /* bw-compat */
@@ -233,6 +238,7 @@ static param_export_t params[] = {
 	{"matching_mode",      INT_PARAM, &matching_mode     },
 	{"cseq_delay",         INT_PARAM, &cseq_delay        },
 	{"hash_size",          INT_PARAM, &ul_hash_size      },
+	{"aor_index",          INT_PARAM, &ul_aor_index      },
 	{"nat_bflag",          STR_PARAM, &nat_bflag_str     },
 	{"contact_refresh_timer",  INT_PARAM, &ct_refresh_timer },
 
@@ -248,6 +254,9 @@ static param_export_t params[] = {
 
 static stat_export_t mod_stats[] = {
 	{"registered_users" ,  STAT_IS_FUNC, (stat_var**)get_number_of_users  },
+	{"flushed_contacts" ,  0,            &ul_flushed_contacts             },
+	{"flush_latency_us" ,  STAT_NO_RESET, &ul_flush_latency               },
+	{"sync_queue_depth" ,  STAT_IS_FUNC, (stat_var**)get_sync_queue_depth },
 	{0,0,0}
 };
 
@@ -408,6 +417,11 @@ static void ul_rpc_data_load(int sender_id, void *unsused)
 {
 	dlist_t* ptr;
 
+	/* a snapshot taken at shutdown is way faster to load than the DB
+	 * table, while holding the same data */
+	if (ul_snapshot_restore(1) == 0)
+		return;
+
 	for( ptr=root ; ptr ; ptr=ptr->next) {
 		if (preload_udomain(ul_dbh, ptr->d) < 0) {
 			LM_ERR("failed to preload domain '%.*s'\n",
@@ -417,6 +431,12 @@ static void ul_rpc_data_load(int sender_id, void *unsused)
 	}
 }
 
+static void ul_rpc_snapshot_load(int sender_id, void *unsused)
+{
+	if (ul_snapshot_restore(0) != 0)
+		LM_INFO("no snapshot loaded, starting with an empty location\n");
+}
+
 int init_cachedb(void)
 {
 	if (!cdbf.init) {
@@ -441,6 +461,15 @@ static int child_init(int _rank)
 	    return -1;
 	}
 
+	/* without SQL preloading, the snapshot is the only local data source;
+	 * cluster sync (if any) will still bring in the newer data */
+	if (_rank==1 && ul_snapshot_file.s && rr_persist != RRP_LOAD_FROM_SQL &&
+	        have_mem_storage() &&
+	        ipc_send_rpc(process_no, ul_rpc_snapshot_load, NULL) < 0) {
+		LM_ERR("failed to fire RPC for snapshot load\n");
+		return -1;
+	}
+
 	if (!have_sql_con())
 		return 0;
 
@@ -513,6 +542,12 @@ static void destroy(void)
 		}
 	}
 
+	if (ul_snapshot_file.s && have_mem_storage()) {
+		ul_unlock_locks();
+		if (ul_snapshot_write(1) != 0)
+			LM_ERR("failed to save the usrloc snapshot\n");
+	}
+
 	if (cdbc)
 		cdbf.destroy(cdbc);
 	cdbc = NULL;
@@ -821,6 +856,8 @@ int ul_init_globals(void)
 	methods_col.len = strlen(methods_col.s);
 	sip_instance_col.len = strlen(sip_instance_col.s);
 	kv_store_col.len = strlen(kv_store_col.s);
+	if (ul_snapshot_file.s)
+		ul_snapshot_file.len = strlen(ul_snapshot_file.s);
 	attr_col.len = strlen(attr_col.s);
 	last_mod_col.len = strlen(last_mod_col.s);
 
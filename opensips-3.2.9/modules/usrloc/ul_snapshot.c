@@ -0,0 +1,432 @@
+/*
+ * Copyright (C) 2026 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*! \file
+ *  \brief USRLOC - on-disk snapshots of the in-memory location data
+ *  \ingroup usrloc
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "../../dprint.h"
+#include "../../mem/mem.h"
+#include "../../bin_interface.h"
+#include "../../crc.h"
+#include "../../ut.h"
+
+#include "ul_snapshot.h"
+#include "ul_cluster.h"
+#include "ul_mod.h"
+#include "dlist.h"
+
+str ul_snapshot_file;
+int ul_snapshot_interval;
+int ul_snapshot_max_age = 3600;
+
+/* set while restoring, so that the restored contacts are not written
+ * back to the DB as new ones */
+int ul_restoring;
+/* the DB sync state of the contact being restored */
+int ul_restored_state;
+
+/* start a new bin packet once the current one is half full, so that
+ * any regular contact still fits in the remaining space */
+#define UL_SNAPSHOT_PKT_FLUSH (BIN_MAX_BUF_LEN / 2)
+
+
+/* the packets filled up while a hash slot is locked, only written to the
+ * file once it is unlocked */
+struct snapshot_pkt {
+	str buf;
+	struct snapshot_pkt *next;
+};
+
+struct snapshot_pkts {
+	struct snapshot_pkt *first;
+	struct snapshot_pkt **last;
+};
+
+/* moves the content of @packet at the end of @pkts, @packet is reset */
+static int close_packet(bin_packet_t *packet, struct snapshot_pkts *pkts)
+{
+	struct snapshot_pkt *pkt;
+
+	pkt = pkg_malloc(sizeof *pkt);
+	if (!pkt) {
+		LM_ERR("oom\n");
+		return -1;
+	}
+
+	bin_get_buffer(packet, &pkt->buf);
+	pkt->next = NULL;
+	*pkts->last = pkt;
+	pkts->last = &pkt->next;
+
+	/* the buffer now belongs to @pkt */
+	packet->buffer.s = NULL;
+	if (bin_init(packet, &contact_repl_cap, UL_SNAPSHOT_PACKET,
+	             UL_BIN_VERSION, 0) != 0) {
+		LM_ERR("failed to init bin packet\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* writes (if @f is given) and frees all the packets of @pkts */
+static int write_packets(FILE *f, struct snapshot_pkts *pkts,
+                         unsigned long long *body_len)
+{
+	struct snapshot_pkt *pkt;
+	unsigned int crc;
+	int rc = 0;
+
+	while ((pkt = pkts->first)) {
+		pkts->first = pkt->next;
+
+		if (f && rc == 0) {
+			crc32_uint(&pkt->buf, &crc);
+			if (fwrite(&crc, sizeof crc, 1, f) != 1 ||
+			        fwrite(pkt->buf.s, pkt->buf.len, 1, f) != 1) {
+				LM_ERR("failed to write to snapshot file: %s\n",
+				       strerror(errno));
+				rc = -1;
+			} else {
+				*body_len += sizeof crc + pkt->buf.len;
+			}
+		}
+
+		pkg_free(pkt->buf.s);
+		pkg_free(pkt);
+	}
+
+	pkts->last = &pkts->first;
+	return rc;
+}
+
+
+int ul_snapshot_write(int clean)
+{
+	struct ct_match cmatch = {CT_MATCH_CONTACT_CALLID, NULL};
+	struct ul_snapshot_hdr hdr;
+	struct timeval start;
+	bin_packet_t packet;
+	struct snapshot_pkts pkts = {NULL, &pkts.first};
+	char *tmp_path;
+	FILE *f;
+	dlist_t *dl;
+	udomain_t *dom;
+	map_iterator_t it;
+	urecord_t *r;
+	ucontact_t *c;
+	void **p;
+	int i;
+
+	if (!ul_snapshot_file.s)
+		return 0;
+
+	gettimeofday(&start, NULL);
+
+	tmp_path = pkg_malloc(ul_snapshot_file.len + 5);
+	if (!tmp_path) {
+		LM_ERR("oom\n");
+		return -1;
+	}
+	sprintf(tmp_path, "%.*s.tmp", ul_snapshot_file.len, ul_snapshot_file.s);
+
+	f = fopen(tmp_path, "w");
+	if (!f) {
+		LM_ERR("failed to open %s: %s\n", tmp_path, strerror(errno));
+		pkg_free(tmp_path);
+		return -1;
+	}
+
+	memset(&hdr, 0, sizeof hdr);
+	memcpy(hdr.magic, UL_SNAPSHOT_MAGIC, sizeof hdr.magic);
+	hdr.version = UL_SNAPSHOT_VERSION;
+	hdr.bin_version = UL_BIN_VERSION;
+	hdr.created = (long long)time(NULL);
+	hdr.clean = clean;
+
+	/* the final header is written at the end */
+	if (fwrite(&hdr, sizeof hdr, 1, f) != 1) {
+		LM_ERR("failed to write to %s: %s\n", tmp_path, strerror(errno));
+		goto error_close;
+	}
+
+	if (bin_init(&packet, &contact_repl_cap, UL_SNAPSHOT_PACKET,
+	             UL_BIN_VERSION, 0) != 0) {
+		LM_ERR("failed to init bin packet\n");
+		goto error_close;
+	}
+
+	/* no disk I/O while holding the slot locks - the slot is serialized
+	 * in memory, then written */
+	for (dl = root; dl; dl = dl->next) {
+		dom = dl->d;
+		for (i = 0; i < dom->size; i++) {
+			lock_ulslot(dom, i);
+			for (map_first(dom->table[i].records, &it);
+			        iterator_is_valid(&it); iterator_next(&it)) {
+
+				p = iterator_val(&it);
+				if (!p)
+					goto error_unlock;
+				r = (urecord_t *)*p;
+
+				if (packet.buffer.len > UL_SNAPSHOT_PKT_FLUSH &&
+				        close_packet(&packet, &pkts) != 0)
+					goto error_unlock;
+
+				if (bin_push_int(&packet, 0) < 0 ||
+				        bin_push_urecord(&packet, r) < 0)
+					goto error_push;
+				hdr.records++;
+
+				for (c = r->contacts; c; c = c->next) {
+					if (packet.buffer.len > UL_SNAPSHOT_PKT_FLUSH &&
+					        close_packet(&packet, &pkts) != 0)
+						goto error_unlock;
+
+					if (bin_push_int(&packet, 1) < 0 ||
+					        bin_push_int(&packet, c->state) < 0 ||
+					        bin_push_contact(&packet, r, c, &cmatch) < 0)
+						goto error_push;
+					hdr.contacts++;
+				}
+			}
+			unlock_ulslot(dom, i);
+
+			if (write_packets(f, &pkts, &hdr.body_len) != 0)
+				goto error_free;
+		}
+	}
+
+	if (close_packet(&packet, &pkts) != 0 ||
+	        write_packets(f, &pkts, &hdr.body_len) != 0)
+		goto error_free;
+	bin_free_packet(&packet);
+
+	if (fseek(f, 0, SEEK_SET) != 0 || fwrite(&hdr, sizeof hdr, 1, f) != 1 ||
+	        fflush(f) != 0 || fsync(fileno(f)) != 0) {
+		LM_ERR("failed to finalize %s: %s\n", tmp_path, strerror(errno));
+		goto error_close;
+	}
+	fclose(f);
+
+	if (rename(tmp_path, ul_snapshot_file.s) != 0) {
+		LM_ERR("failed to rename %s: %s\n", tmp_path, strerror(errno));
+		unlink(tmp_path);
+		pkg_free(tmp_path);
+		return -1;
+	}
+
+	LM_INFO("saved %u AoRs, %u contacts to %s in %d ms\n", hdr.records,
+	        hdr.contacts, ul_snapshot_file.s, get_time_diff(&start) / 1000);
+
+	pkg_free(tmp_path);
+	return 0;
+
+error_push:
+	LM_ERR("AoR %.*s does not fit into a snapshot packet, dropping the "
+	       "snapshot\n", r->aor.len, r->aor.s);
+error_unlock:
+	unlock_ulslot(dom, i);
+error_free:
+	write_packets(NULL, &pkts, NULL);
+	bin_free_packet(&packet);
+error_close:
+	fclose(f);
+	unlink(tmp_path);
+	pkg_free(tmp_path);
+	return -1;
+}
+
+
+/*! \brief
+ * Walks the bin packets of the snapshot body, checking their framing and
+ * CRCs. If @load is set, also loads their content into memory.
+ */
+static int walk_snapshot(char *body, unsigned long long body_len, int load)
+{
+	bin_packet_t packet;
+	char *p, *end = body + body_len;
+	unsigned int crc, pkt_crc, len;
+	str buf;
+
+	for (p = body; p < end; p += sizeof crc + len) {
+		if (end - p < sizeof crc + MIN_BIN_PACKET_SIZE) {
+			LM_ERR("truncated snapshot packet at offset %ld\n",
+			       (long)(p - body));
+			return -1;
+		}
+
+		memcpy(&pkt_crc, p, sizeof pkt_crc);
+		memcpy(&len, p + sizeof crc + BIN_PACKET_MARKER_SIZE, sizeof len);
+
+		if (!is_valid_bin_packet(p + sizeof crc) || len < MIN_BIN_PACKET_SIZE
+		        || len > end - p - sizeof crc) {
+			LM_ERR("bad snapshot packet at offset %ld\n", (long)(p - body));
+			return -1;
+		}
+
+		if (!load) {
+			buf.s = p + sizeof crc;
+			buf.len = len;
+			crc32_uint(&buf, &crc);
+			if (crc != pkt_crc) {
+				LM_ERR("checksum mismatch for snapshot packet at offset %ld\n",
+				       (long)(p - body));
+				return -1;
+			}
+			continue;
+		}
+
+		bin_init_buffer(&packet, p + sizeof crc, len);
+		if (receive_snapshot_packet(&packet) != 0)
+			LM_ERR("failed to load some of the data at offset %ld\n",
+			       (long)(p - body));
+	}
+
+	return 0;
+}
+
+
+/* the loaded snapshot is no longer the last word on the location data:
+ * anything may change from now on, with or without a snapshot of it */
+static void mark_snapshot_loaded(void)
+{
+	unsigned int clean = 0;
+	int fd;
+
+	fd = open(ul_snapshot_file.s, O_WRONLY);
+	if (fd < 0 || pwrite(fd, &clean, sizeof clean,
+	        offsetof(struct ul_snapshot_hdr, clean)) != sizeof clean ||
+	        fsync(fd) != 0) {
+		LM_ERR("failed to mark %s as loaded: %s\n", ul_snapshot_file.s,
+		        strerror(errno));
+		/* do not let it be loaded over the DB data again */
+		if (unlink(ul_snapshot_file.s) != 0)
+			LM_ERR("failed to remove %s: %s\n", ul_snapshot_file.s,
+			        strerror(errno));
+	}
+
+	if (fd >= 0)
+		close(fd);
+}
+
+
+int ul_snapshot_restore(int need_clean)
+{
+	struct ul_snapshot_hdr *hdr;
+	struct timeval start;
+	struct stat st;
+	char *map;
+	int fd, rc = -1;
+
+	if (!ul_snapshot_file.s)
+		return -1;
+
+	gettimeofday(&start, NULL);
+
+	fd = open(ul_snapshot_file.s, O_RDONLY);
+	if (fd < 0) {
+		LM_INFO("no usable snapshot (%s: %s)\n", ul_snapshot_file.s,
+		        strerror(errno));
+		return -1;
+	}
+
+	if (fstat(fd, &st) != 0 || st.st_size < sizeof *hdr) {
+		LM_ERR("bad snapshot file %s\n", ul_snapshot_file.s);
+		close(fd);
+		return -1;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		LM_ERR("failed to mmap %s: %s\n", ul_snapshot_file.s, strerror(errno));
+		return -1;
+	}
+
+	hdr = (struct ul_snapshot_hdr *)map;
+	if (memcmp(hdr->magic, UL_SNAPSHOT_MAGIC, sizeof hdr->magic) ||
+	        hdr->version != UL_SNAPSHOT_VERSION ||
+	        hdr->bin_version != UL_BIN_VERSION) {
+		LM_WARN("snapshot %s has an unsupported format, ignoring\n",
+		        ul_snapshot_file.s);
+		goto out;
+	}
+
+	if (hdr->body_len != st.st_size - sizeof *hdr) {
+		LM_WARN("snapshot %s is incomplete, ignoring\n", ul_snapshot_file.s);
+		goto out;
+	}
+
+	if (ul_snapshot_max_age > 0 &&
+	        hdr->created + ul_snapshot_max_age < (long long)time(NULL)) {
+		LM_INFO("snapshot %s is older than %ds, ignoring\n",
+		        ul_snapshot_file.s, ul_snapshot_max_age);
+		goto out;
+	}
+
+	if (need_clean && !hdr->clean) {
+		LM_INFO("snapshot %s was not taken at shutdown or was already "
+		        "loaded, the DB may be newer, ignoring\n", ul_snapshot_file.s);
+		goto out;
+	}
+
+	/* check everything first - a bad file must not leave half the data in */
+	if (walk_snapshot(map + sizeof *hdr, hdr->body_len, 0) != 0) {
+		LM_WARN("snapshot %s is corrupted, ignoring\n", ul_snapshot_file.s);
+		goto out;
+	}
+
+	ul_restoring = 1;
+	walk_snapshot(map + sizeof *hdr, hdr->body_len, 1);
+	ul_restoring = 0;
+
+	if (hdr->clean)
+		mark_snapshot_loaded();
+
+	LM_INFO("restored %u AoRs, %u contacts from %s in %d ms\n",
+	        hdr->records, hdr->contacts, ul_snapshot_file.s,
+	        get_time_diff(&start) / 1000);
+	rc = 0;
+
+out:
+	munmap(map, st.st_size);
+	return rc;
+}
+
+
+void ul_snapshot_timer(unsigned int ticks, void *param)
+{
+	if (ul_snapshot_write(0) != 0)
+		LM_ERR("failed to write the usrloc snapshot\n");
+}
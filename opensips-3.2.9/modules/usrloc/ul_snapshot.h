@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2026 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*! \file
+ *  \brief USRLOC - on-disk snapshots of the in-memory location data
+ *  \ingroup usrloc
+ */
+
+#ifndef _USRLOC_SNAPSHOT_H_
+#define _USRLOC_SNAPSHOT_H_
+
+#include "../../timer.h"
+
+#define UL_SNAPSHOT_MAGIC    "OSULSNAP"
+#define UL_SNAPSHOT_VERSION  2
+
+/* bin packet type of the snapshot chunks (same payload as a sync chunk) */
+#define UL_SNAPSHOT_PACKET   200
+
+/*
+ * +--------+-----+------+------+------+----------------------+
+ * | header | CRC | bin packet  | CRC  | bin packet  | ...... |
+ * +--------+-----+------+------+------+----------------------+
+ *
+ * Each bin packet holds a series of sync-like chunks: an int telling if
+ * a contact or an AoR follows, then the AoR/contact data itself, exactly
+ * as pushed by the cluster sync. A contact is preceded by its DB sync
+ * state. The CRC is the crc32 of its bin packet.
+ */
+struct ul_snapshot_hdr {
+	char magic[8];
+	unsigned int version;       /* UL_SNAPSHOT_VERSION */
+	unsigned int bin_version;   /* UL_BIN_VERSION of the packed data */
+	long long created;          /* UNIX timestamp */
+	unsigned long long body_len;
+	unsigned int records;
+	unsigned int contacts;
+	unsigned int clean;         /* taken at shutdown, not yet loaded */
+};
+
+extern str ul_snapshot_file;
+extern int ul_snapshot_interval;
+extern int ul_snapshot_max_age;
+extern int ul_restoring;
+extern int ul_restored_state;
+
+/*! \brief
+ * Dump all the in-memory AoRs and contacts to the snapshot file
+ * \param clean set for the snapshot taken at shutdown, once nothing
+ *        may change the location data any more
+ */
+int ul_snapshot_write(int clean);
+
+/*! \brief
+ * Load the snapshot file into memory, if present and not stale.
+ * Nothing is loaded unless the whole file checks out.
+ * \param need_clean only load a snapshot taken at shutdown and not yet
+ *        loaded, i.e. one that no later DB write can be missing from
+ * \return 0 on success, -1 if the caller should fall back to DB/cluster sync
+ */
+int ul_snapshot_restore(int need_clean);
+
+timer_function ul_snapshot_timer;
+
+#endif /* _USRLOC_SNAPSHOT_H_ */
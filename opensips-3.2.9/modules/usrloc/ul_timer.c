@@ -22,14 +22,26 @@
 #include "../../locking.h"
 #include "../../lib/list.h"
 
+#include "../../ut.h"
 #include "ul_timer.h"
+#include "ul_mod.h"
 #include "ul_evi.h"
 #include "ul_mi.h"
 #include "dlist.h"
+#include "ul_snapshot.h"
 
 int timer_interval = 60;              /*!< Timer interval in seconds */
+int timer_spread;                     /*!< Spread the sync over the interval */
 int ct_refresh_timer;
 
+stat_var *ul_flushed_contacts;        /*!< contacts written to / deleted from DB */
+stat_var *ul_flush_latency;           /*!< duration of the last sync run (us) */
+unsigned int ul_sync_queued;          /*!< contacts found out of sync, this run */
+
+/* contacts found out of sync, as last seen by the timer in each slot part */
+static unsigned int *sync_queue;
+static unsigned int sync_parts = 1;
+
 static struct list_head *pending_refreshes;
 static gen_lock_t *ul_refresh_lock;
 
@@ -38,13 +50,38 @@ static void synchronize_all_udomains(unsigned int ticks, void* param);
 
 int ul_init_timers(void)
 {
-	/* cache -> DB timer */
-	if (register_timer("ul-timer", synchronize_all_udomains, 0, timer_interval,
-	                   TIMER_FLAG_DELAY_ON_DELAY) < 0) {
+	/* cache -> DB timer; if spread, each 1-second run only goes through
+	 * 1/timer_interval of the hash slots of each domain, so all the contacts
+	 * are still synced once per timer_interval, without the load spikes */
+	if (timer_spread && timer_interval > 1 && have_mem_storage()) {
+		if (register_timer("ul-timer", synchronize_all_udomains, 0, 1,
+		                   TIMER_FLAG_DELAY_ON_DELAY) < 0) {
+			LM_ERR("oom\n");
+			return -1;
+		}
+	} else if (register_timer("ul-timer", synchronize_all_udomains, 0,
+	                   timer_interval, TIMER_FLAG_DELAY_ON_DELAY) < 0) {
+		LM_ERR("oom\n");
+		return -1;
+	}
+
+	/* periodic snapshots, on top of the one taken at shutdown */
+	if (ul_snapshot_file.s && ul_snapshot_interval > 0 && have_mem_storage()
+	        && register_timer("ul-snapshot-timer", ul_snapshot_timer, 0,
+	                          ul_snapshot_interval, TIMER_FLAG_SKIP_ON_DELAY) < 0) {
 		LM_ERR("oom\n");
 		return -1;
 	}
 
+	if (timer_spread && timer_interval > 1 && have_mem_storage())
+		sync_parts = timer_interval;
+	sync_queue = shm_malloc(sync_parts * sizeof *sync_queue);
+	if (!sync_queue) {
+		LM_ERR("oom\n");
+		return -1;
+	}
+	memset(sync_queue, 0, sync_parts * sizeof *sync_queue);
+
 	pending_refreshes = shm_malloc(sizeof *pending_refreshes);
 	if (!pending_refreshes) {
 		LM_ERR("oom\n");
@@ -76,13 +113,55 @@ int ul_init_timers(void)
  */
 static void synchronize_all_udomains(unsigned int ticks, void* param)
 {
+	/* not derived from @ticks: with TIMER_FLAG_DELAY_ON_DELAY, a slow run
+	 * makes them jump and the skipped parts would wait for another whole
+	 * interval */
+	static unsigned int part;
+	struct timeval start;
+	int rc;
+
+	gettimeofday(&start, NULL);
+
+	ul_sync_queued = 0;
+
 	if (sync_lock)
 		lock_start_read(sync_lock);
-	if (_synchronize_all_udomains() != 0) {
+	if (sync_parts > 1)
+		rc = synchronize_udomains(part, sync_parts);
+	else
+		rc = _synchronize_all_udomains();
+	if (rc != 0) {
 		LM_ERR("synchronizing cache failed\n");
 	}
 	if (sync_lock)
 		lock_stop_read(sync_lock);
+
+	sync_queue[part] = ul_sync_queued;
+	part = (part + 1) % sync_parts;
+
+	/* not resettable, so only the last duration is kept by moving it by
+	 * the difference (this timer is its only writer) */
+	update_stat(ul_flush_latency, (long)get_time_diff(&start) -
+		(long)get_stat_val(ul_flush_latency));
+}
+
+
+/*! \brief
+ * Contacts waiting to be written to / deleted from the DB, as found by the
+ * last pass of the timer over each part of the hash tables
+ */
+unsigned long get_sync_queue_depth(void *foo)
+{
+	unsigned long depth = 0;
+	unsigned int i;
+
+	if (!sync_queue)
+		return 0;
+
+	for (i = 0; i < sync_parts; i++)
+		depth += sync_queue[i];
+
+	return depth;
 }
 
 
@@ -23,13 +23,20 @@
 #define __UL_TIMER_H__
 
 #include "../../timer.h"
+#include "../../statistics.h"
 
 #include "ucontact.h"
 
 extern int timer_interval;
+extern int timer_spread;
 extern int ct_refresh_timer;
 
+extern stat_var *ul_flushed_contacts;
+extern stat_var *ul_flush_latency;
+extern unsigned int ul_sync_queued;
+
 int ul_init_timers(void);
+unsigned long get_sync_queue_depth(void *foo);
 void start_refresh_timer(ucontact_t *ct);
 void stop_refresh_timer(ucontact_t *ct);
 
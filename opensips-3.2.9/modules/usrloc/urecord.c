@@ -51,6 +51,7 @@
 #include "dlist.h"
 #include "usrloc.h"
 #include "kv_store.h"
+#include "ul_snapshot.h"
 
 extern int max_contact_delete;
 extern db_key_t *cid_keys;
@@ -116,6 +117,7 @@ void free_urecord(urecord_t* _r)
 
 	shm_free_all(_r->remote_aors);
 	store_destroy(_r->kv_storage);
+	drop_lookup_cache(_r);
 
 	if (have_mem_storage() && !_r->is_static) {
 		if (_r->aor.s) shm_free(_r->aor.s);
@@ -154,6 +156,7 @@ ucontact_t* mem_insert_ucontact(urecord_t* _r, str* _c, ucontact_info_t* _ci)
 	}
 
 	if_update_stat( _r->slot, _r->slot->d->contacts, 1);
+	drop_lookup_cache(_r);
 
 	if (c->kv_storage)
 		restore_urecord_kv_store(_r, c);
@@ -199,6 +202,7 @@ void mem_remove_ucontact(urecord_t* _r, ucontact_t* _c)
 	int_str_t **rstore;
 
 	stop_refresh_timer(_c);
+	drop_lookup_cache(_r);
 
 	if (_c->prev) {
 		_c->prev->next = _c->next;
@@ -343,8 +347,10 @@ static inline int wb_timer(urecord_t* _r,query_list_t **ins_list)
 			/* Should we remove the contact from the database ? */
 			if (cid_vals && st_expired_ucontact(t) == 1
 			        && !(t->flags & FL_MEM)) {
+				ul_sync_queued++;
 				VAL_BIGINT(cid_vals+cid_len) = t->contact_id;
 				if ((++cid_len) == max_contact_delete) {
+					update_stat(ul_flushed_contacts, cid_len);
 					if (db_multiple_ucontact_delete(_r->domain, cid_keys,
 												cid_vals, cid_len) < 0) {
 						LM_ERR("failed to delete contacts from database\n");
@@ -372,6 +378,8 @@ static inline int wb_timer(urecord_t* _r,query_list_t **ins_list)
 				break;
 
 			case 1: /* insert */
+				ul_sync_queued++;
+				update_stat(ul_flushed_contacts, 1);
 				if (db_insert_ucontact(ptr,ins_list,0) < 0) {
 					LM_ERR("inserting contact into database failed\n");
 					ptr->state = old_state;
@@ -381,6 +389,8 @@ static inline int wb_timer(urecord_t* _r,query_list_t **ins_list)
 				break;
 
 			case 2: /* update */
+				ul_sync_queued++;
+				update_stat(ul_flushed_contacts, 1);
 				if (db_update_ucontact(ptr) < 0) {
 					LM_ERR("updating contact in db failed\n");
 					ptr->state = old_state;
@@ -886,7 +896,7 @@ int insert_ucontact(urecord_t* _r, str* _contact, ucontact_info_t* _ci,
 	if (!first_contact && exists_ulcb_type(UL_AOR_UPDATE))
 		run_ul_callbacks(UL_AOR_UPDATE, _r);
 
-	if (sql_wmode == SQL_WRITE_THROUGH) {
+	if (sql_wmode == SQL_WRITE_THROUGH && !ul_restoring) {
 		if (persist_urecord_kv_store(_r) != 0)
 			LM_DBG("failed to persist latest urecord K/V storage\n");
 
@@ -918,6 +928,10 @@ int delete_ucontact(urecord_t* _r, struct ucontact* _c,
 
 	LM_DBG("deleting contact '%.*s'\n", _c->c.len, _c->c.s);
 
+	/* in write-back mode, the contact may only be marked as expired and
+	 * left in place for the timer, so do not keep it in the branch set */
+	drop_lookup_cache(_r);
+
 	if (st_delete_ucontact(_c) > 0) {
 		if (sql_wmode == SQL_WRITE_THROUGH) {
 			if (db_delete_ucontact(_c) < 0) {
@@ -37,6 +37,7 @@
 
 #include "../../map.h"
 #include "../../str.h"
+#include "../../mem/shm_mem.h"
 #include "../../qvalue.h"
 #include "../../str_list.h"
 #include "../../db/db_insertq.h"
@@ -67,9 +68,22 @@ typedef struct urecord {
 	int is_static;
 
 	map_t kv_storage;              /*!< data attached by API subscribers >*/
+
+	void *lookup_cache;            /*!< registrar lookup() branch set, a
+	                                * single shm chunk. Dropped on any
+	                                * change of the contact list */
 } urecord_t;
 
 
+static inline void drop_lookup_cache(urecord_t *_r)
+{
+	if (_r->lookup_cache) {
+		shm_free(_r->lookup_cache);
+		_r->lookup_cache = NULL;
+	}
+}
+
+
 /* Create a new record */
 int new_urecord(str* _dom, str* _aor, urecord_t** _r);
 
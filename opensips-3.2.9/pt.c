@@ -26,6 +26,7 @@
 #include "net/net_tcp.h"
 #include "net/net_udp.h"
 #include "db/db_insertq.h"
+#include "evi/evi_dispatch.h"
 #include "sr_module.h"
 #include "dprint.h"
 #include "pt.h"
@@ -96,6 +97,12 @@ int init_multi_proc_support(void)
 		return -1;
 	}
 
+	/* give each possible process its own part of the histograms */
+	if (init_hist_stats( counted_max_processes ) != 0) {
+		LM_ERR("failed to init the histograms\n");
+		return -1;
+	}
+
 	/* create the IPC pipes for all possible procs */
 	if (create_ipc_pipes( counted_max_processes )<0) {
 		LM_ERR("failed to create IPC pipes, aborting\n");
@@ -388,6 +395,12 @@ int count_child_processes(void)
 	/* attendent */
 	proc_no++;
 
+	/* DB writer for the insert queues */
+	proc_no += ql_count_processes();
+
+	/* event dispatchers of the transports */
+	proc_no += evi_dispatch_count_processes();
+
 	/* count the processes requested by modules */
 	proc_no += count_module_procs(0);
 
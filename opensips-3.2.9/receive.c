@@ -169,6 +169,8 @@ int receive_msg(char* buf, unsigned int len, struct receive_info* rcv_info,
 	}
 	LM_DBG("After parse_msg...\n");
 
+	/* always timed, for the processing time histogram */
+	start_hist_timer(start);
 	start_expire_timer(start,execmsgthreshold);
 	/* jumpt to parse_error_reset (not to parse_error) while
 	 * start_expire_timer() is still on */
@@ -290,6 +292,7 @@ end:
 
 	__stop_expire_timer( start, execmsgthreshold, "msg processing",
 		msg->buf, msg->len, 0, slow_msgs);
+	stop_hist_timer(start, msg_proc_time);
 	reset_longest_action_list(execmsgthreshold);
 
 	/* free possible loaded avps -bogdan */
@@ -53,6 +53,27 @@
 fetch_dns_cache_f *dnscache_fetch_func=NULL;
 put_dns_cache_f *dnscache_put_func=NULL;
 
+/* when set, the lookups are only answered from the DNS cache - the first
+ * record missing from the cache is saved and no query is sent */
+int dns_cache_only=0;
+int dns_cache_miss_type=0;
+char dns_cache_miss_name[MAX_DNS_NAME];
+
+static inline void dns_cache_miss(char *name, int type)
+{
+	int len;
+
+	if (dns_cache_miss_type)
+		return;
+
+	len = strlen(name);
+	if (len >= MAX_DNS_NAME)
+		len = MAX_DNS_NAME - 1;
+	memcpy(dns_cache_miss_name, name, len);
+	dns_cache_miss_name[len] = 0;
+	dns_cache_miss_type = type;
+}
+
 /* stuff related to DNS failover */
 #define DNS_NODE_SRV   1
 #define DNS_NODE_A     2
@@ -393,20 +414,46 @@ int get_dns_answer(union dns_query *answer,int anslen,char *qname,int qtype,int
 	return 0;
 }
 
+/*! \brief parses the answer of an A / AAAA query and stores it in the cache
+ * \param size - the length of the answer, negative if the query failed
+ * \return the static hostent holding the addresses or NULL on error */
+struct hostent* parse_he_answer(char *name, int af, union dns_query *answer,
+																int size)
+{
+	int type = af==AF_INET ? T_A : T_AAAA;
+	int min_ttl = INT_MAX;
+
+	global_he.h_addrtype=af;
+	global_he.h_length=af==AF_INET ? 4 : 16;
+
+	if (size < 0) {
+		LM_DBG("Domain name not found\n");
+		if (dnscache_put_func(name,type,NULL,0,1,0) < 0)
+			LM_ERR("Failed to store %s - %d in cache\n",name,af);
+		return NULL;
+	}
+
+	if (get_dns_answer(answer,size,name,type,&min_ttl) < 0) {
+		LM_ERR("Failed to get dns answer\n");
+		return NULL;
+	}
+
+	if (dnscache_put_func(name,type,&global_he,-1,0,min_ttl) < 0)
+		LM_ERR("Failed to store %s - %d in cache\n",name,af);
+	return &global_he;
+}
+
 struct hostent* own_gethostbyname2(char *name,int af)
 {
 	int size,type;
 	struct hostent *cached_he;
 	static union dns_query buff;
-	int min_ttl = INT_MAX;
 
 	switch (af) {
 		case AF_INET:
-			size=4;
 			type=T_A;
 			break;
 		case AF_INET6:
-			size=16;
 			type=T_AAAA;
 			break;
 		default:
@@ -414,7 +461,7 @@ struct hostent* own_gethostbyname2(char *name,int af)
 			return NULL;
 	}
 
-	cached_he = (struct hostent *)dnscache_fetch_func(name,af==AF_INET?T_A:T_AAAA,0);
+	cached_he = (struct hostent *)dnscache_fetch_func(name,type,0);
 	if (cached_he == NULL) {
 		LM_DBG("not found in cache or other internal error\n");
 		goto query;
@@ -427,25 +474,13 @@ struct hostent* own_gethostbyname2(char *name,int af)
 	}
 
 query:
-	global_he.h_addrtype=af;
-	global_he.h_length=size;
-
-	size=res_search(name, C_IN, type, buff.buff, sizeof(buff));
-	if (size < 0) {
-		LM_DBG("Domain name not found\n");
-		if (dnscache_put_func(name,af==AF_INET?T_A:T_AAAA,NULL,0,1,0) < 0)
-			LM_ERR("Failed to store %s - %d in cache\n",name,af);
-		return NULL;
-	}
-
-	if (get_dns_answer(&buff,size,name,type,&min_ttl) < 0) {
-		LM_ERR("Failed to get dns answer\n");
+	if (dns_cache_only) {
+		dns_cache_miss(name, type);
 		return NULL;
 	}
 
-	if (dnscache_put_func(name,af==AF_INET?T_A:T_AAAA,&global_he,-1,0,min_ttl) < 0)
-		LM_ERR("Failed to store %s - %d in cache\n",name,af);
-	return &global_he;
+	size=res_search(name, C_IN, type, buff.buff, sizeof(buff));
+	return parse_he_answer(name, af, &buff, size);
 }
 
 inline struct hostent* resolvehost(char* name, int no_ip_test)
@@ -1044,16 +1079,16 @@ void free_rdata_list(struct rdata* head)
 
 
 
-/*! \brief gets the DNS records for name:type
+/*! \brief parses the answer of a name:type query and stores it in the cache
+ * \param size - the length of the answer, negative if the query failed
  * \return A dyn. alloc'ed struct rdata linked list with the parsed responses
  * or 0 on error
  * \note see rfc1035 for the query/response format */
-struct rdata* get_record(char* name, int type)
+struct rdata* parse_record_answer(char* name, int type,
+									union dns_query *answer, int size)
 {
-	int size;
 	int qno, answers_no;
 	int r;
-	static union dns_query buff;
 	unsigned char* p;
 /*	unsigned char* t;
 	int ans_len;
@@ -1073,29 +1108,8 @@ struct rdata* get_record(char* name, int type)
 	struct naptr_rdata* naptr_rd;
 	struct txt_rdata* txt_rd;
 	struct ebl_rdata* ebl_rd;
-	struct timeval start;
 	int rdata_buf_len=0;
 
-	if (dnscache_fetch_func != NULL) {
-		head = (struct rdata *)dnscache_fetch_func(name,type,0);
-		if (head == NULL) {
-			LM_DBG("not found in cache or other internal error\n");
-			goto query;
-		} else if (head == (void *)-1) {
-			LM_DBG("previously failed query\n");
-			goto not_found;
-		} else {
-			LM_DBG("cache hit for %s - %d\n",name,type);
-			return head;
-		}
-	}
-
-query:
-	start_expire_timer(start,execdnsthreshold);
-	size=res_search(name, C_IN, type, buff.buff, sizeof(buff));
-	_stop_expire_timer(start, execdnsthreshold, "dns",
-	            name, strlen(name), 0, dns_slow_queries, dns_total_queries);
-
 	if (size<0) {
 		LM_DBG("lookup(%s, %d) failed\n", name, type);
 		if (dnscache_put_func != NULL) {
@@ -1104,14 +1118,14 @@ query:
 		}
 		goto not_found;
 	}
-	else if ((unsigned int)size > sizeof(buff)) size=sizeof(buff);
+	else if ((unsigned int)size > sizeof(*answer)) size=sizeof(*answer);
 	head=rd=0;
 	last=crt=&head;
 
-	p=buff.buff+DNS_HDR_SIZE;
-	end=buff.buff+size;
+	p=answer->buff+DNS_HDR_SIZE;
+	end=answer->buff+size;
 	if (p>=end) goto error_boundary;
-	qno=ntohs((unsigned short)buff.hdr.qdcount);
+	qno=ntohs((unsigned short)answer->hdr.qdcount);
 
 	for (r=0; r<qno; r++){
 		/* skip the name of the question */
@@ -1129,7 +1143,7 @@ query:
 			goto error;
 		}
 	};
-	answers_no=ntohs((unsigned short)buff.hdr.ancount);
+	answers_no=ntohs((unsigned short)answer->hdr.ancount);
 	/*ans_len=ANS_SIZE;
 	t=answer;*/
 	for (r=0; (r<answers_no) && (p<end); r++){
@@ -1139,7 +1153,7 @@ query:
 			goto error;
 		}
 		/*
-		skip=dn_expand(buff.buff, end, p, t, ans_len);
+		skip=dn_expand(answer->buff, end, p, t, ans_len);
 		p+=skip;
 		*/
 		/* check if enough space is left for type, class, ttl & size */
@@ -1185,7 +1199,7 @@ query:
 		rd->next=0;
 		switch(rtype){
 			case T_SRV:
-				srv_rd= dns_srv_parser(buff.buff, end, p);
+				srv_rd= dns_srv_parser(answer->buff, end, p);
 				if (srv_rd==0) goto error_parse;
 				if (dnscache_put_func)
 					rdata_buf_len+=4*sizeof(unsigned short) +
@@ -1226,7 +1240,7 @@ query:
 				last=&(rd->next);
 				break;
 			case T_CNAME:
-				rd->rdata=(void*) dns_cname_parser(buff.buff, end, p);
+				rd->rdata=(void*) dns_cname_parser(answer->buff, end, p);
 				if(rd->rdata==0) goto error_parse;
 				if (dnscache_put_func)
 					rdata_buf_len+=
@@ -1236,7 +1250,7 @@ query:
 				last=&(rd->next);
 				break;
 			case T_NAPTR:
-				naptr_rd = dns_naptr_parser(buff.buff,end,p);
+				naptr_rd = dns_naptr_parser(answer->buff,end,p);
 				rd->rdata=(void*) naptr_rd;
 				if(rd->rdata==0) goto error_parse;
 				if (dnscache_put_func)
@@ -1248,7 +1262,7 @@ query:
 				last=&(rd->next);
 				break;
 			case T_TXT:
-				txt_rd = dns_txt_parser(buff.buff, end, p);
+				txt_rd = dns_txt_parser(answer->buff, end, p);
 				rd->rdata=(void*) txt_rd;
 				if(rd->rdata==0) goto error_parse;
 				if (dnscache_put_func)
@@ -1257,7 +1271,7 @@ query:
 				last=&(rd->next);
 				break;
 			case T_EBL:
-				ebl_rd = dns_ebl_parser(buff.buff, end, p);
+				ebl_rd = dns_ebl_parser(answer->buff, end, p);
 				rd->rdata=(void*) ebl_rd;
 				if(rd->rdata==0) goto error_parse;
 				if (dnscache_put_func)
@@ -1301,6 +1315,47 @@ not_found:
 
 
 
+/*! \brief gets the DNS records for name:type
+ * \return A dyn. alloc'ed struct rdata linked list with the parsed responses
+ * or 0 on error
+ * \note see rfc1035 for the query/response format */
+struct rdata* get_record(char* name, int type)
+{
+	int size;
+	static union dns_query buff;
+	struct rdata* head;
+	struct timeval start;
+
+	if (dnscache_fetch_func != NULL) {
+		head = (struct rdata *)dnscache_fetch_func(name,type,0);
+		if (head == NULL) {
+			LM_DBG("not found in cache or other internal error\n");
+			goto query;
+		} else if (head == (void *)-1) {
+			LM_DBG("previously failed query\n");
+			return 0;
+		} else {
+			LM_DBG("cache hit for %s - %d\n",name,type);
+			return head;
+		}
+	}
+
+query:
+	if (dns_cache_only) {
+		dns_cache_miss(name, type);
+		return 0;
+	}
+
+	start_expire_timer(start,execdnsthreshold);
+	size=res_search(name, C_IN, type, buff.buff, sizeof(buff));
+	_stop_expire_timer(start, execdnsthreshold, "dns",
+	            name, strlen(name), 0, dns_slow_queries, dns_total_queries);
+
+	return parse_record_answer(name, type, &buff, size);
+}
+
+
+
 static inline int get_naptr_proto(struct naptr_rdata *n)
 {
 	if (n->services[3]=='s' || n->services[3]=='S' )
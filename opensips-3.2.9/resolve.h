@@ -67,6 +67,12 @@ typedef int (put_dns_cache_f)(char *name,int r_type,void *record,int rdata_len,
 extern fetch_dns_cache_f *dnscache_fetch_func;
 extern put_dns_cache_f *dnscache_put_func;
 
+/*! \brief cache-only lookups - the first name:type missing from the cache
+ * is saved in dns_cache_miss_name / dns_cache_miss_type (if not yet set) */
+extern int dns_cache_only;
+extern int dns_cache_miss_type;
+extern char dns_cache_miss_name[];
+
 /*! \brief query union*/
 union dns_query{
 	HEADER hdr;
@@ -151,6 +157,10 @@ struct dns_node {
 
 
 struct rdata* get_record(char* name, int type);
+struct rdata* parse_record_answer(char* name, int type,
+									union dns_query *answer, int size);
+struct hostent* parse_he_answer(char *name, int af, union dns_query *answer,
+																int size);
 void free_rdata_list(struct rdata* head);
 
 
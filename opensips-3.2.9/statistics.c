@@ -58,6 +58,30 @@
 static stats_collector *collector = NULL;
 static int stats_ready;
 
+/* each process only writes its own part of a histogram, so the writes
+ * need no locking; the parts are only merged when read */
+struct stat_hist_shard {
+	unsigned long sum;
+	unsigned long buckets[STAT_HIST_BUCKETS];
+};
+
+struct stat_hist {
+	struct stat_hist_shard *shards;
+	int procs;
+	struct stat_hist *next;
+};
+
+/* the histograms waiting for the processes to be counted */
+static struct stat_hist *hists;
+static int hist_procs;
+
+static void free_stat_hist(struct stat_hist *h)
+{
+	if (h->shards)
+		shm_free(h->shards);
+	shm_free(h);
+}
+
 static mi_response_t *mi_get_stats(const mi_params_t *params,
 								struct mi_handler *async_hdl);
 static mi_response_t *w_mi_list_stats(const mi_params_t *params,
@@ -351,6 +375,8 @@ void destroy_stats_collector(void)
 				stat = stat->hnext;
 				if ((tmp_stat->flags&STAT_IS_FUNC)==0 && tmp_stat->u.val && !(tmp_stat->flags&STAT_NOT_ALLOCATED))
 					shm_free(tmp_stat->u.val);
+				if (tmp_stat->flags&STAT_IS_HIST)
+					free_stat_hist(tmp_stat->context);
 				if ( (tmp_stat->flags&STAT_SHM_NAME) && tmp_stat->name.s)
 					shm_free(tmp_stat->name.s);
 				if (!(tmp_stat->flags&STAT_NOT_ALLOCATED))
@@ -362,6 +388,8 @@ void destroy_stats_collector(void)
 				stat = stat->hnext;
 				if ((tmp_stat->flags&STAT_IS_FUNC)==0 && tmp_stat->u.val && !(tmp_stat->flags&STAT_NOT_ALLOCATED))
 					shm_free(tmp_stat->u.val);
+				if (tmp_stat->flags&STAT_IS_HIST)
+					free_stat_hist(tmp_stat->context);
 				if ( (tmp_stat->flags&STAT_SHM_NAME) && tmp_stat->name.s)
 					shm_free(tmp_stat->name.s);
 				if (!(tmp_stat->flags&STAT_NOT_ALLOCATED))
@@ -402,6 +430,170 @@ int stats_are_ready(void)
 
 /********************* Create/Register STATS functions ***********************/
 
+static int alloc_hist_shards(struct stat_hist *h, int procs_no)
+{
+	h->shards = shm_malloc(procs_no * sizeof *h->shards);
+	if (!h->shards) {
+		LM_ERR("no more shm memory\n");
+		return -1;
+	}
+	memset(h->shards, 0, procs_no * sizeof *h->shards);
+	h->procs = procs_no;
+
+	return 0;
+}
+
+static struct stat_hist *new_stat_hist(void)
+{
+	struct stat_hist *h;
+
+	h = shm_malloc(sizeof *h);
+	if (!h) {
+		LM_ERR("no more shm memory\n");
+		return NULL;
+	}
+	memset(h, 0, sizeof *h);
+
+	if (hist_procs) {
+		if (alloc_hist_shards(h, hist_procs) < 0) {
+			shm_free(h);
+			return NULL;
+		}
+	} else {
+		h->next = hists;
+		hists = h;
+	}
+
+	return h;
+}
+
+int init_hist_stats(int procs_no)
+{
+	struct stat_hist *h;
+
+	for (h = hists; h; h = h->next)
+		if (alloc_hist_shards(h, procs_no) < 0)
+			return -1;
+
+	hists = NULL;
+	hist_procs = procs_no;
+	return 0;
+}
+
+static inline int stat_hist_bucket(unsigned long val)
+{
+	int msb;
+
+	if (val < STAT_HIST_SUB)
+		return val;
+
+	msb = 8 * sizeof val - 1 - __builtin_clzl(val);
+	if (msb >= STAT_HIST_MAX_BITS)
+		return STAT_HIST_BUCKETS - 1;
+
+	return (msb - STAT_HIST_SUB_BITS + 1) * STAT_HIST_SUB +
+		((val >> (msb - STAT_HIST_SUB_BITS)) & (STAT_HIST_SUB - 1));
+}
+
+unsigned long stat_hist_bucket_max(int idx)
+{
+	int msb;
+
+	if (idx < STAT_HIST_SUB)
+		return idx;
+	if (idx >= STAT_HIST_BUCKETS - 1)
+		return ~0UL;
+
+	msb = idx / STAT_HIST_SUB + STAT_HIST_SUB_BITS - 1;
+	return ((unsigned long)(STAT_HIST_SUB + idx % STAT_HIST_SUB + 1) <<
+		(msb - STAT_HIST_SUB_BITS)) - 1;
+}
+
+void update_hist_stat(stat_var *var, unsigned long val)
+{
+	struct stat_hist *h = (struct stat_hist *)var->context;
+	struct stat_hist_shard *sh;
+	int idx;
+
+	/* not yet forked, nothing to record */
+	if (!h->shards || process_no >= h->procs)
+		return;
+
+	sh = &h->shards[process_no];
+	idx = stat_hist_bucket(val);
+
+	/* single writer - the atomics only keep the readers from tearing */
+	__atomic_store_n(&sh->buckets[idx], sh->buckets[idx] + 1,
+		__ATOMIC_RELAXED);
+	__atomic_store_n(&sh->sum, sh->sum + val, __ATOMIC_RELAXED);
+}
+
+void update_hist_stat_time(stat_var *var, struct timeval *begin)
+{
+	int usdiff = get_time_diff(begin);
+
+	/* the wall clock may go back */
+	update_hist_stat(var, usdiff > 0 ? usdiff : 0);
+}
+
+int get_stat_hist_val(stat_var *var, stat_hist_val *hv)
+{
+	struct stat_hist *h = (struct stat_hist *)var->context;
+	struct stat_hist_shard *sh;
+	int i, p;
+
+	memset(hv, 0, sizeof *hv);
+
+	if (!(var->flags & STAT_IS_HIST))
+		return -1;
+
+	for (p = 0; h->shards && p < h->procs; p++) {
+		sh = &h->shards[p];
+		for (i = 0; i < STAT_HIST_BUCKETS; i++)
+			hv->buckets[i] += __atomic_load_n(&sh->buckets[i],
+				__ATOMIC_RELAXED);
+		hv->sum += __atomic_load_n(&sh->sum, __ATOMIC_RELAXED);
+	}
+
+	/* counted from the buckets, so it always matches them */
+	for (i = 0; i < STAT_HIST_BUCKETS; i++)
+		hv->count += hv->buckets[i];
+
+	return 0;
+}
+
+unsigned long stat_hist_percentile(stat_hist_val *hv, int percent)
+{
+	unsigned long rank, n = 0;
+	int i;
+
+	if (!hv->count)
+		return 0;
+
+	rank = (hv->count * percent + 99) / 100;
+	for (i = 0; i < STAT_HIST_BUCKETS - 1; i++) {
+		n += hv->buckets[i];
+		if (n >= rank)
+			return stat_hist_bucket_max(i);
+	}
+
+	/* beyond the last bucket, the best we know */
+	return stat_hist_bucket_max(STAT_HIST_BUCKETS - 2);
+}
+
+static unsigned long stat_hist_count(void *ctx)
+{
+	struct stat_hist *h = (struct stat_hist *)ctx;
+	unsigned long n = 0;
+	int i, p;
+
+	for (p = 0; h->shards && p < h->procs; p++)
+		for (i = 0; i < STAT_HIST_BUCKETS; i++)
+			n += __atomic_load_n(&h->shards[p].buckets[i], __ATOMIC_RELAXED);
+
+	return n;
+}
+
 /**
  * Note: certain statistics (e.g. shm statistics) require different handling,
  * hence the <unsafe> parameter
@@ -438,7 +630,15 @@ static int __register_stat(str *module, str *name, stat_var **pvar,
 	}
 	memset( stat, 0, sizeof(stat_var) );
 
-	if ( (flags&STAT_IS_FUNC)==0 ) {
+	if (flags&STAT_IS_HIST) {
+		/* read as a function returning the number of values */
+		flags |= STAT_IS_FUNC;
+		ctx = new_stat_hist();
+		if (!ctx)
+			goto error1;
+		stat->u.f = stat_hist_count;
+		*pvar = stat;
+	} else if ( (flags&STAT_IS_FUNC)==0 ) {
 		stat->u.val = unsafe ?
 			(stat_val*)shm_malloc_unsafe(sizeof(stat_val)) :
 			(stat_val*)shm_malloc(sizeof(stat_val));
@@ -552,6 +752,9 @@ do_register:
 	return 0;
 
 error2:
+	/* the histogram is left to the shm cleanup */
+	if (flags&STAT_IS_HIST)
+		*pvar = 0;
 	if ( (flags&STAT_IS_FUNC)==0 ) {
 		if (unsafe)
 			shm_free_unsafe(*pvar);
@@ -707,8 +910,42 @@ str *get_stat_module_name(stat_var *stat)
 
 /***************************** MI STUFF ********************************/
 
+static int mi_print_hist_stat(mi_item_t *resp_obj, str *mod, stat_var *stat)
+{
+	stat_hist_val hv;
+	mi_item_t *hist_obj;
+	str tmp_buf;
+
+	if (mi_stat_name(mod, &stat->name, &tmp_buf) < 0) {
+		LM_ERR("cannot get stat name\n");
+		return -1;
+	}
+
+	get_stat_hist_val(stat, &hv);
+
+	hist_obj = add_mi_object(resp_obj, tmp_buf.s, tmp_buf.len);
+	if (!hist_obj ||
+	add_mi_number(hist_obj, MI_SSTR("count"), hv.count) < 0 ||
+	add_mi_number(hist_obj, MI_SSTR("sum"), hv.sum) < 0 ||
+	add_mi_number(hist_obj, MI_SSTR("p50"),
+		stat_hist_percentile(&hv, 50)) < 0 ||
+	add_mi_number(hist_obj, MI_SSTR("p90"),
+		stat_hist_percentile(&hv, 90)) < 0 ||
+	add_mi_number(hist_obj, MI_SSTR("p99"),
+		stat_hist_percentile(&hv, 99)) < 0) {
+		LM_ERR("cannot add stat\n");
+		return -1;
+	}
+
+	return 0;
+}
+
 inline static int mi_add_stat(mi_item_t *resp_obj, stat_var *stat)
 {
+	if (stat->flags & STAT_IS_HIST)
+		return mi_print_hist_stat(resp_obj,
+			&collector->amodules[stat->mod_idx].name, stat);
+
 	return mi_print_stat(resp_obj, &collector->amodules[stat->mod_idx].name,
 					&stat->name, get_stat_val(stat));
 }
@@ -723,7 +960,9 @@ inline static int mi_list_stat(mi_item_t *resp_obj, str *mod, stat_var *stat)
 		return -1;
 	}
 
-	if (stat->flags & (STAT_IS_FUNC|STAT_NO_RESET))
+	if (stat->flags & STAT_IS_HIST)
+		buf = "histogram";
+	else if (stat->flags & (STAT_IS_FUNC|STAT_NO_RESET))
 		buf = "non-incremental";
 	else
 		buf = "incremental";
@@ -746,8 +985,11 @@ inline static int mi_add_module_stats(mi_item_t *resp_obj, module_stats *mods)
 	for( stat=mods->head ; stat ; stat=stat->lnext) {
 		if (stat_is_hidden(stat))
 			continue;
-		ret = mi_print_stat(resp_obj, &mods->name, &stat->name,
-				get_stat_val(stat));
+		if (stat->flags & STAT_IS_HIST)
+			ret = mi_print_hist_stat(resp_obj, &mods->name, stat);
+		else
+			ret = mi_print_stat(resp_obj, &mods->name, &stat->name,
+					get_stat_val(stat));
 		if (ret < 0)
 			break;
 	}
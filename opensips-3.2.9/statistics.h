@@ -40,6 +40,8 @@
 #include "atomic.h"
 #endif
 
+#include <sys/time.h>
+
 #include "hash_func.h"
 
 #define STATS_HASH_POWER   8
@@ -55,6 +57,17 @@
 #define STAT_HIDDEN    (1<<5)
 #define STAT_PER_PROC  (1<<6)
 #define STAT_HAS_GROUP (1<<7)
+#define STAT_IS_HIST   (1<<8)
+
+/* the histograms have log-linear buckets: the values below STAT_HIST_SUB
+ * get a bucket each, then each power of two is split into STAT_HIST_SUB
+ * equal buckets, up to 2^STAT_HIST_MAX_BITS; the last bucket takes all the
+ * values above that (~67 seconds, when counting microseconds) */
+#define STAT_HIST_SUB_BITS  2
+#define STAT_HIST_SUB       (1<<STAT_HIST_SUB_BITS)
+#define STAT_HIST_MAX_BITS  26
+#define STAT_HIST_BUCKETS \
+	((STAT_HIST_MAX_BITS - STAT_HIST_SUB_BITS + 1) * STAT_HIST_SUB + 1)
 
 #ifdef NO_ATOMIC_OPS
 typedef unsigned int stat_val;
@@ -109,6 +122,13 @@ typedef struct stats_collector_ {
 	group_stats *groups;
 }stats_collector;
 
+/* the values of a histogram, merged from all the processes */
+typedef struct stat_hist_val_ {
+	unsigned long count;
+	unsigned long sum;
+	unsigned long buckets[STAT_HIST_BUCKETS];
+} stat_hist_val;
+
 typedef struct stat_export_ {
 	char* name;                /* null terminated statistic name */
 	unsigned short flags;      /* flags */
@@ -164,6 +184,25 @@ group_stats *find_stat_group(str *name);
 
 unsigned int get_stat_val( stat_var *var );
 
+/* sets up the per-process parts of the histograms; the ones registered
+ * later on get them right away */
+int init_hist_stats(int procs_no);
+
+/* records a value (e.g. a duration, in microseconds) in a histogram */
+void update_hist_stat(stat_var *var, unsigned long val);
+void update_hist_stat_time(stat_var *var, struct timeval *begin);
+
+int get_stat_hist_val(stat_var *var, stat_hist_val *hv);
+
+/* the highest value falling in the bucket */
+unsigned long stat_hist_bucket_max(int idx);
+
+/* the value below which the given percent of the recorded values are */
+unsigned long stat_hist_percentile(stat_hist_val *hv, int percent);
+
+#define start_hist_timer(_begin) gettimeofday(&(_begin), NULL)
+#define stop_hist_timer(_begin, _var) update_hist_stat_time(_var, &(_begin))
+
 /*! \brief
  * Returns the statistic associated with 'numerical_code' and 'is_a_reply'.
  * Specifically:
@@ -210,6 +249,10 @@ extern gen_lock_t *stat_lock;
 	#define add_stats_group(_g, _s)
 	#define get_stat_group(_s);
 	#define find_stat_group(_n);
+	#define init_hist_stats(_n) 0
+	#define update_hist_stat(_var, _val)
+	#define start_hist_timer(_begin) (void)(_begin)
+	#define stop_hist_timer(_begin, _var)
 #endif
 
 